@@ -0,0 +1,263 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GenBackend.h"
+
+#if GEN_SIMD_SSE4
+	#if defined(_MSC_VER) && !defined(__clang__)
+		#include <intrin.h>
+	#else
+		#include <cpuid.h>
+	#endif
+#endif
+
+static bool CalibrationDone = false;
+static FGenBackends CalibratedBackends;
+static FCriticalSection CalibrationLock;
+
+//Backends in the order stages fall back through them
+static EGenBackend GetFallback(EGenBackend backend)
+{
+	switch (backend)
+	{
+	case GEN_BACKEND_AVX512: return GEN_BACKEND_AVX2;
+	case GEN_BACKEND_AVX2: return GEN_BACKEND_SSE;
+	case GEN_BACKEND_ThreadedSIMD: return GEN_BACKEND_Threaded;
+	default: return GEN_BACKEND_Scalar;
+	}
+}
+
+#if GEN_SIMD_SSE4
+static void ReadCpuId(uint32 leaf, uint32 subLeaf, uint32 outRegisters[4])
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	int registers[4];
+	__cpuidex(registers, int(leaf), int(subLeaf));
+	for (int32 i = 0; i < 4; i++) outRegisters[i] = uint32(registers[i]);
+#else
+	__cpuid_count(leaf, subLeaf, outRegisters[0], outRegisters[1], outRegisters[2], outRegisters[3]);
+#endif
+}
+
+//Register state the OS saves on context switches
+static uint64 ReadXcr0()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	return _xgetbv(0);
+#else
+	uint32 eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return (uint64(edx) << 32) | eax;
+#endif
+}
+#endif
+
+EGenBackend FGenBackendOptions::Get(EGenStage stage) const
+{
+	switch (stage)
+	{
+	case GEN_STAGE_Erosion: return erosion;
+	case GEN_STAGE_SectionMesh: return sectionMesh;
+	case GEN_STAGE_TBN: return tbn;
+	case GEN_STAGE_HeightTexture: return heightTexture;
+	case GEN_STAGE_HeightQuery: return heightQuery;
+	case GEN_STAGE_PlacementMask: return placementMask;
+	default: return GEN_BACKEND_Scalar;
+	}
+}
+
+void FGenBackendOptions::Set(EGenStage stage, EGenBackend backend)
+{
+	switch (stage)
+	{
+	case GEN_STAGE_Erosion: erosion = backend; break;
+	case GEN_STAGE_SectionMesh: sectionMesh = backend; break;
+	case GEN_STAGE_TBN: tbn = backend; break;
+	case GEN_STAGE_HeightTexture: heightTexture = backend; break;
+	case GEN_STAGE_HeightQuery: heightQuery = backend; break;
+	case GEN_STAGE_PlacementMask: placementMask = backend; break;
+	default: break;
+	}
+}
+
+const FGenCpuFeatures& FGenCpuFeatures::Get()
+{
+	static const FGenCpuFeatures features = []
+	{
+		FGenCpuFeatures result;
+
+#if GEN_SIMD_SSE4
+		uint32 registers[4];
+		ReadCpuId(0, 0, registers);
+		uint32 maxLeaf = registers[0];
+
+		ReadCpuId(1, 0, registers);
+		result.sse41 = (registers[2] & (1 << 19)) != 0;
+		bool osxsave = (registers[2] & (1 << 27)) != 0;
+
+		//The OS has to save the YMM (and for AVX-512 the ZMM and mask) registers, not just the CPU support them
+		uint64 xcr0 = osxsave ? ReadXcr0() : 0;
+		bool ymmState = (xcr0 & 0x6) == 0x6;
+		bool zmmState = (xcr0 & 0xE6) == 0xE6;
+
+		if (maxLeaf >= 7)
+		{
+			ReadCpuId(7, 0, registers);
+			result.avx2 = ymmState && (registers[1] & (1 << 5)) != 0;
+			result.avx512 = zmmState && (registers[1] & (1 << 16)) != 0;
+		}
+
+		ReadCpuId(0x80000000, 0, registers);
+		if (registers[0] >= 0x80000006)
+		{
+			//Size in KB in the upper half of ECX, reported by Intel and AMD alike
+			ReadCpuId(0x80000006, 0, registers);
+			uint32 l2Kilobytes = registers[2] >> 16;
+			if (l2Kilobytes > 0) result.l2CacheBytes = int32(l2Kilobytes * 1024);
+		}
+#endif
+
+		return result;
+	}();
+
+	return features;
+}
+
+FGenBackends::FGenBackends()
+{
+	for (int32 s = 0; s < GEN_STAGE_Count; s++) Stages[s] = GEN_BACKEND_Scalar;
+}
+
+void FGenBackends::Resolve(const FGenBackendOptions& options)
+{
+	for (int32 s = 0; s < GEN_STAGE_Count; s++)
+	{
+		EGenStage stage = EGenStage(s);
+		EGenBackend requested = options.Get(stage);
+
+		if (requested == GEN_BACKEND_Auto)
+		{
+			FScopeLock lock(&CalibrationLock);
+			check(CalibrationDone);
+			Stages[s] = CalibratedBackends.Get(stage);
+		}
+		else Set(stage, requested);
+	}
+}
+
+void FGenBackends::SetUnoptimized()
+{
+	for (int32 s = 0; s < GEN_STAGE_Count; s++) Set(EGenStage(s), GEN_BACKEND_Threaded);
+}
+
+FGenBackendOptions FGenBackends::ToOptions() const
+{
+	FGenBackendOptions result;
+	for (int32 s = 0; s < GEN_STAGE_Count; s++) result.Set(EGenStage(s), Stages[s]);
+
+	return result;
+}
+
+bool FGenBackends::IsBackendAvailable(EGenBackend backend)
+{
+	const FGenCpuFeatures& cpu = FGenCpuFeatures::Get();
+
+	switch (backend)
+	{
+	case GEN_BACKEND_Scalar:
+	case GEN_BACKEND_Threaded:
+		return true;
+	case GEN_BACKEND_SSE:
+		return GEN_SIMD_SSE4 && cpu.sse41;
+	case GEN_BACKEND_AVX2:
+		return GEN_SIMD_AVX2 && cpu.avx2;
+	case GEN_BACKEND_AVX512:
+		return GEN_SIMD_AVX512 && cpu.avx512;
+	case GEN_BACKEND_ThreadedSIMD:
+		return IsBackendAvailable(GEN_BACKEND_SSE);
+	default:
+		return false;
+	}
+}
+
+bool FGenBackends::StageHasBackend(EGenStage stage, EGenBackend backend)
+{
+	switch (stage)
+	{
+	//Fixed 4 lane kernels on one thread
+	case GEN_STAGE_Erosion:
+	case GEN_STAGE_SectionMesh:
+	case GEN_STAGE_TBN:
+		return backend == GEN_BACKEND_Scalar || backend == GEN_BACKEND_SSE;
+	//Lane count templates over independent sections or blocks
+	case GEN_STAGE_HeightTexture:
+	case GEN_STAGE_HeightQuery:
+	case GEN_STAGE_PlacementMask:
+		return backend != GEN_BACKEND_Auto;
+	default:
+		return backend == GEN_BACKEND_Scalar;
+	}
+}
+
+EGenBackend FGenBackends::GetSupportedBackend(EGenStage stage, EGenBackend backend)
+{
+	if (backend == GEN_BACKEND_Auto) backend = GEN_BACKEND_Scalar;
+
+	while (!(IsBackendAvailable(backend) && StageHasBackend(stage, backend))) backend = GetFallback(backend);
+
+	return backend;
+}
+
+int32 FGenBackends::GetBackendLaneCount(EGenBackend backend)
+{
+	switch (backend)
+	{
+	case GEN_BACKEND_SSE: return 4;
+	case GEN_BACKEND_AVX2: return 8;
+	case GEN_BACKEND_AVX512: return 16;
+	case GEN_BACKEND_ThreadedSIMD:
+		if (IsBackendAvailable(GEN_BACKEND_AVX512)) return 16;
+		if (IsBackendAvailable(GEN_BACKEND_AVX2)) return 8;
+		return 4;
+	default: return 0;
+	}
+}
+
+TArray<EGenBackend> FGenBackends::GetCandidates(EGenStage stage)
+{
+	TArray<EGenBackend> result;
+
+	for (EGenBackend backend : { GEN_BACKEND_Scalar, GEN_BACKEND_SSE, GEN_BACKEND_AVX2, GEN_BACKEND_AVX512, GEN_BACKEND_Threaded, GEN_BACKEND_ThreadedSIMD })
+	{
+		if (IsBackendAvailable(backend) && StageHasBackend(stage, backend)) result.Add(backend);
+	}
+
+	return result;
+}
+
+double FGenBackends::MeasureBestTime(TFunctionRef<void()> run)
+{
+	double bestTime = MAX_dbl;
+
+	for (int32 r = 0; r < 3; r++)
+	{
+		double startTime = FPlatformTime::Seconds();
+		run();
+		bestTime = FMath::Min(bestTime, FPlatformTime::Seconds() - startTime);
+	}
+
+	return bestTime;
+}
+
+bool FGenBackends::HasCalibration()
+{
+	FScopeLock lock(&CalibrationLock);
+	return CalibrationDone;
+}
+
+void FGenBackends::SetCalibration(const FGenBackends& calibrated)
+{
+	FScopeLock lock(&CalibrationLock);
+	CalibratedBackends = calibrated;
+	CalibrationDone = true;
+}
@@ -0,0 +1,117 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GenSimd.h"
+#include "GenBackend.generated.h"
+
+UENUM(BlueprintType)
+enum EGenBackend
+{
+	//Fastest backend of a calibration run on this machine
+	GEN_BACKEND_Auto,
+	GEN_BACKEND_Scalar,
+	GEN_BACKEND_SSE,
+	GEN_BACKEND_AVX2,
+	GEN_BACKEND_AVX512,
+	//Scalar kernels on the task graph
+	GEN_BACKEND_Threaded,
+	//Widest supported kernels on the task graph
+	GEN_BACKEND_ThreadedSIMD,
+};
+
+UENUM(BlueprintType)
+enum EGenStage
+{
+	GEN_STAGE_Erosion,
+	GEN_STAGE_SectionMesh,
+	GEN_STAGE_TBN,
+	GEN_STAGE_HeightTexture,
+	GEN_STAGE_HeightQuery,
+	GEN_STAGE_PlacementMask,
+	GEN_STAGE_Count UMETA(Hidden),
+};
+
+USTRUCT(BlueprintType)
+struct FGenBackendOptions
+{
+	GENERATED_USTRUCT_BODY()
+
+	//Scalar and vector droplets erode different terrains, so erosion is never picked by timing, Auto is the vector kernel where the CPU has it
+	UPROPERTY(BlueprintReadWrite)
+	TEnumAsByte<EGenBackend> erosion = GEN_BACKEND_SSE;
+
+	UPROPERTY(BlueprintReadWrite)
+	TEnumAsByte<EGenBackend> sectionMesh = GEN_BACKEND_Auto;
+
+	UPROPERTY(BlueprintReadWrite)
+	TEnumAsByte<EGenBackend> tbn = GEN_BACKEND_Auto;
+
+	UPROPERTY(BlueprintReadWrite)
+	TEnumAsByte<EGenBackend> heightTexture = GEN_BACKEND_Auto;
+
+	UPROPERTY(BlueprintReadWrite)
+	TEnumAsByte<EGenBackend> heightQuery = GEN_BACKEND_Auto;
+
+	UPROPERTY(BlueprintReadWrite)
+	TEnumAsByte<EGenBackend> placementMask = GEN_BACKEND_Auto;
+
+	EGenBackend Get(EGenStage stage) const;
+	void Set(EGenStage stage, EGenBackend backend);
+};
+
+//Instruction sets of the CPU the process runs on, read once with CPUID
+struct PROCTERRAINGEN_API FGenCpuFeatures
+{
+	bool sse41 = false;
+	bool avx2 = false;
+	bool avx512 = false;
+	//Per core, a conservative guess where the CPU does not report it
+	int32 l2CacheBytes = 512 * 1024;
+
+	static const FGenCpuFeatures& Get();
+};
+
+/**
+ * Backend every stage runs with, never Auto.
+ * A backend is only used when this build contains its kernels (see GenSimd.h) and the CPU reports the instruction set,
+ * otherwise the stage falls back to the next narrower one.
+ */
+class PROCTERRAINGEN_API FGenBackends
+{
+public:
+	FGenBackends();
+
+	//Stages with an Auto backend use the cached calibration result, which has to exist (see HasCalibration)
+	void Resolve(const FGenBackendOptions& options);
+	//Threaded scalar wherever a stage has it, what enableOptimizations = false always ran
+	void SetUnoptimized();
+
+	EGenBackend Get(EGenStage stage) const { return Stages[stage]; };
+	void Set(EGenStage stage, EGenBackend backend) { Stages[stage] = GetSupportedBackend(stage, backend); };
+
+	//0 for the scalar kernels, 4, 8 or 16 for the vector kernels
+	int32 GetLaneCount(EGenStage stage) const { return GetBackendLaneCount(Stages[stage]); };
+	bool IsThreaded(EGenStage stage) const { return Stages[stage] == GEN_BACKEND_Threaded || Stages[stage] == GEN_BACKEND_ThreadedSIMD; };
+
+	FGenBackendOptions ToOptions() const;
+
+	static bool IsBackendAvailable(EGenBackend backend);
+	static bool StageHasBackend(EGenStage stage, EGenBackend backend);
+	static EGenBackend GetSupportedBackend(EGenStage stage, EGenBackend backend);
+	static int32 GetBackendLaneCount(EGenBackend backend);
+
+	//Backends the calibration run measures for the stage
+	static TArray<EGenBackend> GetCandidates(EGenStage stage);
+
+	//Shortest of a few runs in seconds
+	static double MeasureBestTime(TFunctionRef<void()> run);
+
+	//The calibration result is kept for the lifetime of the process, the hardware does not change
+	static bool HasCalibration();
+	static void SetCalibration(const FGenBackends& calibrated);
+
+private:
+	EGenBackend Stages[GEN_STAGE_Count];
+};
@@ -0,0 +1,182 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GenBatch.h"
+#include "Algo/AnyOf.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Tasks/Task.h"
+
+FGenBatch::FGenBatch(const FGenBatchOptions& options, const FHeightGeneratorOptions& heightOptions, FIntPoint sectionCount, FIntPoint sectionSize, float edgeSize)
+{
+	Options = options;
+	SectionCount = sectionCount;
+	SectionSize = sectionSize;
+	EdgeSize = edgeSize;
+
+	if (Options.outputDirectory.IsEmpty()) Options.outputDirectory = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("ProcTerrainGen"), TEXT("Batch"));
+	if (Options.seeds.IsEmpty()) Options.seeds.Add(heightOptions.seed);
+
+	Variants = Options.variants;
+	if (Variants.IsEmpty()) Variants.Add(heightOptions);
+
+	TMap<FString, int32> baseIndices;
+	for (float seed : Options.seeds)
+	{
+		for (int32 v = 0; v < Variants.Num(); v++)
+		{
+			FHeightGeneratorOptions variant = Variants[v];
+			variant.seed = seed;
+
+			FString key = GetBaseKey(variant);
+			int32* baseIndex = baseIndices.Find(key);
+			if (!baseIndex)
+			{
+				baseIndex = &baseIndices.Add(key, Bases.Num());
+				Bases.Add(MakeUnique<FBatchBase>());
+			}
+
+			Bases[*baseIndex]->remainingRuns++;
+			Runs.Add({ seed, v, *baseIndex });
+		}
+	}
+
+	Runs.StableSort([](const FBatchRun& a, const FBatchRun& b) { return a.base < b.base; });
+
+	int32 maxConcurrency = Options.maxConcurrentRuns > 0 ? Options.maxConcurrentRuns : FMath::Max(FTaskGraphInterface::Get().GetNumWorkerThreads(), 1);
+	Concurrency = FMath::Min(maxConcurrency, Runs.Num());
+}
+
+FGenBatchReport FGenBatch::Run(TConstArrayView<UGenHeight*> workers, const FGenBackends& backends)
+{
+	check(workers.Num() == Concurrency);
+
+	FGenBatchReport report;
+	report.concurrentRuns = Concurrency;
+	report.outputDirectory = Options.outputDirectory;
+	report.runs.SetNum(Runs.Num());
+
+	IFileManager::Get().MakeDirectory(*Options.outputDirectory, true);
+	StatsPath = FPaths::Combine(Options.outputDirectory, TEXT("runs.csv"));
+	FFileHelper::SaveStringToFile(TEXT("seed,variant,width,height,heightGenTime,erosionTime,writeTime,minHeight,maxHeight,heightfield\n"), *StatsPath);
+
+	//Runs already fill every core, threaded stages would only add scheduling overhead
+	FGenBackends runBackends = backends;
+	for (int32 stage = 0; stage < GEN_STAGE_Count; stage++)
+	{
+		EGenBackend backend = backends.Get(EGenStage(stage));
+		if (backend == GEN_BACKEND_Threaded) runBackends.Set(EGenStage(stage), GEN_BACKEND_Scalar);
+		else if (backend == GEN_BACKEND_ThreadedSIMD) runBackends.Set(EGenStage(stage), GEN_BACKEND_AVX512);
+	}
+
+	double startTime = FPlatformTime::Seconds();
+
+	TArray<UE::Tasks::FTask> tasks;
+	for (UGenHeight* worker : workers)
+	{
+		worker->SetBackends(runBackends);
+
+		tasks.Add(UE::Tasks::Launch(TEXT("BatchWorker"), [this, worker, &report]
+		{
+			for (int32 r = NextRun++; r < Runs.Num(); r = NextRun++) RunOne(worker, r, report.runs[r]);
+		}));
+	}
+
+	UE::Tasks::Wait(tasks);
+
+	report.wallTime = FPlatformTime::Seconds() - startTime;
+	report.generatedBases = GeneratedBases;
+	return report;
+}
+
+void FGenBatch::RunOne(UGenHeight* worker, int32 runIndex, FGenBatchRunStats& outStats)
+{
+	const FBatchRun& run = Runs[runIndex];
+	FBatchBase& base = *Bases[run.base];
+
+	FHeightGeneratorOptions heightOptions = Variants[run.variant];
+	heightOptions.seed = run.seed;
+
+	outStats.seed = run.seed;
+	outStats.variant = run.variant;
+
+	//Also seeds the erosion random stream
+	worker->SetGenerationOptions(heightOptions);
+	worker->Initialize(SectionCount.X, SectionCount.Y, SectionSize.X, SectionSize.Y, EdgeSize);
+
+	TSharedPtr<const TArray<float>, ESPMode::ThreadSafe> baseHeights;
+	bool generated = false;
+	{
+		//Other runs of the base wait here instead of generating the same heights
+		FScopeLock lock(&base.lock);
+
+		if (!base.heights.IsValid())
+		{
+			double heightStart = FPlatformTime::Seconds();
+
+			TArray<float> sectionHeights;
+			for (int32 s = 0; s < SectionCount.X * SectionCount.Y; s++) worker->GenerateHeight(s % SectionCount.X, s / SectionCount.X, sectionHeights);
+
+			base.heights = MakeShared<const TArray<float>, ESPMode::ThreadSafe>(worker->GetHeightData());
+			outStats.heightGenTime = FPlatformTime::Seconds() - heightStart;
+
+			GeneratedBases++;
+			generated = true;
+		}
+
+		baseHeights = base.heights;
+	}
+
+	//The shared heights are never written, every run erodes its own copy
+	if (!generated) worker->SetHeightData(*baseHeights);
+	if (--base.remainingRuns == 0) base.heights.Reset();
+	baseHeights.Reset();
+
+	double erosionStart = FPlatformTime::Seconds();
+	worker->Erode();
+	outStats.erosionTime = FPlatformTime::Seconds() - erosionStart;
+
+	const TArray<float>& heights = worker->GetHeightData();
+
+	outStats.minHeight = MAX_flt;
+	outStats.maxHeight = -MAX_flt;
+	for (float height : heights)
+	{
+		outStats.minHeight = FMath::Min(outStats.minHeight, height);
+		outStats.maxHeight = FMath::Max(outStats.maxHeight, height);
+	}
+
+	double writeStart = FPlatformTime::Seconds();
+
+	outStats.heightfieldPath = FPaths::Combine(Options.outputDirectory, FString::Printf(TEXT("Run_%d_Seed_%g_Variant_%d.r32"), runIndex, run.seed, run.variant));
+	FFileHelper::SaveArrayToFile(TArrayView64<const uint8>(reinterpret_cast<const uint8*>(heights.GetData()), heights.Num() * sizeof(float)), *outStats.heightfieldPath);
+
+	outStats.writeTime = FPlatformTime::Seconds() - writeStart;
+
+	//Rows are in the order runs finish
+	FString row = FString::Printf(TEXT("%g,%d,%d,%d,%.6f,%.6f,%.6f,%g,%g,%s\n"), run.seed, run.variant, SectionCount.X * SectionSize.X, SectionCount.Y * SectionSize.Y,
+		outStats.heightGenTime, outStats.erosionTime, outStats.writeTime, outStats.minHeight, outStats.maxHeight, *FPaths::GetCleanFilename(outStats.heightfieldPath));
+
+	FScopeLock lock(&StatsLock);
+	FFileHelper::SaveStringToFile(row, *StatsPath, FFileHelper::EEncodingOptions::AutoDetect, &IFileManager::Get(), FILEWRITE_Append);
+}
+
+FString FGenBatch::GetBaseKey(const FHeightGeneratorOptions& options)
+{
+	static const TCHAR* erosionPrefixes[] = { TEXT("erosion"), TEXT("particleErosion_"), TEXT("gridErosion_"), TEXT("pipeErosion_"), TEXT("streamPower_"), TEXT("stencil_") };
+
+	FString key;
+	for (TFieldIterator<FProperty> it(FHeightGeneratorOptions::StaticStruct()); it; ++it)
+	{
+		FString name = it->GetName();
+		if (Algo::AnyOf(erosionPrefixes, [&](const TCHAR* prefix) { return name.StartsWith(prefix, ESearchCase::CaseSensitive); })) continue;
+
+		key += name + TEXT("=");
+		it->ExportTextItem_Direct(key, it->ContainerPtrToValuePtr<void>(&options), nullptr, nullptr, PPF_None);
+		key += TEXT(";");
+	}
+
+	return key;
+}
@@ -0,0 +1,142 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GenBackend.h"
+#include "GenHeight.h"
+#include <atomic>
+#include "GenBatch.generated.h"
+
+USTRUCT(BlueprintType)
+struct FGenBatchOptions
+{
+	GENERATED_USTRUCT_BODY()
+
+	//Every variant runs once per seed, empty runs the current seed of the world
+	UPROPERTY(BlueprintReadWrite)
+	TArray<float> seeds;
+
+	//Height options to sweep, their seed is replaced by the batch seed. Variants that only differ in erosion options share the uneroded heights.
+	//Empty runs the current height options of the world.
+	UPROPERTY(BlueprintReadWrite)
+	TArray<FHeightGeneratorOptions> variants;
+
+	//Raw heightfields and runs.csv go here, empty for Saved/ProcTerrainGen/Batch
+	UPROPERTY(BlueprintReadWrite)
+	FString outputDirectory;
+
+	//Runs in flight at once, each holds one heightfield, 0 for one per task graph worker
+	UPROPERTY(BlueprintReadWrite)
+	int32 maxConcurrentRuns = 0;
+};
+
+USTRUCT(BlueprintType)
+struct FGenBatchRunStats
+{
+	GENERATED_USTRUCT_BODY()
+
+	UPROPERTY(BlueprintReadWrite)
+	float seed = 0.f;
+
+	//Index into FGenBatchOptions::variants
+	UPROPERTY(BlueprintReadWrite)
+	int32 variant = 0;
+
+	//0 when the run used heights another run of the same seed generated
+	UPROPERTY(BlueprintReadWrite)
+	double heightGenTime = 0.;
+
+	UPROPERTY(BlueprintReadWrite)
+	double erosionTime = 0.;
+
+	UPROPERTY(BlueprintReadWrite)
+	double writeTime = 0.;
+
+	UPROPERTY(BlueprintReadWrite)
+	float minHeight = 0.f;
+
+	UPROPERTY(BlueprintReadWrite)
+	float maxHeight = 0.f;
+
+	//Row major 32 bit float heights, width and height as in runs.csv
+	UPROPERTY(BlueprintReadWrite)
+	FString heightfieldPath;
+};
+
+USTRUCT(BlueprintType)
+struct FGenBatchReport
+{
+	GENERATED_USTRUCT_BODY()
+
+	UPROPERTY(BlueprintReadWrite)
+	TArray<FGenBatchRunStats> runs;
+
+	UPROPERTY(BlueprintReadWrite)
+	int32 concurrentRuns = 0;
+
+	//Uneroded heightfields generated, fewer than runs when variants share them
+	UPROPERTY(BlueprintReadWrite)
+	int32 generatedBases = 0;
+
+	UPROPERTY(BlueprintReadWrite)
+	double wallTime = 0.;
+
+	UPROPERTY(BlueprintReadWrite)
+	FString outputDirectory;
+};
+
+/**
+ * Generates and erodes seeds and option variants without meshes, textures or foliage, for AGenWorld::RunBatch.
+ * Every worker takes the next run until none are left and writes its result before taking another, so memory stays at one heightfield per worker
+ * plus the uneroded heights that runs in flight share. Runs are single threaded, throughput comes from running one per core.
+ */
+class PROCTERRAINGEN_API FGenBatch
+{
+public:
+	FGenBatch(const FGenBatchOptions& options, const FHeightGeneratorOptions& heightOptions, FIntPoint sectionCount, FIntPoint sectionSize, float edgeSize);
+
+	//Height generators the caller has to create for Run
+	int32 GetConcurrency() const { return Concurrency; };
+
+	//Blocks until every run is written
+	FGenBatchReport Run(TConstArrayView<UGenHeight*> workers, const FGenBackends& backends);
+
+private:
+	struct FBatchRun
+	{
+		float seed;
+		int32 variant;
+		int32 base;
+	};
+
+	//Uneroded heights of a seed and the options that are not erosion options, generated by the first run that needs them
+	struct FBatchBase
+	{
+		FCriticalSection lock;
+		TSharedPtr<const TArray<float>, ESPMode::ThreadSafe> heights;
+		//Runs that still need the heights, they are released with the last one
+		std::atomic<int32> remainingRuns = 0;
+	};
+
+	FGenBatchOptions Options;
+	TArray<FHeightGeneratorOptions> Variants;
+	FIntPoint SectionCount;
+	FIntPoint SectionSize;
+	float EdgeSize;
+	int32 Concurrency;
+
+	//Sorted by base, so that a base is only alive while its runs are in flight
+	TArray<FBatchRun> Runs;
+	TArray<TUniquePtr<FBatchBase>> Bases;
+
+	std::atomic<int32> NextRun = 0;
+	std::atomic<int32> GeneratedBases = 0;
+	FCriticalSection StatsLock;
+	FString StatsPath;
+
+	void RunOne(UGenHeight* worker, int32 runIndex, FGenBatchRunStats& outStats);
+
+	//Seed and every option that is not an erosion option
+	static FString GetBaseKey(const FHeightGeneratorOptions& options);
+};
@@ -2,6 +2,9 @@
 
 
 #include "GenFoliage.h"
+#include "Async/ParallelFor.h"
+#include "FoliageType.h"
+#include "Async/Async.h"
 
 UGenFoliage::UGenFoliage()
 {
@@ -17,61 +20,452 @@ void UGenFoliage::UpdateBounds(const FVector& position, const FVector& extent)
 
 	auto foliageVolumeAABB = FBox::BuildAABB(position, extent);
 	ProceduralFoliageVolume->GetBrushComponent()->Bounds = foliageVolumeAABB;
+	ScatterBounds = foliageVolumeAABB;
+}
+
+void UGenFoliage::SetSectionLayout(int32 xSectionCount, int32 ySectionCount, int32 xVertexCount, int32 yVertexCount, float vertexSize)
+{
+	FIntPoint sectionSamples(xVertexCount, yVertexCount);
+	if (xSectionCount == xSections && ySectionCount == ySections && sectionSamples == SectionSamples && vertexSize == VertexSize) return;
+
+	Clear();
+
+	xSections = xSectionCount;
+	ySections = ySectionCount;
+	SectionSamples = sectionSamples;
+	VertexSize = vertexSize;
+
+	SectionGuids.SetNum(xSections * ySections);
+	for (FGuid& guid : SectionGuids) guid = FGuid::NewGuid();
+
+	SectionStamps.Init(0, xSections * ySections);
+	PlacementMask.Initialize(xSections, ySections, xVertexCount, yVertexCount);
+	ScatterKey = 0;
 }
 
 void UGenFoliage::Spawn(UGenHeight* heightGenerator, FFoliageGenerationOptions options)
 {
-	float slopeAngleValue = FMath::Cos(FMath::DegreesToRadians(options.maxSlopeAngleDeg));
+	//Stamps of the previous spawn are already set, its instances have to go in before anything else changes.
+	//It is reported together with this spawn, its listeners would otherwise run in the middle of this call
+	int32 flushedSections = FlushSpawn();
+
+	if (!FoliageSpawner || SectionGuids.IsEmpty())
+	{
+		OnSpawnFinished.Broadcast(flushedSections);
+		return;
+	}
 
-	TArray<FDesiredFoliageInstance> desiredInstances;
+	UpdateScatter();
 
-	ProceduralFoliageVolume->ProceduralComponent->GenerateProceduralContent(desiredInstances);
+	uint32 optionsHash = HashCombine(HashCombine(GetTypeHash(options.maxSlopeAngleDeg), GetTypeHash(options.beachHeight)), GetTypeHash(options.alpineZone));
 
-	TMap<const UFoliageType*, TArray<FFoliageInstance>> instanceMap;
+	TArray<int32> dirtySections;
+	TSet<FGuid> dirtyGuids;
 
-	for (const FDesiredFoliageInstance& desiredInstance : desiredInstances)
+	for (int32 ySection = 0; ySection < ySections; ySection++)
 	{
-		TArray<FFoliageInstance>& instancesForType = instanceMap.FindOrAdd(desiredInstance.FoliageType);
+		for (int32 xSection = 0; xSection < xSections; xSection++)
+		{
+			int32 sectionIndex = ySection * xSections + xSection;
+			uint32 stamp = HashCombine(heightGenerator->GetSectionVersion(xSection, ySection), optionsHash);
+
+			if (SectionStamps[sectionIndex] == stamp) continue;
+
+			SectionStamps[sectionIndex] = stamp;
+			dirtySections.Add(sectionIndex);
+			dirtyGuids.Add(SectionGuids[sectionIndex]);
+		}
+	}
+
+	if (dirtySections.IsEmpty())
+	{
+		OnSpawnFinished.Broadcast(flushedSections);
+		return;
+	}
+
+	//Instances outside the volume would not have been hit by its traces
+	options.beachHeight = FMath::Max(options.beachHeight, float(ScatterBounds.Min.Z));
+	options.alpineZone = FMath::Min(options.alpineZone, float(ScatterBounds.Max.Z));
+
+	MaxInstancesPerFrame = options.maxInstancesPerFrame;
+
+	TSharedPtr<FFoliageSpawnBuffers> buffers = MakeShared<FFoliageSpawnBuffers>();
+	buffers->replacedSections = MoveTemp(dirtyGuids);
+	buffers->updatedSections = dirtySections.Num() + flushedSections;
+
+	uint32 epoch = ++SpawnEpoch;
+	SpawnInProgress = true;
+	SpawnBuffers = buffers;
+	FTransform terrainTransform = GetOwner()->GetActorTransform();
+
+	//The game thread part may run after the component was destroyed
+	TWeakObjectPtr<UGenFoliage> weakThis(this);
+
+	SpawnTask = Async(EAsyncExecution::ThreadPool, [=, this, dirtySections = MoveTemp(dirtySections)]
+	{
+		BuildBuffers(heightGenerator, options, terrainTransform, dirtySections, epoch, *buffers);
+
+		AsyncTask(ENamedThreads::GameThread, [weakThis, epoch, buffers]
+		{
+			UGenFoliage* foliage = weakThis.Get();
+			if (!foliage) return;
+
+			//Buffers of a cancelled spawn are incomplete, those of a flushed one are already in
+			if (epoch != foliage->SpawnEpoch || foliage->SpawnBuffers != buffers) return;
+
+			foliage->BeginSubmit();
+
+			int32 updatedSections;
+			if (foliage->MaxInstancesPerFrame <= 0 && foliage->SubmitBuffers(MAX_int32, updatedSections)) foliage->OnSpawnFinished.Broadcast(updatedSections);
+		});
+	});
+}
+
+void UGenFoliage::BuildBuffers(UGenHeight* heightGenerator, const FFoliageGenerationOptions& options, const FTransform& terrainTransform, const TArray<int32>& dirtySections, uint32 epoch, FFoliageSpawnBuffers& outBuffers)
+{
+	constexpr int32 blockSize = 1024;
+
+	//Masks are in terrain space, the height band is given in world space
+	float heightOffset = float(terrainTransform.GetLocation().Z);
+	int32 blocksPerSection = PlacementMask.GetBlocksPerSection();
+	int32 width = xSections * SectionSamples.X;
+	int32 height = ySections * SectionSamples.Y;
+
+	TArray<TArray<int32>> sectionCandidates;
+	sectionCandidates.SetNum(dirtySections.Num());
+
+	ParallelFor(dirtySections.Num(), [&](int32 d)
+	{
+		if (epoch != SpawnEpoch) return;
+
+		int32 sectionIndex = dirtySections[d];
+		PlacementMask.UpdateSection(heightGenerator, sectionIndex % xSections, sectionIndex / xSections, options.beachHeight - heightOffset, options.alpineZone - heightOffset, options.maxSlopeAngleDeg);
 
-		//Cannot use AInstancedFoliageActor::FoliageTrace as it will not collide with the procedural mesh
-		FHitResult result;
-		if (!GetWorld()->LineTraceSingleByChannel(result, desiredInstance.StartTrace, desiredInstance.EndTrace, ECollisionChannel::ECC_WorldDynamic)) continue;
+		for (int32 block = 0; block < blocksPerSection; block++)
+		{
+			//Nothing can grow here, skip all points of the block
+			if (!PlacementMask.IsBlockOccupied(sectionIndex, block)) continue;
 
-		float height = result.Location.Z;
-		if (height > options.alpineZone || height < options.beachHeight) continue;
+			int32 blockKey = sectionIndex * blocksPerSection + block;
 
-		if (result.Normal.GetAbs().Dot(FVector::UpVector) < slopeAngleValue) continue;
+			for (int32 p = BlockPointStart[blockKey]; p < BlockPointStart[blockKey + 1]; p++)
+			{
+				const FVector2D& position = SectionPoints[p].position;
+				int32 x = FMath::Clamp(FMath::RoundToInt32(position.X / VertexSize), 0, width - 1);
+				int32 y = FMath::Clamp(FMath::RoundToInt32(position.Y / VertexSize), 0, height - 1);
 
-		FFoliageInstance newInstance;
-		newInstance.Location = result.Location;
-		newInstance.Rotation = desiredInstance.Rotation.Rotator();
-		newInstance.ProceduralGuid = desiredInstance.ProceduralGuid;
-		newInstance.AlignToNormal(result.Normal, FMath::DegreesToRadians(30.f));
+				if (PlacementMask.Test(x, y)) sectionCandidates[d].Add(p);
+			}
+		}
+	}, heightGenerator->GetBackends().IsThreaded(GEN_STAGE_PlacementMask) ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread);
 
-		instancesForType.Add(newInstance);
+	if (epoch != SpawnEpoch) return;
+
+	TArray<int32> candidatePoints;
+	TArray<int32> candidateSections;
+
+	for (int32 d = 0; d < dirtySections.Num(); d++)
+	{
+		candidatePoints.Append(sectionCandidates[d]);
+		for (int32 i = 0; i < sectionCandidates[d].Num(); i++) candidateSections.Add(dirtySections[d]);
+	}
+
+	int32 candidateCount = candidatePoints.Num();
+
+	//Only accepted candidates need the exact height and normal
+	TArray<FVector2D> localPositions;
+	localPositions.SetNumUninitialized(candidateCount);
+	for (int32 i = 0; i < candidateCount; i++) localPositions[i] = SectionPoints[candidatePoints[i]].position;
+
+	TArray<float> localHeights;
+	TArray<FVector> localNormals;
+	TBitArray<> valid;
+	heightGenerator->HeightfieldCastBatch(localPositions, localHeights, localNormals, valid);
+
+	if (epoch != SpawnEpoch) return;
+
+	int32 blockCount = FMath::DivideAndRoundUp(candidateCount, blockSize);
+	int32 typeCount = FoliageTypes.Num();
+
+	//Instances per block and type, turned into write offsets below
+	TArray<int32> blockTypeOffsets;
+	blockTypeOffsets.SetNumZeroed(blockCount * typeCount);
+
+	ParallelFor(blockCount, [&](int32 b)
+	{
+		int32 start = b * blockSize;
+		int32 count = FMath::Min(blockSize, candidateCount - start);
+
+		for (int32 i = start; i < start + count; i++)
+		{
+			if (valid[i]) blockTypeOffsets[b * typeCount + SectionPoints[candidatePoints[i]].typeIndex]++;
+		}
+	});
+
+	outBuffers.types.SetNum(typeCount);
+
+	for (int32 t = 0; t < typeCount; t++)
+	{
+		int32 total = 0;
+		for (int32 b = 0; b < blockCount; b++)
+		{
+			int32 count = blockTypeOffsets[b * typeCount + t];
+			blockTypeOffsets[b * typeCount + t] = total;
+			total += count;
+		}
+
+		outBuffers.types[t].foliageType = FoliageTypes[t];
+		outBuffers.types[t].instances.SetNum(total);
 	}
 
+	//Every block writes to its own range of each type's array
+	ParallelFor(blockCount, [&](int32 b)
+	{
+		int32 start = b * blockSize;
+		int32 count = FMath::Min(blockSize, candidateCount - start);
+
+		for (int32 candidate = start; candidate < start + count; candidate++)
+		{
+			if (!valid[candidate]) continue;
+
+			const FGenScatterPoint& point = SectionPoints[candidatePoints[candidate]];
+			int32 typeIndex = point.typeIndex;
+
+			FFoliageInstance& newInstance = outBuffers.types[typeIndex].instances[blockTypeOffsets[b * typeCount + typeIndex]++];
+			newInstance.Location = terrainTransform.TransformPosition(FVector(localPositions[candidate], localHeights[candidate]));
+			newInstance.Rotation = FRotator(0.f, point.yaw, 0.f);
+			newInstance.DrawScale3D = FVector3f(point.scale);
+			newInstance.ProceduralGuid = SectionGuids[candidateSections[candidate]];
+			newInstance.AlignToNormal(terrainTransform.TransformVectorNoScale(localNormals[candidate]), FMath::DegreesToRadians(30.f));
+		}
+	});
+
+	//AddInstances takes pointers, build those here as well
+	for (FFoliageTypeBuffer& typeBuffer : outBuffers.types)
+	{
+		typeBuffer.instancePointers.Reserve(typeBuffer.instances.Num());
+		for (const FFoliageInstance& newInstance : typeBuffer.instances) typeBuffer.instancePointers.Add(&newInstance);
+	}
+}
+
+void UGenFoliage::BeginSubmit()
+{
+	PendingBuffers = MoveTemp(SpawnBuffers);
+
 	InstancedFoliageActor = AInstancedFoliageActor::Get(GetWorld(), true, GetWorld()->GetCurrentLevel(), FVector::ZeroVector);
 
-	for (const auto& instance : instanceMap)
+	//Old instances go right away, new ones may take a few frames
+	RemoveSectionInstances(PendingBuffers->replacedSections, SubmitChangedInfos);
+}
+
+bool UGenFoliage::SubmitBuffers(int32 maxInstances, int32& outUpdatedSections)
+{
+	int32 budget = maxInstances;
+
+	for (FFoliageTypeBuffer& typeBuffer : PendingBuffers->types)
 	{
+		int32 remaining = typeBuffer.instancePointers.Num() - typeBuffer.submitted;
+		if (remaining <= 0) continue;
+
+		int32 count = FMath::Min(remaining, budget);
+
 		FFoliageInfo* info;
+		InstancedFoliageActor->AddFoliageType(typeBuffer.foliageType, &info);
 
-		InstancedFoliageActor->AddFoliageType(instance.Key, &info);
-		
-		TArray<const FFoliageInstance*> instances;
-		for (const FFoliageInstance& newInstance : instance.Value) instances.Add(&newInstance);
+		info->AddInstances(typeBuffer.foliageType, TArray<const FFoliageInstance*>(typeBuffer.instancePointers.GetData() + typeBuffer.submitted, count));
+		SubmitChangedInfos.Add(info);
 
-		info->AddInstances(instance.Key, instances);
-		info->Refresh(true, false);
+		typeBuffer.submitted += count;
+		budget -= count;
+
+		if (budget <= 0) break;
 	}
+
+	for (const FFoliageTypeBuffer& typeBuffer : PendingBuffers->types)
+	{
+		if (typeBuffer.submitted < typeBuffer.instancePointers.Num()) return false;
+	}
+
+	//Everything is in, rebuild the cluster trees once (asynchronously)
+	for (FFoliageInfo* info : SubmitChangedInfos) info->Refresh(true, false);
+	SubmitChangedInfos.Reset();
+
+	outUpdatedSections = PendingBuffers->updatedSections;
+	PendingBuffers.Reset();
+	SpawnInProgress = false;
+
+	return true;
+}
+
+int32 UGenFoliage::FlushSpawn()
+{
+	if (SpawnTask.IsValid()) SpawnTask.Wait();
+
+	//The worker is done, SpawnBuffers is only still set when its spawn was not cancelled
+	if (SpawnBuffers) BeginSubmit();
+
+	int32 updatedSections = 0;
+	if (PendingBuffers) SubmitBuffers(MAX_int32, updatedSections);
+
+	return updatedSections;
+}
+
+void UGenFoliage::UpdateScatter()
+{
+	const FTransform& terrainTransform = GetOwner()->GetActorTransform();
+
+	uint32 key = HashCombine(GetTypeHash(ScatterBounds.Min), GetTypeHash(ScatterBounds.Max));
+	key = HashCombine(key, HashCombine(GetTypeHash(FoliageSpawner), GetTypeHash(FoliageSpawner->RandomSeed)));
+	key = HashCombine(key, HashCombine(GetTypeHash(FoliageSpawner->TileSize), GetTypeHash(terrainTransform.GetLocation())));
+
+	if (key == ScatterKey) return;
+
+	ScatterKey = key;
+
+	TArray<FGenScatterType> scatterTypes;
+	FoliageTypes.Reset();
+
+	for (const FFoliageTypeObject& typeObject : FoliageSpawner->GetFoliageTypes())
+	{
+		const UFoliageType* foliageType = typeObject.GetInstance();
+		if (!foliageType) continue;
+
+		FGenScatterType& scatterType = scatterTypes.AddDefaulted_GetRef();
+		scatterType.foliageType = foliageType;
+		scatterType.radius = FMath::Max(foliageType->CollisionRadius, 1.f);
+		scatterType.density = foliageType->GetSeedDensitySquared();
+		scatterType.scale = foliageType->ScaleX;
+		scatterType.randomYaw = foliageType->RandomYaw;
+
+		FoliageTypes.Add(foliageType);
+	}
+
+	TArray<FGenScatterPoint> points;
+	FoliageScatter.Scatter(FBox2D(FVector2D(ScatterBounds.Min), FVector2D(ScatterBounds.Max)), FoliageSpawner->TileSize, FoliageSpawner->RandomSeed, scatterTypes, points);
+
+	//Bucket the points by section and mask block of their nearest sample, in terrain space
+	float terrainZ = terrainTransform.GetLocation().Z;
+	int32 width = xSections * SectionSamples.X;
+	int32 height = ySections * SectionSamples.Y;
+	int32 blocksPerSection = PlacementMask.GetBlocksPerSection();
+	int32 blockKeyCount = xSections * ySections * blocksPerSection;
+
+	TArray<int32> pointKeys;
+	pointKeys.SetNumUninitialized(points.Num());
+
+	BlockPointStart.Init(0, blockKeyCount + 2);
+
+	for (int32 i = 0; i < points.Num(); i++)
+	{
+		points[i].position = FVector2D(terrainTransform.InverseTransformPosition(FVector(points[i].position, terrainZ)));
+
+		int32 x = FMath::RoundToInt32(points[i].position.X / VertexSize);
+		int32 y = FMath::RoundToInt32(points[i].position.Y / VertexSize);
+
+		if (x < 0 || y < 0 || x >= width || y >= height)
+		{
+			pointKeys[i] = blockKeyCount;
+		}
+		else
+		{
+			int32 xSection = x / SectionSamples.X;
+			int32 ySection = y / SectionSamples.Y;
+			int32 block = PlacementMask.GetBlockIndex(x - xSection * SectionSamples.X, y - ySection * SectionSamples.Y);
+
+			pointKeys[i] = (ySection * xSections + xSection) * blocksPerSection + block;
+		}
+
+		BlockPointStart[pointKeys[i] + 1]++;
+	}
+
+	for (int32 i = 1; i < BlockPointStart.Num(); i++) BlockPointStart[i] += BlockPointStart[i - 1];
+
+	SectionPoints.SetNumUninitialized(BlockPointStart[blockKeyCount]);
+	TArray<int32> writeOffsets = BlockPointStart;
+
+	for (int32 i = 0; i < points.Num(); i++)
+	{
+		if (pointKeys[i] == blockKeyCount) continue;
+
+		SectionPoints[writeOffsets[pointKeys[i]]++] = points[i];
+	}
+
+	//New points for every section
+	SectionStamps.Init(0, xSections * ySections);
+}
+
+void UGenFoliage::RemoveSectionInstances(const TSet<FGuid>& sectionGuids, TSet<FFoliageInfo*>& outChangedInfos)
+{
+	if (!InstancedFoliageActor) return;
+
+	InstancedFoliageActor->ForEachFoliageInfo([&](UFoliageType* foliageType, FFoliageInfo& info)
+	{
+		TArray<int32> instancesToRemove;
+
+		for (int32 i = 0; i < info.Instances.Num(); i++)
+		{
+			if (sectionGuids.Contains(info.Instances[i].ProceduralGuid)) instancesToRemove.Add(i);
+		}
+
+		if (!instancesToRemove.IsEmpty())
+		{
+			info.RemoveInstances(instancesToRemove, false);
+			outChangedInfos.Add(&info);
+		}
+
+		return true;
+	});
+}
+
+void UGenFoliage::CancelSpawn()
+{
+	SpawnEpoch++;
+	SpawnBuffers.Reset();
+	PendingBuffers.Reset();
+	SpawnInProgress = false;
+
+	//Stamps were set for the sections of the dropped spawn, the next one has to look at all of them again
+	SectionStamps.Init(0, SectionGuids.Num());
 }
 
 void UGenFoliage::Clear()
 {
+	//Drop spawns in flight, instances they already submitted are removed with the rest
+	SpawnEpoch++;
+	if (SpawnTask.IsValid()) SpawnTask.Wait();
+
+	SpawnBuffers.Reset();
+	PendingBuffers.Reset();
+	SubmitChangedInfos.Reset();
+	SpawnInProgress = false;
+
+	SectionStamps.Init(0, SectionGuids.Num());
+
 	if (!InstancedFoliageActor) return;
 
-	InstancedFoliageActor->DeleteInstancesForAllProceduralFoliageComponents(true);
+	TSet<FFoliageInfo*> changedInfos;
+	RemoveSectionInstances(TSet<FGuid>(SectionGuids), changedInfos);
+
+	for (FFoliageInfo* info : changedInfos) info->Refresh(true, false);
+}
+
+void UGenFoliage::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	int32 updatedSections;
+	if (PendingBuffers && SubmitBuffers(MaxInstancesPerFrame > 0 ? MaxInstancesPerFrame : MAX_int32, updatedSections)) OnSpawnFinished.Broadcast(updatedSections);
+}
+
+void UGenFoliage::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	SpawnEpoch++;
+	if (SpawnTask.IsValid()) SpawnTask.Wait();
+
+	SpawnBuffers.Reset();
+	PendingBuffers.Reset();
+
+	Super::EndPlay(EndPlayReason);
 }
 
 void UGenFoliage::BeginPlay()
@@ -10,8 +10,14 @@
 #include "InstancedFoliageActor.h"
 #include "Components/BrushComponent.h"
 #include "GenHeight.h"
+#include "GenFoliageScatter.h"
+#include "GenPlacementMask.h"
+#include "Async/Future.h"
+#include <atomic>
 #include "GenFoliage.generated.h"
 
+DECLARE_MULTICAST_DELEGATE_OneParam(FFoliageSpawnFinished, int32 /*updatedSections*/);
+
 USTRUCT(BlueprintType)
 struct FFoliageGenerationOptions
 {
@@ -25,6 +31,10 @@ struct FFoliageGenerationOptions
 
 	UPROPERTY(BlueprintReadWrite)
 	float alpineZone = 8000.f;
+
+	//Instances added to the foliage actor per frame, 0 adds everything in the frame the buffers are ready
+	UPROPERTY(BlueprintReadWrite)
+	int32 maxInstancesPerFrame = 0;
 };
 
 UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
@@ -37,12 +47,30 @@ public:
 	UGenFoliage();
 
 	void UpdateBounds(const FVector& position, const FVector& extent);
+
+	//Foliage is kept per terrain section, changing the layout clears all sections
+	void SetSectionLayout(int32 xSectionCount, int32 ySectionCount, int32 xVertexCount, int32 yVertexCount, float vertexSize);
+
+	/**
+	 * Replaces the instances of sections whose heights or options changed since the last call.
+	 * Instances are built on a worker thread and submitted on the game thread, OnSpawnFinished is broadcast once they are all in.
+	 * Heights must not change until then.
+	 */
 	void Spawn(UGenHeight* heightGenerator, FFoliageGenerationOptions options);
 	void Clear();
+	//Drops the spawn in flight without waiting for it, its worker stops at the next section
+	void CancelSpawn();
+
+	bool IsSpawning() const { return SpawnInProgress; };
+
+	FFoliageSpawnFinished OnSpawnFinished;
+
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 
 protected:
 	// Called when the game starts
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 private:
 	UPROPERTY(VisibleAnywhere)
@@ -52,4 +80,65 @@ private:
 	UProceduralFoliageSpawner* FoliageSpawner = nullptr;
 
 	AInstancedFoliageActor* InstancedFoliageActor = nullptr;
+
+	FBox ScatterBounds = FBox(ForceInit);
+	FGenFoliageScatter FoliageScatter;
+
+	int32 xSections = 0;
+	int32 ySections = 0;
+	FIntPoint SectionSamples = FIntPoint::ZeroValue;
+	float VertexSize = 0.f;
+
+	//Scatter points do not depend on heights, they are only regenerated when the bounds or the spawner change.
+	//Points are sorted by section and placement mask block, BlockPointStart has the first point of every block
+	uint32 ScatterKey = 0;
+	TArray<FGenScatterPoint> SectionPoints;
+	TArray<int32> BlockPointStart;
+	TArray<const UFoliageType*> FoliageTypes;
+
+	//Instances of a section are tagged with its guid, the stamp combines the section's height version and the options
+	TArray<FGuid> SectionGuids;
+	TArray<uint32> SectionStamps;
+
+	//Height band and slope per sample, updated with the sections on the spawn worker
+	FGenPlacementMask PlacementMask;
+
+	struct FFoliageTypeBuffer
+	{
+		const UFoliageType* foliageType = nullptr;
+		TArray<FFoliageInstance> instances;
+		TArray<const FFoliageInstance*> instancePointers;
+		int32 submitted = 0;
+	};
+
+	//Everything a spawn adds and removes, ready to be handed to the foliage actor
+	struct FFoliageSpawnBuffers
+	{
+		TArray<FFoliageTypeBuffer> types;
+		TSet<FGuid> replacedSections;
+		int32 updatedSections = 0;
+	};
+
+	TFuture<void> SpawnTask;
+	std::atomic<uint32> SpawnEpoch = 0;
+	bool SpawnInProgress = false;
+	int32 MaxInstancesPerFrame = 0;
+
+	//Buffers the worker of the current spawn fills, moved to PendingBuffers once it is done. Only touched on the game thread,
+	//the worker has its own reference and hands it back through its game thread continuation
+	TSharedPtr<FFoliageSpawnBuffers> SpawnBuffers;
+	TSharedPtr<FFoliageSpawnBuffers> PendingBuffers;
+	TSet<FFoliageInfo*> SubmitChangedInfos;
+
+	//Returns early, with incomplete buffers, once SpawnEpoch moves past epoch
+	void BuildBuffers(UGenHeight* heightGenerator, const FFoliageGenerationOptions& options, const FTransform& terrainTransform, const TArray<int32>& dirtySections, uint32 epoch, FFoliageSpawnBuffers& outBuffers);
+	void BeginSubmit();
+	//Adds up to maxInstances, true once everything is in, the caller broadcasts OnSpawnFinished
+	bool SubmitBuffers(int32 maxInstances, int32& outUpdatedSections);
+
+	//Finishes the previous spawn right away without broadcasting, returns its updated sections
+	int32 FlushSpawn();
+
+	void UpdateScatter();
+	void RemoveSectionInstances(const TSet<FGuid>& sectionGuids, TSet<FFoliageInfo*>& outChangedInfos);
 };
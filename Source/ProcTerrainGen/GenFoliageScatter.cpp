@@ -0,0 +1,153 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GenFoliageScatter.h"
+#include "Async/ParallelFor.h"
+#include "Algo/Sort.h"
+
+void FGenFoliageScatter::Scatter(const FBox2D& area, float tileSize, int32 seed, const TArray<FGenScatterType>& types, TArray<FGenScatterPoint>& outPoints)
+{
+	outPoints.Reset();
+
+	if (!area.bIsValid || tileSize <= 0.f || types.IsEmpty()) return;
+
+	Area = area;
+	TileSize = tileSize;
+	XTiles = FMath::Max(FMath::CeilToInt32(area.GetSize().X / tileSize), 1);
+	YTiles = FMath::Max(FMath::CeilToInt32(area.GetSize().Y / tileSize), 1);
+
+	MaxRadius = 0.f;
+	for (const FGenScatterType& type : types) MaxRadius = FMath::Max(MaxRadius, type.radius);
+
+	//Large types first, so that small ones fill the gaps instead of blocking them
+	TArray<int32> typeOrder;
+	for (int32 t = 0; t < types.Num(); t++) typeOrder.Add(t);
+	Algo::StableSort(typeOrder, [&types](int32 a, int32 b) { return types[a].radius > types[b].radius; });
+
+	TilePoints.Reset();
+	TilePoints.SetNum(XTiles * YTiles);
+
+	for (int32 phase = 0; phase < 4; phase++)
+	{
+		int32 xPhase = phase & 1;
+		int32 yPhase = phase >> 1;
+		int32 xPhaseTiles = (XTiles - xPhase + 1) / 2;
+		int32 yPhaseTiles = (YTiles - yPhase + 1) / 2;
+
+		ParallelFor(xPhaseTiles * yPhaseTiles, [&](int32 i)
+		{
+			ScatterTile((i % xPhaseTiles) * 2 + xPhase, (i / xPhaseTiles) * 2 + yPhase, seed, types, typeOrder);
+		});
+	}
+
+	int32 pointCount = 0;
+	for (const TArray<FGenScatterPoint>& points : TilePoints) pointCount += points.Num();
+
+	outPoints.Reserve(pointCount);
+	for (const TArray<FGenScatterPoint>& points : TilePoints) outPoints.Append(points);
+
+	TilePoints.Empty();
+}
+
+void FGenFoliageScatter::ScatterTile(int32 xTile, int32 yTile, int32 seed, const TArray<FGenScatterType>& types, const TArray<int32>& typeOrder)
+{
+	FVector2D tileMin = Area.Min + FVector2D(xTile, yTile) * TileSize;
+	FVector2D tileMax = FVector2D::Min(tileMin + FVector2D(TileSize), Area.Max);
+	FVector2D tileSize = tileMax - tileMin;
+
+	//Conflict grid over the tile and an apron of MaxRadius, a dart only has to check the 3x3 cells around it
+	float cellSize = FMath::Max(MaxRadius, TileSize / 128.f);
+	FVector2D gridMin = tileMin - FVector2D(MaxRadius);
+	int32 xCells = FMath::CeilToInt32((tileSize.X + 2.f * MaxRadius) / cellSize) + 1;
+	int32 yCells = FMath::CeilToInt32((tileSize.Y + 2.f * MaxRadius) / cellSize) + 1;
+
+	TArray<int32> cellHeads;
+	cellHeads.Init(INDEX_NONE, xCells * yCells);
+
+	TArray<FGenScatterPoint> gridPoints;
+	TArray<int32> nextPoint;
+
+	auto getCell = [&](const FVector2D& position)
+	{
+		int32 x = FMath::Clamp(int32((position.X - gridMin.X) / cellSize), 0, xCells - 1);
+		int32 y = FMath::Clamp(int32((position.Y - gridMin.Y) / cellSize), 0, yCells - 1);
+		return FIntPoint(x, y);
+	};
+
+	auto insert = [&](const FGenScatterPoint& point)
+	{
+		FIntPoint cell = getCell(point.position);
+		int32& head = cellHeads[cell.Y * xCells + cell.X];
+
+		nextPoint.Add(head);
+		head = gridPoints.Add(point);
+	};
+
+	//Points of finished neighbours, neighbours of later phases are still empty
+	FBox2D apronBox(gridMin, tileMax + FVector2D(MaxRadius));
+
+	for (int32 y = FMath::Max(yTile - 1, 0); y <= FMath::Min(yTile + 1, YTiles - 1); y++)
+	{
+		for (int32 x = FMath::Max(xTile - 1, 0); x <= FMath::Min(xTile + 1, XTiles - 1); x++)
+		{
+			if (x == xTile && y == yTile) continue;
+
+			for (const FGenScatterPoint& point : TilePoints[y * XTiles + x])
+			{
+				if (apronBox.IsInside(point.position)) insert(point);
+			}
+		}
+	}
+
+	FRandomStream random(int32(HashCombine(HashCombine(GetTypeHash(seed), GetTypeHash(xTile)), GetTypeHash(yTile))));
+
+	TArray<FGenScatterPoint>& tilePoints = TilePoints[yTile * XTiles + xTile];
+
+	for (int32 typeIndex : typeOrder)
+	{
+		const FGenScatterType& type = types[typeIndex];
+
+		//Density is per 10m x 10m
+		float expectedCount = type.density * float(tileSize.X * tileSize.Y) / 1000000.f;
+		int32 targetCount = FMath::FloorToInt32(expectedCount) + (random.FRand() < FMath::Frac(expectedCount) ? 1 : 0);
+		int32 attempts = targetCount * 8;
+
+		int32 placed = 0;
+		for (int32 a = 0; a < attempts && placed < targetCount; a++)
+		{
+			FVector2D position(tileMin.X + random.FRand() * tileSize.X, tileMin.Y + random.FRand() * tileSize.Y);
+			FIntPoint cell = getCell(position);
+
+			bool conflict = false;
+
+			for (int32 y = FMath::Max(cell.Y - 1, 0); y <= FMath::Min(cell.Y + 1, yCells - 1) && !conflict; y++)
+			{
+				for (int32 x = FMath::Max(cell.X - 1, 0); x <= FMath::Min(cell.X + 1, xCells - 1) && !conflict; x++)
+				{
+					for (int32 p = cellHeads[y * xCells + x]; p != INDEX_NONE; p = nextPoint[p])
+					{
+						float minDistance = FMath::Max(type.radius, types[gridPoints[p].typeIndex].radius);
+
+						if (FVector2D::DistSquared(position, gridPoints[p].position) < minDistance * minDistance)
+						{
+							conflict = true;
+							break;
+						}
+					}
+				}
+			}
+
+			if (conflict) continue;
+
+			FGenScatterPoint point;
+			point.position = position;
+			point.yaw = type.randomYaw ? random.FRandRange(0.f, 360.f) : 0.f;
+			point.scale = type.scale.Interpolate(random.FRand());
+			point.typeIndex = typeIndex;
+
+			insert(point);
+			tilePoints.Add(point);
+			placed++;
+		}
+	}
+}
@@ -0,0 +1,54 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UFoliageType;
+
+struct FGenScatterType
+{
+	const UFoliageType* foliageType = nullptr;
+
+	//Minimum distance to any other point (world units)
+	float radius = 100.f;
+
+	//Instances per 10m x 10m, UFoliageType::InitialSeedDensity squared as the procedural foliage simulation uses it
+	float density = 1.f;
+
+	FFloatInterval scale = FFloatInterval(1.f, 1.f);
+	bool randomYaw = true;
+};
+
+struct FGenScatterPoint
+{
+	FVector2D position;
+	float yaw = 0.f;
+	float scale = 1.f;
+	int32 typeIndex = 0;
+};
+
+/**
+ * Tiled Poisson disk scatter.
+ * Every tile draws its darts from its own seed, so the result does not depend on the thread count. Tiles are processed in
+ * four phases of a 2x2 checkerboard: tiles of one phase never touch and run in parallel, and later phases reject darts
+ * that conflict with points from already finished neighbouring tiles.
+ */
+class PROCTERRAINGEN_API FGenFoliageScatter
+{
+public:
+	void Scatter(const FBox2D& area, float tileSize, int32 seed, const TArray<FGenScatterType>& types, TArray<FGenScatterPoint>& outPoints);
+
+	int32 GetTileCount() const { return XTiles * YTiles; };
+
+private:
+	FBox2D Area;
+	float TileSize = 0.f;
+	int32 XTiles = 0;
+	int32 YTiles = 0;
+	float MaxRadius = 0.f;
+
+	TArray<TArray<FGenScatterPoint>> TilePoints;
+
+	void ScatterTile(int32 xTile, int32 yTile, int32 seed, const TArray<FGenScatterType>& types, const TArray<int32>& typeOrder);
+};
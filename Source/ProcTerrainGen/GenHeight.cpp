@@ -2,6 +2,13 @@
 
 
 #include "GenHeight.h"
+#include "Async/ParallelFor.h"
+#include "HAL/FileManager.h"
+#include "Misc/Compression.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
 
 // Sets default values for this component's properties
 UGenHeight::UGenHeight()
@@ -21,14 +28,24 @@ void UGenHeight::Initialize(uint32 xSectionCount, uint32 ySectionCount, uint32 s
 	ySize = sectionHeight;
 	vertexSize = edgeSize;
 
+	WorldOffset = FIntPoint::ZeroValue;
+	SampleSpacing = FVector2D::UnitVector;
+	RandomStream.Initialize(GetTypeHash(GenOptions.seed));
+	QuantizedHeight.Reset();
+
+	SectionVersions.Init(0, xSectionCount * ySectionCount);
+	HeightPyramid.Reset();
+
+	MarkAllSectionsDirty();
+	SectionHeightRange.Init(FVector2f::ZeroVector, xSectionCount * ySectionCount);
+
 	uint32 arraySize = ySectionCount * sectionHeight * xSectionCount * sectionWidth;
-	
-	HeightData.Empty(arraySize);
 
-	for (uint32 i = 0; i < arraySize; i++)
-	{
-		HeightData.AddUninitialized();
-	}
+	//Working buffers of the previous resolution do not fit anymore
+	Scratch.SetResolution(arraySize);
+	Scratch.ResetStageStats();
+
+	HeightData.SetNumUninitialized(arraySize);
 }
 
 TArray<float>& UGenHeight::GenerateHeight(uint32 xSection, uint32 ySection, TArray<float>& outLocalHeightData)
@@ -40,7 +57,7 @@ TArray<float>& UGenHeight::GenerateHeight(uint32 xSection, uint32 ySection, TArr
 	{
 		for (uint32 x = 0; x < xSize; x++)
 		{
-			FVector2D position(float(xStart + x), float(yStart + y));
+			FVector2D position(float(xStart + x) * SampleSpacing.X + WorldOffset.X, float(yStart + y) * SampleSpacing.Y + WorldOffset.Y);
 
 			float heightValue = CalculateHeightValue(position);
 			//HeightData[ySection * xSections * xSize * ySize + y * xSections * xSize + xSection * xSize + x] = heightValue;
@@ -49,58 +66,595 @@ TArray<float>& UGenHeight::GenerateHeight(uint32 xSection, uint32 ySection, TArr
 		}
 	}
 
+	//Sections are generated in parallel
+	FScopeLock lock(&SectionStateLock);
+	DirtySections[ySection * xSections + xSection] = true;
+	SectionVersions[ySection * xSections + xSection] = ++VersionCounter;
+
 	return HeightData;
 }
 
+void UGenHeight::SetHeightData(const TArray<float>& heights)
+{
+	check(heights.Num() == GetHeightCount());
+
+	QuantizedHeight.Reset();
+	HeightData = heights;
+	MarkAllSectionsDirty();
+}
+
 void UGenHeight::Erode()
 {
+	BeginErosion();
+	while (!AdvanceErosion(MAX_dbl));
+}
+
+void UGenHeight::BeginErosion()
+{
+	ExpandHeightData();
+	MarkAllSectionsDirty();
+
+	ErosionState = MakeUnique<FErosionState>();
+	ErosionState->method = GenOptions.erosionMethod;
+
 	switch (GenOptions.erosionMethod)
 	{
 	case EErosionMethod::EROSION_METHOD_Particle:
-		ParticleBasedErosion();
+		ErosionState->iterationCount = GenOptions.particleErosion_iterations;
 		break;
 	case EErosionMethod::EROSION_METHOD_Grid:
-		GridBasedErosion();
+		BeginGridErosion();
+		break;
+	case EErosionMethod::EROSION_METHOD_Pipe:
+		ErosionState->iterationCount = GenOptions.pipeErosion_iterations;
+		BeginPipeErosion();
+		break;
+	case EErosionMethod::EROSION_METHOD_StreamPower:
+		ErosionState->iterationCount = GenOptions.streamPower_iterations;
 		break;
 	}
+
+	//Enough droplets to fill the vector kernel a few times, one step for the solvers, later chunks are sized from measured time
+	ErosionState->chunkSize = ErosionState->method == EErosionMethod::EROSION_METHOD_Particle ? 256 : 1;
+	ErosionState->nextCheckpoint = CheckpointInterval;
 }
 
-//https://dl-acm-org.cobalt.champlain.edu/doi/10.1145/74334.74337
-void UGenHeight::GridBasedErosion()
+bool UGenHeight::AdvanceErosion(double maxSeconds)
 {
-	if (EnableOptimizations) GridBasedErosion_Intrin();
-	else GridBasedErosion_Impl();
+	if (!ErosionState) return true;
+	FErosionState& state = *ErosionState;
+
+	double startTime = FPlatformTime::Seconds();
+	double endTime = maxSeconds < MAX_dbl ? startTime + maxSeconds : MAX_dbl;
+	if (GenOptions.erosion_timeBudget > 0.f) endTime = FMath::Min(endTime, startTime + GenOptions.erosion_timeBudget - state.seconds);
+
+	//The vector droplet kernel starts a group of lanes at the first droplet of every call, chunks and windows keep the groups of an uninterrupted run
+	int32 group = state.method == EErosionMethod::EROSION_METHOD_Particle ? FMath::Max(Backends.GetLaneCount(GEN_STAGE_Erosion), 1) : 1;
+
+	bool trackChange = GenOptions.erosion_minChange > 0.f;
+	//Convergence is measured over fixed windows of 1% of the iterations, so that the decision does not depend on how the slices fell
+	int32 changeWindow = FMath::Max(state.iterationCount / 100 / group, 1) * group;
+
+	while (state.iteration < state.iterationCount && !state.converged)
+	{
+		int32 count = FMath::Min(FMath::Max(state.chunkSize / group * group, group), state.iterationCount - state.iteration);
+		if (trackChange)
+		{
+			int32 windowIteration = state.iteration % changeWindow;
+			if (windowIteration == 0 || state.changeInput.Num() != HeightData.Num()) state.changeInput = HeightData;
+			count = FMath::Min(count, changeWindow - windowIteration);
+		}
+
+		double chunkStart = FPlatformTime::Seconds();
+
+		switch (state.method)
+		{
+		case EErosionMethod::EROSION_METHOD_Particle:
+			if (Backends.GetLaneCount(GEN_STAGE_Erosion) > 0) ParticleBasedErosion_Intrin(count);
+			else ParticleBasedErosion_Impl(count);
+			break;
+		case EErosionMethod::EROSION_METHOD_Grid:
+			GridErosionStep(count);
+			break;
+		case EErosionMethod::EROSION_METHOD_Pipe:
+			PipeErosionStep(count);
+			break;
+		case EErosionMethod::EROSION_METHOD_StreamPower:
+			StreamPowerErosionSteps(count);
+			break;
+		}
+
+		if (IsCancelled())
+		{
+			ErosionState.Reset();
+			return true;
+		}
+
+		double now = FPlatformTime::Seconds();
+		state.iteration += count;
+		state.seconds += now - chunkStart;
+
+		//Coarse multigrid levels erode their own fields and leave HeightData as it is, only the full resolution level can converge once it started
+		bool finestLevel = state.method != EErosionMethod::EROSION_METHOD_Grid || state.level < 0 || (state.level == 0 && state.levelIteration > 0);
+
+		if (trackChange && finestLevel && state.iteration % changeWindow == 0)
+		{
+			//Mean change per cell over the window, the target means the same for every method and iteration count
+			double change = 0.;
+			for (int32 i = 0; i < HeightData.Num(); i++) change += FMath::Abs(HeightData[i] - state.changeInput[i]);
+			change /= HeightData.Num();
+
+			state.converged = change < GenOptions.erosion_minChange;
+		}
+
+		bool checkpoints = !CheckpointDirectory.IsEmpty() && CheckpointInterval > 0.f;
+		if (checkpoints && state.seconds >= state.nextCheckpoint)
+		{
+			//Skipped rather than waited for while the last one is still being written
+			if (!CheckpointTask.IsValid() || CheckpointTask.IsCompleted()) WriteErosionCheckpoint();
+			state.nextCheckpoint = state.seconds + CheckpointInterval;
+		}
+
+		if (now >= endTime) break;
+
+		//The next chunk takes about what is left of the slice, or until the next checkpoint
+		double chunkEnd = checkpoints ? FMath::Min(endTime, now + state.nextCheckpoint - state.seconds) : endTime;
+		double iterationSeconds = FMath::Max((now - chunkStart) / count, 1e-9);
+		state.chunkSize = int32(FMath::Clamp((chunkEnd - now) / iterationSeconds, 1., double(MAX_int32 / 2)));
+	}
+
+	//The snapshot has to be picked up by the next texture and mesh update
+	MarkAllSectionsDirty();
+
+	bool budgetUsed = GenOptions.erosion_timeBudget > 0.f && state.seconds >= GenOptions.erosion_timeBudget;
+	if (state.iteration < state.iterationCount && !state.converged && !budgetUsed) return false;
+
+	//Before anything that only happens at the end, so that the run can be extended from it
+	if (!CheckpointDirectory.IsEmpty()) WriteErosionCheckpoint();
+
+	if (state.method == EErosionMethod::EROSION_METHOD_Pipe) FinishPipeErosion();
+	ErosionState.Reset();
+	return true;
 }
 
-void UGenHeight::GridBasedErosion_Impl()
+float UGenHeight::GetErosionProgress() const
 {
-	int32 erosionIterations = GenOptions.gridErosion_iterations;
-	int32 rainfallInterval = GenOptions.gridErosion_rainfallInterval;
-	float rainfall = GenOptions.gridErosion_rainfall;
+	if (!ErosionState || ErosionState->converged || ErosionState->iterationCount <= 0) return 1.f;
 
-	float Kd = GenOptions.gridErosion_depositionConstant;
-	float Kc = GenOptions.gridErosion_sedimentCapacity;
-	float Ks = GenOptions.gridErosion_soilSoftness;
+	return float(ErosionState->iteration) / ErosionState->iterationCount;
+}
 
-	TArray<float> water;
-	TArray<float> sediment;
+//Checkpoint file layout: magic, version, options hash, width, height, uncompressed size, zlib compressed payload
+static constexpr uint32 ErosionCheckpointMagic = 0x45475450; //PTGE
+static constexpr int32 ErosionCheckpointVersion = 1;
 
-	TArray<float> newHeight;
-	TArray<float> newWater;
-	TArray<float> newSediment;
+FString UGenHeight::GetErosionCheckpointPath(int32 iteration) const
+{
+	return FPaths::Combine(CheckpointDirectory, FString::Printf(TEXT("Erosion_%08x_%d.ckpt"), GetErosionOptionsHash(), iteration));
+}
 
-	for (int32 i = 0; i < HeightData.Num(); i++)
+uint32 UGenHeight::GetErosionOptionsHash() const
+{
+	//Iterations can be extended from a checkpoint, the stop conditions only decide when to stop and blocking does not change the result
+	static const FName excluded[] =
 	{
-		water.Add(rainfall);
-		newWater.Add(0.f);
+		GET_MEMBER_NAME_CHECKED(FHeightGeneratorOptions, erosion_timeBudget),
+		GET_MEMBER_NAME_CHECKED(FHeightGeneratorOptions, erosion_minChange),
+		GET_MEMBER_NAME_CHECKED(FHeightGeneratorOptions, particleErosion_iterations),
+		GET_MEMBER_NAME_CHECKED(FHeightGeneratorOptions, gridErosion_iterations),
+		GET_MEMBER_NAME_CHECKED(FHeightGeneratorOptions, gridErosion_levelIterations),
+		GET_MEMBER_NAME_CHECKED(FHeightGeneratorOptions, pipeErosion_iterations),
+		GET_MEMBER_NAME_CHECKED(FHeightGeneratorOptions, streamPower_iterations),
+		GET_MEMBER_NAME_CHECKED(FHeightGeneratorOptions, stencil_blockIterations),
+		GET_MEMBER_NAME_CHECKED(FHeightGeneratorOptions, stencil_cacheBytes),
+	};
 
-		sediment.Add(0.f);
-		newSediment.Add(0.f);
+	FString values;
+	for (TFieldIterator<FProperty> it(FHeightGeneratorOptions::StaticStruct()); it; ++it)
+	{
+		if (MakeArrayView(excluded).Contains(it->GetFName())) continue;
 
-		newHeight.Add(0.f);
+		values += it->GetName() + TEXT("=");
+		it->ExportTextItem_Direct(values, it->ContainerPtrToValuePtr<void>(&GenOptions), nullptr, nullptr, PPF_None);
+		values += TEXT(";");
 	}
 
+	uint32 hash = FCrc::StrCrc32(*values);
+	hash = HashCombine(hash, HashCombine(GetTypeHash(vertexSize), HashCombine(GetTypeHash(WorldOffset), GetTypeHash(SampleSpacing))));
+	//Scalar and vector droplets do not take identical paths
+	return HashCombine(hash, GetTypeHash(Backends.GetLaneCount(GEN_STAGE_Erosion)));
+}
+
+void UGenHeight::SerializeErosionState(FArchive& ar, FErosionState& state)
+{
+	uint8 method = uint8(state.method);
+	ar << method;
+	state.method = EErosionMethod(method);
+
+	ar << state.iteration;
+	ar << state.changeInput;
+
+	ar << state.levelIterations;
+	ar << state.levelHeights;
+	ar << state.levelSizes;
+	ar << state.level;
+	ar << state.levelIteration;
+	ar << state.levelInput;
+	ar << state.delta;
+	ar << state.water;
+	ar << state.sediment;
+
+	FPipeErosionState& pipe = state.pipe;
+	ar << pipe.water;
+	ar << pipe.sediment;
+	ar << pipe.fluxLeft;
+	ar << pipe.fluxRight;
+	ar << pipe.fluxTop;
+	ar << pipe.fluxBottom;
+	ar << pipe.velocityX;
+	ar << pipe.velocityY;
+	ar << state.waveSpeed;
+}
+
+void UGenHeight::WriteErosionCheckpoint()
+{
+	TArray<uint8> payload;
+	FMemoryWriter writer(payload);
+
+	int32 seed = RandomStream.GetCurrentSeed();
+	writer << seed;
+	writer << HeightData;
+	SerializeErosionState(writer, *ErosionState);
+
+	TArray<uint8> header;
+	FMemoryWriter headerWriter(header);
+
+	uint32 magic = ErosionCheckpointMagic;
+	int32 version = ErosionCheckpointVersion;
+	uint32 optionsHash = GetErosionOptionsHash();
 	int32 width = xSections * xSize;
+	int32 height = ySections * ySize;
+	int32 payloadSize = payload.Num();
+	headerWriter << magic << version << optionsHash << width << height << payloadSize;
+
+	FString path = GetErosionCheckpointPath(ErosionState->iteration);
+
+	//Written in order, so that the last checkpoint of a run is never overwritten by an older one
+	TArray<UE::Tasks::FTask> prerequisites;
+	if (CheckpointTask.IsValid()) prerequisites.Add(CheckpointTask);
+
+	//Only owns copies, the component may be gone by the time it runs
+	CheckpointTask = UE::Tasks::Launch(TEXT("ErosionCheckpoint"), [payload = MoveTemp(payload), header = MoveTemp(header), path]() mutable
+	{
+		int32 compressedSize = FCompression::CompressMemoryBound(NAME_Zlib, payload.Num());
+
+		TArray<uint8> data = MoveTemp(header);
+		int32 headerSize = data.Num();
+		data.AddUninitialized(compressedSize);
+
+		if (!FCompression::CompressMemory(NAME_Zlib, data.GetData() + headerSize, compressedSize, payload.GetData(), payload.Num())) return;
+		data.SetNum(headerSize + compressedSize);
+
+		//A crash during the write leaves the previous checkpoints intact
+		FString tempPath = path + TEXT(".tmp");
+		if (FFileHelper::SaveArrayToFile(data, *tempPath)) IFileManager::Get().Move(*path, *tempPath);
+	}, prerequisites);
+}
+
+bool UGenHeight::ResumeErosion(const FString& checkpointPath)
+{
+	TArray<uint8> data;
+	if (!FFileHelper::LoadFileToArray(data, *checkpointPath)) return false;
+
+	FMemoryReader headerReader(data);
+
+	uint32 magic = 0;
+	int32 version = 0;
+	uint32 optionsHash = 0;
+	int32 width = 0;
+	int32 height = 0;
+	int32 payloadSize = 0;
+	headerReader << magic << version << optionsHash << width << height << payloadSize;
+
+	if (headerReader.IsError() || magic != ErosionCheckpointMagic || version != ErosionCheckpointVersion) return false;
+	if (optionsHash != GetErosionOptionsHash() || width != int32(xSections * xSize) || height != int32(ySections * ySize)) return false;
+
+	int32 headerSize = int32(headerReader.Tell());
+	TArray<uint8> payload;
+	payload.SetNumUninitialized(payloadSize);
+	if (!FCompression::UncompressMemory(NAME_Zlib, payload.GetData(), payloadSize, data.GetData() + headerSize, data.Num() - headerSize)) return false;
+
+	FMemoryReader reader(payload);
+
+	int32 seed = 0;
+	TArray<float> heights;
+	reader << seed;
+	reader << heights;
+	if (reader.IsError() || heights.Num() != GetHeightCount()) return false;
+
+	TUniquePtr<FErosionState> loaded = MakeUnique<FErosionState>();
+	SerializeErosionState(reader, *loaded);
+	if (reader.IsError() || loaded->method != GenOptions.erosionMethod) return false;
+
+	TArray<int32> levelIterations = GenOptions.gridErosion_levelIterations;
+	if (levelIterations.IsEmpty()) levelIterations.Add(GenOptions.gridErosion_iterations);
+
+	if (loaded->method == EErosionMethod::EROSION_METHOD_Grid)
+	{
+		//Only the finest level can be extended, it is the last one to run
+		if (levelIterations.Num() != loaded->levelIterations.Num()) return false;
+		for (int32 l = 1; l < levelIterations.Num(); l++)
+		{
+			if (levelIterations[l] != loaded->levelIterations[l]) return false;
+		}
+
+		if (loaded->level < 0 && levelIterations[0] > loaded->levelIterations[0])
+		{
+			loaded->level = 0;
+			loaded->levelIteration = loaded->levelIterations[0];
+		}
+
+		loaded->levelIterations = MoveTemp(levelIterations);
+	}
+
+	QuantizedHeight.Reset();
+	HeightData = MoveTemp(heights);
+	RandomStream.Initialize(seed);
+
+	//Sets up the scratch buffers and the iteration count of the current options, everything else comes from the checkpoint
+	BeginErosion();
+
+	FPipeErosionState& pipe = ErosionState->pipe;
+	loaded->pipe.width = pipe.width;
+	loaded->pipe.height = pipe.height;
+	loaded->pipe.cellSize = pipe.cellSize;
+	loaded->pipe.newHeight = MoveTemp(pipe.newHeight);
+	loaded->pipe.newSediment = MoveTemp(pipe.newSediment);
+
+	loaded->iterationCount = ErosionState->iterationCount;
+	loaded->chunkSize = ErosionState->chunkSize;
+	loaded->nextCheckpoint = CheckpointInterval;
+
+	ErosionState = MoveTemp(loaded);
+	return true;
+}
+
+double UGenHeight::MeasureBackend(EGenStage stage, EGenBackend backend)
+{
+	FGenBackends previousBackends = Backends;
+	Backends.Set(stage, backend);
+
+	uint32 sectionCount = xSections * ySections;
+	double result = 0.;
+
+	switch (stage)
+	{
+	case GEN_STAGE_Erosion:
+	{
+		//Every run starts from the same heights and random stream
+		TArray<float> savedHeights = HeightData;
+		FRandomStream savedStream = RandomStream;
+
+		result = FGenBackends::MeasureBestTime([&]
+		{
+			HeightData = savedHeights;
+			RandomStream = savedStream;
+			Erode();
+		});
+
+		HeightData = MoveTemp(savedHeights);
+		RandomStream = savedStream;
+		break;
+	}
+	case GEN_STAGE_HeightTexture:
+	{
+		TArray<uint16> pixels;
+		pixels.SetNumUninitialized(sectionCount * xSize * ySize);
+
+		result = FGenBackends::MeasureBestTime([&]
+		{
+			ParallelFor(sectionCount, [&](int32 i)
+			{
+				NormalizeSection(i % xSections, i / xSections, pixels.GetData() + i * xSize * ySize);
+			}, Backends.IsThreaded(GEN_STAGE_HeightTexture) ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread);
+		});
+		break;
+	}
+	case GEN_STAGE_HeightQuery:
+	{
+		FRandomStream positionStream(0);
+		TArray<FVector2D> positions;
+		for (int32 i = 0; i < 16384; i++) positions.Add(FVector2D(positionStream.FRandRange(0.f, (xSections * xSize - 1) * vertexSize), positionStream.FRandRange(0.f, (ySections * ySize - 1) * vertexSize)));
+
+		TArray<float> heights;
+		TArray<FVector> normals;
+		TBitArray<> valid;
+
+		result = FGenBackends::MeasureBestTime([&]
+		{
+			HeightfieldCastBatch(positions, heights, normals, valid);
+		});
+		break;
+	}
+	case GEN_STAGE_PlacementMask:
+	{
+		TArray<TArray<uint8>> bits;
+		bits.SetNum(sectionCount);
+
+		result = FGenBackends::MeasureBestTime([&]
+		{
+			ParallelFor(sectionCount, [&](int32 i)
+			{
+				ComputePlacementMask(i % xSections, i / xSections, -MAX_flt, MAX_flt, 30.f, bits[i]);
+			}, Backends.IsThreaded(GEN_STAGE_PlacementMask) ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread);
+		});
+		break;
+	}
+	default:
+		break;
+	}
+
+	Backends = previousBackends;
+	return result;
+}
+
+//https://dl-acm-org.cobalt.champlain.edu/doi/10.1145/74334.74337
+void UGenHeight::GridErosionSteps(TArray<float>& heights, int32 width, TArray<float>& water, TArray<float>& sediment, int32 firstIteration, int32 erosionIterations)
+{
+	FGenScratchArena::FStageScope scratchScope(Scratch, TEXT("GridErosion"));
+
+	//Heights, water and sediment and the three fields an iteration accumulates into
+	TArray<float>* fields[3] = { &heights, &water, &sediment };
+
+	RunStencilBlocks(fields, width, erosionIterations, 6 * sizeof(float), 0, [&](TArrayView<TArray<float>* const> band, int32 blockIteration, int32 count, bool finish)
+	{
+		if (Backends.GetLaneCount(GEN_STAGE_Erosion) > 0) GridErosionSteps_Intrin(*band[0], width, *band[1], *band[2], firstIteration + blockIteration, count);
+		else GridErosionSteps_Impl(*band[0], width, *band[1], *band[2], firstIteration + blockIteration, count);
+	});
+}
+
+//2x2 box filter, the last row and column repeat for odd sizes
+static void DownsampleField(const TArray<float>& field, FIntPoint size, TArray<float>& outField, FIntPoint outSize)
+{
+	outField.SetNumUninitialized(outSize.X * outSize.Y);
+
+	for (int32 y = 0; y < outSize.Y; y++)
+	{
+		int32 y0 = FMath::Min(y * 2, size.Y - 1);
+		int32 y1 = FMath::Min(y * 2 + 1, size.Y - 1);
+
+		for (int32 x = 0; x < outSize.X; x++)
+		{
+			int32 x0 = FMath::Min(x * 2, size.X - 1);
+			int32 x1 = FMath::Min(x * 2 + 1, size.X - 1);
+
+			outField[y * outSize.X + x] = (field[y0 * size.X + x0] + field[y0 * size.X + x1] + field[y1 * size.X + x0] + field[y1 * size.X + x1]) * .25f;
+		}
+	}
+}
+
+//Bilinear, a coarse sample lies at the center of the 2x2 fine samples it was averaged from
+static void UpsampleField(const TArray<float>& field, FIntPoint size, TArray<float>& outField, FIntPoint outSize)
+{
+	outField.SetNumUninitialized(outSize.X * outSize.Y);
+
+	for (int32 y = 0; y < outSize.Y; y++)
+	{
+		float yCoarse = FMath::Clamp((y + .5f) * .5f - .5f, 0.f, float(size.Y - 1));
+		int32 y0 = FMath::FloorToInt32(yCoarse);
+		int32 y1 = FMath::Min(y0 + 1, size.Y - 1);
+		float yAlpha = yCoarse - y0;
+
+		for (int32 x = 0; x < outSize.X; x++)
+		{
+			float xCoarse = FMath::Clamp((x + .5f) * .5f - .5f, 0.f, float(size.X - 1));
+			int32 x0 = FMath::FloorToInt32(xCoarse);
+			int32 x1 = FMath::Min(x0 + 1, size.X - 1);
+			float xAlpha = xCoarse - x0;
+
+			float top = FMath::Lerp(field[y0 * size.X + x0], field[y0 * size.X + x1], xAlpha);
+			float bottom = FMath::Lerp(field[y1 * size.X + x0], field[y1 * size.X + x1], xAlpha);
+			outField[y * outSize.X + x] = FMath::Lerp(top, bottom, yAlpha);
+		}
+	}
+}
+
+void UGenHeight::BeginGridErosion()
+{
+	FErosionState& state = *ErosionState;
+
+	//A single level is the plain solver at full resolution
+	state.levelIterations = GenOptions.gridErosion_levelIterations;
+	if (state.levelIterations.IsEmpty()) state.levelIterations.Add(GenOptions.gridErosion_iterations);
+
+	int32 levelCount = state.levelIterations.Num();
+	for (int32 iterations : state.levelIterations) state.iterationCount += iterations;
+
+	//Level 0 is HeightData itself, every further level halves the one before
+	state.levelHeights.SetNum(levelCount);
+	state.levelSizes.SetNum(levelCount);
+	state.levelSizes[0] = FIntPoint(xSections * xSize, ySections * ySize);
+
+	for (int32 l = 1; l < levelCount; l++)
+	{
+		state.levelSizes[l] = FIntPoint(FMath::DivideAndRoundUp(state.levelSizes[l - 1].X, 2), FMath::DivideAndRoundUp(state.levelSizes[l - 1].Y, 2));
+		DownsampleField(l == 1 ? HeightData : state.levelHeights[l - 1], state.levelSizes[l - 1], state.levelHeights[l], state.levelSizes[l]);
+	}
+
+	state.level = levelCount - 1;
+	state.levelIteration = 0;
+}
+
+void UGenHeight::GridErosionStep(int32 count)
+{
+	FErosionState& state = *ErosionState;
+	int32 levelCount = state.levelIterations.Num();
+
+	while (count > 0 && state.level >= 0)
+	{
+		int32 l = state.level;
+		TArray<float>& heights = l == 0 ? HeightData : state.levelHeights[l];
+		FIntPoint size = state.levelSizes[l];
+
+		if (state.levelIteration == 0)
+		{
+			//The delta of the finest level is not needed, HeightData is the result
+			if (l > 0) state.levelInput = heights;
+
+			if (l == levelCount - 1)
+			{
+				state.water.Init(GenOptions.gridErosion_rainfall, heights.Num());
+				state.sediment.Init(0.f, heights.Num());
+			}
+			else
+			{
+				//The coarser level established the drainage, this one keeps its own detail and refines it
+				TArray<float> upsampled;
+				UpsampleField(state.delta, state.levelSizes[l + 1], upsampled, size);
+				for (int32 i = 0; i < heights.Num(); i++) heights[i] += upsampled[i];
+
+				UpsampleField(state.water, state.levelSizes[l + 1], upsampled, size);
+				state.water = MoveTemp(upsampled);
+				UpsampleField(state.sediment, state.levelSizes[l + 1], upsampled, size);
+				state.sediment = MoveTemp(upsampled);
+			}
+		}
+
+		int32 steps = FMath::Min(count, state.levelIterations[l] - state.levelIteration);
+		GridErosionSteps(heights, size.X, state.water, state.sediment, state.levelIteration, steps);
+		if (IsCancelled()) return;
+
+		state.levelIteration += steps;
+		count -= steps;
+
+		if (state.levelIteration < state.levelIterations[l]) break;
+
+		if (l > 0)
+		{
+			//Includes the change carried down from the levels above
+			state.delta.SetNumUninitialized(heights.Num());
+			for (int32 i = 0; i < heights.Num(); i++) state.delta[i] = heights[i] - state.levelInput[i];
+		}
+
+		state.level--;
+		state.levelIteration = 0;
+	}
+}
+
+void UGenHeight::GridErosionSteps_Impl(TArray<float>& heights, int32 width, TArray<float>& water, TArray<float>& sediment, int32 firstIteration, int32 erosionIterations)
+{
+	int32 rainfallInterval = GenOptions.gridErosion_rainfallInterval;
+	float rainfall = GenOptions.gridErosion_rainfall;
+
+	float Kd = GenOptions.gridErosion_depositionConstant;
+	float Kc = GenOptions.gridErosion_sedimentCapacity;
+	float Ks = GenOptions.gridErosion_soilSoftness;
+
+	FGenScratchArena::FStageScope scratchScope(Scratch, TEXT("GridErosion"));
+	TArray<float>& newHeight = Scratch.GetZeroed<float>(TEXT("GridHeight"), heights.Num());
+	TArray<float>& newWater = Scratch.GetZeroed<float>(TEXT("GridWater"), heights.Num());
+	TArray<float>& newSediment = Scratch.GetZeroed<float>(TEXT("GridSediment"), heights.Num());
+
 	TArray<int32> deltas;
 	deltas.Add(-1);
 	deltas.Add(1);
@@ -109,16 +663,18 @@ void UGenHeight::GridBasedErosion_Impl()
 
 	for (int32 e = 0; e < erosionIterations; e++)
 	{
-		for (int32 i = 0; i < HeightData.Num(); i++)
+		if (IsCancelled()) return;
+
+		for (int32 i = 0; i < heights.Num(); i++)
 		{
 			for (const int32& delta : deltas)
 			{
 				//TODO: no wraparound
 
 				int32 ai = i + delta; //Adjacent index
-				if (ai < 0 || ai >= HeightData.Num()) continue;
+				if (ai < 0 || ai >= heights.Num()) continue;
 
-				float waterFlow = FMath::Min(water[i], (water[i] + HeightData[i]) - (water[ai] + HeightData[ai]));
+				float waterFlow = FMath::Min(water[i], (water[i] + heights[i]) - (water[ai] + heights[ai]));
 
 				if (waterFlow <= 0.f)
 				{
@@ -148,25 +704,25 @@ void UGenHeight::GridBasedErosion_Impl()
 			}
 		}
 
-		float additionalRainfall = e % rainfallInterval == 0 ? rainfall : 0.f;
+		float additionalRainfall = (firstIteration + e) % rainfallInterval == 0 ? rainfall : 0.f;
 
-		for (int32 i = 0; i < HeightData.Num(); i++)
+		for (int32 i = 0; i < heights.Num(); i++)
 		{
-			HeightData[i] += FMath::Clamp(newHeight[i], -10.f, 10.f);
-			water[i] = newWater[i] + additionalRainfall;
-			sediment[i] = newSediment[i];
-
-
-			newHeight[i] = 0.f;
-			newWater[i] = 0.f;
-			newSediment[i] = 0.f;
+			heights[i] += FMath::Clamp(newHeight[i], -10.f, 10.f);
+			newWater[i] += additionalRainfall;
 		}
+
+		//The new fields become the current ones, the old ones are cleared for the next iteration to accumulate into
+		Swap(water, newWater);
+		Swap(sediment, newSediment);
+		FMemory::Memzero(newHeight.GetData(), newHeight.Num() * sizeof(float));
+		FMemory::Memzero(newWater.GetData(), newWater.Num() * sizeof(float));
+		FMemory::Memzero(newSediment.GetData(), newSediment.Num() * sizeof(float));
 	}
 }
 
-void UGenHeight::GridBasedErosion_Intrin()
+void UGenHeight::GridErosionSteps_Intrin(TArray<float>& heights, int32 width, TArray<float>& water, TArray<float>& sediment, int32 firstIteration, int32 erosionIterations)
 {
-	int32 erosionIterations = GenOptions.gridErosion_iterations;
 	int32 rainfallInterval = GenOptions.gridErosion_rainfallInterval;
 	float rainfall = GenOptions.gridErosion_rainfall;
 
@@ -174,127 +730,111 @@ void UGenHeight::GridBasedErosion_Intrin()
 	float Kc = GenOptions.gridErosion_sedimentCapacity;
 	float Ks = GenOptions.gridErosion_soilSoftness;
 
-	TArray<float> water;
-	TArray<float> sediment;
-
-	TArray<float> newHeight;
-	TArray<float> newWater;
-	TArray<float> newSediment;
-
-	for (int32 i = 0; i < HeightData.Num(); i++)
-	{
-		water.Add(rainfall);
-		newWater.Add(0.f);
-
-		sediment.Add(0.f);
-		newSediment.Add(0.f);
-
-		newHeight.Add(0.f);
-	}
+	FGenScratchArena::FStageScope scratchScope(Scratch, TEXT("GridErosion"));
+	TArray<float>& newHeight = Scratch.GetZeroed<float>(TEXT("GridHeight"), heights.Num());
+	TArray<float>& newWater = Scratch.GetZeroed<float>(TEXT("GridWater"), heights.Num());
+	TArray<float>& newSediment = Scratch.GetZeroed<float>(TEXT("GridSediment"), heights.Num());
 
-	int32 width = xSections * xSize;
 	//TArray<int32> deltas;
 	//deltas.Add(-1);
 	//deltas.Add(1);
 	//deltas.Add(-width);
 	//deltas.Add(width);
 
-	__m128i deltas = _mm_setr_epi32(-1, 1, -width, width);
+	FGenInt4 deltas = GenSimdSet<FGenInt4>(-1, 1, -width, width);
 
 	for (int32 e = 0; e < erosionIterations; e++)
 	{
-		for (int32 i = 0; i < HeightData.Num(); i++)
+		if (IsCancelled()) return;
+
+		for (int32 i = 0; i < heights.Num(); i++)
 		{
-			__m128i adjacentIndices = _mm_set1_epi32(i);
-			adjacentIndices = _mm_add_epi32(adjacentIndices, deltas);
+			FGenInt4 adjacentIndices = FGenInt4::Splat(i) + deltas;
 
-			//Clamp between 0 and HeightData.Num
-			adjacentIndices = _mm_max_epi32(_mm_set1_epi32(0), adjacentIndices);
-			adjacentIndices = _mm_min_epi32(_mm_set1_epi32(HeightData.Num() - 1), adjacentIndices);
+			//Clamp between 0 and heights.Num
+			adjacentIndices = FGenInt4::Max(FGenInt4::Splat(0), adjacentIndices);
+			adjacentIndices = FGenInt4::Min(FGenInt4::Splat(heights.Num() - 1), adjacentIndices);
 
-			__m128 currentWater = _mm_set1_ps(water[i]);
-			__m128 currentHeight = _mm_set1_ps(HeightData[i]);
-			__m128 currentLevel = _mm_add_ps(currentWater, currentHeight);
+			FGenFloat4 currentWater = FGenFloat4::Splat(water[i]);
+			FGenFloat4 currentHeight = FGenFloat4::Splat(heights[i]);
+			FGenFloat4 currentLevel = currentWater + currentHeight;
 
-			__m128 adjacentWaterLevel = _mm_setr_ps(water[adjacentIndices.m128i_i32[0]], water[adjacentIndices.m128i_i32[1]], water[adjacentIndices.m128i_i32[2]], water[adjacentIndices.m128i_i32[3]]);
-			__m128 adjacentHeight = _mm_setr_ps(HeightData[adjacentIndices.m128i_i32[0]], HeightData[adjacentIndices.m128i_i32[1]], HeightData[adjacentIndices.m128i_i32[2]], HeightData[adjacentIndices.m128i_i32[3]]);
-			adjacentWaterLevel = _mm_add_ps(adjacentWaterLevel, adjacentHeight); //water[ai4] + HeightData[ai4]
+			FGenFloat4 adjacentWaterLevel = FGenFloat4::Gather(water.GetData(), adjacentIndices);
+			FGenFloat4 adjacentHeight = FGenFloat4::Gather(heights.GetData(), adjacentIndices);
+			adjacentWaterLevel = adjacentWaterLevel + adjacentHeight; //water[ai4] + heights[ai4]
 
-			__m128 waterFlow = _mm_sub_ps(currentLevel, adjacentWaterLevel); //for each delta
-			waterFlow = _mm_min_ps(currentWater, waterFlow);
+			FGenFloat4 waterFlow = currentLevel - adjacentWaterLevel; //for each delta
+			waterFlow = FGenFloat4::Min(currentWater, waterFlow);
 
-			__m128 waterFlowAlpha = mm128_is_negative(waterFlow); 
+			FGenFloat4 waterFlowAlpha = simd_is_negative(waterFlow); 
 
 			//waterFlowAlpha 0 if waterFlow > 0 -- HIGH WATER
-				__m128 di_newWater_highWater = _mm_mul_ps(_mm_set1_ps(-1.f), waterFlow);
-				__m128 dai_newWater_highWater = waterFlow;
+				FGenFloat4 di_newWater_highWater = FGenFloat4::Splat(-1.f) * waterFlow;
+				FGenFloat4 dai_newWater_highWater = waterFlow;
 			
-				__m128 c = _mm_mul_ps(_mm_set1_ps(Kc), waterFlow);
-				__m128 sedimentLevel = _mm_sub_ps(_mm_set1_ps(sediment[i]), c);
-				__m128 sedimentAlpha = mm128_is_negative(sedimentLevel);
+				FGenFloat4 c = FGenFloat4::Splat(Kc) * waterFlow;
+				FGenFloat4 sedimentLevel = FGenFloat4::Splat(sediment[i]) - c;
+				FGenFloat4 sedimentAlpha = simd_is_negative(sedimentLevel);
 			
 					//sedimentAlpha 0 if sediment > c -- HIGH SEDIMENT
-					__m128 dai_newSediment_highSediment = c;
-					__m128 di_newHeight_highSediment = _mm_mul_ps(_mm_set1_ps(Kd), sedimentLevel);
-					__m128 di_newSediment_highSediment = _mm_mul_ps(_mm_set1_ps(1.f - Kd), sedimentLevel);
+					FGenFloat4 dai_newSediment_highSediment = c;
+					FGenFloat4 di_newHeight_highSediment = FGenFloat4::Splat(Kd) * sedimentLevel;
+					FGenFloat4 di_newSediment_highSediment = FGenFloat4::Splat(1.f - Kd) * sedimentLevel;
 					//sedimentAlpha 1 if sediment < c -- LOW SEDIMENT
-					__m128 dai_newSediment_lowSediment = _mm_mul_ps(_mm_set1_ps(Ks), sedimentLevel);
-					dai_newSediment_lowSediment = _mm_add_ps(dai_newSediment_lowSediment, _mm_set1_ps(sediment[i]));
-					__m128 di_newHeight_lowSediment = _mm_mul_ps(_mm_set1_ps(-Ks), sedimentLevel);
-					__m128 i_newSediment_lowSediment = _mm_set1_ps(0.f);
+					FGenFloat4 dai_newSediment_lowSediment = FGenFloat4::Splat(Ks) * sedimentLevel;
+					dai_newSediment_lowSediment = dai_newSediment_lowSediment + FGenFloat4::Splat(sediment[i]);
+					FGenFloat4 di_newHeight_lowSediment = FGenFloat4::Splat(-Ks) * sedimentLevel;
+					FGenFloat4 i_newSediment_lowSediment = FGenFloat4::Zero();
 
-				__m128 dai_newSediment = mm128_lerp(dai_newSediment_highSediment, dai_newSediment_lowSediment, sedimentAlpha);
-				__m128 di_newHeight = mm128_lerp(di_newHeight_highSediment, di_newHeight_lowSediment, sedimentAlpha);
-				__m128 di_newSediment = mm128_lerp(di_newSediment_highSediment, i_newSediment_lowSediment, sedimentAlpha);
+				FGenFloat4 dai_newSediment = simd_lerp(dai_newSediment_highSediment, dai_newSediment_lowSediment, sedimentAlpha);
+				FGenFloat4 di_newHeight = simd_lerp(di_newHeight_highSediment, di_newHeight_lowSediment, sedimentAlpha);
+				FGenFloat4 di_newSediment = simd_lerp(di_newSediment_highSediment, i_newSediment_lowSediment, sedimentAlpha);
 
 			//waterFlowAlpha 1 if waterFlow < 0 -- LOW WATER
 			float kdsi = Kd* sediment[i];
-			__m128 di_newHeight_lowWater = _mm_set1_ps(kdsi);
-			__m128 di_newSediment_lowWater = _mm_set1_ps(-kdsi);
+			FGenFloat4 di_newHeight_lowWater = FGenFloat4::Splat(kdsi);
+			FGenFloat4 di_newSediment_lowWater = FGenFloat4::Splat(-kdsi);
 
 			//lerp(highwater, lowwater)
-			__m128 di_newHeight_final = mm128_lerp(di_newHeight, di_newHeight_lowWater, waterFlowAlpha);
-			__m128 dai_newWater_final = mm128_lerp(dai_newWater_highWater, _mm_set1_ps(0.f), waterFlowAlpha);
-			__m128 dai_newSediment_final = mm128_lerp(dai_newSediment, _mm_set1_ps(0.f), waterFlowAlpha);
-			__m128 di_newSediment_final = mm128_lerp(di_newSediment, di_newSediment_lowWater, waterFlowAlpha);
+			FGenFloat4 di_newHeight_final = simd_lerp(di_newHeight, di_newHeight_lowWater, waterFlowAlpha);
+			FGenFloat4 dai_newWater_final = simd_lerp(dai_newWater_highWater, FGenFloat4::Zero(), waterFlowAlpha);
+			FGenFloat4 dai_newSediment_final = simd_lerp(dai_newSediment, FGenFloat4::Zero(), waterFlowAlpha);
+			FGenFloat4 di_newSediment_final = simd_lerp(di_newSediment, di_newSediment_lowWater, waterFlowAlpha);
 
 			//apply the deltas
-			di_newHeight_final = _mm_hadd_ps(di_newHeight_final, di_newHeight_final);
-			di_newHeight_final = _mm_hadd_ps(di_newHeight_final, di_newHeight_final);
-			newHeight[i] += di_newHeight_final.m128_f32[0];
+			newHeight[i] += di_newHeight_final.ReduceAdd();
+			newSediment[i] += di_newSediment_final.ReduceAdd();
 
-			di_newSediment_final = _mm_hadd_ps(di_newSediment_final, di_newSediment_final);
-			di_newSediment_final = _mm_hadd_ps(di_newSediment_final, di_newSediment_final);
-			newSediment[i] += di_newSediment_final.m128_f32[0];
+			int32 adjacent[4];
+			float adjacentWater[4];
+			float adjacentSediment[4];
+			adjacentIndices.Store(adjacent);
+			dai_newWater_final.Store(adjacentWater);
+			dai_newSediment_final.Store(adjacentSediment);
 
-			for (int f = 0; f < 4; f++) newWater[adjacentIndices.m128i_i32[f]] += dai_newWater_final.m128_f32[f];
+			for (int f = 0; f < 4; f++) newWater[adjacent[f]] += adjacentWater[f];
 
-			for (int f = 0; f < 4; f++) newSediment[adjacentIndices.m128i_i32[f]] += dai_newSediment_final.m128_f32[f];
+			for (int f = 0; f < 4; f++) newSediment[adjacent[f]] += adjacentSediment[f];
 		}
 
-		float additionalRainfall = e % rainfallInterval == 0 ? rainfall : 0.f;
+		float additionalRainfall = (firstIteration + e) % rainfallInterval == 0 ? rainfall : 0.f;
 
-		for (int32 i = 0; i < HeightData.Num(); i++)
+		for (int32 i = 0; i < heights.Num(); i++)
 		{
-			HeightData[i] += FMath::Clamp(newHeight[i], -10.f, 10.f);
-			water[i] = newWater[i] + additionalRainfall;
-			sediment[i] = newSediment[i];
-
-
-			newHeight[i] = 0.f;
-			newWater[i] = 0.f;
-			newSediment[i] = 0.f;
+			heights[i] += FMath::Clamp(newHeight[i], -10.f, 10.f);
+			newWater[i] += additionalRainfall;
 		}
-	}
-}
 
-void UGenHeight::ParticleBasedErosion()
-{
-	if (EnableOptimizations) ParticleBasedErosion_Intrin();
-	else ParticleBasedErosion_Impl();
+		//The new fields become the current ones, the old ones are cleared for the next iteration to accumulate into
+		Swap(water, newWater);
+		Swap(sediment, newSediment);
+		FMemory::Memzero(newHeight.GetData(), newHeight.Num() * sizeof(float));
+		FMemory::Memzero(newWater.GetData(), newWater.Num() * sizeof(float));
+		FMemory::Memzero(newSediment.GetData(), newSediment.Num() * sizeof(float));
+	}
 }
 
-void UGenHeight::ParticleBasedErosion_Impl()
+void UGenHeight::ParticleBasedErosion_Impl(int32 erosionIterations)
 {
 	struct FErsonionParticle
 	{
@@ -311,8 +851,6 @@ void UGenHeight::ParticleBasedErosion_Impl()
 	float Ks = GenOptions.particleErosion_soilSoftnessConstant; //Soil softness constant (0-1, inclusive)
 	float evaporationRate = GenOptions.particleErosion_evaporationRate;
 
-	int32 erosionIterations = 16384;
-
 	float totalWidth = xSections * xSize;
 	float totalHeight = ySections * ySize;
 
@@ -320,9 +858,12 @@ void UGenHeight::ParticleBasedErosion_Impl()
 
 	for (int32 e = 0; e < erosionIterations; e++)
 	{
+		//Checked every 256 droplets
+		if ((e & 255) == 0 && IsCancelled()) return;
+
 		FErsonionParticle currentParticle;
 		currentParticle.waterVolume = GenOptions.particleErosion_waterAmount;
-		currentParticle.position = FVector2D(FMath::RandRange(1.f, totalWidth - 2.f), FMath::RandRange(1.f, totalHeight - 2.f));
+		currentParticle.position = FVector2D(RandomStream.FRandRange(1.f, totalWidth - 2.f), RandomStream.FRandRange(1.f, totalHeight - 2.f));
 
 		while (currentParticle.waterVolume > 0.f)
 		{
@@ -361,7 +902,7 @@ void UGenHeight::ParticleBasedErosion_Impl()
 	//EnsureSectionsConnect();
 }
 
-void UGenHeight::ParticleBasedErosion_Intrin()
+void UGenHeight::ParticleBasedErosion_Intrin(int32 erosionIterations)
 {
 	float Ka = GenOptions.particleErosion_accelerationConsant; //Acceleration constant
 	float Kf = GenOptions.particleErosion_frictionConstant; //Friction constant
@@ -370,8 +911,6 @@ void UGenHeight::ParticleBasedErosion_Intrin()
 	float Ks = GenOptions.particleErosion_soilSoftnessConstant; //Soil softness constant (0-1, inclusive)
 	float evaporationRate = GenOptions.particleErosion_evaporationRate;
 
-	int32 erosionIterations = 16384;
-
 	float totalWidth = xSections * xSize;
 	float totalHeight = ySections * ySize;
 
@@ -379,158 +918,835 @@ void UGenHeight::ParticleBasedErosion_Intrin()
 
 	for (int32 e = 0; e < erosionIterations; e += 4)
 	{
-		__m256 currentVelocity = _mm256_set1_ps(0.f);
+		if ((e & 255) == 0 && IsCancelled()) return;
+
+		int32 particleCount = FMath::Min(4, erosionIterations - e);
+
+		//Start positions are drawn particle by particle, same as the scalar path
+		float rp[8] = {};
+		for (int32 p = 0; p < particleCount; p++)
+		{
+			rp[p * 2] = RandomStream.FRandRange(1.f, totalWidth - 2.f);
+			rp[p * 2 + 1] = RandomStream.FRandRange(1.f, totalHeight - 2.f);
+		}
 
-		float rp[8];
-		for (int p = 0; p < 8; p++) rp[p] = FMath::RandRange(1.f, totalWidth - 2.f);
-		__m256 currentPosition = _mm256_setr_ps(rp[0], rp[1], rp[2], rp[3], rp[4], rp[5], rp[6], rp[7]);
+		//4 particles, x and y in separate vectors so every lane is one particle
+		FGenFloat4 positionX = GenSimdSet<FGenFloat4>(rp[0], rp[2], rp[4], rp[6]);
+		FGenFloat4 positionY = GenSimdSet<FGenFloat4>(rp[1], rp[3], rp[5], rp[7]);
+		FGenFloat4 velocityX = FGenFloat4::Zero();
+		FGenFloat4 velocityY = FGenFloat4::Zero();
 
-		__m128 currentWaterVolume = _mm_set1_ps(GenOptions.particleErosion_waterAmount * .25f);
-		__m128 currentSediment = _mm_set1_ps(0.f);
+		FGenFloat4 currentWaterVolume = FGenFloat4::Splat(GenOptions.particleErosion_waterAmount);
+		FGenFloat4 currentSediment = FGenFloat4::Zero();
 
-		while (mm128_sum(currentWaterVolume) > 0.f)
+		//Lanes drop out once their particle leaves the terrain or runs out of water
+		FGenMask4 active = FGenMask4::FirstN(particleCount) & (currentWaterVolume > FGenFloat4::Zero());
+
+		while (active.Any())
 		{
-			FVector np[4];
-			for (int p = 0; p < 4; p++) np[p] = GetNormalF(currentPosition.m256_f32[p * 2], currentPosition.m256_f32[p * 2 + 1]);
+			uint32 activeBits = active.GetBits();
 
-			__m256 normal = _mm256_setr_ps(np[0].X, np[0].Y, np[1].X, np[1].Y, np[2].X, np[2].Y, np[3].X, np[3].Y);
+			float px[4];
+			float py[4];
+			positionX.Store(px);
+			positionY.Store(py);
 
-			__m256 deltaVelocity = _mm256_mul_ps(_mm256_set1_ps(Ka), normal);
-			currentVelocity = _mm256_add_ps(currentVelocity, deltaVelocity);
-			currentVelocity = _mm256_mul_ps(currentVelocity, _mm256_set1_ps(1.f - Kf));
+			FVector np[4];
+			for (int p = 0; p < 4; p++) np[p] = (activeBits & (1 << p)) ? GetNormalF(px[p], py[p]) : FVector::ZeroVector;
 
-			currentPosition = _mm256_add_ps(currentPosition, currentVelocity);
-			currentPosition = _mm256_min_ps(_mm256_set1_ps(totalWidth - 1.f), currentPosition);
-			currentPosition = _mm256_max_ps(_mm256_set1_ps(0.f), currentPosition);
+			FGenFloat4 normalX = GenSimdSet<FGenFloat4>(np[0].X, np[1].X, np[2].X, np[3].X);
+			FGenFloat4 normalY = GenSimdSet<FGenFloat4>(np[0].Y, np[1].Y, np[2].Y, np[3].Y);
 
-			__m256 currentVelocityDot = _mm256_pow_ps(currentVelocity, _mm256_set1_ps(2.f));
-			currentVelocityDot = _mm256_hadd_ps(currentVelocityDot, currentVelocityDot);
-			__m128 currentSpeed = _mm256_extractf32x4_ps(currentVelocityDot, 0);
-			currentSpeed = _mm_sqrt_ps(currentSpeed);
+			velocityX = (velocityX + FGenFloat4::Splat(Ka) * normalX) * FGenFloat4::Splat(1.f - Kf);
+			velocityY = (velocityY + FGenFloat4::Splat(Ka) * normalY) * FGenFloat4::Splat(1.f - Kf);
 
-			__m128 maxSediment = _mm_mul_ps(currentSpeed, currentWaterVolume);
-			maxSediment = _mm_mul_ps(maxSediment, _mm_set_ps1(Kc));
+			positionX = FGenFloat4::Select(active, positionX + velocityX, positionX);
+			positionY = FGenFloat4::Select(active, positionY + velocityY, positionY);
 
-			__m128 missingSediment = _mm_sub_ps(maxSediment, currentSediment);
+			active = active & (positionX > FGenFloat4::Zero()) & (positionX < FGenFloat4::Splat(totalWidth - 1.f));
+			active = active & (positionY > FGenFloat4::Zero()) & (positionY < FGenFloat4::Splat(totalHeight - 1.f));
 
-			__m128 missingSedimentAlpha = mm128_is_negative(missingSediment);
-			//0 if maxSediment > currentSediment - MISSING
-			missingSediment = _mm_mul_ps(_mm_set1_ps(Ks), missingSediment); //positive
-		
-			//1 if maxSediment < currentSediment - EXCESS
-			__m128 excessSediment = _mm_mul_ps(_mm_set1_ps(Kd), missingSediment); //negative
+			FGenFloat4 currentSpeed = FGenFloat4::Sqrt(velocityX * velocityX + velocityY * velocityY);
+			FGenFloat4 maxSediment = currentSpeed * currentWaterVolume * FGenFloat4::Splat(Kc);
 
+			//Negative when the particle carries more than it can hold and deposits the excess
+			FGenFloat4 missingSediment = maxSediment - currentSediment;
+			FGenFloat4 dSediment = FGenFloat4::Select(currentSediment > maxSediment, FGenFloat4::Splat(Kd) * missingSediment, FGenFloat4::Splat(Ks) * missingSediment);
+			dSediment = FGenFloat4::Select(active, dSediment, FGenFloat4::Zero());
+			currentSediment = currentSediment + dSediment;
 
-			__m128 dSediment = mm128_lerp(missingSediment, excessSediment, missingSedimentAlpha);
-			currentSediment = _mm_add_ps(currentSediment, dSediment);
-			for (int p = 0; p < 4; p++) ModifyHeightF(currentPosition.m256_f32[p * 2], currentPosition.m256_f32[p * 2 + 1], -currentSediment.m128_f32[p]);
+			float sedimentLanes[4];
+			positionX.Store(px);
+			positionY.Store(py);
+			dSediment.Store(sedimentLanes);
+			activeBits = active.GetBits();
+			for (int p = 0; p < 4; p++)
+			{
+				if (activeBits & (1 << p)) ModifyHeightF(px[p], py[p], -sedimentLanes[p]);
+			}
 
-			currentWaterVolume = _mm_sub_ps(currentWaterVolume, _mm_set1_ps(evaporationRate));
+			currentWaterVolume = currentWaterVolume - FGenFloat4::Splat(evaporationRate);
+			active = active & (currentWaterVolume > FGenFloat4::Zero());
 		}
 	}
 }
 
-void UGenHeight::ThermalWeathering()
+//Fast Hydraulic Erosion Simulation and Visualization on GPU, Mei et al. 2007
+//Heights and cell size are in Unreal units, so gravity is in cm/s^2
+static constexpr float PipeGravity = 981.f;
+//Water depth below which a cell counts as dry and has no velocity
+static constexpr float PipeMinWaterDepth = .01f;
+//Flat ground still carries some sediment
+static constexpr float PipeMinTilt = .05f;
+//Same limit per step as the grid method
+static constexpr float PipeMaxErosion = 10.f;
+
+void UGenHeight::BeginPipeErosion()
 {
-	float T = FMath::DegreesToRadians(15.f);
-	float c = .1f;
-	int32 iterations = 8;
+	FPipeErosionState& state = ErosionState->pipe;
+	state.width = xSections * xSize;
+	state.height = ySections * ySize;
+	state.cellSize = vertexSize;
+
+	int32 cellCount = HeightData.Num();
+	float maxTimeStep = GenOptions.pipeErosion_maxTimeStep;
+
+	state.water.Init(GenOptions.pipeErosion_rainfall * maxTimeStep, cellCount);
+	state.sediment.Init(0.f, cellCount);
+	state.fluxLeft.Init(0.f, cellCount);
+	state.fluxRight.Init(0.f, cellCount);
+	state.fluxTop.Init(0.f, cellCount);
+	state.fluxBottom.Init(0.f, cellCount);
+	state.velocityX.Init(0.f, cellCount);
+	state.velocityY.Init(0.f, cellCount);
+	state.newHeight.SetNumUninitialized(cellCount);
+	state.newSediment.SetNumUninitialized(cellCount);
+
+	ErosionState->waveSpeed = 0.f;
+}
 
-	TArray<float> newHeight;
+void UGenHeight::PipeErosionStep(int32 count)
+{
+	FPipeErosionState& state = ErosionState->pipe;
+	float& waveSpeed = ErosionState->waveSpeed;
+	float maxTimeStep = GenOptions.pipeErosion_maxTimeStep;
 
-	for (int32 i = 0; i < HeightData.Num(); i++)
-	{
-		newHeight.Add(HeightData[i]);
-	}
+	int32 lanes = Backends.GetLaneCount(GEN_STAGE_Erosion);
+	EParallelForFlags parallelFlags = Backends.IsThreaded(GEN_STAGE_Erosion) ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread;
 
-	int32 width = xSections * xSize;
-	TArray<int32> deltas;
-	deltas.Add(-1);
-	deltas.Add(1);
-	deltas.Add(-width);
-	deltas.Add(width);
+	//Bands of rows, every pass only writes the cells of its own band and reads the neighbours from arrays no pass writes at the same time
+	constexpr int32 tileRows = 16;
+	int32 tileCount = FMath::DivideAndRoundUp(state.height, tileRows);
 
-	for (int32 e = 0; e < iterations; e++)
+	TArray<float> tileWaveSpeeds;
+	tileWaveSpeeds.Init(0.f, tileCount);
+
+	for (int32 e = 0; e < count; e++)
 	{
-		for (int32 i = 0; i < HeightData.Num(); i++)
+		if (IsCancelled()) return;
+
+		//Neither water nor sediment moves further than half a cell per step
+		FPipeErosionStep step;
+		step.timeStep = waveSpeed > 0.f ? FMath::Min(maxTimeStep, .5f * state.cellSize / waveSpeed) : maxTimeStep;
+		step.gravity = PipeGravity;
+		step.fluxScale = step.timeStep * PipeGravity * state.cellSize;
+		step.sedimentCapacity = GenOptions.pipeErosion_sedimentCapacity;
+		step.soilSoftness = GenOptions.pipeErosion_soilSoftness;
+		step.depositionConstant = GenOptions.pipeErosion_depositionConstant;
+
+		ParallelFor(tileCount, [&](int32 t)
 		{
-			for (const int32& delta : deltas)
+			int32 yEnd = FMath::Min((t + 1) * tileRows, state.height);
+			for (int32 y = t * tileRows; y < yEnd; y++)
 			{
-				//TODO: no wraparound
-
-				int32 ai = i + delta; //Adjacent index
-				if (ai < 0 || ai >= HeightData.Num()) continue;
+				switch (lanes)
+				{
+				case 16: PipeFluxRow_Intrin<16>(state, step, y); break;
+				case 8: PipeFluxRow_Intrin<8>(state, step, y); break;
+				case 4: PipeFluxRow_Intrin<4>(state, step, y); break;
+				default: PipeFluxRow_Impl(state, step, y, 0, state.width); break;
+				}
+			}
+		}, parallelFlags);
 
-				if (HeightData[i] - HeightData[ai] > T)
+		ParallelFor(tileCount, [&](int32 t)
+		{
+			float tileWaveSpeed = 0.f;
+
+			int32 yEnd = FMath::Min((t + 1) * tileRows, state.height);
+			for (int32 y = t * tileRows; y < yEnd; y++)
+			{
+				float rowWaveSpeed;
+				switch (lanes)
 				{
-					newHeight[ai] += c * (HeightData[i] - HeightData[ai] - T);
+				case 16: rowWaveSpeed = PipeWaterRow_Intrin<16>(state, step, y); break;
+				case 8: rowWaveSpeed = PipeWaterRow_Intrin<8>(state, step, y); break;
+				case 4: rowWaveSpeed = PipeWaterRow_Intrin<4>(state, step, y); break;
+				default: rowWaveSpeed = PipeWaterRow_Impl(state, step, y, 0, state.width); break;
 				}
+
+				tileWaveSpeed = FMath::Max(tileWaveSpeed, rowWaveSpeed);
 			}
+
+			tileWaveSpeeds[t] = tileWaveSpeed;
+		}, parallelFlags);
+
+		//The water pass read the slopes from the old heights
+		Swap(HeightData, state.newHeight);
+
+		ParallelFor(tileCount, [&](int32 t)
+		{
+			int32 yEnd = FMath::Min((t + 1) * tileRows, state.height);
+			for (int32 y = t * tileRows; y < yEnd; y++) PipeAdvectRow(state, step, y);
+		}, parallelFlags);
+
+		Swap(state.sediment, state.newSediment);
+
+		waveSpeed = 0.f;
+		for (float tileWaveSpeed : tileWaveSpeeds) waveSpeed = FMath::Max(waveSpeed, tileWaveSpeed);
+	}
+}
+
+void UGenHeight::FinishPipeErosion()
+{
+	//Whatever is still in suspension settles where it is
+	const TArray<float>& sediment = ErosionState->pipe.sediment;
+	for (int32 i = 0; i < HeightData.Num(); i++) HeightData[i] += sediment[i];
+}
+
+void UGenHeight::PipeFluxRow_Impl(FPipeErosionState& state, const FPipeErosionStep& step, int32 y, int32 xBegin, int32 xEnd)
+{
+	int32 width = state.width;
+	float volumeScale = state.cellSize * state.cellSize / step.timeStep;
+
+	for (int32 x = xBegin; x < xEnd; x++)
+	{
+		int32 i = y * width + x;
+		float level = HeightData[i] + state.water[i];
+
+		//No flux across the map border
+		float left = x > 0 ? FMath::Max(0.f, state.fluxLeft[i] + step.fluxScale * (level - HeightData[i - 1] - state.water[i - 1])) : 0.f;
+		float right = x < width - 1 ? FMath::Max(0.f, state.fluxRight[i] + step.fluxScale * (level - HeightData[i + 1] - state.water[i + 1])) : 0.f;
+		float top = y > 0 ? FMath::Max(0.f, state.fluxTop[i] + step.fluxScale * (level - HeightData[i - width] - state.water[i - width])) : 0.f;
+		float bottom = y < state.height - 1 ? FMath::Max(0.f, state.fluxBottom[i] + step.fluxScale * (level - HeightData[i + width] - state.water[i + width])) : 0.f;
+
+		//A cell can not give away more water than it has
+		float total = FMath::Max(left + right + top + bottom, UE_SMALL_NUMBER);
+		float k = FMath::Min(1.f, state.water[i] * volumeScale / total);
+
+		state.fluxLeft[i] = left * k;
+		state.fluxRight[i] = right * k;
+		state.fluxTop[i] = top * k;
+		state.fluxBottom[i] = bottom * k;
+	}
+}
+
+template<int32 Lanes>
+void UGenHeight::PipeFluxRow_Intrin(FPipeErosionState& state, const FPipeErosionStep& step, int32 y)
+{
+	using FFloatV = TGenFloatVec<Lanes>;
+
+	int32 width = state.width;
+
+	//Border rows have no neighbour on one side
+	if (y == 0 || y == state.height - 1)
+	{
+		PipeFluxRow_Impl(state, step, y, 0, width);
+		return;
+	}
+
+	const float* heights = HeightData.GetData() + y * width;
+	const float* water = state.water.GetData() + y * width;
+	float* fluxLeft = state.fluxLeft.GetData() + y * width;
+	float* fluxRight = state.fluxRight.GetData() + y * width;
+	float* fluxTop = state.fluxTop.GetData() + y * width;
+	float* fluxBottom = state.fluxBottom.GetData() + y * width;
+
+	FFloatV zero = FFloatV::Zero();
+	FFloatV one = FFloatV::Splat(1.f);
+	FFloatV minTotal = FFloatV::Splat(UE_SMALL_NUMBER);
+	FFloatV fluxScale = FFloatV::Splat(step.fluxScale);
+	FFloatV volumeScale = FFloatV::Splat(state.cellSize * state.cellSize / step.timeStep);
+
+	//Border columns as well
+	PipeFluxRow_Impl(state, step, y, 0, 1);
+
+	int32 x = 1;
+	for (; x + Lanes <= width - 1; x += Lanes)
+	{
+		FFloatV cellWater = FFloatV::Load(water + x);
+		FFloatV level = FFloatV::Load(heights + x) + cellWater;
+
+		FFloatV left = FFloatV::Max(zero, FFloatV::Load(fluxLeft + x) + fluxScale * (level - FFloatV::Load(heights + x - 1) - FFloatV::Load(water + x - 1)));
+		FFloatV right = FFloatV::Max(zero, FFloatV::Load(fluxRight + x) + fluxScale * (level - FFloatV::Load(heights + x + 1) - FFloatV::Load(water + x + 1)));
+		FFloatV top = FFloatV::Max(zero, FFloatV::Load(fluxTop + x) + fluxScale * (level - FFloatV::Load(heights + x - width) - FFloatV::Load(water + x - width)));
+		FFloatV bottom = FFloatV::Max(zero, FFloatV::Load(fluxBottom + x) + fluxScale * (level - FFloatV::Load(heights + x + width) - FFloatV::Load(water + x + width)));
+
+		FFloatV total = FFloatV::Max(left + right + top + bottom, minTotal);
+		FFloatV k = FFloatV::Min(one, cellWater * volumeScale / total);
+
+		(left * k).Store(fluxLeft + x);
+		(right * k).Store(fluxRight + x);
+		(top * k).Store(fluxTop + x);
+		(bottom * k).Store(fluxBottom + x);
+	}
+
+	PipeFluxRow_Impl(state, step, y, x, width);
+}
+
+float UGenHeight::PipeWaterRow_Impl(FPipeErosionState& state, const FPipeErosionStep& step, int32 y, int32 xBegin, int32 xEnd)
+{
+	int32 width = state.width;
+	int32 height = state.height;
+	float inverseCellArea = 1.f / (state.cellSize * state.cellSize);
+	float inverseSlopeDistance = .5f / state.cellSize;
+
+	float maxWaveSpeed = 0.f;
+
+	for (int32 x = xBegin; x < xEnd; x++)
+	{
+		int32 i = y * width + x;
+
+		//Outflow of the neighbours towards this cell
+		float fromLeft = x > 0 ? state.fluxRight[i - 1] : 0.f;
+		float fromRight = x < width - 1 ? state.fluxLeft[i + 1] : 0.f;
+		float fromTop = y > 0 ? state.fluxBottom[i - width] : 0.f;
+		float fromBottom = y < height - 1 ? state.fluxTop[i + width] : 0.f;
+
+		float outflow = state.fluxLeft[i] + state.fluxRight[i] + state.fluxTop[i] + state.fluxBottom[i];
+		float previousWater = state.water[i];
+		float water = FMath::Max(previousWater + step.timeStep * (fromLeft + fromRight + fromTop + fromBottom - outflow) * inverseCellArea, 0.f);
+		state.water[i] = water;
+
+		//Mean flux through the cell per unit of cross section
+		float meanWater = (previousWater + water) * .5f;
+		float velocityScale = meanWater > PipeMinWaterDepth ? .5f / (state.cellSize * meanWater) : 0.f;
+		float velocityX = (fromLeft - state.fluxLeft[i] + state.fluxRight[i] - fromRight) * velocityScale;
+		float velocityY = (fromTop - state.fluxTop[i] + state.fluxBottom[i] - fromBottom) * velocityScale;
+		state.velocityX[i] = velocityX;
+		state.velocityY[i] = velocityY;
+
+		//Central differences, the border repeats its edge sample
+		float xSlope = (HeightData[y * width + FMath::Min(x + 1, width - 1)] - HeightData[y * width + FMath::Max(x - 1, 0)]) * inverseSlopeDistance;
+		float ySlope = (HeightData[FMath::Min(y + 1, height - 1) * width + x] - HeightData[FMath::Max(y - 1, 0) * width + x]) * inverseSlopeDistance;
+		float slope = xSlope * xSlope + ySlope * ySlope;
+		float sine = FMath::Max(FMath::Sqrt(slope / (1.f + slope)), PipeMinTilt);
+		float speed = FMath::Sqrt(velocityX * velocityX + velocityY * velocityY);
+
+		//Positive erodes, negative deposits
+		float capacity = step.sedimentCapacity * sine * speed;
+		float sediment = state.sediment[i];
+		float change = capacity > sediment ? FMath::Min(step.soilSoftness * (capacity - sediment), PipeMaxErosion) : step.depositionConstant * (capacity - sediment);
+
+		state.newHeight[i] = HeightData[i] - change;
+		state.sediment[i] = sediment + change;
+
+		maxWaveSpeed = FMath::Max(maxWaveSpeed, speed + FMath::Sqrt(step.gravity * water));
+	}
+
+	return maxWaveSpeed;
+}
+
+template<int32 Lanes>
+float UGenHeight::PipeWaterRow_Intrin(FPipeErosionState& state, const FPipeErosionStep& step, int32 y)
+{
+	using FFloatV = TGenFloatVec<Lanes>;
+
+	int32 width = state.width;
+
+	if (y == 0 || y == state.height - 1) return PipeWaterRow_Impl(state, step, y, 0, width);
+
+	const float* heights = HeightData.GetData() + y * width;
+	const float* fluxLeft = state.fluxLeft.GetData() + y * width;
+	const float* fluxRight = state.fluxRight.GetData() + y * width;
+	const float* fluxTop = state.fluxTop.GetData() + y * width;
+	const float* fluxBottom = state.fluxBottom.GetData() + y * width;
+	float* water = state.water.GetData() + y * width;
+	float* sediment = state.sediment.GetData() + y * width;
+	float* velocityX = state.velocityX.GetData() + y * width;
+	float* velocityY = state.velocityY.GetData() + y * width;
+	float* newHeight = state.newHeight.GetData() + y * width;
+
+	FFloatV zero = FFloatV::Zero();
+	FFloatV one = FFloatV::Splat(1.f);
+	FFloatV half = FFloatV::Splat(.5f);
+	FFloatV timeStep = FFloatV::Splat(step.timeStep);
+	FFloatV gravity = FFloatV::Splat(step.gravity);
+	FFloatV cellSize = FFloatV::Splat(state.cellSize);
+	FFloatV inverseCellArea = FFloatV::Splat(1.f / (state.cellSize * state.cellSize));
+	FFloatV inverseSlopeDistance = FFloatV::Splat(.5f / state.cellSize);
+	FFloatV minWaterDepth = FFloatV::Splat(PipeMinWaterDepth);
+	FFloatV minTilt = FFloatV::Splat(PipeMinTilt);
+	FFloatV maxErosion = FFloatV::Splat(PipeMaxErosion);
+	FFloatV sedimentCapacity = FFloatV::Splat(step.sedimentCapacity);
+	FFloatV soilSoftness = FFloatV::Splat(step.soilSoftness);
+	FFloatV depositionConstant = FFloatV::Splat(step.depositionConstant);
+
+	FFloatV maxWaveSpeed = zero;
+
+	int32 x = 1;
+	for (; x + Lanes <= width - 1; x += Lanes)
+	{
+		FFloatV fromLeft = FFloatV::Load(fluxRight + x - 1);
+		FFloatV fromRight = FFloatV::Load(fluxLeft + x + 1);
+		FFloatV fromTop = FFloatV::Load(fluxBottom + x - width);
+		FFloatV fromBottom = FFloatV::Load(fluxTop + x + width);
+
+		FFloatV cellFluxLeft = FFloatV::Load(fluxLeft + x);
+		FFloatV cellFluxRight = FFloatV::Load(fluxRight + x);
+		FFloatV cellFluxTop = FFloatV::Load(fluxTop + x);
+		FFloatV cellFluxBottom = FFloatV::Load(fluxBottom + x);
+
+		FFloatV outflow = cellFluxLeft + cellFluxRight + cellFluxTop + cellFluxBottom;
+		FFloatV previousWater = FFloatV::Load(water + x);
+		FFloatV cellWater = FFloatV::Max(previousWater + timeStep * (fromLeft + fromRight + fromTop + fromBottom - outflow) * inverseCellArea, zero);
+		cellWater.Store(water + x);
+
+		//Dry lanes divide by zero, Select drops them
+		FFloatV meanWater = (previousWater + cellWater) * half;
+		FFloatV velocityScale = FFloatV::Select(meanWater > minWaterDepth, half / (cellSize * meanWater), zero);
+		FFloatV cellVelocityX = (fromLeft - cellFluxLeft + cellFluxRight - fromRight) * velocityScale;
+		FFloatV cellVelocityY = (fromTop - cellFluxTop + cellFluxBottom - fromBottom) * velocityScale;
+		cellVelocityX.Store(velocityX + x);
+		cellVelocityY.Store(velocityY + x);
+
+		FFloatV xSlope = (FFloatV::Load(heights + x + 1) - FFloatV::Load(heights + x - 1)) * inverseSlopeDistance;
+		FFloatV ySlope = (FFloatV::Load(heights + x + width) - FFloatV::Load(heights + x - width)) * inverseSlopeDistance;
+		FFloatV slope = xSlope * xSlope + ySlope * ySlope;
+		FFloatV sine = FFloatV::Max(FFloatV::Sqrt(slope / (one + slope)), minTilt);
+		FFloatV speed = FFloatV::Sqrt(cellVelocityX * cellVelocityX + cellVelocityY * cellVelocityY);
+
+		FFloatV capacity = sedimentCapacity * sine * speed;
+		FFloatV cellSediment = FFloatV::Load(sediment + x);
+		FFloatV erosion = FFloatV::Min(soilSoftness * (capacity - cellSediment), maxErosion);
+		FFloatV deposition = depositionConstant * (capacity - cellSediment);
+		FFloatV change = FFloatV::Select(capacity > cellSediment, erosion, deposition);
+
+		(FFloatV::Load(heights + x) - change).Store(newHeight + x);
+		(cellSediment + change).Store(sediment + x);
+
+		maxWaveSpeed = FFloatV::Max(maxWaveSpeed, speed + FFloatV::Sqrt(gravity * cellWater));
+	}
+
+	float result = maxWaveSpeed.ReduceMax();
+	result = FMath::Max(result, PipeWaterRow_Impl(state, step, y, 0, 1));
+	result = FMath::Max(result, PipeWaterRow_Impl(state, step, y, x, width));
+
+	return result;
+}
+
+void UGenHeight::PipeAdvectRow(FPipeErosionState& state, const FPipeErosionStep& step, int32 y)
+{
+	int32 width = state.width;
+	int32 height = state.height;
+
+	float cellsPerVelocity = step.timeStep / state.cellSize;
+	float evaporation = FMath::Max(1.f - GenOptions.pipeErosion_evaporationRate * step.timeStep, 0.f);
+	float rainfall = GenOptions.pipeErosion_rainfall * step.timeStep;
+
+	const float* sediment = state.sediment.GetData();
+
+	for (int32 x = 0; x < width; x++)
+	{
+		int32 i = y * width + x;
+
+		//Sediment arriving here was upstream one step ago
+		float xSource = FMath::Clamp(x - state.velocityX[i] * cellsPerVelocity, 0.f, float(width - 1));
+		float ySource = FMath::Clamp(y - state.velocityY[i] * cellsPerVelocity, 0.f, float(height - 1));
+
+		int32 x0 = FMath::FloorToInt32(xSource);
+		int32 y0 = FMath::FloorToInt32(ySource);
+		int32 x1 = FMath::Min(x0 + 1, width - 1);
+		int32 y1 = FMath::Min(y0 + 1, height - 1);
+		float xAlpha = xSource - x0;
+		float yAlpha = ySource - y0;
+
+		float top = FMath::Lerp(sediment[y0 * width + x0], sediment[y0 * width + x1], xAlpha);
+		float bottom = FMath::Lerp(sediment[y1 * width + x0], sediment[y1 * width + x1], xAlpha);
+		state.newSediment[i] = FMath::Lerp(top, bottom, yAlpha);
+
+		state.water[i] = state.water[i] * evaporation + rainfall;
+	}
+}
+
+//D8 neighbourhood, distances in cells
+static const int32 StreamPowerXOffsets[8] = { -1, 0, 1, -1, 1, -1, 0, 1 };
+static const int32 StreamPowerYOffsets[8] = { -1, -1, -1, 0, 0, 1, 1, 1 };
+static const float StreamPowerDistances[8] = { UE_SQRT_2, 1.f, UE_SQRT_2, 1.f, 1.f, UE_SQRT_2, 1.f, UE_SQRT_2 };
+
+//Priority-Flood, Barnes et al. 2014, floods inwards from the map border, which is where all water leaves
+static void FillDepressions(TArray<float>& heights, int32 width, int32 height, float epsilon, FGenScratchArena& scratch)
+{
+	//Starts with the border, which is most of what it ever holds
+	TArray<TPair<float, int32>>& open = scratch.GetEmpty<TPair<float, int32>>(TEXT("FillOpen"), 2 * (width + height));
+	TArray<bool>& closed = scratch.GetZeroed<bool>(TEXT("FillClosed"), heights.Num());
+	auto lowerFirst = [](const TPair<float, int32>& a, const TPair<float, int32>& b) { return a.Key < b.Key; };
+
+	for (int32 y = 0; y < height; y++)
+	{
+		for (int32 x = 0; x < width; x++)
+		{
+			if (x > 0 && x < width - 1 && y > 0 && y < height - 1) continue;
+
+			int32 i = y * width + x;
+			closed[i] = true;
+			open.HeapPush(TPair<float, int32>(heights[i], i), lowerFirst);
 		}
+	}
+
+	while (!open.IsEmpty())
+	{
+		TPair<float, int32> cell;
+		open.HeapPop(cell, lowerFirst, EAllowShrinking::No);
+
+		int32 x = cell.Value % width;
+		int32 y = cell.Value / width;
 
-		for (int32 i = 0; i < HeightData.Num(); i++)
+		for (int32 n = 0; n < 8; n++)
 		{
-			HeightData[i] = newHeight[i];
+			int32 xNeighbour = x + StreamPowerXOffsets[n];
+			int32 yNeighbour = y + StreamPowerYOffsets[n];
+			if (xNeighbour < 0 || xNeighbour >= width || yNeighbour < 0 || yNeighbour >= height) continue;
+
+			int32 j = yNeighbour * width + xNeighbour;
+			if (closed[j]) continue;
+			closed[j] = true;
+
+			//Cells below the spill height of the cell that reached them are part of a depression and are raised just above it
+			heights[j] = FMath::Max(heights[j], cell.Key + epsilon);
+			open.HeapPush(TPair<float, int32>(heights[j], j), lowerFirst);
 		}
 	}
 }
 
-void UGenHeight::GlobalSmooth()
+//Braun and Willett 2013, with the slope exponent n = 1 every step is a single pass from the outlets upstream
+void UGenHeight::StreamPowerErosionSteps(int32 count)
 {
-	TArray<float> newHeightData = HeightData;
-
-	int32 smoothSize = 2;
 	int32 width = xSections * xSize;
+	int32 height = ySections * ySize;
+	int32 cellCount = HeightData.Num();
+
+	EParallelForFlags parallelFlags = Backends.IsThreaded(GEN_STAGE_Erosion) ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread;
+
+	float erodibility = GenOptions.streamPower_erodibility;
+	float areaExponent = GenOptions.streamPower_areaExponent;
 
-	for (uint32 xSec = 0; xSec < xSections; xSec++)
+	FGenScratchArena::FStageScope scratchScope(Scratch, TEXT("StreamPowerErosion"));
+
+	//Steepest downhill neighbour, itself for outlets
+	TArray<int32>& receivers = Scratch.Get<int32>(TEXT("StreamPowerReceivers"), cellCount);
+	TArray<float>& receiverDistances = Scratch.Get<float>(TEXT("StreamPowerReceiverDistances"), cellCount);
+
+	//Donors of cell i are donors[donorOffsets[i]] to donors[donorOffsets[i + 1] - 1]
+	TArray<int32>& donorOffsets = Scratch.Get<int32>(TEXT("StreamPowerDonorOffsets"), cellCount + 1);
+	TArray<int32>& donorCursor = Scratch.Get<int32>(TEXT("StreamPowerDonorCursor"), cellCount + 1);
+	TArray<int32>& donors = Scratch.Get<int32>(TEXT("StreamPowerDonors"), cellCount);
+
+	//Cells of every basin, each after its receiver, basin b is order[basinStarts[b]] to order[basinStarts[b + 1] - 1]
+	TArray<int32>& order = Scratch.GetEmpty<int32>(TEXT("StreamPowerOrder"), cellCount);
+	TArray<int32>& basinStarts = Scratch.GetEmpty<int32>(TEXT("StreamPowerBasinStarts"), 0);
+
+	TArray<float>& area = Scratch.Get<float>(TEXT("StreamPowerArea"), cellCount);
+
+	for (int32 e = 0; e < count; e++)
 	{
-		for (uint32 ySec = 0; ySec < ySections; ySec++)
+		if (IsCancelled()) return;
+
+		FillDepressions(HeightData, width, height, GenOptions.streamPower_fillEpsilon, Scratch);
+
+		ParallelFor(height, [&](int32 y)
 		{
-			for (uint32 y = 0; y < ySize; y++)
+			for (int32 x = 0; x < width; x++)
 			{
-				for (uint32 x = 0; x < xSize; x++)
+				int32 i = y * width + x;
+				receivers[i] = i;
+				receiverDistances[i] = 1.f;
+
+				//Water leaves the map at the border
+				if (x == 0 || x == width - 1 || y == 0 || y == height - 1) continue;
+
+				float steepestSlope = 0.f;
+				for (int32 n = 0; n < 8; n++)
 				{
-					float heightSum = 0.f;
-					int32 neighbors = 0;
+					int32 j = i + StreamPowerYOffsets[n] * width + StreamPowerXOffsets[n];
+					float slope = (HeightData[i] - HeightData[j]) / StreamPowerDistances[n];
 
-					for (int32 dy = -smoothSize; dy <= smoothSize; dy++)
+					if (slope > steepestSlope)
 					{
-						for (int32 dx = -smoothSize; dx <= smoothSize; dx++)
-						{
-							//No wraparound
-							if (xSec == 0 && int32(x) + dx < 0) continue;
-							if (xSec == xSections - 1 && int32(x) + dx >= int32(xSize)) continue;
-
-							int32 newIndex = GetGlobalIndex(xSec, ySec, x, y) + dy * width + dx;
-							if (newIndex < 0 || newIndex >= HeightData.Num()) continue;
-
-							heightSum += HeightData[newIndex];
-							neighbors++;
-						}
+						steepestSlope = slope;
+						receivers[i] = j;
+						receiverDistances[i] = StreamPowerDistances[n];
 					}
+				}
+			}
+		}, parallelFlags);
+
+		FMemory::Memzero(donorOffsets.GetData(), donorOffsets.Num() * sizeof(int32));
+		for (int32 i = 0; i < cellCount; i++)
+		{
+			if (receivers[i] != i) donorOffsets[receivers[i] + 1]++;
+		}
+		for (int32 i = 0; i < cellCount; i++) donorOffsets[i + 1] += donorOffsets[i];
+
+		FMemory::Memcpy(donorCursor.GetData(), donorOffsets.GetData(), donorOffsets.Num() * sizeof(int32));
+		for (int32 i = 0; i < cellCount; i++)
+		{
+			if (receivers[i] != i) donors[donorCursor[receivers[i]]++] = i;
+		}
+
+		//Breadth first from every outlet, basins do not share cells, so they accumulate and erode independently
+		order.Reset();
+		basinStarts.Reset();
+		for (int32 i = 0; i < cellCount; i++)
+		{
+			if (receivers[i] != i) continue;
 
-					if (neighbors == 0) continue;
+			basinStarts.Add(order.Num());
+			order.Add(i);
 
-					newHeightData[GetGlobalIndex(xSec, ySec, x, y)] = heightSum / float(neighbors);
+			for (int32 k = basinStarts.Last(); k < order.Num(); k++)
+			{
+				int32 cell = order[k];
+				for (int32 d = donorOffsets[cell]; d < donorOffsets[cell + 1]; d++) order.Add(donors[d]);
+			}
+		}
+		basinStarts.Add(order.Num());
+
+		ParallelFor(basinStarts.Num() - 1, [&](int32 b)
+		{
+			int32 start = basinStarts[b];
+			int32 end = basinStarts[b + 1];
+
+			//Drainage area, downstream from the sources
+			for (int32 k = start; k < end; k++) area[order[k]] = 1.f;
+			for (int32 k = end - 1; k > start; k--) area[receivers[order[k]]] += area[order[k]];
+
+			//Implicit incision, upstream from the outlet, so the receiver already has its new height
+			for (int32 k = start + 1; k < end; k++)
+			{
+				int32 cell = order[k];
+				float factor = erodibility * FMath::Pow(area[cell], areaExponent) / receiverDistances[cell];
+
+				HeightData[cell] = (HeightData[cell] + factor * HeightData[receivers[cell]]) / (1.f + factor);
+			}
+		}, parallelFlags);
+	}
+}
+
+int32 UGenHeight::GetStencilBandRows(int32 width, int32 haloRows, int32 bytesPerCell) const
+{
+	int64 cacheBytes = GenOptions.stencil_cacheBytes > 0 ? GenOptions.stencil_cacheBytes : FGenCpuFeatures::Get().l2CacheBytes;
+
+	//The band and its halo on both sides, with every buffer the pass works in
+	int64 rows = cacheBytes / (int64(width) * bytesPerCell) - 2 * haloRows;
+	return int32(FMath::Clamp<int64>(rows, 0, MAX_int32));
+}
+
+void UGenHeight::RunRowBands(TArrayView<TArray<float>* const> fields, int32 width, int32 haloRows, int32 bytesPerCell, TFunctionRef<void(TArrayView<TArray<float>* const> band)> pass)
+{
+	int32 rows = fields[0]->Num() / width;
+	int32 bandRows = GetStencilBandRows(width, haloRows, bytesPerCell);
+
+	//Thinner bands recompute more halo rows than the cache saves
+	if (bandRows < haloRows || bandRows >= rows)
+	{
+		pass(fields);
+		return;
+	}
+
+	TArray<TArray<float>*, TInlineAllocator<4>> bandFields;
+	TArray<TArray<float>*, TInlineAllocator<4>> outFields;
+
+	//Every band reads its halo from the fields as they were before the pass, the rows it keeps go to separate outputs
+	for (int32 f = 0; f < fields.Num(); f++) outFields.Add(&Scratch.Get<float>(FName(TEXT("BandOutput"), f), fields[f]->Num()));
+
+	for (int32 firstRow = 0; firstRow < rows; firstRow += bandRows)
+	{
+		int32 endRow = FMath::Min(firstRow + bandRows, rows);
+		int32 haloFirstRow = FMath::Max(firstRow - haloRows, 0);
+		int32 haloEndRow = FMath::Min(endRow + haloRows, rows);
+
+		bandFields.Reset();
+		for (int32 f = 0; f < fields.Num(); f++)
+		{
+			TArray<float>& band = Scratch.Get<float>(FName(TEXT("BandField"), f), (haloEndRow - haloFirstRow) * width);
+			FMemory::Memcpy(band.GetData(), fields[f]->GetData() + haloFirstRow * width, band.Num() * sizeof(float));
+			bandFields.Add(&band);
+		}
+
+		pass(bandFields);
+		if (IsCancelled()) return;
+
+		for (int32 f = 0; f < fields.Num(); f++)
+		{
+			FMemory::Memcpy(outFields[f]->GetData() + firstRow * width, bandFields[f]->GetData() + (firstRow - haloFirstRow) * width, (endRow - firstRow) * width * sizeof(float));
+		}
+	}
+
+	for (int32 f = 0; f < fields.Num(); f++) Swap(*fields[f], *outFields[f]);
+}
+
+void UGenHeight::RunStencilBlocks(TArrayView<TArray<float>* const> fields, int32 width, int32 iterations, int32 bytesPerCell, int32 finishHaloRows,
+	TFunctionRef<void(TArrayView<TArray<float>* const> band, int32 firstIteration, int32 count, bool finish)> pass)
+{
+	int32 blockIterations = GenOptions.stencil_blockIterations;
+	if (blockIterations <= 1)
+	{
+		pass(fields, 0, iterations, true);
+		return;
+	}
+
+	for (int32 e = 0; e < iterations; e += blockIterations)
+	{
+		int32 count = FMath::Min(blockIterations, iterations - e);
+		bool finish = e + count == iterations;
+
+		//What a band gets wrong at its edges spreads one row and, past the row ends, one cell further every iteration
+		int32 haloRows = count + 1 + (finish ? finishHaloRows : 0);
+
+		RunRowBands(fields, width, haloRows, bytesPerCell, [&](TArrayView<TArray<float>* const> band)
+		{
+			pass(band, e, count, finish);
+		});
+
+		if (IsCancelled()) return;
+	}
+}
+
+static constexpr int32 ThermalWeatheringIterations = 8;
+
+void UGenHeight::ThermalWeathering()
+{
+	ExpandHeightData();
+	MarkAllSectionsDirty();
+
+	FGenScratchArena::FStageScope scratchScope(Scratch, TEXT("ThermalWeathering"));
+
+	int32 width = xSections * xSize;
+	TArray<float>* fields[1] = { &HeightData };
+
+	//Heights and the buffer the iteration writes
+	RunStencilBlocks(fields, width, ThermalWeatheringIterations, 2 * sizeof(float), 0, [&](TArrayView<TArray<float>* const> band, int32 firstIteration, int32 count, bool finish)
+	{
+		ThermalWeatheringSteps(*band[0], width, count);
+	});
+}
+
+void UGenHeight::ThermalWeatheringSteps(TArray<float>& heights, int32 width, int32 iterations)
+{
+	float T = FMath::DegreesToRadians(15.f);
+	float c = .1f;
+
+	TArray<float>& newHeight = Scratch.Get<float>(TEXT("ThermalHeight"), heights.Num());
+
+	//Every cell gathers from the neighbours that shed material onto it, in the order the neighbours would have scattered it
+	int32 deltas[4] = { -width, -1, 1, width };
+
+	for (int32 e = 0; e < iterations; e++)
+	{
+		for (int32 ai = 0; ai < heights.Num(); ai++)
+		{
+			float height = heights[ai];
+
+			for (int32 delta : deltas)
+			{
+				//TODO: no wraparound
+
+				int32 i = ai + delta; //Neighbour that may shed onto ai
+				if (i < 0 || i >= heights.Num()) continue;
+
+				if (heights[i] - heights[ai] > T)
+				{
+					height += c * (heights[i] - heights[ai] - T);
 				}
 			}
+
+			newHeight[ai] = height;
 		}
+
+		Swap(heights, newHeight);
 	}
+}
+
+void UGenHeight::GlobalSmooth()
+{
+	ExpandHeightData();
+	MarkAllSectionsDirty();
 
-	for (int32 i = 0; i < HeightData.Num(); i++)
+	FGenScratchArena::FStageScope scratchScope(Scratch, TEXT("GlobalSmooth"));
+	SmoothPass(HeightData, xSections * xSize);
+}
+
+void UGenHeight::SmoothPass(TArray<float>& heights, int32 width)
+{
+	TArray<float>& newHeightData = Scratch.Get<float>(TEXT("SmoothHeight"), heights.Num());
+
+	int32 smoothSize = 2;
+
+	for (int32 i = 0; i < heights.Num(); i++)
 	{
-		HeightData[i] = newHeightData[i];
+		int32 x = i % width;
+
+		float heightSum = 0.f;
+		int32 neighbors = 0;
+
+		for (int32 dy = -smoothSize; dy <= smoothSize; dy++)
+		{
+			for (int32 dx = -smoothSize; dx <= smoothSize; dx++)
+			{
+				//No wraparound
+				if (x + dx < 0 || x + dx >= width) continue;
+
+				int32 newIndex = i + dy * width + dx;
+				if (newIndex < 0 || newIndex >= heights.Num()) continue;
+
+				heightSum += heights[newIndex];
+				neighbors++;
+			}
+		}
+
+		//The cell itself always counts
+		newHeightData[i] = heightSum / float(neighbors);
 	}
+
+	Swap(heights, newHeightData);
+}
+
+void UGenHeight::ThermalWeatheringAndSmooth()
+{
+	ExpandHeightData();
+	MarkAllSectionsDirty();
+
+	FGenScratchArena::FStageScope scratchScope(Scratch, TEXT("ThermalWeathering"));
+
+	int32 width = xSections * xSize;
+	TArray<float>* fields[1] = { &HeightData };
+
+	//Smoothing reads two rows further
+	RunStencilBlocks(fields, width, ThermalWeatheringIterations, 2 * sizeof(float), 2, [&](TArrayView<TArray<float>* const> band, int32 firstIteration, int32 count, bool finish)
+	{
+		ThermalWeatheringSteps(*band[0], width, count);
+		if (finish) SmoothPass(*band[0], width);
+	});
 }
 
 void UGenHeight::GetSectionHeight(uint32 sectionIndex, TArray<float>& height)
 {
 	uint32 xSection = sectionIndex % xSections;
-	uint32 ySection = sectionIndex / ySections;
+	uint32 ySection = sectionIndex / xSections;
 
 	bool hasXBorder = xSection < xSections - 1;
 	bool hasYBorder = ySection < ySections - 1;
 
+	//Decompress only the section window (including its border), the layout is the same as below
+	if (IsCompacted())
+	{
+		TArray<float> window;
+		QuantizedHeight.DecompressRegion(xSection * xSize, ySection * ySize, xSize + (hasXBorder ? 1 : 0), ySize + (hasYBorder ? 1 : 0), window);
+		height.Append(window);
+		return;
+	}
+
 	for (uint32 y = 0; y < ySize; y++)
 	{
 		for (uint32 x = 0; x < xSize; x++)
@@ -565,6 +1781,416 @@ bool UGenHeight::HeightfieldCast(float xPos, float yPos, float& outHeight, FVect
 	return true;
 }
 
+void UGenHeight::HeightfieldCastBatch(TConstArrayView<FVector2D> positions, TArray<float>& outHeights, TArray<FVector>& outNormals, TBitArray<>& outValid)
+{
+	//Tiles of 64x64 cells, queries are sorted by tile so that neighbouring queries read neighbouring heights
+	constexpr int32 tileShift = 6;
+	constexpr int32 blockSize = 1024;
+	constexpr int32 parallelThreshold = 4 * blockSize;
+
+	int32 queryCount = positions.Num();
+	int32 width = xSections * xSize;
+	int32 height = ySections * ySize;
+
+	outHeights.SetNumUninitialized(queryCount);
+	outNormals.SetNumUninitialized(queryCount);
+	outValid.Init(false, queryCount);
+
+	if (queryCount == 0 || (HeightData.IsEmpty() && !IsCompacted())) return;
+
+	int32 xTiles = ((width - 1) >> tileShift) + 1;
+	int32 yTiles = ((height - 1) >> tileShift) + 1;
+	int32 invalidTile = xTiles * yTiles;
+
+	float inverseVertexSize = 1.f / vertexSize;
+
+	TArray<float> localX;
+	TArray<float> localY;
+	TArray<int32> tileKeys;
+	localX.SetNumUninitialized(queryCount);
+	localY.SetNumUninitialized(queryCount);
+	tileKeys.SetNumUninitialized(queryCount);
+
+	ParallelFor(queryCount, [&](int32 i)
+	{
+		float x = float(positions[i].X) * inverseVertexSize;
+		float y = float(positions[i].Y) * inverseVertexSize;
+
+		localX[i] = x;
+		localY[i] = y;
+
+		bool valid = x >= 0.f && y >= 0.f && x + 1.f < float(width) && y + 1.f < float(height);
+		tileKeys[i] = valid ? (int32(y) >> tileShift) * xTiles + (int32(x) >> tileShift) : invalidTile;
+	}, queryCount < parallelThreshold ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+
+	//Counting sort by tile
+	TArray<int32> tileStart;
+	tileStart.SetNumZeroed(invalidTile + 2);
+	for (int32 key : tileKeys) tileStart[key + 1]++;
+	for (int32 t = 1; t < tileStart.Num(); t++) tileStart[t] += tileStart[t - 1];
+
+	int32 validCount = tileStart[invalidTile];
+
+	TArray<float> sortedX;
+	TArray<float> sortedY;
+	TArray<int32> sortedIndices;
+	sortedX.SetNumUninitialized(validCount);
+	sortedY.SetNumUninitialized(validCount);
+	sortedIndices.SetNumUninitialized(validCount);
+
+	for (int32 i = 0; i < queryCount; i++)
+	{
+		if (tileKeys[i] == invalidTile) continue;
+
+		int32 target = tileStart[tileKeys[i]]++;
+		sortedX[target] = localX[i];
+		sortedY[target] = localY[i];
+		sortedIndices[target] = i;
+
+		outValid[i] = true;
+	}
+
+	int32 blockCount = FMath::DivideAndRoundUp(validCount, blockSize);
+
+	ParallelFor(blockCount, [&](int32 b)
+	{
+		int32 start = b * blockSize;
+
+		FHeightQueryBlock block;
+		block.xPositions = sortedX.GetData() + start;
+		block.yPositions = sortedY.GetData() + start;
+		block.queryIndices = sortedIndices.GetData() + start;
+		block.count = FMath::Min(blockSize, validCount - start);
+
+		//Gathers need the float heightfield
+		switch (IsCompacted() ? 0 : Backends.GetLaneCount(GEN_STAGE_HeightQuery))
+		{
+		case 16: HeightfieldCastBlock_Intrin<16>(block, outHeights.GetData(), outNormals.GetData()); break;
+		case 8: HeightfieldCastBlock_Intrin<8>(block, outHeights.GetData(), outNormals.GetData()); break;
+		case 4: HeightfieldCastBlock_Intrin<4>(block, outHeights.GetData(), outNormals.GetData()); break;
+		default: HeightfieldCastBlock_Impl(block, outHeights.GetData(), outNormals.GetData()); break;
+		}
+	}, validCount < parallelThreshold || !Backends.IsThreaded(GEN_STAGE_HeightQuery) ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+
+	for (int32 i = 0; i < queryCount; i++)
+	{
+		if (outValid[i]) continue;
+
+		outHeights[i] = 0.f;
+		outNormals[i] = FVector::UpVector;
+	}
+}
+
+void UGenHeight::HeightfieldCastBlock_Impl(const FHeightQueryBlock& block, float* outHeights, FVector* outNormals)
+{
+	int32 width = xSections * xSize;
+
+	for (int32 i = 0; i < block.count; i++)
+	{
+		float x = block.xPositions[i];
+		float y = block.yPositions[i];
+
+		int32 x0 = FMath::FloorToInt32(x);
+		int32 y0 = FMath::FloorToInt32(y);
+		float fx = x - float(x0);
+		float fy = y - float(y0);
+
+		int32 index = y0 * width + x0;
+
+		float w00 = (1.f - fx) * (1.f - fy);
+		float w10 = fx * (1.f - fy);
+		float w01 = (1.f - fx) * fy;
+		float w11 = fx * fy;
+
+		int32 queryIndex = block.queryIndices[i];
+
+		outHeights[queryIndex] = ReadHeight(index) * w00 + ReadHeight(index + 1) * w10 + ReadHeight(index + width) * w01 + ReadHeight(index + width + 1) * w11;
+		outNormals[queryIndex] = (GetNormal(index) * w00 + GetNormal(index + 1) * w10 + GetNormal(index + width) * w01 + GetNormal(index + width + 1) * w11).GetSafeNormal();
+	}
+}
+
+template<int32 Lanes>
+void UGenHeight::HeightfieldCastBlock_Intrin(const FHeightQueryBlock& block, float* outHeights, FVector* outNormals)
+{
+	using FFloatV = TGenFloatVec<Lanes>;
+	using FIntV = TGenIntVec<Lanes>;
+	using FMaskV = TGenMaskVec<Lanes>;
+
+	int32 width = xSections * xSize;
+	int32 height = ySections * ySize;
+	const float* heights = HeightData.GetData();
+
+	FIntV widthV = FIntV::Splat(width);
+	FIntV oneV = FIntV::Splat(1);
+	FIntV twoV = FIntV::Splat(2);
+	FIntV zeroV = FIntV::Splat(0);
+	FIntV lastIndexV = FIntV::Splat(GetHeightCount() - 1);
+	FIntV lastTopRowV = FIntV::Splat(height - 2);
+	FFloatV onesV = FFloatV::Splat(1.f);
+	FFloatV normalZV = FFloatV::Splat(2.f);
+
+	//Same neighbour rules as GetNormal, normal of a sample is (left - right, top - bottom, 2) normalized
+	auto normalize = [](FFloatV& x, FFloatV& y, FFloatV& z)
+	{
+		FFloatV length = FFloatV::Sqrt(x * x + y * y + z * z);
+		x = x / length;
+		y = y / length;
+		z = z / length;
+	};
+
+	//The last partial vector loads its positions masked, the missing lanes sample (0, 0) and are not written
+	for (int32 i = 0; i < block.count; i += Lanes)
+	{
+		int32 laneCount = FMath::Min(Lanes, block.count - i);
+		FMaskV laneMask = FMaskV::FirstN(laneCount);
+
+		FFloatV x = FFloatV::LoadMasked(block.xPositions + i, laneMask);
+		FFloatV y = FFloatV::LoadMasked(block.yPositions + i, laneMask);
+
+		FFloatV xFloor = FFloatV::Floor(x);
+		FFloatV yFloor = FFloatV::Floor(y);
+		FFloatV fx = x - xFloor;
+		FFloatV fy = y - yFloor;
+
+		FIntV y0 = yFloor.ToInt();
+		FIntV index = y0 * widthV + xFloor.ToInt();
+		FIntV indexBelow = index + widthV;
+
+		//Rows above and below fall back to the sample itself at the edges, like GetNormal
+		FIntV topOffset = FIntV::Select(y0 > zeroV, widthV, zeroV);
+		FIntV bottomOffset = FIntV::Select(lastTopRowV > y0, widthV, zeroV);
+
+		FFloatV h00 = FFloatV::Gather(heights, index);
+		FFloatV h10 = FFloatV::Gather(heights, index + oneV);
+		FFloatV h01 = FFloatV::Gather(heights, indexBelow);
+		FFloatV h11 = FFloatV::Gather(heights, indexBelow + oneV);
+
+		FFloatV left00 = FFloatV::Gather(heights, FIntV::Max(index - oneV, zeroV));
+		FFloatV left01 = FFloatV::Gather(heights, indexBelow - oneV);
+		FFloatV right10 = FFloatV::Gather(heights, index + twoV);
+		FFloatV right11 = FFloatV::Gather(heights, FIntV::Min(indexBelow + twoV, lastIndexV));
+
+		FIntV topIndex = index - topOffset;
+		FFloatV top00 = FFloatV::Gather(heights, topIndex);
+		FFloatV top10 = FFloatV::Gather(heights, topIndex + oneV);
+
+		FIntV bottomIndex = indexBelow + bottomOffset;
+		FFloatV bottom01 = FFloatV::Gather(heights, bottomIndex);
+		FFloatV bottom11 = FFloatV::Gather(heights, bottomIndex + oneV);
+
+		FFloatV ifx = onesV - fx;
+		FFloatV ify = onesV - fy;
+		FFloatV w00 = ifx * ify;
+		FFloatV w10 = fx * ify;
+		FFloatV w01 = ifx * fy;
+		FFloatV w11 = fx * fy;
+
+		FFloatV resultHeight = h00 * w00 + h10 * w10 + h01 * w01 + h11 * w11;
+
+		FFloatV nx00 = left00 - h10, ny00 = top00 - h01, nz00 = normalZV;
+		FFloatV nx10 = h00 - right10, ny10 = top10 - h11, nz10 = normalZV;
+		FFloatV nx01 = left01 - h11, ny01 = h00 - bottom01, nz01 = normalZV;
+		FFloatV nx11 = h01 - right11, ny11 = h10 - bottom11, nz11 = normalZV;
+
+		normalize(nx00, ny00, nz00);
+		normalize(nx10, ny10, nz10);
+		normalize(nx01, ny01, nz01);
+		normalize(nx11, ny11, nz11);
+
+		FFloatV nx = nx00 * w00 + nx10 * w10 + nx01 * w01 + nx11 * w11;
+		FFloatV ny = ny00 * w00 + ny10 * w10 + ny01 * w01 + ny11 * w11;
+		FFloatV nz = nz00 * w00 + nz10 * w10 + nz01 * w01 + nz11 * w11;
+		normalize(nx, ny, nz);
+
+		float resultHeights[Lanes];
+		float resultX[Lanes];
+		float resultY[Lanes];
+		float resultZ[Lanes];
+		resultHeight.Store(resultHeights);
+		nx.Store(resultX);
+		ny.Store(resultY);
+		nz.Store(resultZ);
+
+		for (int32 l = 0; l < laneCount; l++)
+		{
+			int32 queryIndex = block.queryIndices[i + l];
+
+			outHeights[queryIndex] = resultHeights[l];
+			outNormals[queryIndex] = FVector(resultX[l], resultY[l], resultZ[l]);
+		}
+	}
+}
+
+void UGenHeight::ComputePlacementMask(uint32 xSection, uint32 ySection, float minHeight, float maxHeight, float maxSlopeDeg, TArray<uint8>& outBits)
+{
+	int32 width = xSections * xSize;
+	int32 height = ySections * ySize;
+	int32 rowBytes = FMath::DivideAndRoundUp(int32(xSize), 8);
+
+	outBits.Init(0, rowBytes * ySize);
+
+	//Section plus one sample on every side, clamped to the heightfield
+	int32 pitch = xSize + 2;
+	TArray<float> window;
+	window.SetNumUninitialized(pitch * (ySize + 2));
+
+	for (int32 y = 0; y < int32(ySize) + 2; y++)
+	{
+		int32 globalY = FMath::Clamp(int32(ySection * ySize) + y - 1, 0, height - 1);
+
+		for (int32 x = 0; x < pitch; x++)
+		{
+			int32 globalX = FMath::Clamp(int32(xSection * xSize) + x - 1, 0, width - 1);
+			window[y * pitch + x] = ReadHeight(globalY * width + globalX);
+		}
+	}
+
+	//The normal is (left - right, top - bottom, 2) normalized, so |z| >= cos(maxSlope) becomes a limit on the squared gradient
+	float slopeCos = FMath::Cos(FMath::DegreesToRadians(maxSlopeDeg));
+
+	FPlacementMaskRow row;
+	row.pitch = pitch;
+	row.count = xSize;
+	row.minHeight = minHeight;
+	row.maxHeight = maxHeight;
+	row.maxGradient = slopeCos > UE_KINDA_SMALL_NUMBER ? 4.f * (1.f - slopeCos * slopeCos) / (slopeCos * slopeCos) : MAX_flt;
+
+	for (uint32 y = 0; y < ySize; y++)
+	{
+		row.heights = window.GetData() + (y + 1) * pitch + 1;
+
+		switch (Backends.GetLaneCount(GEN_STAGE_PlacementMask))
+		{
+		case 16: PlacementMaskRow_Intrin<16>(row, outBits.GetData() + y * rowBytes); break;
+		case 8: PlacementMaskRow_Intrin<8>(row, outBits.GetData() + y * rowBytes); break;
+		case 4: PlacementMaskRow_Intrin<4>(row, outBits.GetData() + y * rowBytes); break;
+		default: PlacementMaskRow_Impl(row, outBits.GetData() + y * rowBytes); break;
+		}
+	}
+}
+
+void UGenHeight::PlacementMaskRow_Impl(const FPlacementMaskRow& row, uint8* outBits)
+{
+	for (int32 i = 0; i < row.count; i++)
+	{
+		const float* sample = row.heights + i;
+
+		float xGradient = sample[-1] - sample[1];
+		float yGradient = sample[-row.pitch] - sample[row.pitch];
+
+		bool accepted = *sample >= row.minHeight && *sample <= row.maxHeight;
+		accepted &= xGradient * xGradient + yGradient * yGradient <= row.maxGradient;
+
+		if (accepted) outBits[i >> 3] |= 1 << (i & 7);
+	}
+}
+
+template<int32 Lanes>
+void UGenHeight::PlacementMaskRow_Intrin(const FPlacementMaskRow& row, uint8* outBits)
+{
+	using FFloatV = TGenFloatVec<Lanes>;
+
+	//Narrow vectors are combined so that every step fills whole bytes
+	constexpr int32 stepSize = Lanes > 8 ? Lanes : 8;
+
+	FFloatV minHeight = FFloatV::Splat(row.minHeight);
+	FFloatV maxHeight = FFloatV::Splat(row.maxHeight);
+	FFloatV maxGradient = FFloatV::Splat(row.maxGradient);
+
+	int32 i = 0;
+	for (; i + stepSize <= row.count; i += stepSize)
+	{
+		uint32 accepted = 0;
+
+		for (int32 v = 0; v < stepSize; v += Lanes)
+		{
+			const float* sample = row.heights + i + v;
+
+			FFloatV height = FFloatV::Load(sample);
+			FFloatV xGradient = FFloatV::Load(sample - 1) - FFloatV::Load(sample + 1);
+			FFloatV yGradient = FFloatV::Load(sample - row.pitch) - FFloatV::Load(sample + row.pitch);
+			FFloatV gradient = xGradient * xGradient + yGradient * yGradient;
+
+			accepted |= ((height >= minHeight) & (height <= maxHeight) & (gradient <= maxGradient)).GetBits() << v;
+		}
+
+		for (int32 b = 0; b < stepSize / 8; b++) outBits[(i >> 3) + b] = uint8(accepted >> (b * 8));
+	}
+
+	//Remainder, i is a multiple of 8 so the remaining bits start at a new byte
+	FPlacementMaskRow remainder = row;
+	remainder.heights += i;
+	remainder.count -= i;
+	PlacementMaskRow_Impl(remainder, outBits + (i >> 3));
+}
+
+void UGenHeight::CompactHeightData()
+{
+	if (!QuantizedStorage || IsCompacted() || HeightData.IsEmpty()) return;
+
+	QuantizedHeight.Compress(HeightData, xSections * xSize, ySections * ySize, xSize, ySize);
+	HeightData.Empty();
+
+	//The working buffers of erosion are as large as the heightfield, they are allocated again by the next stage that modifies heights
+	Scratch.Empty();
+}
+
+void UGenHeight::ExpandHeightData()
+{
+	if (!IsCompacted()) return;
+
+	QuantizedHeight.Decompress(HeightData);
+	QuantizedHeight.Reset();
+}
+
+bool UGenHeight::HeightfieldRaycast(const FVector& origin, const FVector& direction, float maxDistance, FVector& outLocation, FVector& outNormal)
+{
+	if (!HeightPyramid.IsValid()) return false;
+
+	int32 width = xSections * xSize;
+
+	//Heightfield space, t stays in world units
+	FVector localOrigin(origin.X / vertexSize, origin.Y / vertexSize, origin.Z);
+	FVector localDirection(direction.X / vertexSize, direction.Y / vertexSize, direction.Z);
+
+	float t;
+	FIntPoint cell;
+	if (!HeightPyramid.Raycast(localOrigin, localDirection, maxDistance, [this, width](int32 x, int32 y) { return ReadHeight(y * width + x); }, t, cell)) return false;
+
+	outLocation = origin + direction * t;
+	outNormal = GetNormalF(localOrigin.X + localDirection.X * t, localOrigin.Y + localDirection.Y * t);
+
+	return true;
+}
+
+void UGenHeight::UpdateHeightPyramid()
+{
+	int32 width = xSections * xSize;
+	auto readHeight = [this, width](int32 x, int32 y) { return ReadHeight(y * width + x); };
+
+	if (!HeightPyramid.IsValid())
+	{
+		HeightPyramid.Build(width, ySections * ySize, readHeight);
+		PyramidSectionVersions = SectionVersions;
+		return;
+	}
+
+	for (uint32 ySection = 0; ySection < ySections; ySection++)
+	{
+		for (uint32 xSection = 0; xSection < xSections; xSection++)
+		{
+			uint32 sectionIndex = ySection * xSections + xSection;
+			if (PyramidSectionVersions[sectionIndex] == SectionVersions[sectionIndex]) continue;
+
+			//Cells touching the section's samples, including the ones shared with the previous section
+			FIntRect cellRect(xSection * xSize - 1, ySection * ySize - 1, (xSection + 1) * xSize, (ySection + 1) * ySize);
+			HeightPyramid.Update(cellRect, readHeight);
+
+			PyramidSectionVersions[sectionIndex] = SectionVersions[sectionIndex];
+		}
+	}
+}
+
 // Called when the game starts
 void UGenHeight::BeginPlay()
 {
@@ -576,28 +2202,205 @@ void UGenHeight::DrawTexture()
 	int32 xTexSize = xSections * xSize;
 	int32 yTexSize = ySections * ySize;
 
-	//Even though a R8 format would be the most efficiet, render as RGB so that it shows up ok in the UI
-	HeightmapTexture = UTexture2D::CreateTransient(xTexSize, yTexSize, EPixelFormat::PF_R8G8B8A8, "Heightmap texture");
-	HeightmapTexture->MipGenSettings = TextureMipGenSettings::TMGS_NoMipmaps;
-	HeightmapTexture->Filter = TextureFilter::TF_Nearest;
-	
-	FByteBulkData& textureData = HeightmapTexture->GetPlatformData()->Mips[0].BulkData;
-	auto pixels = reinterpret_cast<FColor*>(textureData.Lock(LOCK_READ_WRITE));
+	//Only recreated when the resolution changes, otherwise dirty sections are uploaded as texture regions
+	if (!HeightmapTexture || HeightmapTexture->GetSizeX() != xTexSize || HeightmapTexture->GetSizeY() != yTexSize)
+	{
+		HeightmapTexture = UTexture2D::CreateTransient(xTexSize, yTexSize, EPixelFormat::PF_G16, "Heightmap texture");
+		HeightmapTexture->MipGenSettings = TextureMipGenSettings::TMGS_NoMipmaps;
+		HeightmapTexture->Filter = TextureFilter::TF_Nearest;
+		HeightmapTexture->SRGB = false;
+		HeightmapTexture->UpdateResource();
+
+		MarkAllSectionsDirty();
+	}
+
+	TArray<int32> dirtySections;
+	for (TConstSetBitIterator<> it(DirtySections); it; ++it) dirtySections.Add(it.GetIndex());
+
+	TArray<uint16*> sectionPixels;
+	sectionPixels.SetNum(dirtySections.Num());
 
-	for (int32 i = 0; i < HeightData.Num(); i++)
+	ParallelFor(dirtySections.Num(), [&](int32 i)
 	{
-		float normalizedValue = NormalizeHeightValue(HeightData[i]);
-		uint8 grayscaleValue = FMath::Floor(normalizedValue * 255.f);
+		uint32 sectionIndex = dirtySections[i];
 
-		pixels[i] = FColor(grayscaleValue, grayscaleValue, grayscaleValue);
+		//Freed by the render thread once the region is uploaded
+		sectionPixels[i] = new uint16[xSize * ySize];
+		NormalizeSection(sectionIndex % xSections, sectionIndex / xSections, sectionPixels[i]);
+	}, Backends.IsThreaded(GEN_STAGE_HeightTexture) ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread);
+
+	for (int32 i = 0; i < dirtySections.Num(); i++)
+	{
+		uint32 sectionIndex = dirtySections[i];
+
+		auto region = new FUpdateTextureRegion2D((sectionIndex % xSections) * xSize, (sectionIndex / xSections) * ySize, 0, 0, xSize, ySize);
+
+		HeightmapTexture->UpdateTextureRegions(0, 1, region, xSize * sizeof(uint16), sizeof(uint16), reinterpret_cast<uint8*>(sectionPixels[i]), [](uint8* data, const FUpdateTextureRegion2D* regions)
+		{
+			delete[] reinterpret_cast<uint16*>(data);
+			delete regions;
+		});
 	}
 
-	textureData.Unlock();
-	HeightmapTexture->UpdateResource();
+	DirtySections.Init(false, xSections * ySections);
+
+	DrawPreviewTexture();
 
 	OnHeightmapTextureUpdated.Broadcast(HeightmapTexture);
 }
 
+void UGenHeight::GetHeightRange(float& outMin, float& outMax) const
+{
+	outMin = MAX_flt;
+	outMax = -MAX_flt;
+
+	for (const FVector2f& range : SectionHeightRange)
+	{
+		outMin = FMath::Min(outMin, range.X);
+		outMax = FMath::Max(outMax, range.Y);
+	}
+}
+
+void UGenHeight::MarkAllSectionsDirty()
+{
+	DirtySections.Init(true, xSections * ySections);
+
+	for (uint32& version : SectionVersions) version = ++VersionCounter;
+}
+
+void UGenHeight::NormalizeSection(uint32 xSection, uint32 ySection, uint16* outPixels)
+{
+	TArray<float> window;
+	const float* heights;
+	int32 pitch;
+
+	//Compacted heightfields are only decompressed one section at a time
+	if (IsCompacted())
+	{
+		QuantizedHeight.DecompressTile(xSection, ySection, window);
+		heights = window.GetData();
+		pitch = xSize;
+	}
+	else
+	{
+		heights = HeightData.GetData() + GetGlobalIndex(xSection, ySection, 0, 0);
+		pitch = xSections * xSize;
+	}
+
+	FVector2f range(MAX_flt, -MAX_flt);
+
+	for (uint32 y = 0; y < ySize; y++)
+	{
+		switch (Backends.GetLaneCount(GEN_STAGE_HeightTexture))
+		{
+		case 16: NormalizeHeightRow_Intrin<16>(heights + y * pitch, xSize, outPixels + y * xSize, range.X, range.Y); break;
+		case 8: NormalizeHeightRow_Intrin<8>(heights + y * pitch, xSize, outPixels + y * xSize, range.X, range.Y); break;
+		case 4: NormalizeHeightRow_Intrin<4>(heights + y * pitch, xSize, outPixels + y * xSize, range.X, range.Y); break;
+		default: NormalizeHeightRow_Impl(heights + y * pitch, xSize, outPixels + y * xSize, range.X, range.Y); break;
+		}
+	}
+
+	SectionHeightRange[ySection * xSections + xSection] = range;
+}
+
+void UGenHeight::NormalizeHeightRow_Impl(const float* heights, int32 count, uint16* outPixels, float& inOutMin, float& inOutMax)
+{
+	//Same operations as the vector path so that every backend produces identical pixels
+	float bias = GenOptions.islandModifier ? 1000.f - GenOptions.islandWaterLevelOffset : 0.f;
+	float scale = .5f / (GenOptions.step1Amplitude + GenOptions.step2Amplitude);
+
+	for (int32 i = 0; i < count; i++)
+	{
+		float normalizedValue = FMath::Clamp((heights[i] + bias) * scale + .5f, 0.f, 1.f);
+		outPixels[i] = uint16(FMath::FloorToInt32(normalizedValue * 65535.f + .5f));
+
+		inOutMin = FMath::Min(inOutMin, heights[i]);
+		inOutMax = FMath::Max(inOutMax, heights[i]);
+	}
+}
+
+template<int32 Lanes>
+void UGenHeight::NormalizeHeightRow_Intrin(const float* heights, int32 count, uint16* outPixels, float& inOutMin, float& inOutMax)
+{
+	using FFloatV = TGenFloatVec<Lanes>;
+
+	//NormalizeHeightValue as (height + bias) * scale + .5
+	float bias = GenOptions.islandModifier ? 1000.f - GenOptions.islandWaterLevelOffset : 0.f;
+	float scale = .5f / (GenOptions.step1Amplitude + GenOptions.step2Amplitude);
+
+	FFloatV biasV = FFloatV::Splat(bias);
+	FFloatV scaleV = FFloatV::Splat(scale);
+	FFloatV halfV = FFloatV::Splat(.5f);
+	FFloatV zeroV = FFloatV::Zero();
+	FFloatV oneV = FFloatV::Splat(1.f);
+	FFloatV maxValueV = FFloatV::Splat(65535.f);
+
+	FFloatV minV = FFloatV::Splat(inOutMin);
+	FFloatV maxV = FFloatV::Splat(inOutMax);
+
+	int32 i = 0;
+	for (; i + Lanes <= count; i += Lanes)
+	{
+		FFloatV height = FFloatV::Load(heights + i);
+
+		minV = FFloatV::Min(minV, height);
+		maxV = FFloatV::Max(maxV, height);
+
+		FFloatV normalized = (height + biasV) * scaleV + halfV;
+		normalized = FFloatV::Min(FFloatV::Max(normalized, zeroV), oneV);
+
+		//Truncating the non-negative value + .5 rounds half up like the scalar path
+		(normalized * maxValueV + halfV).ToInt().StoreSaturatedUint16(outPixels + i);
+	}
+
+	inOutMin = minV.ReduceMin();
+	inOutMax = maxV.ReduceMax();
+
+	//Remainder
+	NormalizeHeightRow_Impl(heights + i, count - i, outPixels + i, inOutMin, inOutMax);
+}
+
+void UGenHeight::DrawPreviewTexture()
+{
+	if (PreviewDownsample <= 0) return;
+
+	int32 xPreviewSize = FMath::Max(int32(xSections * xSize) / PreviewDownsample, 1);
+	int32 yPreviewSize = FMath::Max(int32(ySections * ySize) / PreviewDownsample, 1);
+
+	//RGB so that it shows up ok in the UI
+	if (!HeightmapPreviewTexture || HeightmapPreviewTexture->GetSizeX() != xPreviewSize || HeightmapPreviewTexture->GetSizeY() != yPreviewSize)
+	{
+		HeightmapPreviewTexture = UTexture2D::CreateTransient(xPreviewSize, yPreviewSize, EPixelFormat::PF_B8G8R8A8, "Heightmap preview texture");
+		HeightmapPreviewTexture->MipGenSettings = TextureMipGenSettings::TMGS_NoMipmaps;
+		HeightmapPreviewTexture->Filter = TextureFilter::TF_Nearest;
+		HeightmapPreviewTexture->UpdateResource();
+	}
+
+	int32 width = xSections * xSize;
+	FColor* pixels = new FColor[xPreviewSize * yPreviewSize];
+
+	ParallelFor(yPreviewSize, [&](int32 y)
+	{
+		for (int32 x = 0; x < xPreviewSize; x++)
+		{
+			float normalizedValue = FMath::Clamp(NormalizeHeightValue(ReadHeight(y * PreviewDownsample * width + x * PreviewDownsample)), 0.f, 1.f);
+			uint8 grayscaleValue = FMath::Floor(normalizedValue * 255.f);
+
+			pixels[y * xPreviewSize + x] = FColor(grayscaleValue, grayscaleValue, grayscaleValue);
+		}
+	});
+
+	auto region = new FUpdateTextureRegion2D(0, 0, 0, 0, xPreviewSize, yPreviewSize);
+
+	HeightmapPreviewTexture->UpdateTextureRegions(0, 1, region, xPreviewSize * sizeof(FColor), sizeof(FColor), reinterpret_cast<uint8*>(pixels), [](uint8* data, const FUpdateTextureRegion2D* regions)
+	{
+		delete[] reinterpret_cast<FColor*>(data);
+		delete regions;
+	});
+
+	OnHeightmapPreviewUpdated.Broadcast(HeightmapPreviewTexture);
+}
+
 float UGenHeight::CalculateHeightValue(const FVector2D& position)
 {
 	float result = 0.f;
@@ -624,8 +2427,8 @@ float UGenHeight::CalculateHeightValue(const FVector2D& position)
 	//Island modifier
 	if (!GenOptions.islandModifier) return result;
 
-	float midx = xSections * xSize * 0.5f;
-	float midy = ySections * ySize * 0.5f;
+	float midx = xSections * xSize * SampleSpacing.X * 0.5f;
+	float midy = ySections * ySize * SampleSpacing.Y * 0.5f;
 
 	//Square gradient using chebyshev distance
 	float distance = FMath::Max(FMath::Abs(position.X - midx), FMath::Abs(position.Y - midy));
@@ -677,12 +2480,12 @@ uint32 UGenHeight::GetGlobalIndex(uint32 globalXPosition, uint32 globalYPosition
 FVector UGenHeight::GetNormal(int32 globalIndex)
 {
 	int32 width = xSections * xSize;
-	float current = HeightData[globalIndex];
+	float current = ReadHeight(globalIndex);
 
-	float left = globalIndex > 0 ? HeightData[globalIndex - 1] : current;
-	float right = globalIndex < HeightData.Num() - 1 ? HeightData[globalIndex + 1] : current;
-	float top = globalIndex - width >= 0 ? HeightData[globalIndex - width] : current;
-	float bottom = globalIndex + width < HeightData.Num() ? HeightData[globalIndex + width] : current;
+	float left = globalIndex > 0 ? ReadHeight(globalIndex - 1) : current;
+	float right = globalIndex < GetHeightCount() - 1 ? ReadHeight(globalIndex + 1) : current;
+	float top = globalIndex - width >= 0 ? ReadHeight(globalIndex - width) : current;
+	float bottom = globalIndex + width < GetHeightCount() ? ReadHeight(globalIndex + width) : current;
 
 	return -FVector(2.f * (right - left), 2.f * (bottom - top), -4.f).GetSafeNormal();
 }
@@ -715,7 +2518,7 @@ float UGenHeight::GetHeightF(float xPos, float yPos)
 		{
 			float xDiff = 1.f - FMath::Abs(xPos - float(x));
 
-			result += HeightData[GetGlobalIndex(x, y)] * yDiff * xDiff;
+			result += ReadHeight(GetGlobalIndex(x, y)) * yDiff * xDiff;
 		}
 	}
 
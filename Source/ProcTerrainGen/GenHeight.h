@@ -6,6 +6,11 @@
 #include "Components/ActorComponent.h"
 #include "Engine/Texture2D.h"
 #include "IntrinUtil.h"
+#include "GenBackend.h"
+#include "GenPipeline.h"
+#include "GenQuantizedHeight.h"
+#include "GenHeightPyramid.h"
+#include "GenScratch.h"
 #include "GenHeight.generated.h"
 
 UENUM(BlueprintType)
@@ -13,6 +18,10 @@ enum EErosionMethod
 {
 	EROSION_METHOD_Grid,
 	EROSION_METHOD_Particle,
+	//Virtual pipe shallow water model
+	EROSION_METHOD_Pipe,
+	//Implicit stream power incision along the drainage network
+	EROSION_METHOD_StreamPower,
 };
 
 USTRUCT(BlueprintType)
@@ -50,6 +59,14 @@ struct FHeightGeneratorOptions
 	UPROPERTY(BlueprintReadWrite)
 	TEnumAsByte<EErosionMethod> erosionMethod = EROSION_METHOD_Particle;
 
+	//Seconds of erosion before it stops with the iterations it managed, 0 for no limit
+	UPROPERTY(BlueprintReadWrite)
+	float erosion_timeBudget = 0.f;
+
+	//Erosion stops early once the mean height change per cell over 1% of the iterations drops below this, 0 to always run all iterations
+	UPROPERTY(BlueprintReadWrite)
+	float erosion_minChange = 0.f;
+
 	UPROPERTY(BlueprintReadWrite)
 	int32 particleErosion_iterations = 16384;
 
@@ -94,6 +111,66 @@ struct FHeightGeneratorOptions
 
 	UPROPERTY(BlueprintReadWrite)
 	float gridErosion_soilSoftness = .3f;
+
+	/**
+	 * Iterations per resolution level of the multigrid solver, full resolution first, every further entry adds a level at half the resolution of the one before.
+	 * Water moves one cell per iteration on every level, so a few coarse iterations drain as far as many full resolution ones.
+	 * Empty runs gridErosion_iterations at full resolution only.
+	 */
+	UPROPERTY(BlueprintReadWrite)
+	TArray<int32> gridErosion_levelIterations;
+
+	UPROPERTY(BlueprintReadWrite)
+	int32 pipeErosion_iterations = 64;
+
+	//Upper limit in seconds, the step shrinks so that neither water nor sediment moves more than half a cell
+	UPROPERTY(BlueprintReadWrite)
+	float pipeErosion_maxTimeStep = 2.f;
+
+	//Water height per second
+	UPROPERTY(BlueprintReadWrite)
+	float pipeErosion_rainfall = 1.f;
+
+	//Fraction of the water per second
+	UPROPERTY(BlueprintReadWrite)
+	float pipeErosion_evaporationRate = .05f;
+
+	UPROPERTY(BlueprintReadWrite)
+	float pipeErosion_sedimentCapacity = .05f;
+
+	UPROPERTY(BlueprintReadWrite)
+	float pipeErosion_soilSoftness = .3f;
+
+	UPROPERTY(BlueprintReadWrite)
+	float pipeErosion_depositionConstant = .3f;
+
+	//Every iteration fills depressions, rebuilds the drainage network and runs one implicit incision step
+	UPROPERTY(BlueprintReadWrite)
+	int32 streamPower_iterations = 24;
+
+	//Incision rate per step and unit of drainage area ^ streamPower_areaExponent
+	UPROPERTY(BlueprintReadWrite)
+	float streamPower_erodibility = .01f;
+
+	//Drainage area is counted in cells
+	UPROPERTY(BlueprintReadWrite)
+	float streamPower_areaExponent = .5f;
+
+	//Height step between filled cells, keeps filled depressions draining towards their outlet
+	UPROPERTY(BlueprintReadWrite)
+	float streamPower_fillEpsilon = .01f;
+
+	/**
+	 * Iterations grid erosion and thermal weathering run on a band of rows that fits the cache before the band is written back,
+	 * memory traffic drops by about this factor while the halo rows around every band are computed twice. 1 writes back after every iteration.
+	 * The result is the same for every value.
+	 */
+	UPROPERTY(BlueprintReadWrite)
+	int32 stencil_blockIterations = 1;
+
+	//Cache a band has to fit in, 0 for the L2 size the CPU reports
+	UPROPERTY(BlueprintReadWrite)
+	int32 stencil_cacheBytes = 0;
 };
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FHeightmapTextureUpdated, UTexture2D*, heightmapTexture);
@@ -117,29 +194,119 @@ public:
 	UFUNCTION(BlueprintCallable)
 	UTexture2D* GetHeightmapTexture() const { return HeightmapTexture; };
 
+	//Downsampled RGB copy of the heightmap for the UI, the heightmap itself is 16 bit single channel
+	UPROPERTY(BlueprintAssignable)
+	FHeightmapTextureUpdated OnHeightmapPreviewUpdated;
+
+	UFUNCTION(BlueprintCallable)
+	UTexture2D* GetHeightmapPreviewTexture() const { return HeightmapPreviewTexture; };
+
+	//0 disables the preview texture
+	UFUNCTION(BlueprintCallable)
+	void SetPreviewDownsample(int32 factor) { PreviewDownsample = factor; };
+
+	//Min and max height of the last drawn heightmap
+	void GetHeightRange(float& outMin, float& outMax) const;
+
 	UFUNCTION(BlueprintCallable)
 	void SetGenerationOptions(FHeightGeneratorOptions options) { GenOptions = options; }
 
 	FHeightGeneratorOptions GetGenerationOptions() const { return GenOptions; };
 
+	//Runs the whole erosion at once
 	void Erode();
-	void GridBasedErosion();
-	void GridBasedErosion_Impl();
-	void GridBasedErosion_Intrin();
 
-	void ParticleBasedErosion();
-	void ParticleBasedErosion_Impl();
-	void ParticleBasedErosion_Intrin();
+	//Erosion as a resumable job, BeginErosion sets up the state of the selected method and AdvanceErosion runs it for about maxSeconds
+	void BeginErosion();
+	//True once erosion is done, converged, out of its time budget or cancelled, HeightData is a valid snapshot after every call
+	bool AdvanceErosion(double maxSeconds);
+	//Done iterations over all iterations, 1 when no erosion is running
+	float GetErosionProgress() const;
+
+	//Writes the erosion state to the directory every intervalSeconds of erosion and once it is done, an empty directory disables checkpoints
+	void SetErosionCheckpoints(const FString& directory, float intervalSeconds) { CheckpointDirectory = directory; CheckpointInterval = intervalSeconds; };
+	//Replaces the heights with those of a checkpoint and continues its erosion with the current iteration counts, which may be higher than
+	//those of the run that wrote it. False if the checkpoint is unreadable or from different options or terrain size.
+	bool ResumeErosion(const FString& checkpointPath);
+	//Checkpoint file of the current options after the given number of iterations
+	FString GetErosionCheckpointPath(int32 iteration) const;
 
 	void ThermalWeathering();
 
 	void GlobalSmooth();
+
+	//Same heights as ThermalWeathering followed by GlobalSmooth, with stencil_blockIterations above 1 each band is smoothed while it is still in the cache
+	void ThermalWeatheringAndSmooth();
 	
 	void GetSectionHeight(uint32 sectionIndex, TArray<float>& height);
 
 	bool HeightfieldCast(float xPos, float yPos, float& outHeight, FVector& outNormal);
 
-	void SetEnableOptimizations(bool enable) { EnableOptimizations = enable; };
+	//HeightfieldCast for many component space XY positions at once, outValid is false where HeightfieldCast would fail
+	void HeightfieldCastBatch(TConstArrayView<FVector2D> positions, TArray<float>& outHeights, TArray<FVector>& outNormals, TBitArray<>& outValid);
+
+	//Ray against the heightfield triangles in component space, uses the min/max pyramid to skip empty space
+	bool HeightfieldRaycast(const FVector& origin, const FVector& direction, float maxDistance, FVector& outLocation, FVector& outNormal);
+
+	//Rebuilds the min/max pyramid nodes of sections that changed since the last update
+	void UpdateHeightPyramid();
+	int64 GetHeightPyramidMemory() const { return HeightPyramid.GetAllocatedSize(); };
+
+	/**
+	 * One bit per sample of the section (rows of ceil(sectionWidth / 8) bytes, lowest bit first), set where the height lies in
+	 * [minHeight, maxHeight] and the normal is at most maxSlopeDeg off vertical. Neighbours are clamped at the map border.
+	 */
+	void ComputePlacementMask(uint32 xSection, uint32 ySection, float minHeight, float maxHeight, float maxSlopeDeg, TArray<uint8>& outBits);
+
+	//Heights of the section as the 16 bit heightmap texture pixels, GetSectionSize().X * GetSectionSize().Y of them
+	void NormalizeSection(uint32 xSection, uint32 ySection, uint16* outPixels);
+
+	//Samples per section
+	FIntPoint GetSectionSize() const { return FIntPoint(xSize, ySize); };
+
+	//Changes whenever the heights of the section change
+	uint32 GetSectionVersion(uint32 xSection, uint32 ySection) const { return SectionVersions[ySection * xSections + xSection]; };
+
+	void SetBackends(const FGenBackends& backends) { Backends = backends; };
+	const FGenBackends& GetBackends() const { return Backends; };
+
+	//Erosion returns early once the token is cancelled, the heights are left half eroded
+	void SetCancellation(const FGenCancellationPtr& cancellation) { Cancellation = cancellation; };
+	bool IsCancelled() const { return Cancellation.IsValid() && Cancellation->IsCancelled(); };
+
+	//Best of a few runs of a stage with the given backend on the current heights, which are left unchanged
+	double MeasureBackend(EGenStage stage, EGenBackend backend);
+
+	//Offset (in vertices) added to noise coordinates, used to generate chunks of an unbounded world
+	void SetWorldOffset(int32 xOffset, int32 yOffset) { WorldOffset = FIntPoint(xOffset, yOffset); };
+
+	//Vertices of the full resolution terrain per sample, above 1 for a coarse version of it, reset in Initialize
+	void SetSampleSpacing(FVector2D spacing) { SampleSpacing = spacing; };
+
+	//Seeds the erosion random stream, reset from the generation seed in Initialize
+	void SetRandomSeed(int32 randomSeed) { RandomStream.Initialize(randomSeed); };
+
+	const TArray<float>& GetHeightData() const { return HeightData; };
+	//Replaces every height, for example with those another generator with the same layout produced
+	void SetHeightData(const TArray<float>& heights);
+
+	//Keep heights as 16 bit values with a scale and offset per section once generation is done
+	void SetQuantizedStorage(bool enable) { QuantizedStorage = enable; };
+
+	//Moves HeightData into quantized storage (if enabled) and frees the float heightfield and the scratch buffers
+	void CompactHeightData();
+	//Restores the float heightfield for stages that modify heights
+	void ExpandHeightData();
+	bool IsCompacted() const { return QuantizedHeight.IsValid(); };
+
+	float GetQuantizationMaxError() const { return QuantizedHeight.GetMaxError(); };
+	float GetQuantizationRmsError() const { return QuantizedHeight.GetRmsError(); };
+	//Heights and the scratch buffers still held for the stages that modify them
+	int64 GetResidentHeightMemory() const { return HeightData.GetAllocatedSize() + QuantizedHeight.GetAllocatedSize() + Scratch.GetAllocatedSize(); };
+
+	//Working buffer use per stage since the last Initialize
+	const TArray<FGenScratchStageStats>& GetScratchStats() const { return Scratch.GetStageStats(); };
+	int64 GetScratchMemory() const { return Scratch.GetAllocatedSize(); };
 	
 protected:
 	// Called when the game starts
@@ -153,11 +320,201 @@ private:
 	float vertexSize;
 	TArray<float> HeightData;
 
-	bool EnableOptimizations = false;
+	FGenBackends Backends;
+	FGenCancellationPtr Cancellation;
+
+	FIntPoint WorldOffset = FIntPoint::ZeroValue;
+	FVector2D SampleSpacing = FVector2D::UnitVector;
+	FRandomStream RandomStream;
+
+	bool QuantizedStorage = false;
+	FGenQuantizedHeightfield QuantizedHeight;
+
+	//Reused by the erosion and filter stages, only grows when the resolution changes
+	FGenScratchArena Scratch;
+
+	float ReadHeight(int32 globalIndex) const { return QuantizedHeight.IsValid() ? QuantizedHeight.Get(globalIndex) : HeightData[globalIndex]; };
+	int32 GetHeightCount() const { return int32(xSections * xSize * ySections * ySize); };
 
 	UPROPERTY(VisibleAnywhere, BlueprintGetter = GetHeightmapTexture)
 	UTexture2D* HeightmapTexture = nullptr;
 
+	UPROPERTY(VisibleAnywhere, BlueprintGetter = GetHeightmapPreviewTexture)
+	UTexture2D* HeightmapPreviewTexture = nullptr;
+
+	int32 PreviewDownsample = 4;
+
+	//Sections whose heights changed since the last DrawTexture
+	TBitArray<> DirtySections;
+
+	//Set from VersionCounter every time a section's heights change, so versions are never reused, even across Initialize
+	TArray<uint32> SectionVersions;
+	uint32 VersionCounter = 0;
+	//Guards DirtySections and VersionCounter
+	FCriticalSection SectionStateLock;
+
+	FGenHeightPyramid HeightPyramid;
+	TArray<uint32> PyramidSectionVersions;
+	TArray<FVector2f> SectionHeightRange;
+
+	void MarkAllSectionsDirty();
+	void NormalizeHeightRow_Impl(const float* heights, int32 count, uint16* outPixels, float& inOutMin, float& inOutMax);
+	template<int32 Lanes> void NormalizeHeightRow_Intrin(const float* heights, int32 count, uint16* outPixels, float& inOutMin, float& inOutMax);
+	void DrawPreviewTexture();
+
+	//Samples of one row of a padded window, with the rows above and below at -/+ pitch
+	struct FPlacementMaskRow
+	{
+		const float* heights;
+		int32 pitch;
+		int32 count;
+		float minHeight;
+		float maxHeight;
+		//Max squared horizontal gradient (left - right)^2 + (top - bottom)^2 that still passes the slope test
+		float maxGradient;
+	};
+
+	//Grid erosion iterations on a heightfield of the given row width, water and sediment carry over between calls, firstIteration keeps the rainfall interval across calls
+	void GridErosionSteps(TArray<float>& heights, int32 width, TArray<float>& water, TArray<float>& sediment, int32 firstIteration, int32 erosionIterations);
+	void GridErosionSteps_Impl(TArray<float>& heights, int32 width, TArray<float>& water, TArray<float>& sediment, int32 firstIteration, int32 erosionIterations);
+	void GridErosionSteps_Intrin(TArray<float>& heights, int32 width, TArray<float>& water, TArray<float>& sediment, int32 firstIteration, int32 erosionIterations);
+
+	//Full width bands of rows, the stencils index rows linearly and their neighbours wrap around the row ends
+	int32 GetStencilBandRows(int32 width, int32 haloRows, int32 bytesPerCell) const;
+	/**
+	 * Runs pass on copies of bands of the fields with haloRows extra rows on both sides and keeps only the rows of the band.
+	 * pass sees the map border where a band reaches it, so a pass whose result only depends on rows up to haloRows away is the same as
+	 * on the whole fields. Falls back to one pass on the whole fields when they fit the cache or a band would be thinner than its halo.
+	 */
+	void RunRowBands(TArrayView<TArray<float>* const> fields, int32 width, int32 haloRows, int32 bytesPerCell, TFunctionRef<void(TArrayView<TArray<float>* const> band)> pass);
+	/**
+	 * Iterations of a stencil that reaches one row and one cell around the row end per iteration, in blocks of stencil_blockIterations
+	 * per band. The last block is passed finish, for a following pass reaching finishHaloRows rows that runs on the band as well.
+	 */
+	void RunStencilBlocks(TArrayView<TArray<float>* const> fields, int32 width, int32 iterations, int32 bytesPerCell, int32 finishHaloRows,
+		TFunctionRef<void(TArrayView<TArray<float>* const> band, int32 firstIteration, int32 count, bool finish)> pass);
+
+	void ThermalWeatheringSteps(TArray<float>& heights, int32 width, int32 iterations);
+	//5x5 box filter, cells outside the map are left out
+	void SmoothPass(TArray<float>& heights, int32 width);
+
+	//Structure of arrays state of the pipe model, flux is the outflow towards -x, +x, -y and +y
+	struct FPipeErosionState
+	{
+		int32 width;
+		int32 height;
+		float cellSize;
+
+		TArray<float> water;
+		TArray<float> sediment;
+		TArray<float> fluxLeft;
+		TArray<float> fluxRight;
+		TArray<float> fluxTop;
+		TArray<float> fluxBottom;
+		TArray<float> velocityX;
+		TArray<float> velocityY;
+
+		TArray<float> newHeight;
+		TArray<float> newSediment;
+	};
+
+	//Constants of one pipe step, derived from the options and the time step
+	struct FPipeErosionStep
+	{
+		float timeStep;
+		float gravity;
+		//Time step * gravity * pipe cross section / pipe length
+		float fluxScale;
+		float sedimentCapacity;
+		float soilSoftness;
+		float depositionConstant;
+	};
+
+	//Outflow of every cell from the level difference to its neighbours
+	void PipeFluxRow_Impl(FPipeErosionState& state, const FPipeErosionStep& step, int32 y, int32 xBegin, int32 xEnd);
+	template<int32 Lanes> void PipeFluxRow_Intrin(FPipeErosionState& state, const FPipeErosionStep& step, int32 y);
+	//Water from the net flux, velocity from the flux through the cell, then erosion or deposition towards the transport capacity, returns the fastest wave
+	float PipeWaterRow_Impl(FPipeErosionState& state, const FPipeErosionStep& step, int32 y, int32 xBegin, int32 xEnd);
+	template<int32 Lanes> float PipeWaterRow_Intrin(FPipeErosionState& state, const FPipeErosionStep& step, int32 y);
+	//Semi-Lagrangian sediment transport along the velocity
+	void PipeAdvectRow(FPipeErosionState& state, const FPipeErosionStep& step, int32 y);
+
+	//Everything a running erosion needs to continue, the droplet positions come from RandomStream
+	struct FErosionState
+	{
+		EErosionMethod method;
+		int32 iteration = 0;
+		int32 iterationCount = 0;
+		//Time spent in erosion steps, excluding the pauses between slices
+		double seconds = 0.;
+		bool converged = false;
+		//Heights at the start of the current convergence window
+		TArray<float> changeInput;
+		//Iterations per chunk, adapted to the time the last chunk took
+		int32 chunkSize = 1;
+
+		//Grid, levels of the multigrid pyramid, a single level without one
+		TArray<int32> levelIterations;
+		TArray<TArray<float>> levelHeights;
+		TArray<FIntPoint> levelSizes;
+		int32 level = 0;
+		int32 levelIteration = 0;
+		//Heights of the current level before it was eroded, and the change of the level above
+		TArray<float> levelInput;
+		TArray<float> delta;
+		TArray<float> water;
+		TArray<float> sediment;
+
+		//Pipe
+		FPipeErosionState pipe;
+		float waveSpeed = 0.f;
+
+		//Erosion seconds at which the next checkpoint is written
+		double nextCheckpoint = 0.;
+	};
+
+	TUniquePtr<FErosionState> ErosionState;
+
+	FString CheckpointDirectory;
+	float CheckpointInterval = 0.f;
+	//Compression and the file write of the last checkpoint, checkpoints that come due while it runs are skipped
+	UE::Tasks::FTask CheckpointTask;
+
+	//Hash of everything the erosion result depends on, except the iteration counts and the stop conditions
+	uint32 GetErosionOptionsHash() const;
+	//Everything of the state that carries over between steps, scratch buffers are left to BeginErosion
+	void SerializeErosionState(FArchive& ar, FErosionState& state);
+	//Snapshots the state on the calling thread, compresses and writes it on a worker
+	void WriteErosionCheckpoint();
+
+	void ParticleBasedErosion_Impl(int32 erosionIterations);
+	void ParticleBasedErosion_Intrin(int32 erosionIterations);
+
+	//Erodes a downsampled pyramid coarsest first when gridErosion_levelIterations is set
+	void BeginGridErosion();
+	void GridErosionStep(int32 count);
+
+	void BeginPipeErosion();
+	void PipeErosionStep(int32 count);
+	void FinishPipeErosion();
+
+	void StreamPowerErosionSteps(int32 count);
+
+	void PlacementMaskRow_Impl(const FPlacementMaskRow& row, uint8* outBits);
+	template<int32 Lanes> void PlacementMaskRow_Intrin(const FPlacementMaskRow& row, uint8* outBits);
+
+	//Queries sorted by heightfield tile, positions in samples
+	struct FHeightQueryBlock
+	{
+		const float* xPositions;
+		const float* yPositions;
+		const int32* queryIndices;
+		int32 count;
+	};
+
+	void HeightfieldCastBlock_Impl(const FHeightQueryBlock& block, float* outHeights, FVector* outNormals);
+	template<int32 Lanes> void HeightfieldCastBlock_Intrin(const FHeightQueryBlock& block, float* outHeights, FVector* outNormals);
+
 	UPROPERTY(BlueprintSetter = SetGenerationOptions)
 	FHeightGeneratorOptions GenOptions;
 
@@ -0,0 +1,260 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GenHeightPyramid.h"
+#include "Async/ParallelFor.h"
+#include "Algo/Sort.h"
+
+void FGenHeightPyramid::Build(int32 width, int32 height, TFunctionRef<float(int32 x, int32 y)> readHeight)
+{
+	Reset();
+
+	Width = width;
+	Height = height;
+
+	if (width < 2 || height < 2) return;
+
+	int32 levelWidth = width - 1;
+	int32 levelHeight = height - 1;
+
+	while (true)
+	{
+		FLevel& level = Levels.AddDefaulted_GetRef();
+		level.width = levelWidth;
+		level.height = levelHeight;
+		level.minMax.SetNumUninitialized(levelWidth * levelHeight);
+
+		if (levelWidth == 1 && levelHeight == 1) break;
+
+		levelWidth = (levelWidth + 1) / 2;
+		levelHeight = (levelHeight + 1) / 2;
+	}
+
+	for (int32 l = 0; l < Levels.Num(); l++)
+	{
+		ParallelFor(Levels[l].height, [&](int32 y)
+		{
+			for (int32 x = 0; x < Levels[l].width; x++) UpdateNode(l, x, y, readHeight);
+		});
+	}
+}
+
+void FGenHeightPyramid::Reset()
+{
+	Levels.Empty();
+	Width = 0;
+	Height = 0;
+}
+
+void FGenHeightPyramid::Update(FIntRect cellRect, TFunctionRef<float(int32 x, int32 y)> readHeight)
+{
+	for (int32 l = 0; l < Levels.Num(); l++)
+	{
+		const FLevel& level = Levels[l];
+
+		cellRect.Min.X = FMath::Clamp(cellRect.Min.X, 0, level.width);
+		cellRect.Min.Y = FMath::Clamp(cellRect.Min.Y, 0, level.height);
+		cellRect.Max.X = FMath::Clamp(cellRect.Max.X, cellRect.Min.X, level.width);
+		cellRect.Max.Y = FMath::Clamp(cellRect.Max.Y, cellRect.Min.Y, level.height);
+
+		for (int32 y = cellRect.Min.Y; y < cellRect.Max.Y; y++)
+		{
+			for (int32 x = cellRect.Min.X; x < cellRect.Max.X; x++) UpdateNode(l, x, y, readHeight);
+		}
+
+		//Parents of the updated nodes
+		cellRect.Min.X /= 2;
+		cellRect.Min.Y /= 2;
+		cellRect.Max.X = (cellRect.Max.X + 1) / 2;
+		cellRect.Max.Y = (cellRect.Max.Y + 1) / 2;
+	}
+}
+
+bool FGenHeightPyramid::Raycast(const FVector& origin, const FVector& direction, float maxT, TFunctionRef<float(int32 x, int32 y)> readHeight, float& outT, FIntPoint& outCell) const
+{
+	if (!IsValid()) return false;
+
+	struct FStackEntry
+	{
+		int32 level;
+		int32 x;
+		int32 y;
+		float tEnter;
+	};
+
+	FVector inverseDirection(
+		FMath::IsNearlyZero(direction.X) ? 0. : 1. / direction.X,
+		FMath::IsNearlyZero(direction.Y) ? 0. : 1. / direction.Y,
+		FMath::IsNearlyZero(direction.Z) ? 0. : 1. / direction.Z);
+
+	TArray<FStackEntry, TInlineAllocator<64>> stack;
+
+	float rootTEnter;
+	if (!IntersectNode(Levels.Num() - 1, 0, 0, origin, direction, inverseDirection, maxT, rootTEnter)) return false;
+	stack.Add({ Levels.Num() - 1, 0, 0, rootTEnter });
+
+	float bestT = maxT;
+	bool found = false;
+
+	while (!stack.IsEmpty())
+	{
+		FStackEntry entry = stack.Pop(EAllowShrinking::No);
+
+		//A closer hit was found after this node was pushed
+		if (entry.tEnter > bestT) continue;
+
+		if (entry.level == 0)
+		{
+			FVector v00(entry.x, entry.y, readHeight(entry.x, entry.y));
+			FVector v10(entry.x + 1, entry.y, readHeight(entry.x + 1, entry.y));
+			FVector v01(entry.x, entry.y + 1, readHeight(entry.x, entry.y + 1));
+			FVector v11(entry.x + 1, entry.y + 1, readHeight(entry.x + 1, entry.y + 1));
+
+			//Same split as the mesh, (0,0) (0,1) (1,0) and (0,1) (1,1) (1,0)
+			float t;
+			if (IntersectTriangle(origin, direction, v00, v01, v10, t) && t <= bestT)
+			{
+				bestT = t;
+				outCell = FIntPoint(entry.x, entry.y);
+				found = true;
+			}
+
+			if (IntersectTriangle(origin, direction, v01, v11, v10, t) && t <= bestT)
+			{
+				bestT = t;
+				outCell = FIntPoint(entry.x, entry.y);
+				found = true;
+			}
+
+			continue;
+		}
+
+		int32 childLevel = entry.level - 1;
+		FStackEntry children[4];
+		int32 childCount = 0;
+
+		for (int32 cy = entry.y * 2; cy <= entry.y * 2 + 1 && cy < Levels[childLevel].height; cy++)
+		{
+			for (int32 cx = entry.x * 2; cx <= entry.x * 2 + 1 && cx < Levels[childLevel].width; cx++)
+			{
+				float tEnter;
+				if (!IntersectNode(childLevel, cx, cy, origin, direction, inverseDirection, bestT, tEnter)) continue;
+
+				children[childCount++] = { childLevel, cx, cy, tEnter };
+			}
+		}
+
+		//Push the farthest child first so that the closest one is visited next
+		Algo::Sort(MakeArrayView(children, childCount), [](const FStackEntry& a, const FStackEntry& b) { return a.tEnter > b.tEnter; });
+
+		for (int32 c = 0; c < childCount; c++) stack.Add(children[c]);
+	}
+
+	if (found) outT = bestT;
+
+	return found;
+}
+
+SIZE_T FGenHeightPyramid::GetAllocatedSize() const
+{
+	SIZE_T result = Levels.GetAllocatedSize();
+
+	for (const FLevel& level : Levels) result += level.minMax.GetAllocatedSize();
+
+	return result;
+}
+
+void FGenHeightPyramid::UpdateNode(int32 level, int32 x, int32 y, TFunctionRef<float(int32 x, int32 y)> readHeight)
+{
+	FVector2f& node = Levels[level].minMax[y * Levels[level].width + x];
+
+	if (level == 0)
+	{
+		float h00 = readHeight(x, y);
+		float h10 = readHeight(x + 1, y);
+		float h01 = readHeight(x, y + 1);
+		float h11 = readHeight(x + 1, y + 1);
+
+		node.X = FMath::Min(FMath::Min(h00, h10), FMath::Min(h01, h11));
+		node.Y = FMath::Max(FMath::Max(h00, h10), FMath::Max(h01, h11));
+
+		return;
+	}
+
+	const FLevel& children = Levels[level - 1];
+
+	node = FVector2f(MAX_flt, -MAX_flt);
+
+	for (int32 cy = y * 2; cy <= y * 2 + 1 && cy < children.height; cy++)
+	{
+		for (int32 cx = x * 2; cx <= x * 2 + 1 && cx < children.width; cx++)
+		{
+			const FVector2f& child = children.minMax[cy * children.width + cx];
+
+			node.X = FMath::Min(node.X, child.X);
+			node.Y = FMath::Max(node.Y, child.Y);
+		}
+	}
+}
+
+bool FGenHeightPyramid::IntersectNode(int32 level, int32 x, int32 y, const FVector& origin, const FVector& direction, const FVector& inverseDirection, float maxT, float& outTEnter) const
+{
+	const FVector2f& node = Levels[level].minMax[y * Levels[level].width + x];
+
+	//Cells covered by this node, in sample coordinates
+	FVector boundsMin(x << level, y << level, node.X);
+	FVector boundsMax(FMath::Min((x + 1) << level, Width - 1), FMath::Min((y + 1) << level, Height - 1), node.Y);
+
+	float tMin = 0.f;
+	float tMax = maxT;
+
+	for (int32 axis = 0; axis < 3; axis++)
+	{
+		if (inverseDirection[axis] == 0.)
+		{
+			if (origin[axis] < boundsMin[axis] || origin[axis] > boundsMax[axis]) return false;
+			continue;
+		}
+
+		float t1 = (boundsMin[axis] - origin[axis]) * inverseDirection[axis];
+		float t2 = (boundsMax[axis] - origin[axis]) * inverseDirection[axis];
+		if (t1 > t2) Swap(t1, t2);
+
+		tMin = FMath::Max(tMin, t1);
+		tMax = FMath::Min(tMax, t2);
+
+		if (tMin > tMax) return false;
+	}
+
+	outTEnter = tMin;
+
+	return true;
+}
+
+bool FGenHeightPyramid::IntersectTriangle(const FVector& origin, const FVector& direction, const FVector& a, const FVector& b, const FVector& c, float& outT)
+{
+	//Moller-Trumbore, double sided
+	FVector edge1 = b - a;
+	FVector edge2 = c - a;
+
+	FVector p = FVector::CrossProduct(direction, edge2);
+	double determinant = FVector::DotProduct(edge1, p);
+	if (FMath::Abs(determinant) < UE_DOUBLE_SMALL_NUMBER) return false;
+
+	double inverseDeterminant = 1. / determinant;
+	FVector s = origin - a;
+
+	double u = FVector::DotProduct(s, p) * inverseDeterminant;
+	if (u < 0. || u > 1.) return false;
+
+	FVector q = FVector::CrossProduct(s, edge1);
+	double v = FVector::DotProduct(direction, q) * inverseDeterminant;
+	if (v < 0. || u + v > 1.) return false;
+
+	double t = FVector::DotProduct(edge2, q) * inverseDeterminant;
+	if (t < 0.) return false;
+
+	outT = float(t);
+
+	return true;
+}
@@ -0,0 +1,47 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Hierarchical min/max heights over the cells of a heightfield.
+ * Level 0 holds one node per cell (the quad between four height samples), every level above merges 2x2 nodes until a
+ * single root node covers the whole heightfield.
+ */
+class PROCTERRAINGEN_API FGenHeightPyramid
+{
+public:
+	void Build(int32 width, int32 height, TFunctionRef<float(int32 x, int32 y)> readHeight);
+	void Reset();
+
+	//Recomputes the nodes covering the given cell rectangle (inclusive min, exclusive max) on every level
+	void Update(FIntRect cellRect, TFunctionRef<float(int32 x, int32 y)> readHeight);
+
+	bool IsValid() const { return !Levels.IsEmpty(); };
+
+	/**
+	 * Nearest intersection of a ray with the heightfield triangles, in heightfield space (x/y in samples, z in height units).
+	 * Nodes whose bounds the ray misses, or that start behind the closest hit so far, are skipped with their whole subtree.
+	 */
+	bool Raycast(const FVector& origin, const FVector& direction, float maxT, TFunctionRef<float(int32 x, int32 y)> readHeight, float& outT, FIntPoint& outCell) const;
+
+	SIZE_T GetAllocatedSize() const;
+
+private:
+	struct FLevel
+	{
+		int32 width = 0;
+		int32 height = 0;
+		TArray<FVector2f> minMax;
+	};
+
+	int32 Width = 0;
+	int32 Height = 0;
+	TArray<FLevel> Levels;
+
+	void UpdateNode(int32 level, int32 x, int32 y, TFunctionRef<float(int32 x, int32 y)> readHeight);
+	bool IntersectNode(int32 level, int32 x, int32 y, const FVector& origin, const FVector& direction, const FVector& inverseDirection, float maxT, float& outTEnter) const;
+
+	static bool IntersectTriangle(const FVector& origin, const FVector& direction, const FVector& a, const FVector& b, const FVector& c, float& outT);
+};
@@ -0,0 +1,157 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GenKernelCheck.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+static FString GetBaselinePath()
+{
+	//Throughput only compares on the same hardware, every machine keeps its own file
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("ProcTerrainGen"), FString::Printf(TEXT("KernelBaseline_%s.csv"), FPlatformProcess::ComputerName()));
+}
+
+FGenKernelCheck::FGenKernelCheck(const FGenKernelCheckOptions& options)
+{
+	Options = options;
+	Report.baselinePath = GetBaselinePath();
+
+	//Loaded with updateBaseline as well, kernels that do not run this time keep their rows
+	TArray<FString> lines;
+	if (!FFileHelper::LoadFileToStringArray(lines, *Report.baselinePath)) return;
+
+	//kernel,backend,throughput
+	for (const FString& line : lines)
+	{
+		TArray<FString> columns;
+		if (line.ParseIntoArray(columns, TEXT(",")) != 3) continue;
+
+		Baseline.Add(columns[0] + TEXT(",") + columns[1], FCString::Atod(*columns[2]));
+	}
+}
+
+float FGenKernelCheck::MaxRelativeError(TConstArrayView<float> reference, TConstArrayView<float> values)
+{
+	if (reference.Num() != values.Num()) return MAX_flt;
+	if (reference.IsEmpty()) return 0.f;
+
+	float minValue = MAX_flt;
+	float maxValue = -MAX_flt;
+	float maxError = 0.f;
+
+	for (int32 i = 0; i < reference.Num(); i++)
+	{
+		minValue = FMath::Min(minValue, reference[i]);
+		maxValue = FMath::Max(maxValue, reference[i]);
+
+		float error = FMath::Abs(reference[i] - values[i]);
+		//NaN has to fail as well
+		maxError = error <= maxError ? maxError : error;
+	}
+
+	return maxError / FMath::Max(maxValue - minValue, UE_SMALL_NUMBER);
+}
+
+float FGenKernelCheck::MaxAngleError(TConstArrayView<FVector> reference, TConstArrayView<FVector> values)
+{
+	if (reference.Num() != values.Num()) return UE_PI;
+
+	float maxError = 0.f;
+
+	for (int32 i = 0; i < reference.Num(); i++)
+	{
+		float cosine = FVector::DotProduct(reference[i].GetSafeNormal(), values[i].GetSafeNormal());
+		float error = FMath::Acos(FMath::Clamp(cosine, -1.f, 1.f));
+
+		//Both zero counts as equal, one zero does not
+		if (reference[i].IsNearlyZero() != values[i].IsNearlyZero()) error = UE_PI;
+		maxError = error <= maxError ? maxError : error;
+	}
+
+	return maxError;
+}
+
+float FGenKernelCheck::ChangeStatisticsError(TConstArrayView<float> input, TConstArrayView<float> reference, TConstArrayView<float> values)
+{
+	if (input.Num() != reference.Num() || input.Num() != values.Num()) return MAX_flt;
+	if (input.IsEmpty()) return 0.f;
+
+	//Mean absolute, RMS and net change
+	double referenceStats[3] = {};
+	double valueStats[3] = {};
+
+	for (int32 i = 0; i < input.Num(); i++)
+	{
+		double referenceChange = double(reference[i]) - input[i];
+		double valueChange = double(values[i]) - input[i];
+
+		referenceStats[0] += FMath::Abs(referenceChange);
+		referenceStats[1] += referenceChange * referenceChange;
+		referenceStats[2] += referenceChange;
+
+		valueStats[0] += FMath::Abs(valueChange);
+		valueStats[1] += valueChange * valueChange;
+		valueStats[2] += valueChange;
+	}
+
+	referenceStats[1] = FMath::Sqrt(referenceStats[1]);
+	valueStats[1] = FMath::Sqrt(valueStats[1]);
+
+	//Net change is measured against the total amount moved, it can be close to zero on its own
+	double scales[3] = { referenceStats[0], referenceStats[1], referenceStats[0] };
+
+	float maxError = 0.f;
+	for (int32 s = 0; s < 3; s++)
+	{
+		float error = float(FMath::Abs(valueStats[s] - referenceStats[s]) / FMath::Max(scales[s], UE_DOUBLE_SMALL_NUMBER));
+		maxError = error <= maxError ? maxError : error;
+	}
+
+	return maxError;
+}
+
+void FGenKernelCheck::Add(const FString& kernel, EGenBackend backend, float error, float tolerance, double throughput)
+{
+	FGenKernelCheckResult& result = Report.results.AddDefaulted_GetRef();
+	result.kernel = kernel;
+	result.backend = backend;
+	result.error = error;
+	result.tolerance = tolerance * Options.toleranceScale;
+	result.throughput = throughput;
+	result.correct = error <= result.tolerance;
+
+	FString key = GetBaselineKey(kernel, backend);
+
+	const double* baselineThroughput = Baseline.Find(key);
+	if (baselineThroughput && !Options.updateBaseline)
+	{
+		result.baselineThroughput = *baselineThroughput;
+		result.fastEnough = throughput >= *baselineThroughput * (1.f - Options.throughputMargin);
+	}
+	else
+	{
+		//First run of this variant on this machine becomes its baseline, updateBaseline replaces only the measured variants
+		Baseline.Add(key, throughput);
+		BaselineChanged = true;
+	}
+
+	Report.passed &= result.correct && result.fastEnough;
+}
+
+FGenKernelCheckReport FGenKernelCheck::Finish()
+{
+	if (BaselineChanged)
+	{
+		FString data;
+		for (const TPair<FString, double>& entry : Baseline) data += FString::Printf(TEXT("%s,%.3f\n"), *entry.Key, entry.Value);
+
+		FFileHelper::SaveStringToFile(data, *Report.baselinePath);
+	}
+
+	return Report;
+}
+
+FString FGenKernelCheck::GetBaselineKey(const FString& kernel, EGenBackend backend)
+{
+	return kernel + TEXT(",") + StaticEnum<EGenBackend>()->GetNameStringByValue(backend);
+}
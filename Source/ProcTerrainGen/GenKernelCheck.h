@@ -0,0 +1,124 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GenBackend.h"
+#include "GenKernelCheck.generated.h"
+
+USTRUCT(BlueprintType)
+struct FGenKernelCheckOptions
+{
+	GENERATED_USTRUCT_BODY()
+
+	//Every kernel runs once per seed on the terrain size of the world options
+	UPROPERTY(BlueprintReadWrite)
+	TArray<float> seeds = { 1.f, 7.f, 1337.f };
+
+	//Fail when a variant processes less than (1 - throughputMargin) of its baseline
+	UPROPERTY(BlueprintReadWrite)
+	float throughputMargin = .25f;
+
+	//Multiplies the tolerance of every kernel
+	UPROPERTY(BlueprintReadWrite)
+	float toleranceScale = 1.f;
+
+	//Replace the stored baseline of this machine with the measured throughput
+	UPROPERTY(BlueprintReadWrite)
+	bool updateBaseline = false;
+};
+
+USTRUCT(BlueprintType)
+struct FGenKernelCheckResult
+{
+	GENERATED_USTRUCT_BODY()
+
+	UPROPERTY(BlueprintReadWrite)
+	FString kernel;
+
+	UPROPERTY(BlueprintReadWrite)
+	TEnumAsByte<EGenBackend> backend = GEN_BACKEND_Scalar;
+
+	//Largest deviation from the scalar variant over all seeds, in the metric of the kernel
+	UPROPERTY(BlueprintReadWrite)
+	float error = 0.f;
+
+	UPROPERTY(BlueprintReadWrite)
+	float tolerance = 0.f;
+
+	//Elements per second, cells, vertices or queries depending on the kernel
+	UPROPERTY(BlueprintReadWrite)
+	double throughput = 0.;
+
+	//0 when this machine has no baseline for the variant yet
+	UPROPERTY(BlueprintReadWrite)
+	double baselineThroughput = 0.;
+
+	UPROPERTY(BlueprintReadWrite)
+	bool correct = true;
+
+	UPROPERTY(BlueprintReadWrite)
+	bool fastEnough = true;
+};
+
+USTRUCT(BlueprintType)
+struct FGenKernelCheckReport
+{
+	GENERATED_USTRUCT_BODY()
+
+	UPROPERTY(BlueprintReadWrite)
+	bool passed = true;
+
+	UPROPERTY(BlueprintReadWrite)
+	TArray<FGenKernelCheckResult> results;
+
+	UPROPERTY(BlueprintReadWrite)
+	FString baselinePath;
+};
+
+/**
+ * Collects the results of AGenWorld::CheckKernels and compares them to the throughput baseline of this machine,
+ * kept as CSV in Saved/ProcTerrainGen.
+ */
+class PROCTERRAINGEN_API FGenKernelCheck
+{
+public:
+	FGenKernelCheck(const FGenKernelCheckOptions& options);
+
+	//Largest absolute difference relative to the value range of the reference
+	static float MaxRelativeError(TConstArrayView<float> reference, TConstArrayView<float> values);
+	//Largest angle between the vectors in radians
+	static float MaxAngleError(TConstArrayView<FVector> reference, TConstArrayView<FVector> values);
+	//Fraction of elements that differ, 1 if the counts do not match
+	template<typename T>
+	static float MismatchRate(TConstArrayView<T> reference, TConstArrayView<T> values)
+	{
+		if (reference.Num() != values.Num()) return 1.f;
+		if (reference.IsEmpty()) return 0.f;
+
+		int32 mismatches = 0;
+		for (int32 i = 0; i < reference.Num(); i++) mismatches += reference[i] == values[i] ? 0 : 1;
+
+		return float(mismatches) / reference.Num();
+	}
+
+	/**
+	 * For kernels whose variants do not produce the same field, such as particle erosion where particles run concurrently.
+	 * Largest relative difference of the mean absolute, RMS and net change of the heights against the input.
+	 */
+	static float ChangeStatisticsError(TConstArrayView<float> input, TConstArrayView<float> reference, TConstArrayView<float> values);
+
+	void Add(const FString& kernel, EGenBackend backend, float error, float tolerance, double throughput);
+
+	//Writes the baseline when it was missing entries or updateBaseline is set
+	FGenKernelCheckReport Finish();
+
+private:
+	FGenKernelCheckOptions Options;
+	FGenKernelCheckReport Report;
+
+	TMap<FString, double> Baseline;
+	bool BaselineChanged = false;
+
+	static FString GetBaselineKey(const FString& kernel, EGenBackend backend);
+};
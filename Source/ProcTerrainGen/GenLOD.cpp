@@ -0,0 +1,335 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GenLOD.h"
+#include "Async/ParallelFor.h"
+
+void FGenTerrainLOD::Build(UGenHeight* heightGenerator, int32 xSectionCount, int32 ySectionCount, int32 xVertexCount, int32 yVertexCount, float edgeSize)
+{
+	Reset();
+
+	xSections = xSectionCount;
+	ySections = ySectionCount;
+
+	Chains.SetNum(xSections * ySections);
+
+	//Per section, per level build time (summed up after the parallel build)
+	TArray<double> sectionLevelTime;
+	sectionLevelTime.SetNumZeroed(Chains.Num() * GEN_LOD_LEVEL_COUNT);
+
+	ParallelFor(xSections * ySections, [&](int32 i)
+	{
+		int32 xSection = i % xSections;
+		int32 ySection = i / xSections;
+
+		FGenSectionLODChain& chain = Chains[GetSectionIndex(xSection, ySection)];
+		chain.xSection = xSection;
+		chain.ySection = ySection;
+
+		TArray<float> sectionHeight;
+		heightGenerator->GetSectionHeight(GetSectionIndex(xSection, ySection), sectionHeight);
+
+		//Same layout as the mesh section, including the border shared with the next section
+		int32 gridWidth = xVertexCount + (xSection < xSections - 1 ? 1 : 0);
+		int32 gridHeight = yVertexCount + (ySection < ySections - 1 ? 1 : 0);
+
+		for (int32 l = 0; l < GEN_LOD_LEVEL_COUNT; l++)
+		{
+			int32 stride = 1 << l;
+
+			//Stitching needs at least one interior row and column
+			if (l > 0 && ((gridWidth - 1) / stride < 2 || (gridHeight - 1) / stride < 2)) break;
+
+			double startTime = FPlatformTime::Seconds();
+
+			FGenSectionLODLevel& level = chain.levels.AddDefaulted_GetRef();
+			BuildLevel(sectionHeight, gridWidth, gridHeight, stride, chain, xVertexCount, yVertexCount, edgeSize, level);
+
+			if (l == 0)
+			{
+				for (const FVector& vertex : level.vertices) chain.bounds += vertex;
+			}
+			else
+			{
+				//Keep errors monotonic so that selection can stop at the first level that is too coarse
+				level.geometricError = FMath::Max(level.geometricError, chain.levels[l - 1].geometricError);
+			}
+
+			sectionLevelTime[i * GEN_LOD_LEVEL_COUNT + l] = FPlatformTime::Seconds() - startTime;
+		}
+	});
+
+	for (int32 i = 0; i < sectionLevelTime.Num(); i++)
+	{
+		LevelBuildTime[i % GEN_LOD_LEVEL_COUNT] += sectionLevelTime[i];
+	}
+}
+
+void FGenTerrainLOD::Reset()
+{
+	Chains.Empty();
+
+	for (int32 l = 0; l < GEN_LOD_LEVEL_COUNT; l++) LevelBuildTime[l] = 0.;
+}
+
+void FGenTerrainLOD::SelectLODs(const FVector& viewpoint, float errorTolerance, TArray<int32>& outLevels) const
+{
+	outLevels.SetNum(Chains.Num());
+
+	for (int32 i = 0; i < Chains.Num(); i++)
+	{
+		const FGenSectionLODChain& chain = Chains[i];
+
+		float distance = FMath::Max(FMath::Sqrt(chain.bounds.ComputeSquaredDistanceToPoint(viewpoint)), 1.f);
+		float maxError = errorTolerance * distance;
+
+		int32 selected = 0;
+		for (int32 l = 1; l < chain.levels.Num(); l++)
+		{
+			if (chain.levels[l].geometricError > maxError) break;
+			selected = l;
+		}
+
+		outLevels[i] = selected;
+	}
+}
+
+uint32 FGenTerrainLOD::GetIndexKey(int32 sectionIndex, const TArray<int32>& sectionLevels) const
+{
+	int32 level = sectionLevels[sectionIndex];
+	uint32 key = uint32(level);
+
+	for (int32 e = 0; e < LOD_EDGE_Count; e++)
+	{
+		int32 neighbour = GetNeighbourIndex(sectionIndex, EGenLODEdge(e));
+
+		//Only coarser neighbours change the triangulation
+		int32 edgeLevel = neighbour >= 0 ? FMath::Max(level, sectionLevels[neighbour]) : level;
+		edgeLevel = FMath::Min(edgeLevel, Chains[sectionIndex].levels.Num() - 1);
+
+		key |= uint32(edgeLevel) << (4 * (e + 1));
+	}
+
+	return key;
+}
+
+const TArray<int32>& FGenTerrainLOD::GetStitchedIndices(int32 sectionIndex, const TArray<int32>& sectionLevels)
+{
+	FGenSectionLODChain& chain = Chains[sectionIndex];
+	uint32 key = GetIndexKey(sectionIndex, sectionLevels);
+
+	if (const TArray<int32>* cached = chain.indexCache.Find(key)) return *cached;
+
+	int32 edgeStrides[LOD_EDGE_Count];
+	for (int32 e = 0; e < LOD_EDGE_Count; e++)
+	{
+		edgeStrides[e] = 1 << ((key >> (4 * (e + 1))) & 0xF);
+	}
+
+	TArray<int32>& indices = chain.indexCache.Add(key);
+	BuildIndices(chain.levels[key & 0xF], edgeStrides, indices);
+
+	return indices;
+}
+
+int64 FGenTerrainLOD::GetLevelMemory(int32 level) const
+{
+	int64 result = 0;
+
+	for (const FGenSectionLODChain& chain : Chains)
+	{
+		if (!chain.levels.IsValidIndex(level)) continue;
+
+		const FGenSectionLODLevel& lod = chain.levels[level];
+		result += lod.vertices.GetAllocatedSize() + lod.uvs.GetAllocatedSize() + lod.xSamples.GetAllocatedSize() + lod.ySamples.GetAllocatedSize();
+
+		for (const auto& indexBuffer : chain.indexCache)
+		{
+			if (int32(indexBuffer.Key & 0xF) == level) result += indexBuffer.Value.GetAllocatedSize();
+		}
+	}
+
+	return result;
+}
+
+int32 FGenTerrainLOD::GetNeighbourIndex(int32 sectionIndex, EGenLODEdge edge) const
+{
+	int32 xSection = Chains[sectionIndex].xSection;
+	int32 ySection = Chains[sectionIndex].ySection;
+
+	switch (edge)
+	{
+	case LOD_EDGE_XNeg:
+		return xSection > 0 ? GetSectionIndex(xSection - 1, ySection) : -1;
+	case LOD_EDGE_XPos:
+		return xSection < xSections - 1 ? GetSectionIndex(xSection + 1, ySection) : -1;
+	case LOD_EDGE_YNeg:
+		return ySection > 0 ? GetSectionIndex(xSection, ySection - 1) : -1;
+	case LOD_EDGE_YPos:
+		return ySection < ySections - 1 ? GetSectionIndex(xSection, ySection + 1) : -1;
+	default:
+		return -1;
+	}
+}
+
+void FGenTerrainLOD::BuildLevel(const TArray<float>& sectionHeight, int32 gridWidth, int32 gridHeight, int32 stride, const FGenSectionLODChain& chain, int32 xVertexCount, int32 yVertexCount, float edgeSize, FGenSectionLODLevel& outLevel) const
+{
+	outLevel.stride = stride;
+	BuildSamples(gridWidth - 1, stride, outLevel.xSamples);
+	BuildSamples(gridHeight - 1, stride, outLevel.ySamples);
+
+	outLevel.vertices.Reserve(outLevel.GetXCount() * outLevel.GetYCount());
+	outLevel.uvs.Reserve(outLevel.GetXCount() * outLevel.GetYCount());
+
+	for (int32 y : outLevel.ySamples)
+	{
+		for (int32 x : outLevel.xSamples)
+		{
+			float xValue = (chain.xSection * xVertexCount + x) * edgeSize;
+			float yValue = (chain.ySection * yVertexCount + y) * edgeSize;
+
+			outLevel.vertices.Add(FVector(xValue, yValue, sectionHeight[y * gridWidth + x]));
+			outLevel.uvs.Add(FVector2D((float)x, (float)y));
+		}
+	}
+
+	if (stride == 1) return;
+
+	float maxError = 0.f;
+	for (int32 y = 0; y < gridHeight; y++)
+	{
+		for (int32 x = 0; x < gridWidth; x++)
+		{
+			maxError = FMath::Max(maxError, FMath::Abs(sectionHeight[y * gridWidth + x] - GetLevelHeight(outLevel, x, y)));
+		}
+	}
+
+	outLevel.geometricError = maxError;
+}
+
+void FGenTerrainLOD::BuildIndices(const FGenSectionLODLevel& level, const int32 edgeStrides[LOD_EDGE_Count], TArray<int32>& outIndices) const
+{
+	int32 nx = level.GetXCount();
+	int32 ny = level.GetYCount();
+
+	bool stitched[LOD_EDGE_Count];
+	for (int32 e = 0; e < LOD_EDGE_Count; e++) stitched[e] = edgeStrides[e] > level.stride;
+
+	int32 xStart = stitched[LOD_EDGE_XNeg] ? 1 : 0;
+	int32 xEnd = stitched[LOD_EDGE_XPos] ? nx - 2 : nx - 1;
+	int32 yStart = stitched[LOD_EDGE_YNeg] ? 1 : 0;
+	int32 yEnd = stitched[LOD_EDGE_YPos] ? ny - 2 : ny - 1;
+
+	//Interior, same triangulation as the full resolution mesh
+	for (int32 y = yStart; y < yEnd; y++)
+	{
+		for (int32 x = xStart; x < xEnd; x++)
+		{
+			int32 startIndex = y * nx + x;
+
+			outIndices.Add(startIndex); //(0,0)
+			outIndices.Add(startIndex + nx); //(0, 1)
+			outIndices.Add(startIndex + 1); //(1,0)
+
+			outIndices.Add(startIndex + nx); //(0, 1)
+			outIndices.Add(startIndex + nx + 1); // (1, 1)
+			outIndices.Add(startIndex + 1); //(1, 0)
+		}
+	}
+
+	//Stitched edges: zip the first interior row/column against the coarser neighbour's samples on the edge.
+	//Corners are split diagonally between the two strips
+	for (int32 e = 0; e < LOD_EDGE_Count; e++)
+	{
+		if (!stitched[e]) continue;
+
+		bool alongX = e == LOD_EDGE_YNeg || e == LOD_EDGE_YPos;
+		const TArray<int32>& samples = alongX ? level.xSamples : level.ySamples;
+		int32 fixedOuter = (e == LOD_EDGE_XNeg || e == LOD_EDGE_YNeg) ? 0 : (alongX ? ny - 1 : nx - 1);
+		int32 fixedInner = (e == LOD_EDGE_XNeg || e == LOD_EDGE_YNeg) ? 1 : (alongX ? ny - 2 : nx - 2);
+		int32 innerStart = alongX ? xStart : yStart;
+		int32 innerEnd = alongX ? xEnd : yEnd;
+
+		auto vertexIndex = [&](int32 along, int32 across) { return alongX ? across * nx + along : along * nx + across; };
+
+		TArray<int32> outerSamples;
+		BuildSamples(samples.Last(), edgeStrides[e], outerSamples);
+
+		TArray<int32> outer;
+		for (int32 position : outerSamples)
+		{
+			int32 along = position == samples.Last() ? samples.Num() - 1 : position / level.stride;
+			outer.Add(vertexIndex(along, fixedOuter));
+		}
+
+		TArray<int32> outerPositions = outerSamples;
+		TArray<int32> inner;
+		TArray<int32> innerPositions;
+		for (int32 along = innerStart; along <= innerEnd; along++)
+		{
+			inner.Add(vertexIndex(along, fixedInner));
+			innerPositions.Add(samples[along]);
+		}
+
+		int32 i = 0;
+		int32 j = 0;
+		while (i < outer.Num() - 1 || j < inner.Num() - 1)
+		{
+			bool advanceOuter = j == inner.Num() - 1 || (i < outer.Num() - 1 && outerPositions[i + 1] <= innerPositions[j + 1]);
+
+			if (advanceOuter)
+			{
+				AddTriangle(level, outer[i], outer[i + 1], inner[j], outIndices);
+				i++;
+			}
+			else
+			{
+				AddTriangle(level, outer[i], inner[j + 1], inner[j], outIndices);
+				j++;
+			}
+		}
+	}
+}
+
+void FGenTerrainLOD::BuildSamples(int32 extent, int32 stride, TArray<int32>& outSamples)
+{
+	outSamples.Reset();
+
+	for (int32 position = 0; position < extent; position += stride) outSamples.Add(position);
+	outSamples.Add(extent);
+}
+
+float FGenTerrainLOD::GetLevelHeight(const FGenSectionLODLevel& level, int32 x, int32 y)
+{
+	int32 nx = level.GetXCount();
+
+	int32 xi = FMath::Min(x / level.stride, nx - 2);
+	int32 yi = FMath::Min(y / level.stride, level.GetYCount() - 2);
+
+	float xAlpha = float(x - level.xSamples[xi]) / float(level.xSamples[xi + 1] - level.xSamples[xi]);
+	float yAlpha = float(y - level.ySamples[yi]) / float(level.ySamples[yi + 1] - level.ySamples[yi]);
+
+	float h00 = level.vertices[yi * nx + xi].Z;
+	float h10 = level.vertices[yi * nx + xi + 1].Z;
+	float h01 = level.vertices[(yi + 1) * nx + xi].Z;
+	float h11 = level.vertices[(yi + 1) * nx + xi + 1].Z;
+
+	return FMath::Lerp(FMath::Lerp(h00, h10, xAlpha), FMath::Lerp(h01, h11, xAlpha), yAlpha);
+}
+
+void FGenTerrainLOD::AddTriangle(const FGenSectionLODLevel& level, int32 a, int32 b, int32 c, TArray<int32>& outIndices)
+{
+	FVector2D pa(level.vertices[a]);
+	FVector2D pb(level.vertices[b]);
+	FVector2D pc(level.vertices[c]);
+
+	float cross = FVector2D::CrossProduct(pb - pa, pc - pa);
+	if (FMath::IsNearlyZero(cross)) return;
+
+	//Match the winding of the grid triangles, (0,0) (0,1) (1,0)
+	if (cross > 0.f) Swap(b, c);
+
+	outIndices.Add(a);
+	outIndices.Add(b);
+	outIndices.Add(c);
+}
@@ -0,0 +1,93 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GenHeight.h"
+
+//Full, 1/2, 1/4 and 1/8 resolution
+#define GEN_LOD_LEVEL_COUNT 4
+
+enum EGenLODEdge : uint8
+{
+	LOD_EDGE_XNeg = 0,
+	LOD_EDGE_XPos = 1,
+	LOD_EDGE_YNeg = 2,
+	LOD_EDGE_YPos = 3,
+	LOD_EDGE_Count = 4,
+};
+
+struct FGenSectionLODLevel
+{
+	int32 stride = 1;
+
+	//Local sample positions (in height cells), always including both section edges
+	TArray<int32> xSamples;
+	TArray<int32> ySamples;
+
+	TArray<FVector> vertices;
+	TArray<FVector2D> uvs;
+
+	//Max vertical deviation from the full resolution heightfield (world units)
+	float geometricError = 0.f;
+
+	int32 GetXCount() const { return xSamples.Num(); };
+	int32 GetYCount() const { return ySamples.Num(); };
+};
+
+struct FGenSectionLODChain
+{
+	int32 xSection = 0;
+	int32 ySection = 0;
+	FBox bounds = FBox(ForceInit);
+
+	TArray<FGenSectionLODLevel> levels;
+
+	//Stitched index buffers, keyed by GetIndexKey()
+	TMap<uint32, TArray<int32>> indexCache;
+};
+
+/**
+ * Geomipmapped LOD chains for all terrain sections.
+ * Neighbouring sections at different levels are kept crack-free by re-triangulating the edge strip of the finer
+ * section against the vertices of the coarser one.
+ */
+class PROCTERRAINGEN_API FGenTerrainLOD
+{
+public:
+	void Build(UGenHeight* heightGenerator, int32 xSectionCount, int32 ySectionCount, int32 xVertexCount, int32 yVertexCount, float edgeSize);
+	void Reset();
+
+	bool IsBuilt() const { return !Chains.IsEmpty(); };
+	int32 GetSectionCount() const { return Chains.Num(); };
+	int32 GetLevelCount(int32 sectionIndex) const { return Chains[sectionIndex].levels.Num(); };
+	const FGenSectionLODLevel& GetLevel(int32 sectionIndex, int32 level) const { return Chains[sectionIndex].levels[level]; };
+
+	//Picks the coarsest level per section whose error stays below errorTolerance * distance to the viewpoint
+	void SelectLODs(const FVector& viewpoint, float errorTolerance, TArray<int32>& outLevels) const;
+
+	//Index buffer for a section at the given level, stitched against the levels of its neighbours
+	const TArray<int32>& GetStitchedIndices(int32 sectionIndex, const TArray<int32>& sectionLevels);
+	uint32 GetIndexKey(int32 sectionIndex, const TArray<int32>& sectionLevels) const;
+
+	double GetLevelBuildTime(int32 level) const { return LevelBuildTime[level]; };
+	int64 GetLevelMemory(int32 level) const;
+
+private:
+	int32 xSections = 0;
+	int32 ySections = 0;
+
+	TArray<FGenSectionLODChain> Chains;
+
+	double LevelBuildTime[GEN_LOD_LEVEL_COUNT] = {};
+
+	int32 GetSectionIndex(int32 xSection, int32 ySection) const { return ySection * xSections + xSection; };
+	int32 GetNeighbourIndex(int32 sectionIndex, EGenLODEdge edge) const;
+
+	void BuildLevel(const TArray<float>& sectionHeight, int32 gridWidth, int32 gridHeight, int32 stride, const FGenSectionLODChain& chain, int32 xVertexCount, int32 yVertexCount, float edgeSize, FGenSectionLODLevel& outLevel) const;
+	void BuildIndices(const FGenSectionLODLevel& level, const int32 edgeStrides[LOD_EDGE_Count], TArray<int32>& outIndices) const;
+
+	static void BuildSamples(int32 extent, int32 stride, TArray<int32>& outSamples);
+	static float GetLevelHeight(const FGenSectionLODLevel& level, int32 x, int32 y);
+	static void AddTriangle(const FGenSectionLODLevel& level, int32 a, int32 b, int32 c, TArray<int32>& outIndices);
+};
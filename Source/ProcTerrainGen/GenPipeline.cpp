@@ -0,0 +1,172 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GenPipeline.h"
+#include "Async/TaskGraphInterfaces.h"
+
+FGenPipeline::FGenPipeline()
+{
+	Cancellation = MakeShared<FGenCancellation, ESPMode::ThreadSafe>();
+}
+
+int32 FGenPipeline::AddNode(const TCHAR* stage, int32 section, TUniqueFunction<void()> work, TConstArrayView<int32> prerequisites)
+{
+	return Launch(stage, section, MoveTemp(work), prerequisites, UE::Tasks::EExtendedTaskPriority::None);
+}
+
+int32 FGenPipeline::AddGameThreadNode(const TCHAR* stage, int32 section, TUniqueFunction<void()> work, TConstArrayView<int32> prerequisites)
+{
+	return Launch(stage, section, MoveTemp(work), prerequisites, UE::Tasks::EExtendedTaskPriority::GameThreadNormalPri);
+}
+
+int32 FGenPipeline::Launch(const TCHAR* stage, int32 section, TUniqueFunction<void()> work, TConstArrayView<int32> prerequisites, UE::Tasks::EExtendedTaskPriority extendedPriority)
+{
+	TSharedRef<FNode, ESPMode::ThreadSafe> node = MakeShared<FNode, ESPMode::ThreadSafe>();
+	node->stage = stage;
+	node->section = section;
+	node->prerequisites = prerequisites;
+
+	TArray<UE::Tasks::FTask> prerequisiteTasks;
+	for (int32 prerequisite : prerequisites)
+	{
+		check(Nodes.IsValidIndex(prerequisite));
+		prerequisiteTasks.Add(Nodes[prerequisite]->task);
+	}
+
+	node->task = UE::Tasks::Launch(stage, [node, cancellation = Cancellation, work = MoveTemp(work)]()
+	{
+		//Stale results never reach the game thread
+		if (cancellation->IsCancelled()) return;
+
+		node->startTime = FPlatformTime::Seconds();
+		work();
+		node->endTime = FPlatformTime::Seconds();
+	}, prerequisiteTasks, UE::Tasks::ETaskPriority::Normal, extendedPriority);
+
+	return Nodes.Add(node);
+}
+
+void FGenPipeline::WhenDone(TUniqueFunction<void()> work)
+{
+	TArray<UE::Tasks::FTask> tasks;
+	for (const TSharedRef<FNode, ESPMode::ThreadSafe>& node : Nodes) tasks.Add(node->task);
+
+	DoneTask = UE::Tasks::Launch(TEXT("WhenDone"), MoveTemp(work), tasks, UE::Tasks::ETaskPriority::Normal, UE::Tasks::EExtendedTaskPriority::GameThreadNormalPri);
+}
+
+void FGenPipeline::Drain()
+{
+	check(IsInGameThread());
+
+	//Game thread nodes, and workers waiting on game thread tasks, only finish when this thread gets to them
+	while (IsRunning() || (DoneTask.IsValid() && !DoneTask.IsCompleted()))
+	{
+		FTaskGraphInterface::Get().ProcessThreadUntilIdle(ENamedThreads::GameThread);
+		FPlatformProcess::Sleep(0.f);
+	}
+}
+
+bool FGenPipeline::IsRunning() const
+{
+	for (const TSharedRef<FNode, ESPMode::ThreadSafe>& node : Nodes)
+	{
+		if (!node->task.IsCompleted()) return true;
+	}
+
+	return false;
+}
+
+double FGenPipeline::GetEndTime(const FNode& node) const
+{
+	//A node that is still returning (the one that asks) counts until now
+	if (node.endTime > 0.) return node.endTime;
+	return node.startTime > 0. ? FPlatformTime::Seconds() : 0.;
+}
+
+double FGenPipeline::GetStageSeconds(const TCHAR* stage) const
+{
+	double result = 0.;
+
+	for (const TSharedRef<FNode, ESPMode::ThreadSafe>& node : Nodes)
+	{
+		if (FCString::Strcmp(node->stage, stage) == 0 && node->startTime > 0.) result += GetEndTime(*node) - node->startTime;
+	}
+
+	return result;
+}
+
+double FGenPipeline::GetWallSeconds() const
+{
+	double startTime = MAX_dbl;
+	double endTime = 0.;
+
+	for (const TSharedRef<FNode, ESPMode::ThreadSafe>& node : Nodes)
+	{
+		if (node->startTime <= 0.) continue;
+
+		startTime = FMath::Min(startTime, node->startTime);
+		endTime = FMath::Max(endTime, GetEndTime(*node));
+	}
+
+	return endTime > 0. ? endTime - startTime : 0.;
+}
+
+double FGenPipeline::GetStageEndSeconds(const TCHAR* stage) const
+{
+	double startTime = MAX_dbl;
+	double endTime = 0.;
+
+	for (const TSharedRef<FNode, ESPMode::ThreadSafe>& node : Nodes)
+	{
+		if (node->startTime <= 0.) continue;
+
+		startTime = FMath::Min(startTime, node->startTime);
+		if (FCString::Strcmp(node->stage, stage) == 0) endTime = FMath::Max(endTime, GetEndTime(*node));
+	}
+
+	return endTime > 0. ? endTime - startTime : 0.;
+}
+
+double FGenPipeline::GetCriticalPathSeconds(FString* outPath) const
+{
+	//Nodes are in dependency order, so one pass finds the longest chain ending at every node
+	TArray<double> chainSeconds;
+	TArray<int32> chainPrevious;
+	chainSeconds.SetNumZeroed(Nodes.Num());
+	chainPrevious.Init(INDEX_NONE, Nodes.Num());
+
+	int32 last = INDEX_NONE;
+
+	for (int32 n = 0; n < Nodes.Num(); n++)
+	{
+		const FNode& node = *Nodes[n];
+
+		for (int32 prerequisite : node.prerequisites)
+		{
+			if (chainSeconds[prerequisite] > chainSeconds[n])
+			{
+				chainSeconds[n] = chainSeconds[prerequisite];
+				chainPrevious[n] = prerequisite;
+			}
+		}
+
+		if (node.startTime > 0.) chainSeconds[n] += GetEndTime(node) - node.startTime;
+		if (last == INDEX_NONE || chainSeconds[n] > chainSeconds[last]) last = n;
+	}
+
+	if (last == INDEX_NONE) return 0.;
+
+	if (outPath)
+	{
+		TArray<FString> path;
+		for (int32 n = last; n != INDEX_NONE; n = chainPrevious[n])
+		{
+			const FNode& node = *Nodes[n];
+			path.Insert(node.section == INDEX_NONE ? FString(node.stage) : FString::Printf(TEXT("%s %d"), node.stage, node.section), 0);
+		}
+
+		*outPath = FString::Join(path, TEXT(" > "));
+	}
+
+	return chainSeconds[last];
+}
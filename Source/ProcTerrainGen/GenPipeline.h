@@ -0,0 +1,82 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Tasks/Task.h"
+#include <atomic>
+
+//Set when a newer run replaces the one that owns it, long running work checks it and returns early
+class PROCTERRAINGEN_API FGenCancellation
+{
+public:
+	void Cancel() { Cancelled = true; };
+	bool IsCancelled() const { return Cancelled; };
+
+private:
+	std::atomic<bool> Cancelled = false;
+};
+
+using FGenCancellationPtr = TSharedPtr<FGenCancellation, ESPMode::ThreadSafe>;
+
+/**
+ * Generation as a dependency graph on UE::Tasks.
+ * Nodes have to be added in dependency order (prerequisites first), every node records when it ran,
+ * so that stage times and the critical path can be reported once the graph is done.
+ * Nodes of a cancelled graph still complete, but skip their work.
+ */
+class PROCTERRAINGEN_API FGenPipeline
+{
+public:
+	FGenPipeline();
+
+	//Runs on a worker once all prerequisites are done, section is INDEX_NONE for nodes that span the whole terrain
+	int32 AddNode(const TCHAR* stage, int32 section, TUniqueFunction<void()> work, TConstArrayView<int32> prerequisites);
+	//Runs on the game thread, the only nodes that may touch components
+	int32 AddGameThreadNode(const TCHAR* stage, int32 section, TUniqueFunction<void()> work, TConstArrayView<int32> prerequisites);
+
+	bool IsRunning() const;
+
+	//Nodes that did not start yet are skipped, running ones return at their next check of GetCancellation
+	void Cancel() { Cancellation->Cancel(); };
+	bool IsCancelled() const { return Cancellation->IsCancelled(); };
+	const FGenCancellationPtr& GetCancellation() const { return Cancellation; };
+
+	//Runs on the game thread once every node completed
+	void WhenDone(TUniqueFunction<void()> work);
+
+	//Blocks the game thread until every node and the WhenDone work completed, running the game thread tasks they wait for.
+	//For owners that go away, cancel first so that the nodes skip their work
+	void Drain();
+
+	//Summed duration of all nodes of a stage, nodes of a stage overlap, so this is not wall time
+	double GetStageSeconds(const TCHAR* stage) const;
+	//From the first node starting to the last one ending
+	double GetWallSeconds() const;
+	//From the first node starting to the last node of a stage ending
+	double GetStageEndSeconds(const TCHAR* stage) const;
+	//Longest chain of node durations through the graph, the wall time with unlimited workers and no scheduling delay
+	double GetCriticalPathSeconds(FString* outPath = nullptr) const;
+
+private:
+	struct FNode
+	{
+		const TCHAR* stage;
+		int32 section;
+		TArray<int32> prerequisites;
+		UE::Tasks::FTask task;
+
+		//Written by the task, read once it completed
+		double startTime = 0.;
+		double endTime = 0.;
+	};
+
+	FGenCancellationPtr Cancellation;
+
+	//Shared with the task bodies, so that the graph can be replaced while its last node is still returning
+	TArray<TSharedRef<FNode, ESPMode::ThreadSafe>> Nodes;
+	UE::Tasks::FTask DoneTask;
+
+	int32 Launch(const TCHAR* stage, int32 section, TUniqueFunction<void()> work, TConstArrayView<int32> prerequisites, UE::Tasks::EExtendedTaskPriority extendedPriority);
+	double GetEndTime(const FNode& node) const;
+};
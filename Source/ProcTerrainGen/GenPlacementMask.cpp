@@ -0,0 +1,66 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GenPlacementMask.h"
+
+void FGenPlacementMask::Initialize(int32 xSectionCount, int32 ySectionCount, int32 sectionWidth, int32 sectionHeight)
+{
+	xSections = xSectionCount;
+	ySections = ySectionCount;
+	SectionWidth = sectionWidth;
+	SectionHeight = sectionHeight;
+	RowBytes = FMath::DivideAndRoundUp(sectionWidth, 8);
+	XBlocks = FMath::DivideAndRoundUp(sectionWidth, GEN_PLACEMENT_BLOCK_SIZE);
+	YBlocks = FMath::DivideAndRoundUp(sectionHeight, GEN_PLACEMENT_BLOCK_SIZE);
+
+	SectionBits.Reset();
+	SectionBits.SetNum(xSections * ySections);
+
+	for (TArray<uint8>& bits : SectionBits) bits.SetNumZeroed(RowBytes * SectionHeight);
+
+	BlockOccupied.Init(0, xSections * ySections * XBlocks * YBlocks);
+}
+
+void FGenPlacementMask::Reset()
+{
+	SectionBits.Empty();
+	BlockOccupied.Empty();
+}
+
+void FGenPlacementMask::UpdateSection(UGenHeight* heightGenerator, int32 xSection, int32 ySection, float minHeight, float maxHeight, float maxSlopeDeg)
+{
+	int32 sectionIndex = ySection * xSections + xSection;
+	TArray<uint8>& bits = SectionBits[sectionIndex];
+
+	heightGenerator->ComputePlacementMask(xSection, ySection, minHeight, maxHeight, maxSlopeDeg, bits);
+
+	//A block spans GEN_PLACEMENT_BLOCK_SIZE / 8 bytes of GEN_PLACEMENT_BLOCK_SIZE rows
+	constexpr int32 blockBytes = GEN_PLACEMENT_BLOCK_SIZE / 8;
+
+	for (int32 yBlock = 0; yBlock < YBlocks; yBlock++)
+	{
+		for (int32 xBlock = 0; xBlock < XBlocks; xBlock++)
+		{
+			uint8 occupied = 0;
+
+			int32 yEnd = FMath::Min((yBlock + 1) * GEN_PLACEMENT_BLOCK_SIZE, SectionHeight);
+			int32 xEnd = FMath::Min((xBlock + 1) * blockBytes, RowBytes);
+
+			for (int32 y = yBlock * GEN_PLACEMENT_BLOCK_SIZE; y < yEnd && !occupied; y++)
+			{
+				for (int32 x = xBlock * blockBytes; x < xEnd; x++) occupied |= bits[y * RowBytes + x];
+			}
+
+			BlockOccupied[sectionIndex * GetBlocksPerSection() + yBlock * XBlocks + xBlock] = occupied ? 1 : 0;
+		}
+	}
+}
+
+SIZE_T FGenPlacementMask::GetAllocatedSize() const
+{
+	SIZE_T result = SectionBits.GetAllocatedSize() + BlockOccupied.GetAllocatedSize();
+
+	for (const TArray<uint8>& bits : SectionBits) result += bits.GetAllocatedSize();
+
+	return result;
+}
@@ -0,0 +1,57 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GenHeight.h"
+
+//Samples per side of the blocks used to skip empty areas
+#define GEN_PLACEMENT_BLOCK_SIZE 16
+
+/**
+ * Bit per heightfield sample telling whether foliage may be placed there, kept per terrain section.
+ * Every section also keeps one flag per block of GEN_PLACEMENT_BLOCK_SIZE^2 samples, so that candidates in blocks
+ * without a single set bit can be skipped as a whole.
+ */
+class PROCTERRAINGEN_API FGenPlacementMask
+{
+public:
+	void Initialize(int32 xSectionCount, int32 ySectionCount, int32 sectionWidth, int32 sectionHeight);
+	void Reset();
+
+	bool IsValid() const { return !SectionBits.IsEmpty(); };
+
+	//Sections can be updated in parallel
+	void UpdateSection(UGenHeight* heightGenerator, int32 xSection, int32 ySection, float minHeight, float maxHeight, float maxSlopeDeg);
+
+	//Global sample coordinates
+	bool Test(int32 x, int32 y) const
+	{
+		int32 xSection = x / SectionWidth;
+		int32 ySection = y / SectionHeight;
+		int32 localX = x - xSection * SectionWidth;
+		int32 localY = y - ySection * SectionHeight;
+
+		return SectionBits[ySection * xSections + xSection][localY * RowBytes + (localX >> 3)] & (1 << (localX & 7));
+	};
+
+	int32 GetBlocksPerSection() const { return XBlocks * YBlocks; };
+	int32 GetBlockIndex(int32 localX, int32 localY) const { return (localY / GEN_PLACEMENT_BLOCK_SIZE) * XBlocks + localX / GEN_PLACEMENT_BLOCK_SIZE; };
+	bool IsBlockOccupied(int32 sectionIndex, int32 blockIndex) const { return BlockOccupied[sectionIndex * GetBlocksPerSection() + blockIndex] != 0; };
+
+	SIZE_T GetAllocatedSize() const;
+
+private:
+	int32 xSections = 0;
+	int32 ySections = 0;
+	int32 SectionWidth = 0;
+	int32 SectionHeight = 0;
+	int32 RowBytes = 0;
+	int32 XBlocks = 0;
+	int32 YBlocks = 0;
+
+	TArray<TArray<uint8>> SectionBits;
+
+	//Byte per block, sections are written from different threads
+	TArray<uint8> BlockOccupied;
+};
@@ -0,0 +1,144 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GenQuantizedHeight.h"
+#include "Async/ParallelFor.h"
+
+void FGenQuantizedHeightfield::Compress(const TArray<float>& heightData, int32 width, int32 height, int32 tileWidth, int32 tileHeight)
+{
+	check(width % tileWidth == 0 && height % tileHeight == 0);
+	check(heightData.Num() == width * height);
+
+	Width = width;
+	Height = height;
+	TileWidth = tileWidth;
+	TileHeight = tileHeight;
+	XTiles = width / tileWidth;
+	YTiles = height / tileHeight;
+
+	Data.SetNumUninitialized(width * height);
+	Tiles.SetNum(XTiles * YTiles);
+
+	TArray<float> tileMaxError;
+	TArray<double> tileSquaredError;
+	tileMaxError.SetNumZeroed(Tiles.Num());
+	tileSquaredError.SetNumZeroed(Tiles.Num());
+
+	ParallelFor(Tiles.Num(), [&](int32 tileIndex)
+	{
+		int32 xStart = (tileIndex % XTiles) * TileWidth;
+		int32 yStart = (tileIndex / XTiles) * TileHeight;
+
+		float minHeight = MAX_flt;
+		float maxHeight = -MAX_flt;
+
+		for (int32 y = 0; y < TileHeight; y++)
+		{
+			for (int32 x = 0; x < TileWidth; x++)
+			{
+				float value = heightData[(yStart + y) * Width + xStart + x];
+				minHeight = FMath::Min(minHeight, value);
+				maxHeight = FMath::Max(maxHeight, value);
+			}
+		}
+
+		FQuantizedHeightTile& tile = Tiles[tileIndex];
+		tile.offset = minHeight;
+		tile.scale = (maxHeight - minHeight) / float(MAX_uint16);
+
+		float inverseScale = tile.scale > 0.f ? 1.f / tile.scale : 0.f;
+		uint16* tileData = Data.GetData() + tileIndex * TileWidth * TileHeight;
+
+		for (int32 y = 0; y < TileHeight; y++)
+		{
+			for (int32 x = 0; x < TileWidth; x++)
+			{
+				float value = heightData[(yStart + y) * Width + xStart + x];
+
+				uint16 quantized = uint16(FMath::Clamp(FMath::RoundToInt32((value - tile.offset) * inverseScale), 0, int32(MAX_uint16)));
+				tileData[y * TileWidth + x] = quantized;
+
+				float error = FMath::Abs(tile.offset + tile.scale * float(quantized) - value);
+				tileMaxError[tileIndex] = FMath::Max(tileMaxError[tileIndex], error);
+				tileSquaredError[tileIndex] += error * error;
+			}
+		}
+	});
+
+	MaxError = 0.f;
+	double squaredError = 0.;
+
+	for (int32 i = 0; i < Tiles.Num(); i++)
+	{
+		MaxError = FMath::Max(MaxError, tileMaxError[i]);
+		squaredError += tileSquaredError[i];
+	}
+
+	RmsError = float(FMath::Sqrt(squaredError / double(FMath::Max(Data.Num(), 1))));
+}
+
+void FGenQuantizedHeightfield::Decompress(TArray<float>& outHeightData) const
+{
+	outHeightData.SetNumUninitialized(Width * Height);
+
+	ParallelFor(Tiles.Num(), [&](int32 tileIndex)
+	{
+		int32 xStart = (tileIndex % XTiles) * TileWidth;
+		int32 yStart = (tileIndex / XTiles) * TileHeight;
+
+		const FQuantizedHeightTile& tile = Tiles[tileIndex];
+		const uint16* tileData = Data.GetData() + tileIndex * TileWidth * TileHeight;
+
+		for (int32 y = 0; y < TileHeight; y++)
+		{
+			float* row = outHeightData.GetData() + (yStart + y) * Width + xStart;
+
+			for (int32 x = 0; x < TileWidth; x++)
+			{
+				row[x] = tile.offset + tile.scale * float(tileData[y * TileWidth + x]);
+			}
+		}
+	});
+}
+
+void FGenQuantizedHeightfield::Reset()
+{
+	Data.Empty();
+	Tiles.Empty();
+
+	MaxError = 0.f;
+	RmsError = 0.f;
+}
+
+void FGenQuantizedHeightfield::DecompressRegion(int32 x0, int32 y0, int32 windowWidth, int32 windowHeight, TArray<float>& outWindow) const
+{
+	int32 x1 = FMath::Min(x0 + windowWidth, Width);
+	int32 y1 = FMath::Min(y0 + windowHeight, Height);
+	x0 = FMath::Max(x0, 0);
+	y0 = FMath::Max(y0, 0);
+
+	outWindow.Reset((x1 - x0) * (y1 - y0));
+
+	for (int32 y = y0; y < y1; y++)
+	{
+		for (int32 x = x0; x < x1; x++)
+		{
+			outWindow.Add(Get(x, y));
+		}
+	}
+}
+
+void FGenQuantizedHeightfield::DecompressTile(int32 tileX, int32 tileY, TArray<float>& outWindow) const
+{
+	int32 tileIndex = tileY * XTiles + tileX;
+
+	const FQuantizedHeightTile& tile = Tiles[tileIndex];
+	const uint16* tileData = Data.GetData() + tileIndex * TileWidth * TileHeight;
+
+	outWindow.SetNumUninitialized(TileWidth * TileHeight);
+
+	for (int32 i = 0; i < TileWidth * TileHeight; i++)
+	{
+		outWindow[i] = tile.offset + tile.scale * float(tileData[i]);
+	}
+}
@@ -0,0 +1,58 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FQuantizedHeightTile
+{
+	float offset = 0.f;
+	float scale = 0.f;
+};
+
+/**
+ * Heightfield stored as 16 bit values with a scale and offset per tile.
+ * Values are kept tile by tile so that a tile sized float window can be decompressed with linear reads.
+ */
+class PROCTERRAINGEN_API FGenQuantizedHeightfield
+{
+public:
+	//width and height must be multiples of the tile size
+	void Compress(const TArray<float>& heightData, int32 width, int32 height, int32 tileWidth, int32 tileHeight);
+	void Decompress(TArray<float>& outHeightData) const;
+	void Reset();
+
+	bool IsValid() const { return !Data.IsEmpty(); };
+
+	float Get(int32 x, int32 y) const
+	{
+		int32 tileIndex = (y / TileHeight) * XTiles + x / TileWidth;
+		const FQuantizedHeightTile& tile = Tiles[tileIndex];
+
+		return tile.offset + tile.scale * float(Data[tileIndex * TileWidth * TileHeight + (y % TileHeight) * TileWidth + x % TileWidth]);
+	};
+
+	float Get(int32 globalIndex) const { return Get(globalIndex % Width, globalIndex / Width); };
+
+	//Row major float window, x0/y0/windowWidth/windowHeight are clamped to the heightfield
+	void DecompressRegion(int32 x0, int32 y0, int32 windowWidth, int32 windowHeight, TArray<float>& outWindow) const;
+	void DecompressTile(int32 tileX, int32 tileY, TArray<float>& outWindow) const;
+
+	float GetMaxError() const { return MaxError; };
+	float GetRmsError() const { return RmsError; };
+	SIZE_T GetAllocatedSize() const { return Data.GetAllocatedSize() + Tiles.GetAllocatedSize(); };
+
+private:
+	int32 Width = 0;
+	int32 Height = 0;
+	int32 TileWidth = 0;
+	int32 TileHeight = 0;
+	int32 XTiles = 0;
+	int32 YTiles = 0;
+
+	TArray<uint16> Data;
+	TArray<FQuantizedHeightTile> Tiles;
+
+	float MaxError = 0.f;
+	float RmsError = 0.f;
+};
@@ -0,0 +1,66 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GenScratch.h"
+
+void FGenScratchArena::SetResolution(int32 cellCount)
+{
+	if (cellCount == CellCount) return;
+
+	Empty();
+	CellCount = cellCount;
+}
+
+void FGenScratchArena::Empty()
+{
+	Buffers.Empty();
+	CellCount = 0;
+}
+
+SIZE_T FGenScratchArena::GetAllocatedSize() const
+{
+	SIZE_T result = Buffers.GetAllocatedSize();
+	for (const TPair<FName, TUniquePtr<FBuffer>>& buffer : Buffers) result += buffer.Value->GetAllocatedSize();
+
+	return result;
+}
+
+FGenScratchArena::FStageScope::FStageScope(FGenScratchArena& arena, const TCHAR* stage) : Arena(arena)
+{
+	PreviousStage = Arena.CurrentStage;
+	Arena.CurrentStage = stage;
+}
+
+FGenScratchArena::FStageScope::~FStageScope()
+{
+	FGenScratchStageStats& stats = Arena.GetCurrentStageStats();
+	stats.peakBytes = FMath::Max(stats.peakBytes, int64(Arena.GetAllocatedSize()));
+
+	Arena.CurrentStage = PreviousStage;
+}
+
+void FGenScratchArena::RecordRequest(bool allocates, int64 bytes)
+{
+	FGenScratchStageStats& stats = GetCurrentStageStats();
+	stats.requests++;
+
+	if (!allocates) return;
+
+	stats.allocations++;
+	stats.allocatedBytes += bytes;
+}
+
+FGenScratchStageStats& FGenScratchArena::GetCurrentStageStats()
+{
+	const TCHAR* stage = CurrentStage ? CurrentStage : TEXT("Other");
+
+	//A handful of stages, a linear search is fine
+	for (FGenScratchStageStats& stats : StageStats)
+	{
+		if (stats.stage == stage) return stats;
+	}
+
+	FGenScratchStageStats& stats = StageStats.AddDefaulted_GetRef();
+	stats.stage = stage;
+	return stats;
+}
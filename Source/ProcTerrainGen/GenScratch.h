@@ -0,0 +1,129 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GenScratch.generated.h"
+
+USTRUCT(BlueprintType)
+struct FGenScratchStageStats
+{
+	GENERATED_USTRUCT_BODY()
+
+	UPROPERTY(BlueprintReadWrite)
+	FString stage;
+
+	//Buffer requests, most of them should be served without allocating
+	UPROPERTY(BlueprintReadWrite)
+	int32 requests = 0;
+
+	//Requests that had to grow a buffer
+	UPROPERTY(BlueprintReadWrite)
+	int32 allocations = 0;
+
+	UPROPERTY(BlueprintReadWrite)
+	int64 allocatedBytes = 0;
+
+	//Most memory the arena held at the end of the stage
+	UPROPERTY(BlueprintReadWrite)
+	int64 peakBytes = 0;
+};
+
+/**
+ * Named working buffers of a height generator, kept between stages and runs so that they are only allocated when the
+ * resolution grows. A name always refers to the same element type. Buffers can be swapped with arrays of the same type,
+ * for ping-pong passes that end with the result in the caller's array and the old contents in the arena.
+ * Not thread safe, stages take their buffers before going parallel.
+ */
+class PROCTERRAINGEN_API FGenScratchArena
+{
+public:
+	//Uninitialized contents
+	template<typename T>
+	TArray<T>& Get(FName name, int32 count)
+	{
+		TArray<T>& data = Find<T>(name);
+		RecordRequest(data.Max() < count, int64(count) * sizeof(T));
+
+		data.SetNumUninitialized(count, EAllowShrinking::No);
+		return data;
+	};
+
+	template<typename T>
+	TArray<T>& GetZeroed(FName name, int32 count)
+	{
+		TArray<T>& data = Get<T>(name, count);
+		FMemory::Memzero(data.GetData(), count * sizeof(T));
+		return data;
+	};
+
+	//Empty with room for capacity elements, for buffers that are filled with Add
+	template<typename T>
+	TArray<T>& GetEmpty(FName name, int32 capacity)
+	{
+		TArray<T>& data = Find<T>(name);
+		RecordRequest(data.Max() < capacity, int64(capacity) * sizeof(T));
+
+		data.Reset(capacity);
+		return data;
+	};
+
+	//Frees every buffer when the number of cells changes
+	void SetResolution(int32 cellCount);
+	void Empty();
+
+	SIZE_T GetAllocatedSize() const;
+
+	//Requests and allocations between construction and destruction are counted towards the stage
+	class FStageScope
+	{
+	public:
+		FStageScope(FGenScratchArena& arena, const TCHAR* stage);
+		~FStageScope();
+
+	private:
+		FGenScratchArena& Arena;
+		const TCHAR* PreviousStage;
+	};
+
+	const TArray<FGenScratchStageStats>& GetStageStats() const { return StageStats; };
+	void ResetStageStats() { StageStats.Reset(); };
+
+private:
+	struct FBuffer
+	{
+		virtual ~FBuffer() {};
+		virtual SIZE_T GetAllocatedSize() const = 0;
+		SIZE_T elementSize = 0;
+	};
+
+	template<typename T>
+	struct TBuffer : public FBuffer
+	{
+		virtual SIZE_T GetAllocatedSize() const override { return data.GetAllocatedSize(); };
+		TArray<T> data;
+	};
+
+	TMap<FName, TUniquePtr<FBuffer>> Buffers;
+	int32 CellCount = 0;
+
+	const TCHAR* CurrentStage = nullptr;
+	TArray<FGenScratchStageStats> StageStats;
+
+	template<typename T>
+	TArray<T>& Find(FName name)
+	{
+		TUniquePtr<FBuffer>& buffer = Buffers.FindOrAdd(name);
+		if (!buffer.IsValid())
+		{
+			buffer = MakeUnique<TBuffer<T>>();
+			buffer->elementSize = sizeof(T);
+		}
+
+		check(buffer->elementSize == sizeof(T));
+		return static_cast<TBuffer<T>*>(buffer.Get())->data;
+	};
+
+	void RecordRequest(bool allocates, int64 bytes);
+	FGenScratchStageStats& GetCurrentStageStats();
+};
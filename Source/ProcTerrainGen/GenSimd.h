@@ -0,0 +1,724 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Portable vector types for the _Intrin kernels.
+ * TGenFloatVec<N>, TGenIntVec<N> and TGenMaskVec<N> hold N 32 bit lanes. Widths with a native register use it (SSE4 for 4,
+ * AVX2 for 8, AVX-512 for 16), every other width is split into two halves down to plain scalars, so an 8 wide kernel
+ * runs as two SSE registers on a build without AVX2 and as 8 floats on a build without SSE.
+ * Lanes are never accessed through the MSVC register unions, only with Store/GetLane.
+ *
+ * The 4 lane types only use SSE4 instructions. 8 and 16 lane kernels may only run after FGenBackends checked the CPU.
+ */
+
+//Backends compiled into this build, from the compiler flags
+#if !defined(GEN_SIMD_FORCE_SCALAR) && (defined(_M_X64) || defined(__x86_64__))
+	//MSVC accepts AVX2 and AVX-512 intrinsics without /arch, the runtime dispatch decides whether they are used
+	#if defined(_MSC_VER) && !defined(__clang__)
+		#define GEN_SIMD_MSVC_INTRINSICS 1
+	#else
+		#define GEN_SIMD_MSVC_INTRINSICS 0
+	#endif
+
+	#if defined(__AVX512F__) || (GEN_SIMD_MSVC_INTRINSICS && !defined(GEN_SIMD_NO_MSVC_AVX512))
+		#define GEN_SIMD_AVX512 1
+	#endif
+
+	#if defined(__AVX2__) || GEN_SIMD_MSVC_INTRINSICS
+		#define GEN_SIMD_AVX2 1
+	#endif
+
+	#if defined(__SSE4_1__) || defined(__AVX__) || GEN_SIMD_MSVC_INTRINSICS || (defined(PLATFORM_ALWAYS_HAS_SSE4_1) && PLATFORM_ALWAYS_HAS_SSE4_1)
+		#define GEN_SIMD_SSE4 1
+	#endif
+#endif
+
+#ifndef GEN_SIMD_AVX512
+	#define GEN_SIMD_AVX512 0
+#endif
+#ifndef GEN_SIMD_AVX2
+	#define GEN_SIMD_AVX2 0
+#endif
+#ifndef GEN_SIMD_SSE4
+	#define GEN_SIMD_SSE4 0
+#endif
+
+#if GEN_SIMD_SSE4
+	#include <immintrin.h>
+#endif
+
+template<int32 N> struct TGenMaskVec;
+template<int32 N> struct TGenIntVec;
+template<int32 N> struct TGenFloatVec;
+
+using FGenMask4 = TGenMaskVec<4>;
+using FGenInt4 = TGenIntVec<4>;
+using FGenFloat4 = TGenFloatVec<4>;
+using FGenMask8 = TGenMaskVec<8>;
+using FGenInt8 = TGenIntVec<8>;
+using FGenFloat8 = TGenFloatVec<8>;
+
+/*
+ * Generic widths, made of two halves
+ */
+
+template<int32 N>
+struct TGenMaskVec
+{
+	static_assert(N > 1 && (N & (N - 1)) == 0, "Lane count must be a power of two");
+	using FHalf = TGenMaskVec<N / 2>;
+
+	FHalf Lo;
+	FHalf Hi;
+
+	//First count lanes set
+	static FORCEINLINE TGenMaskVec FirstN(int32 count) { return { FHalf::FirstN(count), FHalf::FirstN(count - N / 2) }; }
+
+	//Bit per lane, lane 0 in the lowest bit
+	FORCEINLINE uint32 GetBits() const { return Lo.GetBits() | (Hi.GetBits() << (N / 2)); }
+	FORCEINLINE bool Any() const { return Lo.Any() || Hi.Any(); }
+
+	friend FORCEINLINE TGenMaskVec operator&(const TGenMaskVec& a, const TGenMaskVec& b) { return { a.Lo & b.Lo, a.Hi & b.Hi }; }
+	friend FORCEINLINE TGenMaskVec operator|(const TGenMaskVec& a, const TGenMaskVec& b) { return { a.Lo | b.Lo, a.Hi | b.Hi }; }
+	static FORCEINLINE TGenMaskVec AndNot(const TGenMaskVec& a, const TGenMaskVec& b) { return { FHalf::AndNot(a.Lo, b.Lo), FHalf::AndNot(a.Hi, b.Hi) }; }
+};
+
+template<int32 N>
+struct TGenIntVec
+{
+	static_assert(N > 1 && (N & (N - 1)) == 0, "Lane count must be a power of two");
+	using FHalf = TGenIntVec<N / 2>;
+	using FMask = TGenMaskVec<N>;
+	using FElement = int32;
+	static constexpr int32 Lanes = N;
+
+	FHalf Lo;
+	FHalf Hi;
+
+	static FORCEINLINE TGenIntVec Splat(int32 value) { return { FHalf::Splat(value), FHalf::Splat(value) }; }
+	static FORCEINLINE TGenIntVec Load(const int32* source) { return { FHalf::Load(source), FHalf::Load(source + N / 2) }; }
+	FORCEINLINE void Store(int32* target) const { Lo.Store(target); Hi.Store(target + N / 2); }
+	FORCEINLINE int32 GetLane(int32 lane) const { return lane < N / 2 ? Lo.GetLane(lane) : Hi.GetLane(lane - N / 2); }
+
+	//Clamps every lane to [0, 65535]
+	FORCEINLINE void StoreSaturatedUint16(uint16* target) const { Lo.StoreSaturatedUint16(target); Hi.StoreSaturatedUint16(target + N / 2); }
+
+	static FORCEINLINE TGenIntVec Min(const TGenIntVec& a, const TGenIntVec& b) { return { FHalf::Min(a.Lo, b.Lo), FHalf::Min(a.Hi, b.Hi) }; }
+	static FORCEINLINE TGenIntVec Max(const TGenIntVec& a, const TGenIntVec& b) { return { FHalf::Max(a.Lo, b.Lo), FHalf::Max(a.Hi, b.Hi) }; }
+	static FORCEINLINE TGenIntVec Select(const FMask& mask, const TGenIntVec& a, const TGenIntVec& b) { return { FHalf::Select(mask.Lo, a.Lo, b.Lo), FHalf::Select(mask.Hi, a.Hi, b.Hi) }; }
+	FORCEINLINE TGenIntVec ShiftLeft(int32 count) const { return { Lo.ShiftLeft(count), Hi.ShiftLeft(count) }; }
+	FORCEINLINE TGenIntVec ShiftRightLogical(int32 count) const { return { Lo.ShiftRightLogical(count), Hi.ShiftRightLogical(count) }; }
+
+	friend FORCEINLINE TGenIntVec operator+(const TGenIntVec& a, const TGenIntVec& b) { return { a.Lo + b.Lo, a.Hi + b.Hi }; }
+	friend FORCEINLINE TGenIntVec operator-(const TGenIntVec& a, const TGenIntVec& b) { return { a.Lo - b.Lo, a.Hi - b.Hi }; }
+	friend FORCEINLINE TGenIntVec operator*(const TGenIntVec& a, const TGenIntVec& b) { return { a.Lo * b.Lo, a.Hi * b.Hi }; }
+	friend FORCEINLINE TGenIntVec operator&(const TGenIntVec& a, const TGenIntVec& b) { return { a.Lo & b.Lo, a.Hi & b.Hi }; }
+	friend FORCEINLINE TGenIntVec operator|(const TGenIntVec& a, const TGenIntVec& b) { return { a.Lo | b.Lo, a.Hi | b.Hi }; }
+	friend FORCEINLINE FMask operator>(const TGenIntVec& a, const TGenIntVec& b) { return { a.Lo > b.Lo, a.Hi > b.Hi }; }
+	friend FORCEINLINE FMask operator<(const TGenIntVec& a, const TGenIntVec& b) { return { a.Lo < b.Lo, a.Hi < b.Hi }; }
+};
+
+template<int32 N>
+struct TGenFloatVec
+{
+	static_assert(N > 1 && (N & (N - 1)) == 0, "Lane count must be a power of two");
+	using FHalf = TGenFloatVec<N / 2>;
+	using FInt = TGenIntVec<N>;
+	using FMask = TGenMaskVec<N>;
+	using FElement = float;
+	static constexpr int32 Lanes = N;
+
+	FHalf Lo;
+	FHalf Hi;
+
+	static FORCEINLINE TGenFloatVec Splat(float value) { return { FHalf::Splat(value), FHalf::Splat(value) }; }
+	static FORCEINLINE TGenFloatVec Zero() { return { FHalf::Zero(), FHalf::Zero() }; }
+	static FORCEINLINE TGenFloatVec Load(const float* source) { return { FHalf::Load(source), FHalf::Load(source + N / 2) }; }
+
+	//Lanes outside the mask are zero and their memory is not touched
+	static FORCEINLINE TGenFloatVec LoadMasked(const float* source, const FMask& mask) { return { FHalf::LoadMasked(source, mask.Lo), FHalf::LoadMasked(source + N / 2, mask.Hi) }; }
+	static FORCEINLINE TGenFloatVec Gather(const float* base, const FInt& indices) { return { FHalf::Gather(base, indices.Lo), FHalf::Gather(base, indices.Hi) }; }
+	static FORCEINLINE TGenFloatVec FromInt(const FInt& value) { return { FHalf::FromInt(value.Lo), FHalf::FromInt(value.Hi) }; }
+	static FORCEINLINE TGenFloatVec FromBits(const FInt& bits) { return { FHalf::FromBits(bits.Lo), FHalf::FromBits(bits.Hi) }; }
+
+	FORCEINLINE void Store(float* target) const { Lo.Store(target); Hi.Store(target + N / 2); }
+	FORCEINLINE void StoreMasked(float* target, const FMask& mask) const { Lo.StoreMasked(target, mask.Lo); Hi.StoreMasked(target + N / 2, mask.Hi); }
+	FORCEINLINE float GetLane(int32 lane) const { return lane < N / 2 ? Lo.GetLane(lane) : Hi.GetLane(lane - N / 2); }
+
+	//Truncating
+	FORCEINLINE FInt ToInt() const { return { Lo.ToInt(), Hi.ToInt() }; }
+	//Round half to even
+	FORCEINLINE FInt ToIntRound() const { return { Lo.ToIntRound(), Hi.ToIntRound() }; }
+	FORCEINLINE FInt ToBits() const { return { Lo.ToBits(), Hi.ToBits() }; }
+
+	FORCEINLINE float ReduceAdd() const { return (Lo + Hi).ReduceAdd(); }
+	FORCEINLINE float ReduceMin() const { return FHalf::Min(Lo, Hi).ReduceMin(); }
+	FORCEINLINE float ReduceMax() const { return FHalf::Max(Lo, Hi).ReduceMax(); }
+
+	static FORCEINLINE TGenFloatVec Min(const TGenFloatVec& a, const TGenFloatVec& b) { return { FHalf::Min(a.Lo, b.Lo), FHalf::Min(a.Hi, b.Hi) }; }
+	static FORCEINLINE TGenFloatVec Max(const TGenFloatVec& a, const TGenFloatVec& b) { return { FHalf::Max(a.Lo, b.Lo), FHalf::Max(a.Hi, b.Hi) }; }
+	static FORCEINLINE TGenFloatVec Sqrt(const TGenFloatVec& x) { return { FHalf::Sqrt(x.Lo), FHalf::Sqrt(x.Hi) }; }
+	static FORCEINLINE TGenFloatVec Floor(const TGenFloatVec& x) { return { FHalf::Floor(x.Lo), FHalf::Floor(x.Hi) }; }
+	static FORCEINLINE TGenFloatVec Select(const FMask& mask, const TGenFloatVec& a, const TGenFloatVec& b) { return { FHalf::Select(mask.Lo, a.Lo, b.Lo), FHalf::Select(mask.Hi, a.Hi, b.Hi) }; }
+
+	friend FORCEINLINE TGenFloatVec operator+(const TGenFloatVec& a, const TGenFloatVec& b) { return { a.Lo + b.Lo, a.Hi + b.Hi }; }
+	friend FORCEINLINE TGenFloatVec operator-(const TGenFloatVec& a, const TGenFloatVec& b) { return { a.Lo - b.Lo, a.Hi - b.Hi }; }
+	friend FORCEINLINE TGenFloatVec operator*(const TGenFloatVec& a, const TGenFloatVec& b) { return { a.Lo * b.Lo, a.Hi * b.Hi }; }
+	friend FORCEINLINE TGenFloatVec operator/(const TGenFloatVec& a, const TGenFloatVec& b) { return { a.Lo / b.Lo, a.Hi / b.Hi }; }
+	friend FORCEINLINE FMask operator<(const TGenFloatVec& a, const TGenFloatVec& b) { return { a.Lo < b.Lo, a.Hi < b.Hi }; }
+	friend FORCEINLINE FMask operator<=(const TGenFloatVec& a, const TGenFloatVec& b) { return { a.Lo <= b.Lo, a.Hi <= b.Hi }; }
+	friend FORCEINLINE FMask operator>(const TGenFloatVec& a, const TGenFloatVec& b) { return { a.Lo > b.Lo, a.Hi > b.Hi }; }
+	friend FORCEINLINE FMask operator>=(const TGenFloatVec& a, const TGenFloatVec& b) { return { a.Lo >= b.Lo, a.Hi >= b.Hi }; }
+};
+
+/*
+ * Scalar lane, the end of every split
+ */
+
+template<>
+struct TGenMaskVec<1>
+{
+	bool V;
+
+	static FORCEINLINE TGenMaskVec FirstN(int32 count) { return { count > 0 }; }
+	FORCEINLINE uint32 GetBits() const { return V ? 1 : 0; }
+	FORCEINLINE bool Any() const { return V; }
+
+	friend FORCEINLINE TGenMaskVec operator&(const TGenMaskVec& a, const TGenMaskVec& b) { return { a.V && b.V }; }
+	friend FORCEINLINE TGenMaskVec operator|(const TGenMaskVec& a, const TGenMaskVec& b) { return { a.V || b.V }; }
+	static FORCEINLINE TGenMaskVec AndNot(const TGenMaskVec& a, const TGenMaskVec& b) { return { a.V && !b.V }; }
+};
+
+template<>
+struct TGenIntVec<1>
+{
+	using FMask = TGenMaskVec<1>;
+	using FElement = int32;
+	static constexpr int32 Lanes = 1;
+
+	int32 V;
+
+	static FORCEINLINE TGenIntVec Splat(int32 value) { return { value }; }
+	static FORCEINLINE TGenIntVec Load(const int32* source) { return { *source }; }
+	FORCEINLINE void Store(int32* target) const { *target = V; }
+	FORCEINLINE int32 GetLane(int32 lane) const { return V; }
+	FORCEINLINE void StoreSaturatedUint16(uint16* target) const { *target = uint16(FMath::Clamp(V, 0, 65535)); }
+
+	static FORCEINLINE TGenIntVec Min(const TGenIntVec& a, const TGenIntVec& b) { return { FMath::Min(a.V, b.V) }; }
+	static FORCEINLINE TGenIntVec Max(const TGenIntVec& a, const TGenIntVec& b) { return { FMath::Max(a.V, b.V) }; }
+	static FORCEINLINE TGenIntVec Select(const FMask& mask, const TGenIntVec& a, const TGenIntVec& b) { return { mask.V ? a.V : b.V }; }
+	FORCEINLINE TGenIntVec ShiftLeft(int32 count) const { return { int32(uint32(V) << count) }; }
+	FORCEINLINE TGenIntVec ShiftRightLogical(int32 count) const { return { int32(uint32(V) >> count) }; }
+
+	//Wrapping like the vector instructions
+	friend FORCEINLINE TGenIntVec operator+(const TGenIntVec& a, const TGenIntVec& b) { return { int32(uint32(a.V) + uint32(b.V)) }; }
+	friend FORCEINLINE TGenIntVec operator-(const TGenIntVec& a, const TGenIntVec& b) { return { int32(uint32(a.V) - uint32(b.V)) }; }
+	friend FORCEINLINE TGenIntVec operator*(const TGenIntVec& a, const TGenIntVec& b) { return { int32(uint32(a.V) * uint32(b.V)) }; }
+	friend FORCEINLINE TGenIntVec operator&(const TGenIntVec& a, const TGenIntVec& b) { return { a.V & b.V }; }
+	friend FORCEINLINE TGenIntVec operator|(const TGenIntVec& a, const TGenIntVec& b) { return { a.V | b.V }; }
+	friend FORCEINLINE FMask operator>(const TGenIntVec& a, const TGenIntVec& b) { return { a.V > b.V }; }
+	friend FORCEINLINE FMask operator<(const TGenIntVec& a, const TGenIntVec& b) { return { a.V < b.V }; }
+};
+
+template<>
+struct TGenFloatVec<1>
+{
+	using FInt = TGenIntVec<1>;
+	using FMask = TGenMaskVec<1>;
+	using FElement = float;
+	static constexpr int32 Lanes = 1;
+
+	float V;
+
+	static FORCEINLINE TGenFloatVec Splat(float value) { return { value }; }
+	static FORCEINLINE TGenFloatVec Zero() { return { 0.f }; }
+	static FORCEINLINE TGenFloatVec Load(const float* source) { return { *source }; }
+	static FORCEINLINE TGenFloatVec LoadMasked(const float* source, const FMask& mask) { return { mask.V ? *source : 0.f }; }
+	static FORCEINLINE TGenFloatVec Gather(const float* base, const FInt& indices) { return { base[indices.V] }; }
+	static FORCEINLINE TGenFloatVec FromInt(const FInt& value) { return { float(value.V) }; }
+
+	static FORCEINLINE TGenFloatVec FromBits(const FInt& bits)
+	{
+		TGenFloatVec result;
+		FMemory::Memcpy(&result.V, &bits.V, sizeof(float));
+		return result;
+	}
+
+	FORCEINLINE void Store(float* target) const { *target = V; }
+	FORCEINLINE void StoreMasked(float* target, const FMask& mask) const { if (mask.V) *target = V; }
+	FORCEINLINE float GetLane(int32 lane) const { return V; }
+
+	FORCEINLINE FInt ToInt() const { return { int32(V) }; }
+	FORCEINLINE FInt ToIntRound() const { return { int32(FMath::RoundHalfToEven(V)) }; }
+
+	FORCEINLINE FInt ToBits() const
+	{
+		FInt result;
+		FMemory::Memcpy(&result.V, &V, sizeof(float));
+		return result;
+	}
+
+	FORCEINLINE float ReduceAdd() const { return V; }
+	FORCEINLINE float ReduceMin() const { return V; }
+	FORCEINLINE float ReduceMax() const { return V; }
+
+	static FORCEINLINE TGenFloatVec Min(const TGenFloatVec& a, const TGenFloatVec& b) { return { a.V < b.V ? a.V : b.V }; }
+	static FORCEINLINE TGenFloatVec Max(const TGenFloatVec& a, const TGenFloatVec& b) { return { a.V > b.V ? a.V : b.V }; }
+	static FORCEINLINE TGenFloatVec Sqrt(const TGenFloatVec& x) { return { FMath::Sqrt(x.V) }; }
+	static FORCEINLINE TGenFloatVec Floor(const TGenFloatVec& x) { return { FMath::FloorToFloat(x.V) }; }
+	static FORCEINLINE TGenFloatVec Select(const FMask& mask, const TGenFloatVec& a, const TGenFloatVec& b) { return { mask.V ? a.V : b.V }; }
+
+	friend FORCEINLINE TGenFloatVec operator+(const TGenFloatVec& a, const TGenFloatVec& b) { return { a.V + b.V }; }
+	friend FORCEINLINE TGenFloatVec operator-(const TGenFloatVec& a, const TGenFloatVec& b) { return { a.V - b.V }; }
+	friend FORCEINLINE TGenFloatVec operator*(const TGenFloatVec& a, const TGenFloatVec& b) { return { a.V * b.V }; }
+	friend FORCEINLINE TGenFloatVec operator/(const TGenFloatVec& a, const TGenFloatVec& b) { return { a.V / b.V }; }
+	friend FORCEINLINE FMask operator<(const TGenFloatVec& a, const TGenFloatVec& b) { return { a.V < b.V }; }
+	friend FORCEINLINE FMask operator<=(const TGenFloatVec& a, const TGenFloatVec& b) { return { a.V <= b.V }; }
+	friend FORCEINLINE FMask operator>(const TGenFloatVec& a, const TGenFloatVec& b) { return { a.V > b.V }; }
+	friend FORCEINLINE FMask operator>=(const TGenFloatVec& a, const TGenFloatVec& b) { return { a.V >= b.V }; }
+};
+
+/*
+ * SSE4.1, 4 lanes
+ */
+
+#if GEN_SIMD_SSE4
+template<>
+struct TGenMaskVec<4>
+{
+	__m128 V;
+
+	static FORCEINLINE TGenMaskVec FirstN(int32 count) { return { _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_set1_epi32(count), _mm_setr_epi32(0, 1, 2, 3))) }; }
+	FORCEINLINE uint32 GetBits() const { return uint32(_mm_movemask_ps(V)); }
+	FORCEINLINE bool Any() const { return _mm_movemask_ps(V) != 0; }
+
+	friend FORCEINLINE TGenMaskVec operator&(const TGenMaskVec& a, const TGenMaskVec& b) { return { _mm_and_ps(a.V, b.V) }; }
+	friend FORCEINLINE TGenMaskVec operator|(const TGenMaskVec& a, const TGenMaskVec& b) { return { _mm_or_ps(a.V, b.V) }; }
+	static FORCEINLINE TGenMaskVec AndNot(const TGenMaskVec& a, const TGenMaskVec& b) { return { _mm_andnot_ps(b.V, a.V) }; }
+};
+
+template<>
+struct TGenIntVec<4>
+{
+	using FMask = TGenMaskVec<4>;
+	using FElement = int32;
+	static constexpr int32 Lanes = 4;
+
+	__m128i V;
+
+	static FORCEINLINE TGenIntVec Splat(int32 value) { return { _mm_set1_epi32(value) }; }
+	static FORCEINLINE TGenIntVec Load(const int32* source) { return { _mm_loadu_si128(reinterpret_cast<const __m128i*>(source)) }; }
+	FORCEINLINE void Store(int32* target) const { _mm_storeu_si128(reinterpret_cast<__m128i*>(target), V); }
+
+	FORCEINLINE int32 GetLane(int32 lane) const
+	{
+		int32 lanes[4];
+		Store(lanes);
+		return lanes[lane];
+	}
+
+	FORCEINLINE void StoreSaturatedUint16(uint16* target) const { _mm_storel_epi64(reinterpret_cast<__m128i*>(target), _mm_packus_epi32(V, V)); }
+
+	static FORCEINLINE TGenIntVec Min(const TGenIntVec& a, const TGenIntVec& b) { return { _mm_min_epi32(a.V, b.V) }; }
+	static FORCEINLINE TGenIntVec Max(const TGenIntVec& a, const TGenIntVec& b) { return { _mm_max_epi32(a.V, b.V) }; }
+	static FORCEINLINE TGenIntVec Select(const FMask& mask, const TGenIntVec& a, const TGenIntVec& b) { return { _mm_blendv_epi8(b.V, a.V, _mm_castps_si128(mask.V)) }; }
+	FORCEINLINE TGenIntVec ShiftLeft(int32 count) const { return { _mm_sll_epi32(V, _mm_cvtsi32_si128(count)) }; }
+	FORCEINLINE TGenIntVec ShiftRightLogical(int32 count) const { return { _mm_srl_epi32(V, _mm_cvtsi32_si128(count)) }; }
+
+	friend FORCEINLINE TGenIntVec operator+(const TGenIntVec& a, const TGenIntVec& b) { return { _mm_add_epi32(a.V, b.V) }; }
+	friend FORCEINLINE TGenIntVec operator-(const TGenIntVec& a, const TGenIntVec& b) { return { _mm_sub_epi32(a.V, b.V) }; }
+	friend FORCEINLINE TGenIntVec operator*(const TGenIntVec& a, const TGenIntVec& b) { return { _mm_mullo_epi32(a.V, b.V) }; }
+	friend FORCEINLINE TGenIntVec operator&(const TGenIntVec& a, const TGenIntVec& b) { return { _mm_and_si128(a.V, b.V) }; }
+	friend FORCEINLINE TGenIntVec operator|(const TGenIntVec& a, const TGenIntVec& b) { return { _mm_or_si128(a.V, b.V) }; }
+	friend FORCEINLINE FMask operator>(const TGenIntVec& a, const TGenIntVec& b) { return { _mm_castsi128_ps(_mm_cmpgt_epi32(a.V, b.V)) }; }
+	friend FORCEINLINE FMask operator<(const TGenIntVec& a, const TGenIntVec& b) { return { _mm_castsi128_ps(_mm_cmplt_epi32(a.V, b.V)) }; }
+};
+
+template<>
+struct TGenFloatVec<4>
+{
+	using FInt = TGenIntVec<4>;
+	using FMask = TGenMaskVec<4>;
+	using FElement = float;
+	static constexpr int32 Lanes = 4;
+
+	__m128 V;
+
+	static FORCEINLINE TGenFloatVec Splat(float value) { return { _mm_set1_ps(value) }; }
+	static FORCEINLINE TGenFloatVec Zero() { return { _mm_setzero_ps() }; }
+	static FORCEINLINE TGenFloatVec Load(const float* source) { return { _mm_loadu_ps(source) }; }
+
+	static FORCEINLINE TGenFloatVec LoadMasked(const float* source, const FMask& mask)
+	{
+		uint32 bits = mask.GetBits();
+		float lanes[4];
+		for (int32 l = 0; l < 4; l++) lanes[l] = bits & (1 << l) ? source[l] : 0.f;
+		return Load(lanes);
+	}
+
+	static FORCEINLINE TGenFloatVec Gather(const float* base, const FInt& indices)
+	{
+		return { _mm_setr_ps(base[_mm_extract_epi32(indices.V, 0)], base[_mm_extract_epi32(indices.V, 1)], base[_mm_extract_epi32(indices.V, 2)], base[_mm_extract_epi32(indices.V, 3)]) };
+	}
+
+	static FORCEINLINE TGenFloatVec FromInt(const FInt& value) { return { _mm_cvtepi32_ps(value.V) }; }
+	static FORCEINLINE TGenFloatVec FromBits(const FInt& bits) { return { _mm_castsi128_ps(bits.V) }; }
+
+	FORCEINLINE void Store(float* target) const { _mm_storeu_ps(target, V); }
+
+	FORCEINLINE void StoreMasked(float* target, const FMask& mask) const
+	{
+		uint32 bits = mask.GetBits();
+		float lanes[4];
+		Store(lanes);
+		for (int32 l = 0; l < 4; l++) if (bits & (1 << l)) target[l] = lanes[l];
+	}
+
+	FORCEINLINE float GetLane(int32 lane) const
+	{
+		float lanes[4];
+		Store(lanes);
+		return lanes[lane];
+	}
+
+	FORCEINLINE FInt ToInt() const { return { _mm_cvttps_epi32(V) }; }
+	FORCEINLINE FInt ToIntRound() const { return { _mm_cvtps_epi32(V) }; }
+	FORCEINLINE FInt ToBits() const { return { _mm_castps_si128(V) }; }
+
+	FORCEINLINE float ReduceAdd() const
+	{
+		__m128 shuffled = _mm_movehdup_ps(V);
+		__m128 sums = _mm_add_ps(V, shuffled);
+		shuffled = _mm_movehl_ps(shuffled, sums);
+		return _mm_cvtss_f32(_mm_add_ss(sums, shuffled));
+	}
+
+	FORCEINLINE float ReduceMin() const
+	{
+		__m128 result = _mm_min_ps(V, _mm_movehl_ps(V, V));
+		return _mm_cvtss_f32(_mm_min_ss(result, _mm_movehdup_ps(result)));
+	}
+
+	FORCEINLINE float ReduceMax() const
+	{
+		__m128 result = _mm_max_ps(V, _mm_movehl_ps(V, V));
+		return _mm_cvtss_f32(_mm_max_ss(result, _mm_movehdup_ps(result)));
+	}
+
+	static FORCEINLINE TGenFloatVec Min(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm_min_ps(a.V, b.V) }; }
+	static FORCEINLINE TGenFloatVec Max(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm_max_ps(a.V, b.V) }; }
+	static FORCEINLINE TGenFloatVec Sqrt(const TGenFloatVec& x) { return { _mm_sqrt_ps(x.V) }; }
+	static FORCEINLINE TGenFloatVec Floor(const TGenFloatVec& x) { return { _mm_floor_ps(x.V) }; }
+	static FORCEINLINE TGenFloatVec Select(const FMask& mask, const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm_blendv_ps(b.V, a.V, mask.V) }; }
+
+	friend FORCEINLINE TGenFloatVec operator+(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm_add_ps(a.V, b.V) }; }
+	friend FORCEINLINE TGenFloatVec operator-(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm_sub_ps(a.V, b.V) }; }
+	friend FORCEINLINE TGenFloatVec operator*(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm_mul_ps(a.V, b.V) }; }
+	friend FORCEINLINE TGenFloatVec operator/(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm_div_ps(a.V, b.V) }; }
+	friend FORCEINLINE FMask operator<(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm_cmplt_ps(a.V, b.V) }; }
+	friend FORCEINLINE FMask operator<=(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm_cmple_ps(a.V, b.V) }; }
+	friend FORCEINLINE FMask operator>(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm_cmpgt_ps(a.V, b.V) }; }
+	friend FORCEINLINE FMask operator>=(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm_cmpge_ps(a.V, b.V) }; }
+};
+#endif
+
+/*
+ * AVX2, 8 lanes
+ */
+
+#if GEN_SIMD_AVX2
+template<>
+struct TGenMaskVec<8>
+{
+	__m256 V;
+
+	static FORCEINLINE TGenMaskVec FirstN(int32 count) { return { _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(count), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7))) }; }
+	FORCEINLINE uint32 GetBits() const { return uint32(_mm256_movemask_ps(V)); }
+	FORCEINLINE bool Any() const { return _mm256_movemask_ps(V) != 0; }
+
+	friend FORCEINLINE TGenMaskVec operator&(const TGenMaskVec& a, const TGenMaskVec& b) { return { _mm256_and_ps(a.V, b.V) }; }
+	friend FORCEINLINE TGenMaskVec operator|(const TGenMaskVec& a, const TGenMaskVec& b) { return { _mm256_or_ps(a.V, b.V) }; }
+	static FORCEINLINE TGenMaskVec AndNot(const TGenMaskVec& a, const TGenMaskVec& b) { return { _mm256_andnot_ps(b.V, a.V) }; }
+};
+
+template<>
+struct TGenIntVec<8>
+{
+	using FMask = TGenMaskVec<8>;
+	using FElement = int32;
+	static constexpr int32 Lanes = 8;
+
+	__m256i V;
+
+	static FORCEINLINE TGenIntVec Splat(int32 value) { return { _mm256_set1_epi32(value) }; }
+	static FORCEINLINE TGenIntVec Load(const int32* source) { return { _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source)) }; }
+	FORCEINLINE void Store(int32* target) const { _mm256_storeu_si256(reinterpret_cast<__m256i*>(target), V); }
+
+	FORCEINLINE int32 GetLane(int32 lane) const
+	{
+		int32 lanes[8];
+		Store(lanes);
+		return lanes[lane];
+	}
+
+	//Pack the two 128 bit halves separately, _mm256_packus_epi32 would interleave them
+	FORCEINLINE void StoreSaturatedUint16(uint16* target) const { _mm_storeu_si128(reinterpret_cast<__m128i*>(target), _mm_packus_epi32(_mm256_castsi256_si128(V), _mm256_extracti128_si256(V, 1))); }
+
+	static FORCEINLINE TGenIntVec Min(const TGenIntVec& a, const TGenIntVec& b) { return { _mm256_min_epi32(a.V, b.V) }; }
+	static FORCEINLINE TGenIntVec Max(const TGenIntVec& a, const TGenIntVec& b) { return { _mm256_max_epi32(a.V, b.V) }; }
+	static FORCEINLINE TGenIntVec Select(const FMask& mask, const TGenIntVec& a, const TGenIntVec& b) { return { _mm256_blendv_epi8(b.V, a.V, _mm256_castps_si256(mask.V)) }; }
+	FORCEINLINE TGenIntVec ShiftLeft(int32 count) const { return { _mm256_sll_epi32(V, _mm_cvtsi32_si128(count)) }; }
+	FORCEINLINE TGenIntVec ShiftRightLogical(int32 count) const { return { _mm256_srl_epi32(V, _mm_cvtsi32_si128(count)) }; }
+
+	friend FORCEINLINE TGenIntVec operator+(const TGenIntVec& a, const TGenIntVec& b) { return { _mm256_add_epi32(a.V, b.V) }; }
+	friend FORCEINLINE TGenIntVec operator-(const TGenIntVec& a, const TGenIntVec& b) { return { _mm256_sub_epi32(a.V, b.V) }; }
+	friend FORCEINLINE TGenIntVec operator*(const TGenIntVec& a, const TGenIntVec& b) { return { _mm256_mullo_epi32(a.V, b.V) }; }
+	friend FORCEINLINE TGenIntVec operator&(const TGenIntVec& a, const TGenIntVec& b) { return { _mm256_and_si256(a.V, b.V) }; }
+	friend FORCEINLINE TGenIntVec operator|(const TGenIntVec& a, const TGenIntVec& b) { return { _mm256_or_si256(a.V, b.V) }; }
+	friend FORCEINLINE FMask operator>(const TGenIntVec& a, const TGenIntVec& b) { return { _mm256_castsi256_ps(_mm256_cmpgt_epi32(a.V, b.V)) }; }
+	friend FORCEINLINE FMask operator<(const TGenIntVec& a, const TGenIntVec& b) { return { _mm256_castsi256_ps(_mm256_cmpgt_epi32(b.V, a.V)) }; }
+};
+
+template<>
+struct TGenFloatVec<8>
+{
+	using FInt = TGenIntVec<8>;
+	using FMask = TGenMaskVec<8>;
+	using FElement = float;
+	static constexpr int32 Lanes = 8;
+
+	__m256 V;
+
+	static FORCEINLINE TGenFloatVec Splat(float value) { return { _mm256_set1_ps(value) }; }
+	static FORCEINLINE TGenFloatVec Zero() { return { _mm256_setzero_ps() }; }
+	static FORCEINLINE TGenFloatVec Load(const float* source) { return { _mm256_loadu_ps(source) }; }
+	static FORCEINLINE TGenFloatVec LoadMasked(const float* source, const FMask& mask) { return { _mm256_maskload_ps(source, _mm256_castps_si256(mask.V)) }; }
+	static FORCEINLINE TGenFloatVec Gather(const float* base, const FInt& indices) { return { _mm256_i32gather_ps(base, indices.V, 4) }; }
+	static FORCEINLINE TGenFloatVec FromInt(const FInt& value) { return { _mm256_cvtepi32_ps(value.V) }; }
+	static FORCEINLINE TGenFloatVec FromBits(const FInt& bits) { return { _mm256_castsi256_ps(bits.V) }; }
+
+	FORCEINLINE void Store(float* target) const { _mm256_storeu_ps(target, V); }
+	FORCEINLINE void StoreMasked(float* target, const FMask& mask) const { _mm256_maskstore_ps(target, _mm256_castps_si256(mask.V), V); }
+
+	FORCEINLINE float GetLane(int32 lane) const
+	{
+		float lanes[8];
+		Store(lanes);
+		return lanes[lane];
+	}
+
+	FORCEINLINE FInt ToInt() const { return { _mm256_cvttps_epi32(V) }; }
+	FORCEINLINE FInt ToIntRound() const { return { _mm256_cvtps_epi32(V) }; }
+	FORCEINLINE FInt ToBits() const { return { _mm256_castps_si256(V) }; }
+
+	FORCEINLINE float ReduceAdd() const { return TGenFloatVec<4>{ _mm_add_ps(_mm256_castps256_ps128(V), _mm256_extractf128_ps(V, 1)) }.ReduceAdd(); }
+	FORCEINLINE float ReduceMin() const { return TGenFloatVec<4>{ _mm_min_ps(_mm256_castps256_ps128(V), _mm256_extractf128_ps(V, 1)) }.ReduceMin(); }
+	FORCEINLINE float ReduceMax() const { return TGenFloatVec<4>{ _mm_max_ps(_mm256_castps256_ps128(V), _mm256_extractf128_ps(V, 1)) }.ReduceMax(); }
+
+	static FORCEINLINE TGenFloatVec Min(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm256_min_ps(a.V, b.V) }; }
+	static FORCEINLINE TGenFloatVec Max(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm256_max_ps(a.V, b.V) }; }
+	static FORCEINLINE TGenFloatVec Sqrt(const TGenFloatVec& x) { return { _mm256_sqrt_ps(x.V) }; }
+	static FORCEINLINE TGenFloatVec Floor(const TGenFloatVec& x) { return { _mm256_floor_ps(x.V) }; }
+	static FORCEINLINE TGenFloatVec Select(const FMask& mask, const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm256_blendv_ps(b.V, a.V, mask.V) }; }
+
+	friend FORCEINLINE TGenFloatVec operator+(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm256_add_ps(a.V, b.V) }; }
+	friend FORCEINLINE TGenFloatVec operator-(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm256_sub_ps(a.V, b.V) }; }
+	friend FORCEINLINE TGenFloatVec operator*(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm256_mul_ps(a.V, b.V) }; }
+	friend FORCEINLINE TGenFloatVec operator/(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm256_div_ps(a.V, b.V) }; }
+	friend FORCEINLINE FMask operator<(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm256_cmp_ps(a.V, b.V, _CMP_LT_OQ) }; }
+	friend FORCEINLINE FMask operator<=(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm256_cmp_ps(a.V, b.V, _CMP_LE_OQ) }; }
+	friend FORCEINLINE FMask operator>(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm256_cmp_ps(a.V, b.V, _CMP_GT_OQ) }; }
+	friend FORCEINLINE FMask operator>=(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm256_cmp_ps(a.V, b.V, _CMP_GE_OQ) }; }
+};
+#endif
+
+/*
+ * AVX-512, 16 lanes
+ */
+
+#if GEN_SIMD_AVX512
+template<>
+struct TGenMaskVec<16>
+{
+	__mmask16 V;
+
+	static FORCEINLINE TGenMaskVec FirstN(int32 count) { return { __mmask16(count >= 16 ? 0xFFFF : count <= 0 ? 0 : (1u << count) - 1) }; }
+	FORCEINLINE uint32 GetBits() const { return uint32(V); }
+	FORCEINLINE bool Any() const { return V != 0; }
+
+	friend FORCEINLINE TGenMaskVec operator&(const TGenMaskVec& a, const TGenMaskVec& b) { return { __mmask16(a.V & b.V) }; }
+	friend FORCEINLINE TGenMaskVec operator|(const TGenMaskVec& a, const TGenMaskVec& b) { return { __mmask16(a.V | b.V) }; }
+	static FORCEINLINE TGenMaskVec AndNot(const TGenMaskVec& a, const TGenMaskVec& b) { return { __mmask16(a.V & ~b.V) }; }
+};
+
+template<>
+struct TGenIntVec<16>
+{
+	using FMask = TGenMaskVec<16>;
+	using FElement = int32;
+	static constexpr int32 Lanes = 16;
+
+	__m512i V;
+
+	static FORCEINLINE TGenIntVec Splat(int32 value) { return { _mm512_set1_epi32(value) }; }
+	static FORCEINLINE TGenIntVec Load(const int32* source) { return { _mm512_loadu_si512(source) }; }
+	FORCEINLINE void Store(int32* target) const { _mm512_storeu_si512(target, V); }
+
+	FORCEINLINE int32 GetLane(int32 lane) const
+	{
+		int32 lanes[16];
+		Store(lanes);
+		return lanes[lane];
+	}
+
+	//The narrowing store saturates as unsigned, clamp negative lanes first
+	FORCEINLINE void StoreSaturatedUint16(uint16* target) const { _mm256_storeu_si256(reinterpret_cast<__m256i*>(target), _mm512_cvtusepi32_epi16(_mm512_max_epi32(V, _mm512_setzero_si512()))); }
+
+	static FORCEINLINE TGenIntVec Min(const TGenIntVec& a, const TGenIntVec& b) { return { _mm512_min_epi32(a.V, b.V) }; }
+	static FORCEINLINE TGenIntVec Max(const TGenIntVec& a, const TGenIntVec& b) { return { _mm512_max_epi32(a.V, b.V) }; }
+	static FORCEINLINE TGenIntVec Select(const FMask& mask, const TGenIntVec& a, const TGenIntVec& b) { return { _mm512_mask_blend_epi32(mask.V, b.V, a.V) }; }
+	FORCEINLINE TGenIntVec ShiftLeft(int32 count) const { return { _mm512_sll_epi32(V, _mm_cvtsi32_si128(count)) }; }
+	FORCEINLINE TGenIntVec ShiftRightLogical(int32 count) const { return { _mm512_srl_epi32(V, _mm_cvtsi32_si128(count)) }; }
+
+	friend FORCEINLINE TGenIntVec operator+(const TGenIntVec& a, const TGenIntVec& b) { return { _mm512_add_epi32(a.V, b.V) }; }
+	friend FORCEINLINE TGenIntVec operator-(const TGenIntVec& a, const TGenIntVec& b) { return { _mm512_sub_epi32(a.V, b.V) }; }
+	friend FORCEINLINE TGenIntVec operator*(const TGenIntVec& a, const TGenIntVec& b) { return { _mm512_mullo_epi32(a.V, b.V) }; }
+	friend FORCEINLINE TGenIntVec operator&(const TGenIntVec& a, const TGenIntVec& b) { return { _mm512_and_si512(a.V, b.V) }; }
+	friend FORCEINLINE TGenIntVec operator|(const TGenIntVec& a, const TGenIntVec& b) { return { _mm512_or_si512(a.V, b.V) }; }
+	friend FORCEINLINE FMask operator>(const TGenIntVec& a, const TGenIntVec& b) { return { _mm512_cmpgt_epi32_mask(a.V, b.V) }; }
+	friend FORCEINLINE FMask operator<(const TGenIntVec& a, const TGenIntVec& b) { return { _mm512_cmplt_epi32_mask(a.V, b.V) }; }
+};
+
+template<>
+struct TGenFloatVec<16>
+{
+	using FInt = TGenIntVec<16>;
+	using FMask = TGenMaskVec<16>;
+	using FElement = float;
+	static constexpr int32 Lanes = 16;
+
+	__m512 V;
+
+	static FORCEINLINE TGenFloatVec Splat(float value) { return { _mm512_set1_ps(value) }; }
+	static FORCEINLINE TGenFloatVec Zero() { return { _mm512_setzero_ps() }; }
+	static FORCEINLINE TGenFloatVec Load(const float* source) { return { _mm512_loadu_ps(source) }; }
+	static FORCEINLINE TGenFloatVec LoadMasked(const float* source, const FMask& mask) { return { _mm512_maskz_loadu_ps(mask.V, source) }; }
+	static FORCEINLINE TGenFloatVec Gather(const float* base, const FInt& indices) { return { _mm512_i32gather_ps(indices.V, base, 4) }; }
+	static FORCEINLINE TGenFloatVec FromInt(const FInt& value) { return { _mm512_cvtepi32_ps(value.V) }; }
+	static FORCEINLINE TGenFloatVec FromBits(const FInt& bits) { return { _mm512_castsi512_ps(bits.V) }; }
+
+	FORCEINLINE void Store(float* target) const { _mm512_storeu_ps(target, V); }
+	FORCEINLINE void StoreMasked(float* target, const FMask& mask) const { _mm512_mask_storeu_ps(target, mask.V, V); }
+
+	FORCEINLINE float GetLane(int32 lane) const
+	{
+		float lanes[16];
+		Store(lanes);
+		return lanes[lane];
+	}
+
+	FORCEINLINE FInt ToInt() const { return { _mm512_cvttps_epi32(V) }; }
+	FORCEINLINE FInt ToIntRound() const { return { _mm512_cvtps_epi32(V) }; }
+	FORCEINLINE FInt ToBits() const { return { _mm512_castps_si512(V) }; }
+
+	FORCEINLINE float ReduceAdd() const { return _mm512_reduce_add_ps(V); }
+	FORCEINLINE float ReduceMin() const { return _mm512_reduce_min_ps(V); }
+	FORCEINLINE float ReduceMax() const { return _mm512_reduce_max_ps(V); }
+
+	static FORCEINLINE TGenFloatVec Min(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm512_min_ps(a.V, b.V) }; }
+	static FORCEINLINE TGenFloatVec Max(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm512_max_ps(a.V, b.V) }; }
+	static FORCEINLINE TGenFloatVec Sqrt(const TGenFloatVec& x) { return { _mm512_sqrt_ps(x.V) }; }
+	static FORCEINLINE TGenFloatVec Floor(const TGenFloatVec& x) { return { _mm512_roundscale_ps(x.V, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC) }; }
+	static FORCEINLINE TGenFloatVec Select(const FMask& mask, const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm512_mask_blend_ps(mask.V, b.V, a.V) }; }
+
+	friend FORCEINLINE TGenFloatVec operator+(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm512_add_ps(a.V, b.V) }; }
+	friend FORCEINLINE TGenFloatVec operator-(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm512_sub_ps(a.V, b.V) }; }
+	friend FORCEINLINE TGenFloatVec operator*(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm512_mul_ps(a.V, b.V) }; }
+	friend FORCEINLINE TGenFloatVec operator/(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm512_div_ps(a.V, b.V) }; }
+	friend FORCEINLINE FMask operator<(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm512_cmp_ps_mask(a.V, b.V, _CMP_LT_OQ) }; }
+	friend FORCEINLINE FMask operator<=(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm512_cmp_ps_mask(a.V, b.V, _CMP_LE_OQ) }; }
+	friend FORCEINLINE FMask operator>(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm512_cmp_ps_mask(a.V, b.V, _CMP_GT_OQ) }; }
+	friend FORCEINLINE FMask operator>=(const TGenFloatVec& a, const TGenFloatVec& b) { return { _mm512_cmp_ps_mask(a.V, b.V, _CMP_GE_OQ) }; }
+};
+#endif
+
+/*
+ * Helpers for every width
+ */
+
+//Vector from its lanes, lane 0 first
+template<typename TVec, typename... TLanes>
+FORCEINLINE TVec GenSimdSet(TLanes... lanes)
+{
+	static_assert(sizeof...(TLanes) == TVec::Lanes, "One value per lane");
+	const typename TVec::FElement values[] = { typename TVec::FElement(lanes)... };
+	return TVec::Load(values);
+}
+
+//4 lane shuffle, result lane n is x[In]
+template<int32 I0, int32 I1, int32 I2, int32 I3>
+FORCEINLINE FGenFloat4 GenSimdSwizzle(const FGenFloat4& x)
+{
+#if GEN_SIMD_SSE4
+	return { _mm_shuffle_ps(x.V, x.V, _MM_SHUFFLE(I3, I2, I1, I0)) };
+#else
+	float lanes[4];
+	x.Store(lanes);
+	return GenSimdSet<FGenFloat4>(lanes[I0], lanes[I1], lanes[I2], lanes[I3]);
+#endif
+}
+
+//Exponent plus a polynomial for ln over the mantissa in [1, 2), relative error around 1e-4, x must be positive
+template<int32 N>
+FORCEINLINE TGenFloatVec<N> GenSimdFastLog2(const TGenFloatVec<N>& x)
+{
+	using FVec = TGenFloatVec<N>;
+	using FInt = TGenIntVec<N>;
+
+	FInt bits = x.ToBits();
+	FVec exponent = FVec::FromInt(bits.ShiftRightLogical(23) - FInt::Splat(127));
+	FVec m = FVec::FromBits((bits & FInt::Splat(0x007FFFFF)) | FInt::Splat(0x3F800000));
+
+	FVec lnMantissa = FVec::Splat(-.056570851f);
+	lnMantissa = lnMantissa * m + FVec::Splat(.44717955f);
+	lnMantissa = lnMantissa * m + FVec::Splat(-1.4699568f);
+	lnMantissa = lnMantissa * m + FVec::Splat(2.8212026f);
+	lnMantissa = lnMantissa * m + FVec::Splat(-1.7417939f);
+
+	return exponent + lnMantissa * FVec::Splat(1.44269504f);
+}
+
+//2^floor(x) through the exponent bits and a 5th order series for the fraction, relative error around 1e-4
+template<int32 N>
+FORCEINLINE TGenFloatVec<N> GenSimdFastExp2(const TGenFloatVec<N>& x)
+{
+	using FVec = TGenFloatVec<N>;
+	using FInt = TGenIntVec<N>;
+
+	FVec clamped = FVec::Min(FVec::Max(x, FVec::Splat(-126.f)), FVec::Splat(127.f));
+	FVec whole = FVec::Floor(clamped);
+	FVec f = clamped - whole;
+
+	FVec fraction = FVec::Splat(1.3333558e-3f);
+	fraction = fraction * f + FVec::Splat(9.6181291e-3f);
+	fraction = fraction * f + FVec::Splat(5.5504109e-2f);
+	fraction = fraction * f + FVec::Splat(2.4022651e-1f);
+	fraction = fraction * f + FVec::Splat(6.9314718e-1f);
+	fraction = fraction * f + FVec::Splat(1.f);
+
+	FVec scale = FVec::FromBits((whole.ToInt() + FInt::Splat(127)).ShiftLeft(23));
+	return fraction * scale;
+}
+
+//x^y for x > 0, 0 otherwise. Only for cases where a few digits are enough, integer powers should stay multiplications
+template<int32 N>
+FORCEINLINE TGenFloatVec<N> GenSimdFastPow(const TGenFloatVec<N>& x, const TGenFloatVec<N>& y)
+{
+	using FVec = TGenFloatVec<N>;
+
+	FVec result = GenSimdFastExp2(y * GenSimdFastLog2(FVec::Max(x, FVec::Splat(UE_SMALL_NUMBER))));
+	return FVec::Select(x > FVec::Zero(), result, FVec::Zero());
+}
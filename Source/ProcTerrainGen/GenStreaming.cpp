@@ -0,0 +1,368 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GenStreaming.h"
+
+UGenStreaming::UGenStreaming()
+{
+	PrimaryComponentTick.bCanEverTick = true;
+}
+
+void UGenStreaming::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	if (!IsStreaming()) return;
+
+	FrameCounter++;
+	UpdateResidency();
+}
+
+void UGenStreaming::Start(UProceduralMeshComponent* mesh, UMaterialInterface* material, const FHeightGeneratorOptions& heightOptions, const FStreamingOptions& options)
+{
+	if (IsStreaming()) Stop();
+
+	StreamingMesh = mesh;
+	StreamingMaterial = material;
+
+	Options = options;
+	Options.chunkVertexCount = FMath::Max(Options.chunkVertexCount, 2);
+	Options.chunkApron = FMath::Max(Options.chunkApron, 1);
+	Options.maxConcurrentChunks = FMath::Max(Options.maxConcurrentChunks, 1);
+	Options.maxResidentChunks = FMath::Max(Options.maxResidentChunks, Options.maxConcurrentChunks);
+
+	//There is no island in an unbounded world
+	HeightOptions = heightOptions;
+	HeightOptions.islandModifier = false;
+
+	//Workers of a previous run are reused, busy ones return to the pool when their (dropped) job finishes
+	while (Workers.Num() < Options.maxConcurrentChunks)
+	{
+		FreeWorkers.Add(Workers.Add(NewObject<UGenHeight>(this)));
+	}
+
+	int32 n = Options.chunkVertexCount;
+
+	ChunkTriangles.Empty((n * n) * 6);
+
+	//Create triangles (ccw winding order)
+	for (int32 y = 0; y < n; y++)
+	{
+		for (int32 x = 0; x < n; x++)
+		{
+			int32 startIndex = y * (n + 1) + x;
+
+			ChunkTriangles.Add(startIndex); //(0,0)
+			ChunkTriangles.Add(startIndex + n + 1); //(0, 1)
+			ChunkTriangles.Add(startIndex + 1); //(1,0)
+
+			ChunkTriangles.Add(startIndex + n + 1); //(0, 1)
+			ChunkTriangles.Add(startIndex + n + 2); // (1, 1)
+			ChunkTriangles.Add(startIndex + 1); //(1, 0)
+		}
+	}
+
+	Stats = FStreamingStats();
+	TotalChunkTime = 0.;
+}
+
+void UGenStreaming::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	//Running jobs write into the workers, which must not be collected under them
+	Stop();
+	UE::Tasks::Wait(ChunkTasks);
+	ChunkTasks.Empty();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void UGenStreaming::Stop()
+{
+	StreamingEpoch++;
+
+	if (StreamingMesh) StreamingMesh->ClearAllMeshSections();
+
+	ResidentChunks.Empty();
+	InFlightChunks.Empty();
+	FreeMeshSections.Empty();
+	NextMeshSection = 0;
+
+	StreamingMesh = nullptr;
+}
+
+FStreamingStats UGenStreaming::GetStreamingStats() const
+{
+	FStreamingStats result = Stats;
+
+	result.residentChunks = ResidentChunks.Num();
+	result.inFlightChunks = InFlightChunks.Num();
+	result.averageChunkTime = Stats.generatedChunks > 0 ? TotalChunkTime / Stats.generatedChunks : 0.;
+
+	int32 vertexCount = (Options.chunkVertexCount + 1) * (Options.chunkVertexCount + 1);
+	int64 meshMemory = vertexCount * sizeof(FProcMeshVertex) + ChunkTriangles.Num() * sizeof(uint32);
+
+	for (const auto& chunk : ResidentChunks)
+	{
+		result.residentMemory += meshMemory + chunk.Value.height.GetAllocatedSize();
+	}
+
+	return result;
+}
+
+bool UGenStreaming::GetHeight(float xPos, float yPos, float& outHeight) const
+{
+	int32 n = Options.chunkVertexCount;
+	float chunkWorldSize = n * Options.edgeSize;
+
+	FIntPoint coords(FMath::FloorToInt32(xPos / chunkWorldSize), FMath::FloorToInt32(yPos / chunkWorldSize));
+
+	const FStreamedChunk* chunk = ResidentChunks.Find(coords);
+	if (!chunk) return false;
+
+	float localx = (xPos - coords.X * chunkWorldSize) / Options.edgeSize;
+	float localy = (yPos - coords.Y * chunkWorldSize) / Options.edgeSize;
+
+	int32 x0 = FMath::Clamp(FMath::FloorToInt32(localx), 0, n - 1);
+	int32 y0 = FMath::Clamp(FMath::FloorToInt32(localy), 0, n - 1);
+
+	float xAlpha = localx - x0;
+	float yAlpha = localy - y0;
+
+	const TArray<float>& height = chunk->height;
+	float h0 = FMath::Lerp(height[y0 * (n + 1) + x0], height[y0 * (n + 1) + x0 + 1], xAlpha);
+	float h1 = FMath::Lerp(height[(y0 + 1) * (n + 1) + x0], height[(y0 + 1) * (n + 1) + x0 + 1], xAlpha);
+
+	outHeight = FMath::Lerp(h0, h1, yAlpha);
+
+	return true;
+}
+
+void UGenStreaming::UpdateResidency()
+{
+	float chunkWorldSize = Options.chunkVertexCount * Options.edgeSize;
+	float radius = Options.streamingRadius;
+
+	//Min heap on the distance to the closest focus point
+	TArray<TPair<float, FIntPoint>> queue;
+	TSet<FIntPoint> queued;
+
+	auto closerFirst = [](const TPair<float, FIntPoint>& a, const TPair<float, FIntPoint>& b) { return a.Key < b.Key; };
+
+	for (const FVector& focus : FocusPoints)
+	{
+		int32 xMin = FMath::FloorToInt32((focus.X - radius) / chunkWorldSize);
+		int32 xMax = FMath::FloorToInt32((focus.X + radius) / chunkWorldSize);
+		int32 yMin = FMath::FloorToInt32((focus.Y - radius) / chunkWorldSize);
+		int32 yMax = FMath::FloorToInt32((focus.Y + radius) / chunkWorldSize);
+
+		for (int32 y = yMin; y <= yMax; y++)
+		{
+			for (int32 x = xMin; x <= xMax; x++)
+			{
+				FIntPoint coords(x, y);
+
+				float distance = GetChunkDistance(coords);
+				if (distance > radius) continue;
+
+				if (FStreamedChunk* chunk = ResidentChunks.Find(coords))
+				{
+					chunk->lastUsedFrame = FrameCounter;
+					continue;
+				}
+
+				if (InFlightChunks.Contains(coords) || queued.Contains(coords)) continue;
+
+				queued.Add(coords);
+				queue.HeapPush(TPair<float, FIntPoint>(distance, coords), closerFirst);
+			}
+		}
+	}
+
+	Stats.queuedChunks = queue.Num();
+
+	while (!FreeWorkers.IsEmpty() && !queue.IsEmpty())
+	{
+		//Make room by evicting the least recently used chunk that is not wanted anymore
+		if (ResidentChunks.Num() + InFlightChunks.Num() >= Options.maxResidentChunks)
+		{
+			FIntPoint evictCoords = FIntPoint::ZeroValue;
+			uint64 oldestFrame = FrameCounter;
+
+			for (const auto& chunk : ResidentChunks)
+			{
+				if (chunk.Value.lastUsedFrame < oldestFrame)
+				{
+					oldestFrame = chunk.Value.lastUsedFrame;
+					evictCoords = chunk.Key;
+				}
+			}
+
+			//Budget is full of chunks that are all in range
+			if (oldestFrame == FrameCounter) break;
+
+			EvictChunk(evictCoords);
+		}
+
+		TPair<float, FIntPoint> next;
+		queue.HeapPop(next, closerFirst);
+		Stats.queuedChunks--;
+
+		DispatchChunk(next.Value);
+	}
+}
+
+void UGenStreaming::DispatchChunk(const FIntPoint& coords)
+{
+	int32 workerIndex = FreeWorkers.Pop();
+	UGenHeight* worker = Workers[workerIndex];
+	worker->SetGenerationOptions(HeightOptions);
+
+	InFlightChunks.Add(coords);
+
+	FStreamingOptions options = Options;
+	int32 seed = GetChunkSeed(coords);
+	uint32 epoch = StreamingEpoch;
+
+	//Only jobs still in flight are worth waiting for
+	ChunkTasks.RemoveAll([](const UE::Tasks::FTask& task) { return task.IsCompleted(); });
+
+	TWeakObjectPtr<UGenStreaming> weakThis(this);
+
+	ChunkTasks.Add(UE::Tasks::Launch(TEXT("StreamedChunk"), [=]()
+	{
+		FStreamedChunkResult result;
+
+		double startTime = FPlatformTime::Seconds();
+		BuildChunk(worker, coords, options, seed, result);
+		result.generationTime = FPlatformTime::Seconds() - startTime;
+
+		//The component may be gone by the time the game thread gets to the result
+		AsyncTask(ENamedThreads::GameThread, [weakThis, workerIndex, epoch, result = MoveTemp(result)]() mutable
+		{
+			if (UGenStreaming* streaming = weakThis.Get()) streaming->OnChunkReady(workerIndex, epoch, result);
+		});
+	}));
+}
+
+void UGenStreaming::OnChunkReady(int32 workerIndex, uint32 epoch, FStreamedChunkResult& result)
+{
+	FreeWorkers.Add(workerIndex);
+
+	//Streaming was stopped or restarted while this chunk was generated
+	if (epoch != StreamingEpoch || !IsStreaming()) return;
+
+	InFlightChunks.Remove(result.coords);
+
+	Stats.generatedChunks++;
+	Stats.maxChunkTime = FMath::Max(Stats.maxChunkTime, result.generationTime);
+	TotalChunkTime += result.generationTime;
+
+	int32 meshSection = FreeMeshSections.IsEmpty() ? NextMeshSection++ : FreeMeshSections.Pop();
+
+	StreamingMesh->CreateMeshSection(meshSection, result.vertices, ChunkTriangles, result.normals, result.uvs, TArray<FColor>(), result.tangents, true);
+	if (StreamingMaterial) StreamingMesh->SetMaterial(meshSection, StreamingMaterial);
+
+	FStreamedChunk& chunk = ResidentChunks.Add(result.coords);
+	chunk.meshSection = meshSection;
+	chunk.lastUsedFrame = FrameCounter;
+	chunk.height = MoveTemp(result.height);
+}
+
+void UGenStreaming::EvictChunk(const FIntPoint& coords)
+{
+	FStreamedChunk chunk;
+	if (!ResidentChunks.RemoveAndCopyValue(coords, chunk)) return;
+
+	StreamingMesh->ClearMeshSection(chunk.meshSection);
+	FreeMeshSections.Add(chunk.meshSection);
+
+	Stats.evictedChunks++;
+}
+
+float UGenStreaming::GetChunkDistance(const FIntPoint& coords) const
+{
+	float chunkWorldSize = Options.chunkVertexCount * Options.edgeSize;
+	FVector2D center((coords.X + .5f) * chunkWorldSize, (coords.Y + .5f) * chunkWorldSize);
+
+	float result = MAX_flt;
+	for (const FVector& focus : FocusPoints)
+	{
+		result = FMath::Min(result, float(FVector2D::Distance(center, FVector2D(focus))));
+	}
+
+	return result;
+}
+
+int32 UGenStreaming::GetChunkSeed(const FIntPoint& coords) const
+{
+	return int32(HashCombine(GetTypeHash(HeightOptions.seed), GetTypeHash(coords)));
+}
+
+void UGenStreaming::BuildChunk(UGenHeight* worker, const FIntPoint& coords, const FStreamingOptions& options, int32 seed, FStreamedChunkResult& outResult)
+{
+	int32 n = options.chunkVertexCount;
+	int32 apron = options.chunkApron;
+	int32 size = n + 1 + 2 * apron;
+
+	outResult.coords = coords;
+
+	worker->Initialize(1, 1, size, size, options.edgeSize);
+	worker->SetWorldOffset(coords.X * n - apron, coords.Y * n - apron);
+	worker->SetRandomSeed(seed);
+
+	TArray<float> rawHeight;
+	worker->GenerateHeight(0, 0, rawHeight);
+
+	if (options.erodeChunks) worker->Erode();
+
+	const TArray<float>& erodedHeight = worker->GetHeightData();
+
+	//x, y in worker space. Erosion fades out towards the chunk edge, the edge and the first ring around it stay
+	//untouched so that both chunks sharing an edge agree on its heights and normals
+	auto sampleHeight = [&](int32 x, int32 y)
+	{
+		int32 index = y * size + x;
+		int32 edgeDistance = FMath::Min(FMath::Min(x - apron, apron + n - x), FMath::Min(y - apron, apron + n - y));
+
+		if (!options.erodeChunks || edgeDistance <= 1) return rawHeight[index];
+
+		float alpha = FMath::Clamp(float(edgeDistance - 1) / float(apron), 0.f, 1.f);
+		return FMath::Lerp(rawHeight[index], erodedHeight[index], alpha);
+	};
+
+	int32 vertexCount = (n + 1) * (n + 1);
+	outResult.height.Reserve(vertexCount);
+	outResult.vertices.Reserve(vertexCount);
+	outResult.normals.Reserve(vertexCount);
+	outResult.uvs.Reserve(vertexCount);
+	outResult.tangents.Reserve(vertexCount);
+
+	for (int32 y = 0; y <= n; y++)
+	{
+		for (int32 x = 0; x <= n; x++)
+		{
+			int32 wx = x + apron;
+			int32 wy = y + apron;
+
+			float heightValue = sampleHeight(wx, wy);
+			outResult.height.Add(heightValue);
+
+			float xValue = (coords.X * n + x) * options.edgeSize;
+			float yValue = (coords.Y * n + y) * options.edgeSize;
+			outResult.vertices.Add(FVector(xValue, yValue, heightValue));
+			outResult.uvs.Add(FVector2D((float)x, (float)y));
+
+			float left = sampleHeight(wx - 1, wy);
+			float right = sampleHeight(wx + 1, wy);
+			float top = sampleHeight(wx, wy - 1);
+			float bottom = sampleHeight(wx, wy + 1);
+
+			//Same as UGenHeight::GetNormal
+			FVector n3 = -FVector(2.f * (right - left), 2.f * (bottom - top), -4.f).GetSafeNormal();
+			outResult.normals.Add(n3);
+
+			FVector t = FVector::ForwardVector - (n3 * FVector::DotProduct(n3, FVector::ForwardVector));
+			outResult.tangents.Add(FProcMeshTangent(t.GetSafeNormal(), false));
+		}
+	}
+}
@@ -0,0 +1,166 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "ProceduralMeshComponent.h"
+#include "GenHeight.h"
+#include "Tasks/Task.h"
+#include "GenStreaming.generated.h"
+
+USTRUCT(BlueprintType)
+struct FStreamingOptions
+{
+	GENERATED_USTRUCT_BODY()
+
+	//Quads per chunk side, neighbouring chunks share their edge vertices
+	UPROPERTY(BlueprintReadWrite)
+	int32 chunkVertexCount = 64;
+
+	//Extra vertices generated around each chunk so that erosion is not cut off at the chunk edge
+	UPROPERTY(BlueprintReadWrite)
+	int32 chunkApron = 16;
+
+	UPROPERTY(BlueprintReadWrite)
+	float edgeSize = 100.f;
+
+	UPROPERTY(BlueprintReadWrite)
+	float streamingRadius = 20000.f;
+
+	UPROPERTY(BlueprintReadWrite)
+	int32 maxResidentChunks = 64;
+
+	UPROPERTY(BlueprintReadWrite)
+	int32 maxConcurrentChunks = 4;
+
+	UPROPERTY(BlueprintReadWrite)
+	bool erodeChunks = true;
+};
+
+USTRUCT(BlueprintType)
+struct FStreamingStats
+{
+	GENERATED_USTRUCT_BODY()
+
+	UPROPERTY(BlueprintReadWrite)
+	int32 residentChunks = 0;
+
+	UPROPERTY(BlueprintReadWrite)
+	int32 inFlightChunks = 0;
+
+	UPROPERTY(BlueprintReadWrite)
+	int32 queuedChunks = 0;
+
+	UPROPERTY(BlueprintReadWrite)
+	int32 generatedChunks = 0;
+
+	UPROPERTY(BlueprintReadWrite)
+	int32 evictedChunks = 0;
+
+	UPROPERTY(BlueprintReadWrite)
+	double averageChunkTime = 0.;
+
+	UPROPERTY(BlueprintReadWrite)
+	double maxChunkTime = 0.;
+
+	UPROPERTY(BlueprintReadWrite)
+	int64 residentMemory = 0;
+};
+
+struct FStreamedChunk
+{
+	int32 meshSection = INDEX_NONE;
+	uint64 lastUsedFrame = 0;
+
+	//(chunkVertexCount + 1)^2 final heights
+	TArray<float> height;
+};
+
+struct FStreamedChunkResult
+{
+	FIntPoint coords;
+	double generationTime = 0.;
+
+	TArray<float> height;
+	TArray<FVector> vertices;
+	TArray<FVector> normals;
+	TArray<FVector2D> uvs;
+	TArray<FProcMeshTangent> tangents;
+};
+
+/**
+ * Generates, erodes and meshes fixed size chunks of an unbounded world around one or more focus points.
+ * Chunk noise coordinates and erosion seeds only depend on the chunk coordinates, and erosion fades out towards the
+ * chunk edge, so shared edges match exactly no matter in which order chunks are generated.
+ */
+UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
+class PROCTERRAINGEN_API UGenStreaming : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	UGenStreaming();
+
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	void Start(UProceduralMeshComponent* mesh, UMaterialInterface* material, const FHeightGeneratorOptions& heightOptions, const FStreamingOptions& options);
+	void Stop();
+
+	bool IsStreaming() const { return StreamingMesh != nullptr; };
+
+	UFUNCTION(BlueprintCallable)
+	void SetFocusPoints(const TArray<FVector>& points) { FocusPoints = points; };
+
+	UFUNCTION(BlueprintCallable)
+	FStreamingStats GetStreamingStats() const;
+
+	//Height at a world XY position, if the chunk containing it is resident
+	bool GetHeight(float xPos, float yPos, float& outHeight) const;
+
+protected:
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+	UPROPERTY()
+	UProceduralMeshComponent* StreamingMesh = nullptr;
+
+	UPROPERTY()
+	UMaterialInterface* StreamingMaterial = nullptr;
+
+	//One height generator per concurrent chunk job
+	UPROPERTY()
+	TArray<UGenHeight*> Workers;
+	TArray<int32> FreeWorkers;
+
+	FHeightGeneratorOptions HeightOptions;
+	FStreamingOptions Options;
+	TArray<FVector> FocusPoints;
+
+	TMap<FIntPoint, FStreamedChunk> ResidentChunks;
+	TSet<FIntPoint> InFlightChunks;
+	TArray<int32> FreeMeshSections;
+	int32 NextMeshSection = 0;
+
+	//Shared by all chunks, they all have the same layout
+	TArray<int32> ChunkTriangles;
+
+	//Bumped on Stop so that results of jobs that were still running get dropped
+	uint32 StreamingEpoch = 0;
+	//Jobs that may still be writing into a worker, EndPlay waits for them
+	TArray<UE::Tasks::FTask> ChunkTasks;
+	uint64 FrameCounter = 0;
+
+	FStreamingStats Stats;
+	double TotalChunkTime = 0.;
+
+	void UpdateResidency();
+	void DispatchChunk(const FIntPoint& coords);
+	void OnChunkReady(int32 workerIndex, uint32 epoch, FStreamedChunkResult& result);
+	void EvictChunk(const FIntPoint& coords);
+
+	float GetChunkDistance(const FIntPoint& coords) const;
+	int32 GetChunkSeed(const FIntPoint& coords) const;
+
+	static void BuildChunk(UGenHeight* worker, const FIntPoint& coords, const FStreamingOptions& options, int32 seed, FStreamedChunkResult& outResult);
+};
@@ -2,6 +2,8 @@
 
 
 #include "GenWorld.h"
+#include "Async/ParallelFor.h"
+#include "Misc/Paths.h"
 
 // Sets default values
 AGenWorld::AGenWorld()
@@ -19,9 +21,17 @@ AGenWorld::AGenWorld()
 	FoliageGenerator = CreateDefaultSubobject<UGenFoliage>("Foliage generator");
 	GenerationStats = CreateDefaultSubobject<UGenStats>("Generation statistics");
 
+	StreamingMesh = CreateDefaultSubobject<UProceduralMeshComponent>("Streaming Mesh");
+	StreamingMesh->AttachToComponent(root, FAttachmentTransformRules::KeepRelativeTransform);
+	StreamingGenerator = CreateDefaultSubobject<UGenStreaming>("Streaming generator");
+
 	HeightGenCounter = GenerationStats->AddCounter(TEXT("HeightmapGen"));
 	TBNCalcCounter = GenerationStats->AddCounter(TEXT("TBNCalculation"));
 	ErosionCounter = GenerationStats->AddCounter(TEXT("Erosion"));
+	LODBuildCounter = GenerationStats->AddCounter(TEXT("LODBuild"));
+	FoliagePlacementCounter = GenerationStats->AddCounter(TEXT("FoliagePlacement"));
+	HeightfieldRaycastCounter = GenerationStats->AddCounter(TEXT("HeightfieldRaycast"));
+	PhysicsRaycastCounter = GenerationStats->AddCounter(TEXT("PhysicsRaycast"));
 }
 
 // Called when the game starts or when spawned
@@ -29,13 +39,27 @@ void AGenWorld::BeginPlay()
 {
 	Super::BeginPlay();
 
-	TerrainSectionReady.AddUObject(this, &AGenWorld::OnNextSectionReady);
-	AllTerrainSectionsReady.AddUObject(this, &AGenWorld::CalculateTerrainTBN);
+	FoliageGenerator->OnSpawnFinished.AddUObject(this, &AGenWorld::OnFoliageUpdated);
 
 	//Do not start generating right after startup
 	//GenerateTerrain();
 }
 
+void AGenWorld::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	//Nodes, the erosion preview and the deferred request all hold this, none of them may run once the actor is gone
+	PendingRequest = nullptr;
+	if (Pipeline)
+	{
+		Pipeline->Cancel();
+		Pipeline->Drain();
+	}
+
+	StopStreaming();
+
+	Super::EndPlay(EndPlayReason);
+}
+
 // Called every frame
 void AGenWorld::Tick(float DeltaTime)
 {
@@ -44,85 +68,811 @@ void AGenWorld::Tick(float DeltaTime)
 
 void AGenWorld::GenerateTerrain()
 {
+	if (DeferWhileGenerating([this] { GenerateTerrain(); })) return;
+
 	BatchGenerationEnabled = false;
 
+	StopStreaming();
+
+	FinishAfterFoliageUpdate = false;
 	FoliageGenerator->Clear();
 	TerrainMesh->ClearAllMeshSections();
+	TerrainLOD.Reset();
 
 	GenerationStats->ResetAllCounters(true);
 
-	HeightGenerator->SetEnableOptimizations(GenOptions.enableOptimizations);
-	HeightGenerator->Initialize(GenOptions.xSections, GenOptions.ySections, GenOptions.xVertexCount, GenOptions.yVertexCount, GenOptions.edgeSize);
+	ResolveBackends();
+	HeightGenerator->SetQuantizedStorage(GenOptions.quantizedHeightStorage);
+	HeightGenerator->SetErosionCheckpoints(GenOptions.erosionCheckpointInterval > 0.f ? FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("ProcTerrainGen"), TEXT("Erosion")) : FString(), GenOptions.erosionCheckpointInterval);
+	HeightGenerator->Initialize(GenOptions.xSections, GenOptions.ySections, GenOptions.xVertexCount, GenOptions.yVertexCount, GenOptions.edgeSize);
+
+	StartPipeline();
+}
+
+void AGenWorld::BatchGenerate(int32 count)
+{
+	if (DeferWhileGenerating([this, count] { BatchGenerate(count); })) return;
+
+	BatchIndex = count;
+
+	//Precompute seeds (do not reset)
+	if (BatchSeeds.Num() != count)
+	{
+		for (int32 i = 0; i < count; i++)
+		{
+			BatchSeeds.Add(FMath::RandRange(0.f, 9999.f));
+		}
+	}
+
+	FHeightGeneratorOptions newSeedOptions = HeightGenerator->GetGenerationOptions();
+	newSeedOptions.seed = BatchSeeds[BatchIndex - 1];
+	HeightGenerator->SetGenerationOptions(newSeedOptions);
+
+	GenerateTerrain();
+	BatchGenerationEnabled = true;
+}
+
+FGenBatchReport AGenWorld::RunBatch(FGenBatchOptions options)
+{
+	//Resolving may recalibrate and replaces the backends the running graph's erosion reads, and the caller waits for the report
+	if (IsGenerating()) return FGenBatchReport();
+
+	ResolveBackends();
+
+	FGenBatch batch(options, HeightGenerator->GetGenerationOptions(), FIntPoint(GenOptions.xSections, GenOptions.ySections), FIntPoint(GenOptions.xVertexCount, GenOptions.yVertexCount), GenOptions.edgeSize);
+
+	TArray<UGenHeight*> workers;
+	for (int32 i = 0; i < batch.GetConcurrency(); i++) workers.Add(NewObject<UGenHeight>(this));
+
+	FGenBatchReport report = batch.Run(workers, Backends);
+
+	for (UGenHeight* worker : workers) worker->MarkAsGarbage();
+
+	return report;
+}
+
+void AGenWorld::UpdateMaterial(FTerrainMaterialOptions options)
+{
+	auto newMaterial = UMaterialInstanceDynamic::Create(terrainMaterial, this);
+
+	newMaterial->SetScalarParameterValue("Ice", options.iceEnable ? 1.f : 0.f);
+	newMaterial->SetScalarParameterValue("Ice blend contrast", options.iceBlendContrast);
+	newMaterial->SetScalarParameterValue("Ice height", options.iceHeight);
+	newMaterial->SetScalarParameterValue("Ice noise blend contrast", options.iceNoiseBlendContrast);
+	newMaterial->SetScalarParameterValue("Ice noise scale", options.iceNoiseScale);
+
+	newMaterial->SetScalarParameterValue("Rock blend power", options.rockBlendPower);
+	newMaterial->SetScalarParameterValue("Rock slope angle", options.rockSlopeAngle);
+
+	newMaterial->SetScalarParameterValue("Beach blend contrast", options.beachBlendContrast);
+	newMaterial->SetScalarParameterValue("Beach blend noise contrast", options.beachBlendNoiseContrast);
+	newMaterial->SetScalarParameterValue("Beach blend noise scale", options.beachBlendNoiseScale);
+	newMaterial->SetScalarParameterValue("Water level", options.beachWaterLevel);
+
+	for (int32 i = 0; i < GenOptions.xSections * GenOptions.ySections; i++)
+	{
+		TerrainMesh->SetMaterial(i, newMaterial);
+	}
+}
+
+void AGenWorld::UpdateFoliage()
+{
+	FoliagePlacementCounter->Start();
+
+	if (!GenFoliage)
+	{
+		FoliageGenerator->Clear();
+		OnFoliageUpdated(0);
+		return;
+	}
+
+	FoliageGenerator->SetSectionLayout(GenOptions.xSections, GenOptions.ySections, GenOptions.xVertexCount, GenOptions.yVertexCount, GenOptions.edgeSize);
+
+	//Continues in OnFoliageUpdated
+	FoliageGenerator->Spawn(HeightGenerator, FoliageGenOptions);
+}
+
+void AGenWorld::OnFoliageUpdated(int32 updatedSections)
+{
+	FoliagePlacementCounter->Stop();
+	FoliageUpdatedSections = updatedSections;
+
+	if (!FinishAfterFoliageUpdate) return;
+
+	FinishAfterFoliageUpdate = false;
+	OnFinishStepDone();
+}
+
+void AGenWorld::StartStreaming()
+{
+	if (DeferWhileGenerating([this] { StartStreaming(); })) return;
+
+	FoliageGenerator->Clear();
+	TerrainMesh->ClearAllMeshSections();
+	TerrainLOD.Reset();
+
+	StreamingGenerator->Start(StreamingMesh, terrainMaterial, HeightGenerator->GetGenerationOptions(), StreamingOptions);
+}
+
+void AGenWorld::StopStreaming()
+{
+	StreamingGenerator->Stop();
+}
+
+void AGenWorld::SetStreamingFocusPoints(const TArray<FVector>& points)
+{
+	//Focus points are given in world space, chunks are generated in actor space
+	TArray<FVector> localPoints;
+	for (const FVector& point : points) localPoints.Add(GetActorTransform().InverseTransformPosition(point));
+
+	StreamingGenerator->SetFocusPoints(localPoints);
+}
+
+void AGenWorld::SetRefinementViewpoint(FVector viewpoint)
+{
+	RefinementViewpoint = GetActorTransform().InverseTransformPosition(viewpoint);
+	HasRefinementViewpoint = true;
+}
+
+void AGenWorld::UpdateLOD(FVector viewpoint)
+{
+	//The graph builds the LODs on a worker and replaces the sections itself
+	if (!TerrainLOD.IsBuilt() || IsGenerating()) return;
+
+	TerrainLOD.SelectLODs(viewpoint, GenOptions.lodErrorTolerance, SectionLODs);
+
+	for (int32 i = 0; i < TerrainLOD.GetSectionCount(); i++)
+	{
+		uint32 key = TerrainLOD.GetIndexKey(i, SectionLODs);
+		if (SectionLODKeys[i] == key) continue;
+
+		SectionLODKeys[i] = key;
+
+		const FGenSectionLODLevel& level = TerrainLOD.GetLevel(i, SectionLODs[i]);
+		const TArray<int32>& indices = TerrainLOD.GetStitchedIndices(i, SectionLODs);
+
+		TArray<FVector> normals;
+		TArray<FProcMeshTangent> tangents;
+		CalculateSectionTBN(level.vertices, indices, level.uvs, normals, tangents);
+
+		TerrainMesh->CreateMeshSection(i, level.vertices, indices, normals, level.uvs, TArray<FColor>(), tangents, true);
+		if (terrainMaterial) TerrainMesh->SetMaterial(i, terrainMaterial);
+	}
+}
+
+FRaycastBenchmarkResult AGenWorld::BenchmarkHeightfieldRaycasts(int32 rayCount)
+{
+	FRaycastBenchmarkResult result;
+
+	//The pyramid and heights are being rebuilt on the workers
+	if (IsGenerating()) return result;
+
+	result.rayCount = rayCount;
+
+	FVector extent(GenOptions.xSections * GenOptions.xVertexCount * GenOptions.edgeSize, GenOptions.ySections * GenOptions.yVertexCount * GenOptions.edgeSize, 0.f);
+	float maxDistance = extent.Size() + 40000.f;
+
+	//Fixed seed, so that runs are comparable
+	FRandomStream random(1234);
+
+	TArray<FVector> origins;
+	TArray<FVector> directions;
+
+	for (int32 i = 0; i < rayCount; i++)
+	{
+		origins.Add(FVector(random.FRandRange(0.f, extent.X), random.FRandRange(0.f, extent.Y), random.FRandRange(5000.f, 20000.f)));
+
+		FVector direction = random.GetUnitVector();
+		direction.Z = -FMath::Abs(direction.Z);
+		directions.Add(direction.GetSafeNormal());
+	}
+
+	TArray<FVector> heightfieldLocations;
+	heightfieldLocations.SetNum(rayCount);
+	TBitArray<> heightfieldHit(false, rayCount);
+
+	HeightfieldRaycastCounter->Start(true);
+	for (int32 i = 0; i < rayCount; i++)
+	{
+		FVector normal;
+		heightfieldHit[i] = HeightGenerator->HeightfieldRaycast(origins[i], directions[i], maxDistance, heightfieldLocations[i], normal);
+	}
+	HeightfieldRaycastCounter->Stop();
+
+	TArray<FHitResult> physicsResults;
+	physicsResults.SetNum(rayCount);
+	TBitArray<> physicsHit(false, rayCount);
+
+	const FTransform& actorTransform = GetActorTransform();
+
+	PhysicsRaycastCounter->Start(true);
+	for (int32 i = 0; i < rayCount; i++)
+	{
+		FVector start = actorTransform.TransformPosition(origins[i]);
+		FVector end = actorTransform.TransformPosition(origins[i] + directions[i] * maxDistance);
+
+		physicsHit[i] = GetWorld()->LineTraceSingleByChannel(physicsResults[i], start, end, ECollisionChannel::ECC_WorldDynamic);
+	}
+	PhysicsRaycastCounter->Stop();
+
+	result.heightfieldTime = HeightfieldRaycastCounter->GetSeconds();
+	result.physicsTime = PhysicsRaycastCounter->GetSeconds();
+
+	for (int32 i = 0; i < rayCount; i++)
+	{
+		result.heightfieldHits += heightfieldHit[i] ? 1 : 0;
+		result.physicsHits += physicsHit[i] ? 1 : 0;
+
+		if (!heightfieldHit[i] || !physicsHit[i]) continue;
+
+		FVector physicsLocation = actorTransform.InverseTransformPosition(physicsResults[i].Location);
+		if (FVector::Distance(physicsLocation, heightfieldLocations[i]) > GenOptions.edgeSize) result.mismatchedHits++;
+	}
+
+	return result;
+}
+
+void AGenWorld::QueryTerrainHeights(const TArray<FVector2D>& worldPositions, TArray<float>& outHeights, TArray<FVector>& outNormals, TArray<bool>& outValid)
+{
+	const FTransform& actorTransform = GetActorTransform();
+	float actorZ = actorTransform.GetLocation().Z;
+
+	TArray<FVector2D> localPositions;
+	localPositions.SetNumUninitialized(worldPositions.Num());
+
+	for (int32 i = 0; i < worldPositions.Num(); i++)
+	{
+		FVector localPosition = actorTransform.InverseTransformPosition(FVector(worldPositions[i], actorZ));
+		localPositions[i] = FVector2D(localPosition);
+	}
+
+	TBitArray<> valid;
+	HeightGenerator->HeightfieldCastBatch(localPositions, outHeights, outNormals, valid);
+
+	outValid.SetNumUninitialized(worldPositions.Num());
+
+	for (int32 i = 0; i < worldPositions.Num(); i++)
+	{
+		outValid[i] = valid[i];
+		if (!valid[i]) continue;
+
+		outHeights[i] = actorTransform.TransformPosition(FVector(localPositions[i], outHeights[i])).Z;
+		outNormals[i] = actorTransform.TransformVectorNoScale(outNormals[i]);
+	}
+}
+
+void AGenWorld::BuildLODs()
+{
+	LODBuildCounter->Start();
+	TerrainLOD.Build(HeightGenerator, GenOptions.xSections, GenOptions.ySections, GenOptions.xVertexCount, GenOptions.yVertexCount, GenOptions.edgeSize);
+	LODBuildCounter->Stop();
+
+	//Full resolution sections are still in the mesh, force the first UpdateLOD to replace all of them
+	SectionLODs.Init(0, TerrainLOD.GetSectionCount());
+	SectionLODKeys.Init(MAX_uint32, TerrainLOD.GetSectionCount());
+}
+
+void AGenWorld::ResolveBackends()
+{
+	if (!GenOptions.enableOptimizations) Backends.SetUnoptimized();
+	else
+	{
+		bool needsCalibration = false;
+		for (int32 s = 0; s < GEN_STAGE_Count; s++) needsCalibration |= GenOptions.backends.Get(EGenStage(s)) == GEN_BACKEND_Auto;
+
+		if (needsCalibration && !FGenBackends::HasCalibration()) CalibrateBackends();
+
+		Backends.Resolve(GenOptions.backends);
+	}
+
+	HeightGenerator->SetBackends(Backends);
+}
+
+void AGenWorld::CalibrateBackends()
+{
+	constexpr int32 sections = 2;
+	constexpr int32 size = 64;
+
+	FGenBackends calibrated;
+
+	//Same noise settings as the real run on a small terrain
+	UGenHeight* calibrationHeight = NewObject<UGenHeight>(this);
+	calibrationHeight->SetGenerationOptions(HeightGenerator->GetGenerationOptions());
+	calibrationHeight->Initialize(sections, sections, size, size, GenOptions.edgeSize);
+
+	TArray<float> heightData;
+	for (int32 y = 0; y < sections; y++)
+	{
+		for (int32 x = 0; x < sections; x++) calibrationHeight->GenerateHeight(x, y, heightData);
+	}
+
+	//The same seed has to erode the same terrain on every run and machine with SSE, and checkpoints have to stay valid
+	calibrated.Set(GEN_STAGE_Erosion, GEN_BACKEND_SSE);
+
+	for (EGenStage stage : { GEN_STAGE_HeightTexture, GEN_STAGE_HeightQuery, GEN_STAGE_PlacementMask })
+	{
+		double bestTime = MAX_dbl;
+		for (EGenBackend backend : FGenBackends::GetCandidates(stage))
+		{
+			double time = calibrationHeight->MeasureBackend(stage, backend);
+			if (time < bestTime)
+			{
+				bestTime = time;
+				calibrated.Set(stage, backend);
+			}
+		}
+	}
+
+	//TBN on a flat grid of the same size, the kernels do not depend on the heights
+	TArray<FVector> gridVertices;
+	TArray<int32> gridIndices;
+	TArray<FVector2D> gridUVs;
+	for (int32 y = 0; y < size; y++)
+	{
+		for (int32 x = 0; x < size; x++)
+		{
+			gridVertices.Add(FVector(x * GenOptions.edgeSize, y * GenOptions.edgeSize, 0.f));
+			gridUVs.Add(FVector2D(x, y));
+
+			if (x < size - 1 && y < size - 1)
+			{
+				int32 i = y * size + x;
+				gridIndices.Append({ i, i + size, i + 1, i + 1, i + size, i + size + 1 });
+			}
+		}
+	}
+
+	double bestTime = MAX_dbl;
+	for (EGenBackend backend : FGenBackends::GetCandidates(GEN_STAGE_TBN))
+	{
+		double time = FGenBackends::MeasureBestTime([&]
+		{
+			TArray<FVector> normals;
+			TArray<FProcMeshTangent> tangents;
+			if (FGenBackends::GetBackendLaneCount(backend) > 0) CalculateSectionTBN_Intrin(gridVertices, gridIndices, gridUVs, normals, tangents);
+			else CalculateSectionTBN_Impl(gridVertices, gridIndices, gridUVs, normals, tangents);
+		});
+
+		if (time < bestTime)
+		{
+			bestTime = time;
+			calibrated.Set(GEN_STAGE_TBN, backend);
+		}
+	}
+
+	//The section mesh kernels take their size from the world options, the heights do not matter
+	TArray<float> flatHeights;
+	flatHeights.Init(0.f, GenOptions.xVertexCount * GenOptions.yVertexCount);
+
+	bestTime = MAX_dbl;
+	for (EGenBackend backend : FGenBackends::GetCandidates(GEN_STAGE_SectionMesh))
+	{
+		double time = FGenBackends::MeasureBestTime([&]
+		{
+			TArray<FVector> meshVertices;
+			TArray<int32> meshTriangles;
+			TArray<FVector2D> meshUVs;
+			if (FGenBackends::GetBackendLaneCount(backend) > 0) BuildSectionMesh_Intrin(0, 0, flatHeights, meshVertices, meshTriangles, meshUVs);
+			else BuildSectionMesh_Impl(0, 0, flatHeights, meshVertices, meshTriangles, meshUVs);
+		});
+
+		if (time < bestTime)
+		{
+			bestTime = time;
+			calibrated.Set(GEN_STAGE_SectionMesh, backend);
+		}
+	}
+
+	calibrationHeight->MarkAsGarbage();
+
+	FGenBackends::SetCalibration(calibrated);
+}
+
+FGenKernelCheckReport AGenWorld::CheckKernels(FGenKernelCheckOptions options)
+{
+	FGenKernelCheck check(options);
+	if (options.seeds.IsEmpty()) return check.Finish();
+
+	int32 seedCount = options.seeds.Num();
+	int32 sectionCount = GenOptions.xSections * GenOptions.ySections;
+	int32 cellCount = sectionCount * GenOptions.xVertexCount * GenOptions.yVertexCount;
+	float extent = FMath::Max(GenOptions.xSections * GenOptions.xVertexCount, GenOptions.ySections * GenOptions.yVertexCount) * GenOptions.edgeSize;
+
+	auto getThroughput = [](double count, double time) { return time > 0. ? count / time : 0.; };
+
+	//Heights with the options of this world and the given seed, every stage scalar except the one that is checked
+	auto createHeight = [&](float seed, EErosionMethod erosionMethod, EGenStage stage, EGenBackend backend)
+	{
+		FHeightGeneratorOptions heightOptions = HeightGenerator->GetGenerationOptions();
+		heightOptions.seed = seed;
+		heightOptions.erosionMethod = erosionMethod;
+
+		FGenBackends backends;
+		backends.Set(stage, backend);
+
+		UGenHeight* height = NewObject<UGenHeight>(this);
+		height->SetGenerationOptions(heightOptions);
+		height->SetBackends(backends);
+		height->Initialize(GenOptions.xSections, GenOptions.ySections, GenOptions.xVertexCount, GenOptions.yVertexCount, GenOptions.edgeSize);
+
+		return height;
+	};
+
+	auto generateAll = [&](UGenHeight* height, TArray<TArray<float>>* outSectionHeights, bool reverse)
+	{
+		for (int32 i = 0; i < sectionCount; i++)
+		{
+			int32 section = reverse ? sectionCount - 1 - i : i;
+
+			TArray<float> sectionHeights;
+			height->GenerateHeight(section % GenOptions.xSections, section / GenOptions.xSections, sectionHeights);
+			if (outSectionHeights) (*outSectionHeights)[section] = MoveTemp(sectionHeights);
+		}
+	};
+
+	//Height generation has one implementation, it has to give the same heights in any section order
+	TArray<UGenHeight*> heights;
+	TArray<TArray<TArray<float>>> sectionHeights;
+	{
+		double time = 0.;
+		float error = 0.f;
+
+		for (float seed : options.seeds)
+		{
+			UGenHeight* height = createHeight(seed, EROSION_METHOD_Grid, GEN_STAGE_Erosion, GEN_BACKEND_Scalar);
+			TArray<TArray<float>>& seedSectionHeights = sectionHeights.AddDefaulted_GetRef();
+			seedSectionHeights.SetNum(sectionCount);
+
+			double startTime = FPlatformTime::Seconds();
+			generateAll(height, &seedSectionHeights, false);
+			time += FPlatformTime::Seconds() - startTime;
+
+			UGenHeight* repeated = createHeight(seed, EROSION_METHOD_Grid, GEN_STAGE_Erosion, GEN_BACKEND_Scalar);
+			generateAll(repeated, nullptr, true);
+			error = FMath::Max(error, FGenKernelCheck::MaxRelativeError(height->GetHeightData(), repeated->GetHeightData()));
+			repeated->MarkAsGarbage();
+
+			heights.Add(height);
+		}
+
+		check.Add(TEXT("HeightGeneration"), GEN_BACKEND_Scalar, error, 0.f, getThroughput(double(cellCount) * seedCount, time));
+	}
+
+	//Grid, pipe and stream power erosion are deterministic, particle erosion runs 4 particles at a time in the vector path, so only its statistics have to match
+	for (EErosionMethod erosionMethod : { EROSION_METHOD_Grid, EROSION_METHOD_Particle, EROSION_METHOD_Pipe, EROSION_METHOD_StreamPower })
+	{
+		TArray<TArray<float>> reference;
+
+		for (EGenBackend backend : FGenBackends::GetCandidates(GEN_STAGE_Erosion))
+		{
+			double time = 0.;
+			float error = 0.f;
+
+			for (int32 s = 0; s < seedCount; s++)
+			{
+				UGenHeight* eroded = createHeight(options.seeds[s], erosionMethod, GEN_STAGE_Erosion, backend);
+				generateAll(eroded, nullptr, false);
+
+				double startTime = FPlatformTime::Seconds();
+				eroded->Erode();
+				time += FPlatformTime::Seconds() - startTime;
+
+				if (backend == GEN_BACKEND_Scalar) reference.Add(eroded->GetHeightData());
+				else if (erosionMethod != EROSION_METHOD_Particle) error = FMath::Max(error, FGenKernelCheck::MaxRelativeError(reference[s], eroded->GetHeightData()));
+				else error = FMath::Max(error, FGenKernelCheck::ChangeStatisticsError(heights[s]->GetHeightData(), reference[s], eroded->GetHeightData()));
+
+				eroded->MarkAsGarbage();
+			}
+
+			if (erosionMethod == EROSION_METHOD_Grid) check.Add(TEXT("GridErosion"), backend, error, 1e-3f, getThroughput(double(cellCount) * seedCount, time));
+			else if (erosionMethod == EROSION_METHOD_Pipe) check.Add(TEXT("PipeErosion"), backend, error, 1e-3f, getThroughput(double(cellCount) * seedCount, time));
+			//Only the threading differs between its backends
+			else if (erosionMethod == EROSION_METHOD_StreamPower) check.Add(TEXT("StreamPowerErosion"), backend, error, 0.f, getThroughput(double(cellCount) * seedCount, time));
+			else check.Add(TEXT("ParticleErosion"), backend, error, .1f, getThroughput(double(cellCount) * seedCount, time));
+		}
+	}
+
+	//Erosion in time slices has to give the same heights as one uninterrupted run, slices of a single droplet split the lane groups of the vector kernel
+	for (EGenBackend backend : FGenBackends::GetCandidates(GEN_STAGE_Erosion))
+	{
+		double time = 0.;
+		float error = 0.f;
+
+		for (int32 s = 0; s < seedCount; s++)
+		{
+			UGenHeight* whole = createHeight(options.seeds[s], EROSION_METHOD_Particle, GEN_STAGE_Erosion, backend);
+			UGenHeight* sliced = createHeight(options.seeds[s], EROSION_METHOD_Particle, GEN_STAGE_Erosion, backend);
+
+			//An iteration count that is not a multiple of the lanes leaves a partial group at the end as well
+			FHeightGeneratorOptions heightOptions = whole->GetGenerationOptions();
+			heightOptions.particleErosion_iterations = FMath::Min(heightOptions.particleErosion_iterations, 2047);
+			//Both runs have to do every iteration
+			heightOptions.erosion_timeBudget = 0.f;
+			heightOptions.erosion_minChange = 0.f;
+			whole->SetGenerationOptions(heightOptions);
+			sliced->SetGenerationOptions(heightOptions);
+
+			generateAll(whole, nullptr, false);
+			generateAll(sliced, nullptr, false);
+
+			whole->Erode();
+
+			//A zero budget runs the smallest chunk the solver allows per call
+			double startTime = FPlatformTime::Seconds();
+			sliced->BeginErosion();
+			while (!sliced->AdvanceErosion(0.));
+			time += FPlatformTime::Seconds() - startTime;
+
+			const TArray<float>& reference = whole->GetHeightData();
+			const TArray<float>& result = sliced->GetHeightData();
+			if (result.Num() != reference.Num() || FMemory::Memcmp(result.GetData(), reference.GetData(), reference.Num() * sizeof(float)) != 0) error = 1.f;
+
+			whole->MarkAsGarbage();
+			sliced->MarkAsGarbage();
+		}
+
+		check.Add(TEXT("ParticleErosionSlices"), backend, error, 0.f, getThroughput(double(cellCount) * seedCount, time));
+	}
+
+	//Coarse multigrid levels leave HeightData unchanged, a convergence test on them must not end the erosion before the full resolution level ran
+	{
+		double time = 0.;
+		float error = 0.f;
+
+		for (int32 s = 0; s < seedCount; s++)
+		{
+			UGenHeight* eroded = createHeight(options.seeds[s], EROSION_METHOD_Grid, GEN_STAGE_Erosion, GEN_BACKEND_Scalar);
+
+			//Every window that is measured converges, so the erosion stops at the first one
+			FHeightGeneratorOptions heightOptions = eroded->GetGenerationOptions();
+			heightOptions.gridErosion_levelIterations = { 4, 4, 4 };
+			heightOptions.erosion_minChange = MAX_flt;
+			eroded->SetGenerationOptions(heightOptions);
+			generateAll(eroded, nullptr, false);
+
+			double startTime = FPlatformTime::Seconds();
+			eroded->Erode();
+			time += FPlatformTime::Seconds() - startTime;
+
+			//Only the full resolution level writes HeightData
+			const TArray<float>& input = heights[s]->GetHeightData();
+			const TArray<float>& result = eroded->GetHeightData();
+			if (result.Num() != input.Num() || FMemory::Memcmp(result.GetData(), input.GetData(), input.Num() * sizeof(float)) == 0) error = 1.f;
+
+			eroded->MarkAsGarbage();
+		}
+
+		check.Add(TEXT("MultigridConvergence"), GEN_BACKEND_Scalar, error, 0.f, getThroughput(double(cellCount) * seedCount, time));
+	}
+
+	struct FSectionMesh
+	{
+		TArray<FVector> vertices;
+		TArray<int32> triangles;
+		TArray<FVector2D> uvs;
+	};
+
+	//Scalar meshes of every seed and section, the input of the TBN check
+	TArray<FSectionMesh> referenceMeshes;
+	int32 vertexCount = 0;
+
+	for (EGenBackend backend : FGenBackends::GetCandidates(GEN_STAGE_SectionMesh))
+	{
+		double time = 0.;
+		float error = 0.f;
+
+		for (int32 s = 0; s < seedCount; s++)
+		{
+			for (int32 section = 0; section < sectionCount; section++)
+			{
+				FSectionMesh mesh;
+				int32 xSection = section % GenOptions.xSections;
+				int32 ySection = section / GenOptions.xSections;
+
+				double startTime = FPlatformTime::Seconds();
+				if (FGenBackends::GetBackendLaneCount(backend) > 0) BuildSectionMesh_Intrin(xSection, ySection, sectionHeights[s][section], mesh.vertices, mesh.triangles, mesh.uvs);
+				else BuildSectionMesh_Impl(xSection, ySection, sectionHeights[s][section], mesh.vertices, mesh.triangles, mesh.uvs);
+				time += FPlatformTime::Seconds() - startTime;
+
+				if (backend == GEN_BACKEND_Scalar)
+				{
+					vertexCount += mesh.vertices.Num();
+					referenceMeshes.Add(MoveTemp(mesh));
+					continue;
+				}
+
+				const FSectionMesh& referenceMesh = referenceMeshes[s * sectionCount + section];
+				error = FMath::Max(error, FGenKernelCheck::MismatchRate<int32>(referenceMesh.triangles, mesh.triangles));
+				error = FMath::Max(error, FGenKernelCheck::MismatchRate<FVector2D>(referenceMesh.uvs, mesh.uvs));
+
+				if (referenceMesh.vertices.Num() != mesh.vertices.Num()) error = 1.f;
+				else for (int32 v = 0; v < mesh.vertices.Num(); v++) error = FMath::Max(error, float(FVector::Dist(referenceMesh.vertices[v], mesh.vertices[v])) / extent);
+			}
+		}
+
+		check.Add(TEXT("SectionMesh"), backend, error, 1e-6f, getThroughput(vertexCount, time));
+	}
+
+	{
+		TArray<TArray<FVector>> referenceNormals;
+		TArray<TArray<FVector>> referenceTangents;
+
+		for (EGenBackend backend : FGenBackends::GetCandidates(GEN_STAGE_TBN))
+		{
+			double time = 0.;
+			float error = 0.f;
+
+			for (int32 m = 0; m < referenceMeshes.Num(); m++)
+			{
+				const FSectionMesh& mesh = referenceMeshes[m];
+				TArray<FVector> normals;
+				TArray<FProcMeshTangent> tangents;
+
+				double startTime = FPlatformTime::Seconds();
+				if (FGenBackends::GetBackendLaneCount(backend) > 0) CalculateSectionTBN_Intrin(mesh.vertices, mesh.triangles, mesh.uvs, normals, tangents);
+				else CalculateSectionTBN_Impl(mesh.vertices, mesh.triangles, mesh.uvs, normals, tangents);
+				time += FPlatformTime::Seconds() - startTime;
+
+				TArray<FVector> tangentVectors;
+				for (const FProcMeshTangent& tangent : tangents) tangentVectors.Add(tangent.TangentX);
+
+				if (backend == GEN_BACKEND_Scalar)
+				{
+					referenceNormals.Add(MoveTemp(normals));
+					referenceTangents.Add(MoveTemp(tangentVectors));
+					continue;
+				}
+
+				error = FMath::Max(error, FGenKernelCheck::MaxAngleError(referenceNormals[m], normals));
+				error = FMath::Max(error, FGenKernelCheck::MaxAngleError(referenceTangents[m], tangentVectors));
+			}
+
+			check.Add(TEXT("TBN"), backend, error, 1e-3f, getThroughput(vertexCount, time));
+		}
+	}
+
+	{
+		constexpr int32 queryCount = 16384;
+
+		FRandomStream random(1234);
+		TArray<FVector2D> positions;
+		for (int32 i = 0; i < queryCount; i++) positions.Add(FVector2D(random.FRandRange(0.f, (GenOptions.xSections * GenOptions.xVertexCount - 1) * GenOptions.edgeSize), random.FRandRange(0.f, (GenOptions.ySections * GenOptions.yVertexCount - 1) * GenOptions.edgeSize)));
+
+		TArray<TArray<float>> referenceHeights;
+		TArray<TArray<FVector>> referenceNormals;
+		TArray<TBitArray<>> referenceValid;
+
+		for (EGenBackend backend : FGenBackends::GetCandidates(GEN_STAGE_HeightQuery))
+		{
+			double time = 0.;
+			float error = 0.f;
+
+			for (int32 s = 0; s < seedCount; s++)
+			{
+				FGenBackends backends;
+				backends.Set(GEN_STAGE_HeightQuery, backend);
+				heights[s]->SetBackends(backends);
+
+				TArray<float> queryHeights;
+				TArray<FVector> queryNormals;
+				TBitArray<> queryValid;
+
+				double startTime = FPlatformTime::Seconds();
+				heights[s]->HeightfieldCastBatch(positions, queryHeights, queryNormals, queryValid);
+				time += FPlatformTime::Seconds() - startTime;
+
+				if (backend == GEN_BACKEND_Scalar)
+				{
+					referenceHeights.Add(MoveTemp(queryHeights));
+					referenceNormals.Add(MoveTemp(queryNormals));
+					referenceValid.Add(MoveTemp(queryValid));
+					continue;
+				}
+
+				error = FMath::Max(error, FGenKernelCheck::MaxRelativeError(referenceHeights[s], queryHeights));
+				error = FMath::Max(error, FGenKernelCheck::MaxAngleError(referenceNormals[s], queryNormals));
+				if (!(queryValid == referenceValid[s])) error = 1.f;
+			}
+
+			check.Add(TEXT("HeightQuery"), backend, error, 1e-3f, getThroughput(double(queryCount) * seedCount, time));
+		}
+	}
+
+	{
+		TArray<TArray<TArray<uint8>>> referenceBits;
+
+		for (EGenBackend backend : FGenBackends::GetCandidates(GEN_STAGE_PlacementMask))
+		{
+			double time = 0.;
+			float error = 0.f;
+
+			for (int32 s = 0; s < seedCount; s++)
+			{
+				FGenBackends backends;
+				backends.Set(GEN_STAGE_PlacementMask, backend);
+				heights[s]->SetBackends(backends);
+
+				//Height band in the middle of the terrain, so both limits and the slope test decide cells
+				float minHeight = MAX_flt;
+				float maxHeight = -MAX_flt;
+				for (float height : heights[s]->GetHeightData())
+				{
+					minHeight = FMath::Min(minHeight, height);
+					maxHeight = FMath::Max(maxHeight, height);
+				}
+
+				TArray<TArray<uint8>> bits;
+				bits.SetNum(sectionCount);
+
+				double startTime = FPlatformTime::Seconds();
+				ParallelFor(sectionCount, [&](int32 section)
+				{
+					heights[s]->ComputePlacementMask(section % GenOptions.xSections, section / GenOptions.xSections, FMath::Lerp(minHeight, maxHeight, .2f), FMath::Lerp(minHeight, maxHeight, .8f), 30.f, bits[section]);
+				}, backends.IsThreaded(GEN_STAGE_PlacementMask) ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread);
+				time += FPlatformTime::Seconds() - startTime;
+
+				if (backend == GEN_BACKEND_Scalar)
+				{
+					referenceBits.Add(MoveTemp(bits));
+					continue;
+				}
+
+				for (int32 section = 0; section < sectionCount; section++) error = FMath::Max(error, FGenKernelCheck::MismatchRate<uint8>(referenceBits[s][section], bits[section]));
+			}
 
-	for (int32 y = 0; y < GenOptions.ySections; y++)
-	{
-		for (int32 x = 0; x < GenOptions.xSections; x++)
-		{
-			SectionQueue.Enqueue({x, y});
+			check.Add(TEXT("PlacementMask"), backend, error, 1e-3f, getThroughput(double(cellCount) * seedCount, time));
 		}
 	}
 
-	HeightGenCounter->Start();
-	GenerateNextSection();
-}
-
-void AGenWorld::BatchGenerate(int32 count)
-{
-	BatchIndex = count;
-
-	//Precompute seeds (do not reset)
-	if (BatchSeeds.Num() != count)
+	//Both paths round half up, so every backend has to give the same pixels
 	{
-		for (int32 i = 0; i < count; i++)
+		TArray<TArray<uint16>> referencePixels;
+
+		for (EGenBackend backend : FGenBackends::GetCandidates(GEN_STAGE_HeightTexture))
 		{
-			BatchSeeds.Add(FMath::RandRange(0.f, 9999.f));
-		}
-	}
+			double time = 0.;
+			float error = 0.f;
 
-	FHeightGeneratorOptions newSeedOptions = HeightGenerator->GetGenerationOptions();
-	newSeedOptions.seed = BatchSeeds[BatchIndex - 1];
-	HeightGenerator->SetGenerationOptions(newSeedOptions);
+			for (int32 s = 0; s < seedCount; s++)
+			{
+				FGenBackends backends;
+				backends.Set(GEN_STAGE_HeightTexture, backend);
+				heights[s]->SetBackends(backends);
 
-	GenerateTerrain();
-	BatchGenerationEnabled = true;
-}
+				FIntPoint sectionSize = heights[s]->GetSectionSize();
+				int32 sectionPixelCount = sectionSize.X * sectionSize.Y;
 
-void AGenWorld::UpdateMaterial(FTerrainMaterialOptions options)
-{
-	auto newMaterial = UMaterialInstanceDynamic::Create(terrainMaterial, this);
+				TArray<uint16> pixels;
+				pixels.SetNumUninitialized(sectionCount * sectionPixelCount);
 
-	newMaterial->SetScalarParameterValue("Ice", options.iceEnable ? 1.f : 0.f);
-	newMaterial->SetScalarParameterValue("Ice blend contrast", options.iceBlendContrast);
-	newMaterial->SetScalarParameterValue("Ice height", options.iceHeight);
-	newMaterial->SetScalarParameterValue("Ice noise blend contrast", options.iceNoiseBlendContrast);
-	newMaterial->SetScalarParameterValue("Ice noise scale", options.iceNoiseScale);
+				double startTime = FPlatformTime::Seconds();
+				ParallelFor(sectionCount, [&](int32 section)
+				{
+					heights[s]->NormalizeSection(section % GenOptions.xSections, section / GenOptions.xSections, pixels.GetData() + section * sectionPixelCount);
+				}, backends.IsThreaded(GEN_STAGE_HeightTexture) ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread);
+				time += FPlatformTime::Seconds() - startTime;
 
-	newMaterial->SetScalarParameterValue("Rock blend power", options.rockBlendPower);
-	newMaterial->SetScalarParameterValue("Rock slope angle", options.rockSlopeAngle);
+				if (backend == GEN_BACKEND_Scalar)
+				{
+					referencePixels.Add(MoveTemp(pixels));
+					continue;
+				}
 
-	newMaterial->SetScalarParameterValue("Beach blend contrast", options.beachBlendContrast);
-	newMaterial->SetScalarParameterValue("Beach blend noise contrast", options.beachBlendNoiseContrast);
-	newMaterial->SetScalarParameterValue("Beach blend noise scale", options.beachBlendNoiseScale);
-	newMaterial->SetScalarParameterValue("Water level", options.beachWaterLevel);
+				error = FMath::Max(error, FGenKernelCheck::MismatchRate<uint16>(referencePixels[s], pixels));
+			}
 
-	for (int32 i = 0; i < GenOptions.xSections * GenOptions.ySections; i++)
-	{
-		TerrainMesh->SetMaterial(i, newMaterial);
+			check.Add(TEXT("HeightTexture"), backend, error, 0.f, getThroughput(double(cellCount) * seedCount, time));
+		}
 	}
-}
-
-void AGenWorld::UpdateFoliage()
-{
-	FoliageGenerator->Clear();
 
-	if (!GenFoliage) return;
+	for (UGenHeight* height : heights) height->MarkAsGarbage();
 
-	FoliageGenerator->Spawn(HeightGenerator, FoliageGenOptions);
+	return check.Finish();
 }
 
 void AGenWorld::CalculateSectionTBN(const TArray<FVector>& secVertices, const TArray<int32>& secIndices, const TArray<FVector2D>& secUVs, TArray<FVector>& outNormals, TArray<FProcMeshTangent>& outTangents)
 {
-	if (GenOptions.enableOptimizations) CalculateSectionTBN_Intrin(secVertices, secIndices, secUVs, outNormals, outTangents);
+	if (Backends.GetLaneCount(GEN_STAGE_TBN) > 0) CalculateSectionTBN_Intrin(secVertices, secIndices, secUVs, outNormals, outTangents);
 	else CalculateSectionTBN_Impl(secVertices, secIndices, secUVs, outNormals, outTangents);
 }
 
@@ -197,55 +947,52 @@ void AGenWorld::CalculateSectionTBN_Intrin(const TArray<FVector>& secVertices, c
 
 	for (int32 i = 0; i < secIndices.Num(); i += 3)
 	{
-		__m128i indices = _mm_set1_epi32(i);
-		__m128i indexOffsets = _mm_setr_epi32(0, 1, 2, 0);
-		indices = _mm_add_epi32(indices, indexOffsets);
+		int32 index0 = secIndices[i];
+		int32 index1 = secIndices[i + 1];
+		int32 index2 = secIndices[i + 2];
 
-		FVector pos0 = secVertices[secIndices[indices.m128i_i32[0]]];
-		FVector pos1 = secVertices[secIndices[indices.m128i_i32[1]]];
-		FVector pos2 = secVertices[secIndices[indices.m128i_i32[2]]];
+		FVector pos0 = secVertices[index0];
+		FVector pos1 = secVertices[index1];
+		FVector pos2 = secVertices[index2];
 
-		FVector2D tex0 = secUVs[secIndices[indices.m128i_i32[0]]];
-		FVector2D tex1 = secUVs[secIndices[indices.m128i_i32[1]]];
-		FVector2D tex2 = secUVs[secIndices[indices.m128i_i32[2]]];
+		FVector2D tex0 = secUVs[index0];
+		FVector2D tex1 = secUVs[index1];
+		FVector2D tex2 = secUVs[index2];
 
-		__m256 pos12 = _mm256_setr_ps(pos1.X, pos1.Y, pos1.Z, 0, pos2.X, pos2.Y, pos2.Z, 0);
-		__m256 pos00 = _mm256_setr_ps(pos0.X, pos0.Y, pos0.Z, 0, pos0.X, pos0.Y, pos0.Z, 0);
-		__m256 edge12 = _mm256_sub_ps(pos12, pos00);
+		FGenFloat4 pos00 = GenSimdSet<FGenFloat4>(pos0.X, pos0.Y, pos0.Z, 0);
+		FGenFloat4 edge1 = GenSimdSet<FGenFloat4>(pos1.X, pos1.Y, pos1.Z, 0) - pos00;
+		FGenFloat4 edge2 = GenSimdSet<FGenFloat4>(pos2.X, pos2.Y, pos2.Z, 0) - pos00;
 
-		__m128 edge1 = _mm256_extractf128_ps(edge12, 0);
-		__m128 edge2 = _mm256_extractf128_ps(edge12, 1);
+		FGenFloat4 tex12 = GenSimdSet<FGenFloat4>(tex1.X, tex1.Y, tex2.X, tex2.Y);
+		FGenFloat4 tex00 = GenSimdSet<FGenFloat4>(tex0.X, tex0.Y, tex0.X, tex0.Y);
+		FGenFloat4 uv12 = tex12 - tex00;
 
-		__m128 tex12 = _mm_setr_ps(tex1.X, tex1.Y, tex2.X, tex2.Y);
-		__m128 tex00 = _mm_setr_ps(tex0.X, tex0.Y, tex0.X, tex0.Y);
-		__m128 uv12 = _mm_sub_ps(tex12, tex00);
-		__m128 uv12_reversed = _mm_shuffle_ps(uv12, uv12, _MM_SHUFFLE(0, 1, 2, 3));
+		//uv1.X * uv2.Y - uv1.Y * uv2.X
+		FGenFloat4 uvProducts = uv12 * GenSimdSwizzle<3, 2, 1, 0>(uv12);
+		FGenFloat4 r = FGenFloat4::Splat(1.f / (uvProducts.GetLane(0) - uvProducts.GetLane(1)));
 
-		__m128 r = _mm_mul_ps(uv12, uv12_reversed);
-		r = _mm_hsub_ps(r, r);
-		r = _mm_rcp_ss(r);
-		r = _mm_broadcastss_ps(r);
+		FGenFloat4 normal = simd_cross_product(edge2, edge1);
 
-		__m128 normal = mm128_cross_product(edge2, edge1);
+		FGenFloat4 uv2y = GenSimdSwizzle<3, 3, 3, 3>(uv12);
+		FGenFloat4 uv1y = GenSimdSwizzle<1, 1, 1, 1>(uv12);
 
-		__m128 uv2y = _mm_shuffle_ps(uv12, uv12, _MM_SHUFFLE(0, 0, 0, 0));
-		__m128 uv1y = _mm_shuffle_ps(uv12, uv12, _MM_SHUFFLE(2, 2, 2, 2));
+		FGenFloat4 tangent = (edge1 * uv2y - edge2 * uv1y) * r;
 
-		edge1 = _mm_mul_ps(edge1, uv2y);
-		edge2 = _mm_mul_ps(edge2, uv1y);
-		__m128 tangent = _mm_sub_ps(edge1, edge2);
-		tangent = _mm_mul_ps(tangent, r);
+		float normalLanes[4];
+		float tangentLanes[4];
+		normal.Store(normalLanes);
+		tangent.Store(tangentLanes);
 
-		FVector normalVector(normal.m128_f32[0], normal.m128_f32[1], normal.m128_f32[2]);
-		FVector tangentVector(tangent.m128_f32[0], tangent.m128_f32[1], tangent.m128_f32[2]);
+		FVector normalVector(normalLanes[0], normalLanes[1], normalLanes[2]);
+		FVector tangentVector(tangentLanes[0], tangentLanes[1], tangentLanes[2]);
 
-		intTangents[secIndices[indices.m128i_i32[0]]] += tangentVector;
-		intTangents[secIndices[indices.m128i_i32[1]]] += tangentVector;
-		intTangents[secIndices[indices.m128i_i32[2]]] += tangentVector;
+		intTangents[index0] += tangentVector;
+		intTangents[index1] += tangentVector;
+		intTangents[index2] += tangentVector;
 
-		intNormals[secIndices[indices.m128i_i32[0]]] += normalVector;
-		intNormals[secIndices[indices.m128i_i32[1]]] += normalVector;
-		intNormals[secIndices[indices.m128i_i32[2]]] += normalVector;
+		intNormals[index0] += normalVector;
+		intNormals[index1] += normalVector;
+		intNormals[index2] += normalVector;
 	}
 
 	for (int32 i = 0; i < secVertices.Num(); i++)
@@ -261,538 +1008,653 @@ void AGenWorld::CalculateSectionTBN_Intrin(const TArray<FVector>& secVertices, c
 	}
 }
 
-void AGenWorld::GenerateNextSection()
-{
-	if (GenOptions.enableOptimizations) GenerateNextSection_Intrin();
-	else GenerateNextSection_Impl();
-}
-
-void AGenWorld::GenerateNextSection_Impl()
+void AGenWorld::BuildSectionMesh_Impl(int32 xSection, int32 ySection, const TArray<float>& heightData, TArray<FVector>& outVertices, TArray<int32>& outTriangles, TArray<FVector2D>& outUVs)
 {
-	vertices.Empty();
-	triangles.Empty();
-	uvs.Empty();
-	//normals.Empty();
-	//tangents.Empty();
-
-	//All sections generated
-	if (SectionQueue.IsEmpty())
-	{
-		HeightGenerator->DrawTexture();
-		AllTerrainSectionsReady.Broadcast();
-		return;
-	}
-
-	TPair<uint32, uint32> section;
-	SectionQueue.Dequeue(section);
-
-	int32 xSection = section.Key;
-	int32 ySection = section.Value;
+	bool hasXBorder = xSection < GenOptions.xSections - 1;
+	bool hasYBorder = ySection < GenOptions.ySections - 1;
 
-	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [=, this]()
+	//Create vertex and UV arrays
+	for (int32 y = 0; y < GenOptions.yVertexCount; y++)
 	{
-		FPlatformProcess::Sleep(.1f);
-
-		sectionIndex = ySection * GenOptions.ySections + xSection;
-
-		TArray<float> heightData;
-		HeightGenerator->GenerateHeight(xSection, ySection, heightData);
-
-		bool hasXBorder = xSection < GenOptions.xSections - 1;
-		bool hasYBorder = ySection < GenOptions.ySections - 1;
-
-		//Create vertex and UV arrays
-		for (int32 y = 0; y < GenOptions.yVertexCount; y++)
+		for (int32 x = 0; x < GenOptions.xVertexCount; x++)
 		{
-			for (int32 x = 0; x < GenOptions.xVertexCount; x++)
-			{
-				float xValue = x * GenOptions.edgeSize;
-				float yValue = y * GenOptions.edgeSize;
+			float xValue = x * GenOptions.edgeSize;
+			float yValue = y * GenOptions.edgeSize;
 
-				xValue += xSection * (GenOptions.xVertexCount) * GenOptions.edgeSize;
-				yValue += ySection * (GenOptions.yVertexCount) * GenOptions.edgeSize;
+			xValue += xSection * (GenOptions.xVertexCount) * GenOptions.edgeSize;
+			yValue += ySection * (GenOptions.yVertexCount) * GenOptions.edgeSize;
 
-				float heightValue = heightData[y * GenOptions.xVertexCount + x];
-				//float heightValue = 0.f;
+			float heightValue = heightData[y * GenOptions.xVertexCount + x];
+			//float heightValue = 0.f;
 
-				FVector newVertex(xValue, yValue, heightValue);
-				vertices.Add(newVertex);
+			FVector newVertex(xValue, yValue, heightValue);
+			outVertices.Add(newVertex);
 
-				FVector2D uvCoord((float)x, (float)y);
-				uvs.Add(uvCoord);
-			}
+			FVector2D uvCoord((float)x, (float)y);
+			outUVs.Add(uvCoord);
+		}
 
-			if (hasXBorder)
-			{
-				FVector borderVertex;
-				borderVertex.X = GenOptions.xVertexCount * GenOptions.edgeSize + xSection * (GenOptions.xVertexCount) * GenOptions.edgeSize;
-				borderVertex.Y = y * GenOptions.edgeSize + ySection * (GenOptions.yVertexCount) * GenOptions.edgeSize;
-				borderVertex.Z = heightData[y * GenOptions.xVertexCount + GenOptions.xVertexCount - 1];
+		if (hasXBorder)
+		{
+			FVector borderVertex;
+			borderVertex.X = GenOptions.xVertexCount * GenOptions.edgeSize + xSection * (GenOptions.xVertexCount) * GenOptions.edgeSize;
+			borderVertex.Y = y * GenOptions.edgeSize + ySection * (GenOptions.yVertexCount) * GenOptions.edgeSize;
+			borderVertex.Z = heightData[y * GenOptions.xVertexCount + GenOptions.xVertexCount - 1];
 
-				vertices.Add(borderVertex);
+			outVertices.Add(borderVertex);
 
-				FVector2D uvCoord(GenOptions.xVertexCount, (float)y);
-				uvs.Add(uvCoord);
-			}
+			FVector2D uvCoord(GenOptions.xVertexCount, (float)y);
+			outUVs.Add(uvCoord);
 		}
+	}
 
-		if (hasYBorder)
+	if (hasYBorder)
+	{
+		for (int32 x = 0; x < GenOptions.xVertexCount; x++)
 		{
-			for (int32 x = 0; x < GenOptions.xVertexCount; x++)
-			{
-				float xValue = x * GenOptions.edgeSize;
-				float yValue = GenOptions.yVertexCount * GenOptions.edgeSize;
+			float xValue = x * GenOptions.edgeSize;
+			float yValue = GenOptions.yVertexCount * GenOptions.edgeSize;
 
-				xValue += xSection * (GenOptions.xVertexCount) * GenOptions.edgeSize;
-				yValue += ySection * (GenOptions.yVertexCount) * GenOptions.edgeSize;
+			xValue += xSection * (GenOptions.xVertexCount) * GenOptions.edgeSize;
+			yValue += ySection * (GenOptions.yVertexCount) * GenOptions.edgeSize;
 
-				float heightValue = heightData[(GenOptions.yVertexCount - 1) * GenOptions.xVertexCount + x];
+			float heightValue = heightData[(GenOptions.yVertexCount - 1) * GenOptions.xVertexCount + x];
 
-				FVector newVertex(xValue, yValue, heightValue);
-				vertices.Add(newVertex);
+			FVector newVertex(xValue, yValue, heightValue);
+			outVertices.Add(newVertex);
 
-				FVector2D uvCoord((float)x, (float)GenOptions.yVertexCount);
-				uvs.Add(uvCoord);
-			}
+			FVector2D uvCoord((float)x, (float)GenOptions.yVertexCount);
+			outUVs.Add(uvCoord);
+		}
 
-			if (hasXBorder)
-			{
-				FVector borderVertex;
-				borderVertex.X = GenOptions.xVertexCount * GenOptions.edgeSize + xSection * (GenOptions.xVertexCount) * GenOptions.edgeSize;
-				borderVertex.Y = GenOptions.yVertexCount * GenOptions.edgeSize + ySection * (GenOptions.yVertexCount) * GenOptions.edgeSize;
-				borderVertex.Z = heightData[(GenOptions.yVertexCount - 1) * GenOptions.xVertexCount + GenOptions.xVertexCount - 1];
+		if (hasXBorder)
+		{
+			FVector borderVertex;
+			borderVertex.X = GenOptions.xVertexCount * GenOptions.edgeSize + xSection * (GenOptions.xVertexCount) * GenOptions.edgeSize;
+			borderVertex.Y = GenOptions.yVertexCount * GenOptions.edgeSize + ySection * (GenOptions.yVertexCount) * GenOptions.edgeSize;
+			borderVertex.Z = heightData[(GenOptions.yVertexCount - 1) * GenOptions.xVertexCount + GenOptions.xVertexCount - 1];
 
-				vertices.Add(borderVertex);
+			outVertices.Add(borderVertex);
 
-				FVector2D uvCoord(GenOptions.xVertexCount, (float)GenOptions.yVertexCount);
-				uvs.Add(uvCoord);
-			}
+			FVector2D uvCoord(GenOptions.xVertexCount, (float)GenOptions.yVertexCount);
+			outUVs.Add(uvCoord);
 		}
+	}
 
-		//Create triangles (ccw winding order)
-		for (int32 y = 0; y < GenOptions.yVertexCount - 1; y++)
+	//Create triangles (ccw winding order)
+	for (int32 y = 0; y < GenOptions.yVertexCount - 1; y++)
+	{
+		for (int32 x = 0; x < GenOptions.xVertexCount - 1; x++)
 		{
-			for (int32 x = 0; x < GenOptions.xVertexCount - 1; x++)
-			{
-				int32 startIndex = y * GenOptions.xVertexCount + x;
+			int32 startIndex = y * GenOptions.xVertexCount + x;
 
-				if (hasXBorder) startIndex += y;
+			if (hasXBorder) startIndex += y;
 
-				int32 offset = hasXBorder ? 1 : 0;
+			int32 offset = hasXBorder ? 1 : 0;
 
-				triangles.Add(startIndex); //(0,0)
-				triangles.Add(startIndex + GenOptions.xVertexCount + offset); //(0, 1)
-				triangles.Add(startIndex + 1); //(1,0)
+			outTriangles.Add(startIndex); //(0,0)
+			outTriangles.Add(startIndex + GenOptions.xVertexCount + offset); //(0, 1)
+			outTriangles.Add(startIndex + 1); //(1,0)
 
-				triangles.Add(startIndex + GenOptions.xVertexCount + offset); //(0, 1)
-				triangles.Add(startIndex + GenOptions.xVertexCount + 1 + offset); // (1, 1)
-				triangles.Add(startIndex + 1); //(1, 0)
-			}
+			outTriangles.Add(startIndex + GenOptions.xVertexCount + offset); //(0, 1)
+			outTriangles.Add(startIndex + GenOptions.xVertexCount + 1 + offset); // (1, 1)
+			outTriangles.Add(startIndex + 1); //(1, 0)
+		}
 
-			if (hasXBorder)
-			{
-				int32 startIndex = y * GenOptions.xVertexCount + (GenOptions.xVertexCount - 1) + y;
+		if (hasXBorder)
+		{
+			int32 startIndex = y * GenOptions.xVertexCount + (GenOptions.xVertexCount - 1) + y;
 
-				triangles.Add(startIndex); //(0,0)
-				triangles.Add(startIndex + GenOptions.xVertexCount + 1); //(0, 1)
-				triangles.Add(startIndex + 1); //(1,0)
+			outTriangles.Add(startIndex); //(0,0)
+			outTriangles.Add(startIndex + GenOptions.xVertexCount + 1); //(0, 1)
+			outTriangles.Add(startIndex + 1); //(1,0)
 
-				triangles.Add(startIndex + GenOptions.xVertexCount + 1); //(0, 1)
-				triangles.Add(startIndex + GenOptions.xVertexCount + 2); // (1, 1)
-				triangles.Add(startIndex + 1); //(1, 0)
-			}
+			outTriangles.Add(startIndex + GenOptions.xVertexCount + 1); //(0, 1)
+			outTriangles.Add(startIndex + GenOptions.xVertexCount + 2); // (1, 1)
+			outTriangles.Add(startIndex + 1); //(1, 0)
 		}
+	}
 
-		if (hasYBorder)
+	if (hasYBorder)
+	{
+		for (int32 x = 0; x < GenOptions.xVertexCount - 1; x++)
 		{
-			for (int32 x = 0; x < GenOptions.xVertexCount - 1; x++)
-			{
-				int32 startIndex = (GenOptions.yVertexCount - 1) * GenOptions.xVertexCount + x;
+			int32 startIndex = (GenOptions.yVertexCount - 1) * GenOptions.xVertexCount + x;
 
-				if (hasXBorder) startIndex += GenOptions.yVertexCount - 1;
+			if (hasXBorder) startIndex += GenOptions.yVertexCount - 1;
 
-				int32 offset = hasXBorder ? 1 : 0;
+			int32 offset = hasXBorder ? 1 : 0;
 
-				triangles.Add(startIndex); //(0,0)
-				triangles.Add(startIndex + GenOptions.xVertexCount + offset); //(0, 1)
-				triangles.Add(startIndex + 1); //(1,0)
+			outTriangles.Add(startIndex); //(0,0)
+			outTriangles.Add(startIndex + GenOptions.xVertexCount + offset); //(0, 1)
+			outTriangles.Add(startIndex + 1); //(1,0)
 
-				triangles.Add(startIndex + GenOptions.xVertexCount + offset); //(0, 1)
-				triangles.Add(startIndex + GenOptions.xVertexCount + 1 + offset); // (1, 1)
-				triangles.Add(startIndex + 1); //(1, 0)
-			}
+			outTriangles.Add(startIndex + GenOptions.xVertexCount + offset); //(0, 1)
+			outTriangles.Add(startIndex + GenOptions.xVertexCount + 1 + offset); // (1, 1)
+			outTriangles.Add(startIndex + 1); //(1, 0)
+		}
 
-			if (hasXBorder)
-			{
-				int32 startIndex = (GenOptions.yVertexCount - 1) * GenOptions.xVertexCount + (GenOptions.xVertexCount - 1) + GenOptions.yVertexCount - 1;
+		if (hasXBorder)
+		{
+			int32 startIndex = (GenOptions.yVertexCount - 1) * GenOptions.xVertexCount + (GenOptions.xVertexCount - 1) + GenOptions.yVertexCount - 1;
 
-				triangles.Add(startIndex); //(0,0)
-				triangles.Add(startIndex + GenOptions.xVertexCount + 1); //(0, 1)
-				triangles.Add(startIndex + 1); //(1,0)
+			outTriangles.Add(startIndex); //(0,0)
+			outTriangles.Add(startIndex + GenOptions.xVertexCount + 1); //(0, 1)
+			outTriangles.Add(startIndex + 1); //(1,0)
 
-				triangles.Add(startIndex + GenOptions.xVertexCount + 1); //(0, 1)
-				triangles.Add(startIndex + GenOptions.xVertexCount + 2); // (1, 1)
-				triangles.Add(startIndex + 1); //(1, 0)
-			}
+			outTriangles.Add(startIndex + GenOptions.xVertexCount + 1); //(0, 1)
+			outTriangles.Add(startIndex + GenOptions.xVertexCount + 2); // (1, 1)
+			outTriangles.Add(startIndex + 1); //(1, 0)
 		}
-
-		AsyncTask(ENamedThreads::GameThread, [&]()
-			{
-				TerrainSectionReady.Broadcast();
-			});
-	});
+	}
 }
 
-void AGenWorld::GenerateNextSection_Intrin()
+void AGenWorld::BuildSectionMesh_Intrin(int32 xSection, int32 ySection, const TArray<float>& heightData, TArray<FVector>& outVertices, TArray<int32>& outTriangles, TArray<FVector2D>& outUVs)
 {
-	vertices.Empty();
-	triangles.Empty();
-	uvs.Empty();
-	//normals.Empty();
-	//tangents.Empty();
+	bool hasXBorder = xSection < GenOptions.xSections - 1;
+	bool hasYBorder = ySection < GenOptions.ySections - 1;
 
-	//All sections generated
-	if (SectionQueue.IsEmpty())
+	//Create vertex and UV arrays
+	for (int32 y = 0; y < GenOptions.yVertexCount; y++)
 	{
-		HeightGenerator->DrawTexture();
-		AllTerrainSectionsReady.Broadcast();
-		return;
-	}
+		for (int32 x = 0; x < GenOptions.xVertexCount; x++)
+		{
+			FGenFloat4 xy00 = FGenFloat4::FromInt(GenSimdSet<FGenInt4>(x, y, 0, 0));
 
-	TPair<uint32, uint32> section;
-	SectionQueue.Dequeue(section);
+			FGenFloat4 edgeSize = FGenFloat4::Splat(GenOptions.edgeSize);
+			xy00 = xy00 * edgeSize; //(float) [x,y] * edgeSize
 
-	int32 xSection = section.Key;
-	int32 ySection = section.Value;
+			FGenInt4 offset_int = GenSimdSet<FGenInt4>(xSection, ySection, 0, 0);
+			FGenInt4 vertexCount_int = GenSimdSet<FGenInt4>(GenOptions.xVertexCount, GenOptions.yVertexCount, 0, 0);
+			FGenFloat4 offset = FGenFloat4::FromInt(offset_int * vertexCount_int); //(float) [x,y]section * GenOptions.[x,y]VertexCount
+			offset = offset * edgeSize; // offset *= edgeSize
 
-	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [=, this]()
-		{
-			FPlatformProcess::Sleep(.1f);
+			xy00 = xy00 + offset; // [x,y] += offset
 
-			sectionIndex = ySection * GenOptions.ySections + xSection;
+			float heightValue = heightData[y * GenOptions.xVertexCount + x];
 
-			TArray<float> heightData;
-			HeightGenerator->GenerateHeight(xSection, ySection, heightData);
+			FVector newVertex(xy00.GetLane(0), xy00.GetLane(1), heightValue);
+			outVertices.Add(newVertex);
 
-			bool hasXBorder = xSection < GenOptions.xSections - 1;
-			bool hasYBorder = ySection < GenOptions.ySections - 1;
+			FVector2D uvCoord((float)x, (float)y);
+			outUVs.Add(uvCoord);
+		}
 
-			//Create vertex and UV arrays
-			for (int32 y = 0; y < GenOptions.yVertexCount; y++)
-			{
-				for (int32 x = 0; x < GenOptions.xVertexCount; x++)
-				{
-					__m128i xy00_int = _mm_setr_epi32(x, y, 0, 0);
-					__m128 xy00 = _mm_cvtepi32_ps(xy00_int);
+		if (hasXBorder)
+		{
+			FVector borderVertex;
+			borderVertex.X = GenOptions.xVertexCount * GenOptions.edgeSize + xSection * (GenOptions.xVertexCount) * GenOptions.edgeSize;
+			borderVertex.Y = y * GenOptions.edgeSize + ySection * (GenOptions.yVertexCount) * GenOptions.edgeSize;
+			borderVertex.Z = heightData[y * GenOptions.xVertexCount + GenOptions.xVertexCount - 1];
 
-					__m128 edgeSize = _mm_set1_ps(GenOptions.edgeSize);
-					xy00 = _mm_mul_ps(xy00, edgeSize); //(float) [x,y] * edgeSize
+			outVertices.Add(borderVertex);
 
-					__m128i offset_int = _mm_setr_epi32(xSection, ySection, 0, 0);
-					__m128i vertexCount_int = _mm_setr_epi32(GenOptions.xVertexCount, GenOptions.yVertexCount, 0, 0);
-					__m128 offset = _mm_cvtepi32_ps(_mm_mullo_epi32(offset_int, vertexCount_int)); //(float) [x,y]section * GenOptions.[x,y]VertexCount
-					offset = _mm_mul_ps(offset, edgeSize); // offset *= edgeSize
+			FVector2D uvCoord(GenOptions.xVertexCount, (float)y);
+			outUVs.Add(uvCoord);
+		}
+	}
 
-					xy00 = _mm_add_ps(xy00, offset); // [x,y] += offset
+	if (hasYBorder)
+	{
+		for (int32 x = 0; x < GenOptions.xVertexCount; x++)
+		{
+			float xValue = x * GenOptions.edgeSize;
+			float yValue = GenOptions.yVertexCount * GenOptions.edgeSize;
 
-					float heightValue = heightData[y * GenOptions.xVertexCount + x];
+			xValue += xSection * (GenOptions.xVertexCount) * GenOptions.edgeSize;
+			yValue += ySection * (GenOptions.yVertexCount) * GenOptions.edgeSize;
 
-					FVector newVertex(xy00.m128_f32[0], xy00.m128_f32[1], heightValue);
-					vertices.Add(newVertex);
+			float heightValue = heightData[(GenOptions.yVertexCount - 1) * GenOptions.xVertexCount + x];
 
-					FVector2D uvCoord((float)x, (float)y);
-					uvs.Add(uvCoord);
-				}
+			FVector newVertex(xValue, yValue, heightValue);
+			outVertices.Add(newVertex);
 
-				if (hasXBorder)
-				{
-					FVector borderVertex;
-					borderVertex.X = GenOptions.xVertexCount * GenOptions.edgeSize + xSection * (GenOptions.xVertexCount) * GenOptions.edgeSize;
-					borderVertex.Y = y * GenOptions.edgeSize + ySection * (GenOptions.yVertexCount) * GenOptions.edgeSize;
-					borderVertex.Z = heightData[y * GenOptions.xVertexCount + GenOptions.xVertexCount - 1];
+			FVector2D uvCoord((float)x, (float)GenOptions.yVertexCount);
+			outUVs.Add(uvCoord);
+		}
 
-					vertices.Add(borderVertex);
+		if (hasXBorder)
+		{
+			FVector borderVertex;
+			borderVertex.X = GenOptions.xVertexCount * GenOptions.edgeSize + xSection * (GenOptions.xVertexCount) * GenOptions.edgeSize;
+			borderVertex.Y = GenOptions.yVertexCount * GenOptions.edgeSize + ySection * (GenOptions.yVertexCount) * GenOptions.edgeSize;
+			borderVertex.Z = heightData[(GenOptions.yVertexCount - 1) * GenOptions.xVertexCount + GenOptions.xVertexCount - 1];
 
-					FVector2D uvCoord(GenOptions.xVertexCount, (float)y);
-					uvs.Add(uvCoord);
-				}
-			}
+			outVertices.Add(borderVertex);
 
-			if (hasYBorder)
-			{
-				for (int32 x = 0; x < GenOptions.xVertexCount; x++)
-				{
-					float xValue = x * GenOptions.edgeSize;
-					float yValue = GenOptions.yVertexCount * GenOptions.edgeSize;
+			FVector2D uvCoord(GenOptions.xVertexCount, (float)GenOptions.yVertexCount);
+			outUVs.Add(uvCoord);
+		}
+	}
 
-					xValue += xSection * (GenOptions.xVertexCount) * GenOptions.edgeSize;
-					yValue += ySection * (GenOptions.yVertexCount) * GenOptions.edgeSize;
+	//Create triangles (ccw winding order)
+	for (int32 y = 0; y < GenOptions.yVertexCount - 1; y++)
+	{
+		for (int32 x = 0; x < GenOptions.xVertexCount - 1; x++)
+		{
+			int32 startIndex = y * GenOptions.xVertexCount + x;
 
-					float heightValue = heightData[(GenOptions.yVertexCount - 1) * GenOptions.xVertexCount + x];
+			if (hasXBorder) startIndex += y;
 
-					FVector newVertex(xValue, yValue, heightValue);
-					vertices.Add(newVertex);
+			int32 offset = hasXBorder ? 1 : 0;
 
-					FVector2D uvCoord((float)x, (float)GenOptions.yVertexCount);
-					uvs.Add(uvCoord);
-				}
+			FGenInt4 t1 = FGenInt4::Splat(startIndex);
+			FGenInt4 t1Offset = GenSimdSet<FGenInt4>(0, GenOptions.xVertexCount, GenOptions.xVertexCount + 1, 1);
+			FGenInt4 t1Indices = GenSimdSet<FGenInt4>(0, offset, offset, 0);
 
-				if (hasXBorder)
-				{
-					FVector borderVertex;
-					borderVertex.X = GenOptions.xVertexCount * GenOptions.edgeSize + xSection * (GenOptions.xVertexCount) * GenOptions.edgeSize;
-					borderVertex.Y = GenOptions.yVertexCount * GenOptions.edgeSize + ySection * (GenOptions.yVertexCount) * GenOptions.edgeSize;
-					borderVertex.Z = heightData[(GenOptions.yVertexCount - 1) * GenOptions.xVertexCount + GenOptions.xVertexCount - 1];
+			t1 = t1 + t1Offset + t1Indices; //[startIndex, startIndex + GenOptions.xVertexCount + offset, startIndex + GenOptions.xVertexCount + 1 + offset, startIndex + 1]
 
-					vertices.Add(borderVertex);
+			int32 t1Lanes[4];
+			t1.Store(t1Lanes);
 
-					FVector2D uvCoord(GenOptions.xVertexCount, (float)GenOptions.yVertexCount);
-					uvs.Add(uvCoord);
-				}
-			}
+			outTriangles.Add(t1Lanes[0]); //(0,0)
+			outTriangles.Add(t1Lanes[1]); //(0, 1)
+			outTriangles.Add(t1Lanes[3]); //(1,0)
 
-			//Create triangles (ccw winding order)
-			for (int32 y = 0; y < GenOptions.yVertexCount - 1; y++)
-			{
-				for (int32 x = 0; x < GenOptions.xVertexCount - 1; x++)
-				{
-					int32 startIndex = y * GenOptions.xVertexCount + x;
+			outTriangles.Add(t1Lanes[1]); //(0, 1)
+			outTriangles.Add(t1Lanes[2]); // (1, 1)
+			outTriangles.Add(t1Lanes[3]); //(1, 0)
+		}
 
-					if (hasXBorder) startIndex += y;
+		if (hasXBorder)
+		{
+			int32 startIndex = y * GenOptions.xVertexCount + (GenOptions.xVertexCount - 1) + y;
 
-					int32 offset = hasXBorder ? 1 : 0;
+			outTriangles.Add(startIndex); //(0,0)
+			outTriangles.Add(startIndex + GenOptions.xVertexCount + 1); //(0, 1)
+			outTriangles.Add(startIndex + 1); //(1,0)
 
-					__m128i t1 = _mm_set1_epi32(startIndex);
-					__m128i t1Offset = _mm_setr_epi32(0, GenOptions.xVertexCount, GenOptions.xVertexCount + 1, 1);
-					__m128i t1Indices = _mm_setr_epi32(0, offset, offset, 0);
+			outTriangles.Add(startIndex + GenOptions.xVertexCount + 1); //(0, 1)
+			outTriangles.Add(startIndex + GenOptions.xVertexCount + 2); // (1, 1)
+			outTriangles.Add(startIndex + 1); //(1, 0)
+		}
+	}
 
-					t1Offset = _mm_add_epi32(t1Offset, t1Indices);
-					t1 = _mm_add_epi32(t1, t1Offset); //[startIndex, startIndex + GenOptions.xVertexCount + offset, startIndex + GenOptions.xVertexCount + 1 + offset, startIndex + 1]
+	if (hasYBorder)
+	{
+		for (int32 x = 0; x < GenOptions.xVertexCount - 1; x++)
+		{
+			int32 startIndex = (GenOptions.yVertexCount - 1) * GenOptions.xVertexCount + x;
 
-					triangles.Add(t1.m128i_i32[0]); //(0,0)
-					triangles.Add(t1.m128i_i32[1]); //(0, 1)
-					triangles.Add(t1.m128i_i32[3]); //(1,0)
+			if (hasXBorder) startIndex += GenOptions.yVertexCount - 1;
 
-					triangles.Add(t1.m128i_i32[1]); //(0, 1)
-					triangles.Add(t1.m128i_i32[2]); // (1, 1)
-					triangles.Add(t1.m128i_i32[3]); //(1, 0)
-				}
+			int32 offset = hasXBorder ? 1 : 0;
 
-				if (hasXBorder)
-				{
-					int32 startIndex = y * GenOptions.xVertexCount + (GenOptions.xVertexCount - 1) + y;
+			outTriangles.Add(startIndex); //(0,0)
+			outTriangles.Add(startIndex + GenOptions.xVertexCount + offset); //(0, 1)
+			outTriangles.Add(startIndex + 1); //(1,0)
 
-					triangles.Add(startIndex); //(0,0)
-					triangles.Add(startIndex + GenOptions.xVertexCount + 1); //(0, 1)
-					triangles.Add(startIndex + 1); //(1,0)
+			outTriangles.Add(startIndex + GenOptions.xVertexCount + offset); //(0, 1)
+			outTriangles.Add(startIndex + GenOptions.xVertexCount + 1 + offset); // (1, 1)
+			outTriangles.Add(startIndex + 1); //(1, 0)
+		}
 
-					triangles.Add(startIndex + GenOptions.xVertexCount + 1); //(0, 1)
-					triangles.Add(startIndex + GenOptions.xVertexCount + 2); // (1, 1)
-					triangles.Add(startIndex + 1); //(1, 0)
-				}
-			}
+		if (hasXBorder)
+		{
+			int32 startIndex = (GenOptions.yVertexCount - 1) * GenOptions.xVertexCount + (GenOptions.xVertexCount - 1) + GenOptions.yVertexCount - 1;
 
-			if (hasYBorder)
-			{
-				for (int32 x = 0; x < GenOptions.xVertexCount - 1; x++)
-				{
-					int32 startIndex = (GenOptions.yVertexCount - 1) * GenOptions.xVertexCount + x;
+			outTriangles.Add(startIndex); //(0,0)
+			outTriangles.Add(startIndex + GenOptions.xVertexCount + 1); //(0, 1)
+			outTriangles.Add(startIndex + 1); //(1,0)
 
-					if (hasXBorder) startIndex += GenOptions.yVertexCount - 1;
+			outTriangles.Add(startIndex + GenOptions.xVertexCount + 1); //(0, 1)
+			outTriangles.Add(startIndex + GenOptions.xVertexCount + 2); // (1, 1)
+			outTriangles.Add(startIndex + 1); //(1, 0)
+		}
+	}
+}
 
-					int32 offset = hasXBorder ? 1 : 0;
+void AGenWorld::BuildCoarseSectionMesh(int32 xSection, int32 ySection, TArray<FVector>& outVertices, TArray<int32>& outTriangles, TArray<FVector2D>& outUVs)
+{
+	const TArray<float>& heightData = CoarseHeightGenerator->GetHeightData();
+	FIntPoint size = CoarseHeightGenerator->GetSectionSize();
+	FVector2D spacing(float(GenOptions.xVertexCount) / size.X, float(GenOptions.yVertexCount) / size.Y);
+	int32 width = GenOptions.xSections * size.X;
 
-					triangles.Add(startIndex); //(0,0)
-					triangles.Add(startIndex + GenOptions.xVertexCount + offset); //(0, 1)
-					triangles.Add(startIndex + 1); //(1,0)
+	//Unlike the full resolution mesh, the border row and column come from the next section, so the coarse sections close without steps
+	int32 xCount = size.X + (xSection < GenOptions.xSections - 1 ? 1 : 0);
+	int32 yCount = size.Y + (ySection < GenOptions.ySections - 1 ? 1 : 0);
 
-					triangles.Add(startIndex + GenOptions.xVertexCount + offset); //(0, 1)
-					triangles.Add(startIndex + GenOptions.xVertexCount + 1 + offset); // (1, 1)
-					triangles.Add(startIndex + 1); //(1, 0)
-				}
+	for (int32 y = 0; y < yCount; y++)
+	{
+		for (int32 x = 0; x < xCount; x++)
+		{
+			int32 xGlobal = xSection * size.X + x;
+			int32 yGlobal = ySection * size.Y + y;
 
-				if (hasXBorder)
-				{
-					int32 startIndex = (GenOptions.yVertexCount - 1) * GenOptions.xVertexCount + (GenOptions.xVertexCount - 1) + GenOptions.yVertexCount - 1;
+			outVertices.Add(FVector(xGlobal * spacing.X * GenOptions.edgeSize, yGlobal * spacing.Y * GenOptions.edgeSize, heightData[yGlobal * width + xGlobal]));
+			outUVs.Add(FVector2D(x * spacing.X, y * spacing.Y));
+		}
+	}
 
-					triangles.Add(startIndex); //(0,0)
-					triangles.Add(startIndex + GenOptions.xVertexCount + 1); //(0, 1)
-					triangles.Add(startIndex + 1); //(1,0)
+	//Create triangles (ccw winding order)
+	for (int32 y = 0; y < yCount - 1; y++)
+	{
+		for (int32 x = 0; x < xCount - 1; x++)
+		{
+			int32 startIndex = y * xCount + x;
 
-					triangles.Add(startIndex + GenOptions.xVertexCount + 1); //(0, 1)
-					triangles.Add(startIndex + GenOptions.xVertexCount + 2); // (1, 1)
-					triangles.Add(startIndex + 1); //(1, 0)
-				}
-			}
+			outTriangles.Add(startIndex); //(0,0)
+			outTriangles.Add(startIndex + xCount); //(0, 1)
+			outTriangles.Add(startIndex + 1); //(1,0)
 
-			AsyncTask(ENamedThreads::GameThread, [&]()
-				{
-					TerrainSectionReady.Broadcast();
-				});
-		});
+			outTriangles.Add(startIndex + xCount); //(0, 1)
+			outTriangles.Add(startIndex + xCount + 1); // (1, 1)
+			outTriangles.Add(startIndex + 1); //(1, 0)
+		}
+	}
 }
 
-void AGenWorld::OnNextSectionReady()
+void AGenWorld::StartPipeline()
 {
-	TerrainMesh->CreateMeshSection(sectionIndex, vertices, triangles, TArray<FVector>(), uvs, TArray<FColor>(), TArray<FProcMeshTangent>(), true);
-	if (terrainMaterial) TerrainMesh->SetMaterial(sectionIndex, terrainMaterial);
+	int32 sectionCount = GenOptions.xSections * GenOptions.ySections;
+	bool meshIntrin = Backends.GetLaneCount(GEN_STAGE_SectionMesh) > 0;
+	bool progressive = GenOptions.progressivePreview;
+
+	Pipeline = MakeUnique<FGenPipeline>();
+	PendingFinishSteps = 2;
+	HeightGenerator->SetCancellation(Pipeline->GetCancellation());
+
+	//Nodes keep pointers into this array, it is not resized until the graph is done
+	Sections.Reset();
+	Sections.SetNum(sectionCount);
+
+	//Full resolution heights wait for the low resolution pass, so that it is not starved of workers
+	TArray<int32> heightPrerequisites;
+	TArray<int32> coarseUploadNodes;
+	if (progressive) heightPrerequisites.Add(AddCoarsePass(coarseUploadNodes));
+
+	//Nodes of a stage are launched in this order, the scheduler mostly keeps it
+	TArray<int32> order;
+	if (progressive) order = GetRefinementOrder();
+	else for (int32 s = 0; s < sectionCount; s++) order.Add(s);
+
+	TArray<int32> heightNodes;
+	TArray<int32> meshNodes;
+	TArray<int32> uploadNodes;
+	heightNodes.Init(INDEX_NONE, sectionCount);
+	meshNodes.Init(INDEX_NONE, sectionCount);
+	uploadNodes.Init(INDEX_NONE, sectionCount);
+
+	for (int32 s : order)
+	{
+		int32 xSection = s % GenOptions.xSections;
+		int32 ySection = s / GenOptions.xSections;
+		FSectionData* section = &Sections[s];
 
-	GenerateNextSection();
-}
+		//Sections write disjoint parts of the heightfield
+		heightNodes[s] = Pipeline->AddNode(TEXT("Height"), s, [this, section, xSection, ySection]
+		{
+			HeightGenerator->GenerateHeight(xSection, ySection, section->heights);
+		}, heightPrerequisites);
 
-void AGenWorld::CalculateTerrainTBN()
-{
-	HeightGenCounter->Stop();
+		meshNodes[s] = Pipeline->AddNode(TEXT("Mesh"), s, [this, section, xSection, ySection, meshIntrin]
+		{
+			if (meshIntrin) BuildSectionMesh_Intrin(xSection, ySection, section->heights, section->vertices, section->triangles, section->uvs);
+			else BuildSectionMesh_Impl(xSection, ySection, section->heights, section->vertices, section->triangles, section->uvs);
+		}, { heightNodes[s] });
 
-	for (int32 i = 0; i < GenOptions.xSections * GenOptions.ySections; i++) TBNQueue.Enqueue(i);
+		//The eroded low resolution section already shows more than the uneroded full resolution one would
+		if (progressive) continue;
 
-	TBNCalcCounter->Start();
+		int32 tbnNode = Pipeline->AddNode(TEXT("TBN"), s, [this, section]
+		{
+			CalculateSectionTBN(section->vertices, section->triangles, section->uvs, section->normals, section->tangents);
+		}, { meshNodes[s] });
 
-	GenerateNextTBN();
-}
+		//Uneroded preview of the section
+		uploadNodes[s] = Pipeline->AddGameThreadNode(TEXT("Upload"), s, [this, section, s]
+		{
+			TerrainMesh->CreateMeshSection(s, section->vertices, section->triangles, section->normals, section->uvs, TArray<FColor>(), section->tangents, true);
+			if (terrainMaterial) TerrainMesh->SetMaterial(s, terrainMaterial);
+		}, { tbnNode });
+	}
 
-void AGenWorld::GenerateNextTBN()
-{
-	if (TBNQueue.IsEmpty())
+	int32 previewTextureNode = Pipeline->AddGameThreadNode(TEXT("PreviewTexture"), INDEX_NONE, [this]
 	{
-		OnTBNCalculationDone();
+		HeightGenerator->DrawTexture();
+	}, heightNodes);
 
-		return;
-	}
+	//Erosion works on the whole heightfield at once, every section is a neighbour of every other one, so it waits for all heights.
+	//It also waits for the preview texture, which reads the uneroded heights.
+	TArray<int32> erosionPrerequisites = heightNodes;
+	erosionPrerequisites.Add(previewTextureNode);
+
+	int32 erosionNode = Pipeline->AddNode(TEXT("Erosion"), INDEX_NONE, [this]
+	{
+		//The generated heights still had to be waited for, the uneroded preview shows them
+		bool resumed = !GenOptions.erosionResumeCheckpoint.IsEmpty() && HeightGenerator->ResumeErosion(GenOptions.erosionResumeCheckpoint);
+		if (!resumed) HeightGenerator->BeginErosion();
 
-	uint32 nextSectionIndex;
-	TBNQueue.Dequeue(nextSectionIndex);
+		double sliceSeconds = GenOptions.erosionPreviewInterval > 0.f ? GenOptions.erosionPreviewInterval : MAX_dbl;
+		while (!HeightGenerator->AdvanceErosion(sliceSeconds)) PublishErosionPreview();
 
-	FProcMeshSection* currentSection = TerrainMesh->GetProcMeshSection(nextSectionIndex);
+		if (HeightGenerator->IsCancelled()) return;
 
-	TArray<FVector> extracedVertices;
-	TArray<FVector2D> extracedUVs;
-	TArray<int32> extracedTriangles;
+		//Heights are final from here on, everything after this only reads them
+		HeightGenerator->UpdateHeightPyramid();
+		HeightGenerator->CompactHeightData();
+	}, erosionPrerequisites);
 
-	for (const FProcMeshVertex& currentVertexData : currentSection->ProcVertexBuffer)
+	Pipeline->AddGameThreadNode(TEXT("Texture"), INDEX_NONE, [this]
 	{
-		extracedVertices.Add(currentVertexData.Position);
-		extracedUVs.Add(currentVertexData.UV0);
-	}
+		HeightGenerator->DrawTexture();
+	}, { erosionNode });
 
-	//Stupid! (but necessary)
-	for (const uint32& index : currentSection->ProcIndexBuffer)
+	//Foliage places on its own workers and continues in OnFoliageUpdated
+	Pipeline->AddGameThreadNode(TEXT("Foliage"), INDEX_NONE, [this]
 	{
-		extracedTriangles.Add(index);
-	}
+		FVector half(GenOptions.xSections * GenOptions.xVertexCount * GenOptions.edgeSize * .5f, GenOptions.ySections * GenOptions.yVertexCount * GenOptions.edgeSize * .5f, 0.f);
+		FoliageGenerator->UpdateBounds(half, half + (FVector::UpVector * 20000.f));
+
+		FinishAfterFoliageUpdate = true;
+		UpdateFoliage();
+	}, { erosionNode });
+
+	TArray<int32> finishPrerequisites;
 
-	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [=, this]
+	for (int32 s : order)
 	{
-		FPlatformProcess::Sleep(.1f);
+		FSectionData* section = &Sections[s];
 
-		TArray<FVector> normals;
-		TArray<FProcMeshTangent> tangents;
+		int32 erodedMeshNode = Pipeline->AddNode(TEXT("ErodedMesh"), s, [this, section, s]
+		{
+			TArray<float> height;
+			HeightGenerator->GetSectionHeight(s, height);
 
-		//TERRIBLY slow
-		//UKismetProceduralMeshLibrary::CalculateTangentsForMesh(extracedVertices, extracedTriangles, extracedUVs, normals, tangents);
+			section->erodedVertices = section->vertices;
+			for (int32 v = 0; v < section->erodedVertices.Num(); v++) section->erodedVertices[v].Z = height[v];
 
-		CalculateSectionTBN(extracedVertices, extracedTriangles, extracedUVs, normals, tangents);
+			CalculateSectionTBN(section->erodedVertices, section->triangles, section->uvs, section->erodedNormals, section->erodedTangents);
+		}, { erosionNode, meshNodes[s] });
 
-		AsyncTask(ENamedThreads::GameThread, [=, this]
+		finishPrerequisites.Add(Pipeline->AddGameThreadNode(TEXT("ErodedUpload"), s, [this, section, s, progressive]
 		{
-			TerrainMesh->UpdateMeshSection(nextSectionIndex, extracedVertices, normals, extracedUVs, TArray<FColor>(), tangents);
-			GenerateNextTBN();
-		});
-	});
-}
+			if (progressive)
+			{
+				//Replaces the low resolution section
+				TerrainMesh->CreateMeshSection(s, section->erodedVertices, section->triangles, section->erodedNormals, section->uvs, TArray<FColor>(), section->erodedTangents, true);
+				if (terrainMaterial) TerrainMesh->SetMaterial(s, terrainMaterial);
+			}
+			else TerrainMesh->UpdateMeshSection(s, section->erodedVertices, section->erodedNormals, section->uvs, TArray<FColor>(), section->erodedTangents);
+		}, { erodedMeshNode, progressive ? coarseUploadNodes[s] : uploadNodes[s] }));
+	}
 
-void AGenWorld::OnTBNCalculationDone()
-{
-	TBNCalcCounter->Stop();
+	if (GenOptions.enableLOD)
+	{
+		//LOD sections replace the full resolution ones on the next UpdateLOD, that has to come after the eroded uploads
+		finishPrerequisites.Add(Pipeline->AddNode(TEXT("LOD"), INDEX_NONE, [this]
+		{
+			BuildLODs();
+		}, { erosionNode }));
+	}
 
-	FVector half(GenOptions.xSections * GenOptions.xVertexCount * GenOptions.edgeSize * .5f, GenOptions.ySections * GenOptions.yVertexCount * GenOptions.edgeSize * .5f, 0.f);
-	FoliageGenerator->UpdateBounds(half, half + (FVector::UpVector * 20000.f));
-	RunGlobalFilters();
+	Pipeline->AddGameThreadNode(TEXT("Finish"), INDEX_NONE, [this]
+	{
+		HeightGenCounter->AddSeconds(Pipeline->GetStageSeconds(TEXT("Height")) + Pipeline->GetStageSeconds(TEXT("Mesh")) + Pipeline->GetStageSeconds(TEXT("CoarseHeight")) + Pipeline->GetStageSeconds(TEXT("CoarseMesh")));
+		TBNCalcCounter->AddSeconds(Pipeline->GetStageSeconds(TEXT("TBN")) + Pipeline->GetStageSeconds(TEXT("ErodedMesh")));
+		ErosionCounter->AddSeconds(Pipeline->GetStageSeconds(TEXT("Erosion")) + Pipeline->GetStageSeconds(TEXT("CoarseErosion")));
+
+		//Section data is not needed anymore, the meshes own their copies
+		for (FSectionData& section : Sections) section = FSectionData();
+		CoarseSections.Reset();
+
+		OnFinishStepDone();
+	}, finishPrerequisites);
 }
 
-void AGenWorld::RunGlobalFilters()
+int32 AGenWorld::AddCoarsePass(TArray<int32>& outUploadNodes)
 {
-	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [=, this]
+	int32 sectionCount = GenOptions.xSections * GenOptions.ySections;
+
+	int32 downsample = FMath::Max(GenOptions.progressiveDownsample, 1);
+	FIntPoint coarseSize(FMath::Max(GenOptions.xVertexCount / downsample, 2), FMath::Max(GenOptions.yVertexCount / downsample, 2));
+	FVector2D spacing(float(GenOptions.xVertexCount) / coarseSize.X, float(GenOptions.yVertexCount) / coarseSize.Y);
+
+	//Particles erode a fixed area each, a coarse cell covers spacing.X * spacing.Y full resolution ones
+	FHeightGeneratorOptions coarseOptions = HeightGenerator->GetGenerationOptions();
+	coarseOptions.particleErosion_iterations = FMath::Max(int32(coarseOptions.particleErosion_iterations / (spacing.X * spacing.Y)), 1);
+
+	if (!CoarseHeightGenerator) CoarseHeightGenerator = NewObject<UGenHeight>(this);
+	CoarseHeightGenerator->SetGenerationOptions(coarseOptions);
+	CoarseHeightGenerator->SetBackends(Backends);
+	CoarseHeightGenerator->SetCancellation(Pipeline->GetCancellation());
+	CoarseHeightGenerator->Initialize(GenOptions.xSections, GenOptions.ySections, coarseSize.X, coarseSize.Y, GenOptions.edgeSize * spacing.X);
+	CoarseHeightGenerator->SetSampleSpacing(spacing);
+
+	CoarseSections.Reset();
+	CoarseSections.SetNum(sectionCount);
+
+	TArray<int32> heightNodes;
+	for (int32 s = 0; s < sectionCount; s++)
 	{
-		ErosionCounter->Start();
-		HeightGenerator->Erode();
-		ErosionCounter->Stop();
+		FSectionData* section = &CoarseSections[s];
 
-		AsyncTask(ENamedThreads::GameThread, [=, this]
+		heightNodes.Add(Pipeline->AddNode(TEXT("CoarseHeight"), s, [this, section, s]
 		{
-			HeightGenerator->DrawTexture();
-			
-			UpdateAllSectionsPost();
-		});
-	});
-}
-
-void AGenWorld::UpdateAllSectionsPost()
-{
-	for (int32 i = 0; i < GenOptions.xSections * GenOptions.ySections; i++) PostSectionQueue.Enqueue(i);
+			CoarseHeightGenerator->GenerateHeight(s % GenOptions.xSections, s / GenOptions.xSections, section->heights);
+		}, {}));
+	}
 
-	UpdateNextSectionPost();
-}
+	int32 erosionNode = Pipeline->AddNode(TEXT("CoarseErosion"), INDEX_NONE, [this]
+	{
+		CoarseHeightGenerator->Erode();
+	}, heightNodes);
 
-void AGenWorld::UpdateNextSectionPost()
-{
-	if (PostSectionQueue.IsEmpty())
+	for (int32 s = 0; s < sectionCount; s++)
 	{
-		OnAllSectionsUpdated();
-		return;
+		FSectionData* section = &CoarseSections[s];
+
+		int32 meshNode = Pipeline->AddNode(TEXT("CoarseMesh"), s, [this, section, s]
+		{
+			BuildCoarseSectionMesh(s % GenOptions.xSections, s / GenOptions.xSections, section->vertices, section->triangles, section->uvs);
+			CalculateSectionTBN(section->vertices, section->triangles, section->uvs, section->normals, section->tangents);
+		}, { erosionNode });
+
+		outUploadNodes.Add(Pipeline->AddGameThreadNode(TEXT("CoarseUpload"), s, [this, section, s]
+		{
+			TerrainMesh->CreateMeshSection(s, section->vertices, section->triangles, section->normals, section->uvs, TArray<FColor>(), section->tangents, false);
+			if (terrainMaterial) TerrainMesh->SetMaterial(s, terrainMaterial);
+		}, { meshNode }));
 	}
 
-	uint32 nextSectionIndex;
-	PostSectionQueue.Dequeue(nextSectionIndex);
+	return erosionNode;
+}
 
-	FProcMeshSection* currentSection = TerrainMesh->GetProcMeshSection(nextSectionIndex);
+void AGenWorld::PublishErosionPreview()
+{
+	FGenCancellationPtr cancellation = Pipeline->GetCancellation();
 
-	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [=, this]
+	UE::Tasks::Launch(TEXT("ErosionPreview"), [this, cancellation]
 	{
-		FPlatformProcess::Sleep(.1f);
+		if (cancellation->IsCancelled()) return;
 
-		//No normals and tangents here, since because the height changed, they will need to be recalculated
-		TArray<FVector> vertices;
-		TArray<FVector2D> uvs;
-		TArray<int32> indices;
+		HeightGenerator->DrawTexture();
 
 		TArray<float> height;
+		TArray<FVector> vertices;
 
-		HeightGenerator->GetSectionHeight(nextSectionIndex, height);
-
-		uint32 j = 0;
-		for (const FProcMeshVertex& vertexData : currentSection->ProcVertexBuffer)
+		int32 sectionCount = FMath::Min(TerrainMesh->GetNumSections(), GenOptions.xSections * GenOptions.ySections);
+		for (int32 s = 0; s < sectionCount; s++)
 		{
-			FVector newVertex = vertexData.Position;
-			newVertex.Z = height[j++];
+			//Every section but the last in a row or column has the border samples of its neighbour, as GetSectionHeight returns them
+			int32 xBorder = s % GenOptions.xSections < GenOptions.xSections - 1 ? 1 : 0;
+			int32 yBorder = s / GenOptions.xSections < GenOptions.ySections - 1 ? 1 : 0;
+			int32 vertexCount = (GenOptions.xVertexCount + xBorder) * (GenOptions.yVertexCount + yBorder);
 
-			vertices.Add(newVertex);
-			uvs.Add(vertexData.UV0);
-		}
+			//Sections that are not uploaded yet, or still show the low resolution pass, keep what they have
+			FProcMeshSection* meshSection = TerrainMesh->GetProcMeshSection(s);
+			if (!meshSection || meshSection->ProcVertexBuffer.Num() != vertexCount) continue;
 
-		for (const uint32& index : currentSection->ProcIndexBuffer)
-		{
-			indices.Add(index);
+			//GetSectionHeight appends
+			height.Reset();
+			HeightGenerator->GetSectionHeight(s, height);
+
+			vertices.SetNumUninitialized(vertexCount);
+			for (int32 v = 0; v < vertexCount; v++) vertices[v] = FVector(meshSection->ProcVertexBuffer[v].Position.X, meshSection->ProcVertexBuffer[v].Position.Y, height[v]);
+
+			//Normals and tangents stay the uneroded ones until the eroded upload
+			TerrainMesh->UpdateMeshSection(s, vertices, TArray<FVector>(), TArray<FVector2D>(), TArray<FColor>(), TArray<FProcMeshTangent>());
 		}
+	}, UE::Tasks::ETaskPriority::Normal, UE::Tasks::EExtendedTaskPriority::GameThreadNormalPri).Wait();
+}
 
-		TArray<FVector> normals;
-		TArray<FProcMeshTangent> tangents;
+TArray<int32> AGenWorld::GetRefinementOrder() const
+{
+	int32 sectionCount = GenOptions.xSections * GenOptions.ySections;
+	FVector2D sectionExtent(GenOptions.xVertexCount * GenOptions.edgeSize, GenOptions.yVertexCount * GenOptions.edgeSize);
+
+	FVector2D viewpoint = HasRefinementViewpoint ? FVector2D(RefinementViewpoint) : FVector2D(GenOptions.xSections, GenOptions.ySections) * sectionExtent * .5f;
+
+	TArray<float> distances;
+	TArray<int32> order;
+	for (int32 s = 0; s < sectionCount; s++)
+	{
+		FVector2D center = (FVector2D(s % GenOptions.xSections, s / GenOptions.xSections) + .5f) * sectionExtent;
+		distances.Add(FVector2D::DistSquared(center, viewpoint));
+		order.Add(s);
+	}
+
+	order.Sort([&distances](int32 a, int32 b) { return distances[a] < distances[b]; });
+	return order;
+}
+
+bool AGenWorld::DeferWhileGenerating(TUniqueFunction<void()> request)
+{
+	if (!IsGenerating()) return false;
 
-		CalculateSectionTBN(vertices, indices, uvs, normals, tangents);
+	//Stale nodes skip their work or return at their next check, the request runs once all of them completed
+	Pipeline->Cancel();
+	FoliageGenerator->CancelSpawn();
+	FinishAfterFoliageUpdate = false;
 
-		AsyncTask(ENamedThreads::GameThread, [=, this]
+	//Only the latest request survives, the graph has a single WhenDone for it
+	bool scheduled = bool(PendingRequest);
+	PendingRequest = MoveTemp(request);
+
+	if (!scheduled)
+	{
+		Pipeline->WhenDone([this]
 		{
-			TerrainMesh->UpdateMeshSection(nextSectionIndex, vertices, normals, uvs, TArray<FColor>(), tangents);
+			//Dropped by EndPlay
+			if (!PendingRequest) return;
 
-			UpdateNextSectionPost();
+			TUniqueFunction<void()> request = MoveTemp(PendingRequest);
+			PendingRequest = nullptr;
+			request();
 		});
-	});
+	}
+
+	return true;
 }
 
-void AGenWorld::OnAllSectionsUpdated()
+void AGenWorld::OnFinishStepDone()
 {
-	UpdateFoliage();
+	if (--PendingFinishSteps == 0) FinishGeneration();
+}
 
+void AGenWorld::FinishGeneration()
+{
 	//All done
 	if (!BatchGenerationEnabled || --BatchIndex <= 0)
 	{
@@ -800,32 +1662,48 @@ void AGenWorld::OnAllSectionsUpdated()
 		resultStats.heightGenTime = HeightGenCounter->GetSeconds();
 		resultStats.tbnCalcTime = TBNCalcCounter->GetSeconds();
 		resultStats.erosionTime = ErosionCounter->GetSeconds();
+		resultStats.lodBuildTime = LODBuildCounter->GetSeconds();
+		resultStats.foliagePlacementTime = FoliagePlacementCounter->GetSeconds();
+		resultStats.foliageUpdatedSections = FoliageUpdatedSections;
+		resultStats.heightQuantizationMaxError = HeightGenerator->GetQuantizationMaxError();
+		resultStats.heightQuantizationRmsError = HeightGenerator->GetQuantizationRmsError();
+		resultStats.residentHeightMemory = HeightGenerator->GetResidentHeightMemory();
+		resultStats.backends = Backends.ToOptions();
+		resultStats.pipelineTime = Pipeline->GetWallSeconds();
+		resultStats.criticalPathTime = Pipeline->GetCriticalPathSeconds(&resultStats.criticalPath);
+		resultStats.firstPreviewTime = Pipeline->GetStageEndSeconds(TEXT("CoarseUpload"));
+		resultStats.scratchStats = HeightGenerator->GetScratchStats();
+
+		const FGenCpuFeatures& cpu = FGenCpuFeatures::Get();
+		resultStats.cpuFeatures = FString::Printf(TEXT("SSE4.1 %d, AVX2 %d, AVX-512 %d"), cpu.sse41, cpu.avx2, cpu.avx512);
+
+		if (TerrainLOD.IsBuilt())
+		{
+			for (int32 l = 0; l < GEN_LOD_LEVEL_COUNT; l++)
+			{
+				resultStats.lodLevelBuildTime.Add(TerrainLOD.GetLevelBuildTime(l));
+				resultStats.lodLevelMemory.Add(TerrainLOD.GetLevelMemory(l));
+			}
+		}
 
 		OnGenerationFinished.Broadcast(resultStats);
 	}
 	else
 	{
-		FoliageGenerator->Clear();
+		//Foliage of sections that change with the next seed is replaced in UpdateFoliage
 		TerrainMesh->ClearAllMeshSections();
+		TerrainLOD.Reset();
 
 		FHeightGeneratorOptions newSeedOptions = HeightGenerator->GetGenerationOptions();
 		newSeedOptions.seed = BatchSeeds[BatchIndex - 1];
 		HeightGenerator->SetGenerationOptions(newSeedOptions);
 
-		HeightGenerator->SetEnableOptimizations(GenOptions.enableOptimizations);
+		ResolveBackends();
+		HeightGenerator->SetQuantizedStorage(GenOptions.quantizedHeightStorage);
 		HeightGenerator->Initialize(GenOptions.xSections, GenOptions.ySections, GenOptions.xVertexCount, GenOptions.yVertexCount, GenOptions.edgeSize);
 
-		for (int32 y = 0; y < GenOptions.ySections; y++)
-		{
-			for (int32 x = 0; x < GenOptions.xSections; x++)
-			{
-				SectionQueue.Enqueue({ x, y });
-			}
-		}
-
 		GenerationStats->AddNewRowToAllCounters();
 
-		HeightGenCounter->Start();
-		GenerateNextSection();
+		StartPipeline();
 	}
 }
@@ -9,6 +9,11 @@
 #include "GenHeight.h"
 #include "GenFoliage.h"
 #include "GenStats.h"
+#include "GenLOD.h"
+#include "GenStreaming.h"
+#include "GenKernelCheck.h"
+#include "GenBatch.h"
+#include "GenPipeline.h"
 #include "IntrinUtil.h"
 #include "GenWorld.generated.h"
 
@@ -20,6 +25,10 @@ struct FWorldGenerationOptions
 	UPROPERTY(BlueprintReadWrite)
 	bool enableOptimizations = false;
 
+	//Backend per stage when enableOptimizations is set
+	UPROPERTY(BlueprintReadWrite)
+	FGenBackendOptions backends;
+
 	UPROPERTY(BlueprintReadWrite)
 	int32 xVertexCount = 64;
 
@@ -34,6 +43,37 @@ struct FWorldGenerationOptions
 
 	UPROPERTY(BlueprintReadWrite)
 	float edgeSize = 100.f;
+
+	UPROPERTY(BlueprintReadWrite)
+	bool enableLOD = false;
+
+	//Allowed geometric error per unit of view distance
+	UPROPERTY(BlueprintReadWrite)
+	float lodErrorTolerance = .002f;
+
+	//Store the final heightfield as 16 bit values per section instead of floats
+	UPROPERTY(BlueprintReadWrite)
+	bool quantizedHeightStorage = false;
+
+	//Show an eroded low resolution version of the whole terrain first, then replace sections nearest to the refinement viewpoint first
+	UPROPERTY(BlueprintReadWrite)
+	bool progressivePreview = false;
+
+	//Vertices per axis of the full resolution section for every vertex of the low resolution one
+	UPROPERTY(BlueprintReadWrite)
+	int32 progressiveDownsample = 8;
+
+	//Seconds between intermediate heightmaps shown on the terrain while erosion runs, 0 shows only the result
+	UPROPERTY(BlueprintReadWrite)
+	float erosionPreviewInterval = 0.f;
+
+	//Seconds of erosion between checkpoints in Saved/ProcTerrainGen/Erosion, 0 disables them
+	UPROPERTY(BlueprintReadWrite)
+	float erosionCheckpointInterval = 0.f;
+
+	//Checkpoint to continue erosion from instead of eroding the generated heights, ignored if it does not match the options
+	UPROPERTY(BlueprintReadWrite)
+	FString erosionResumeCheckpoint;
 };
 
 USTRUCT(BlueprintType)
@@ -88,10 +128,84 @@ struct FGenStatData
 
 	UPROPERTY(BlueprintReadWrite)
 	double erosionTime = 0.;
+
+	UPROPERTY(BlueprintReadWrite)
+	double lodBuildTime = 0.;
+
+	UPROPERTY(BlueprintReadWrite)
+	TArray<double> lodLevelBuildTime;
+
+	UPROPERTY(BlueprintReadWrite)
+	double foliagePlacementTime = 0.;
+
+	//Sections whose foliage was replaced by the last foliage update
+	UPROPERTY(BlueprintReadWrite)
+	int32 foliageUpdatedSections = 0;
+
+	UPROPERTY(BlueprintReadWrite)
+	TArray<int64> lodLevelMemory;
+
+	UPROPERTY(BlueprintReadWrite)
+	float heightQuantizationMaxError = 0.f;
+
+	UPROPERTY(BlueprintReadWrite)
+	float heightQuantizationRmsError = 0.f;
+
+	UPROPERTY(BlueprintReadWrite)
+	int64 residentHeightMemory = 0;
+
+	//Backend every stage ran with, never Auto
+	UPROPERTY(BlueprintReadWrite)
+	FGenBackendOptions backends;
+
+	//From the first node of the generation graph starting to the last one ending
+	UPROPERTY(BlueprintReadWrite)
+	double pipelineTime = 0.;
+
+	//Longest chain of dependent nodes, what pipelineTime would be with unlimited workers
+	UPROPERTY(BlueprintReadWrite)
+	double criticalPathTime = 0.;
+
+	UPROPERTY(BlueprintReadWrite)
+	FString criticalPath;
+
+	//Until every low resolution section was shown, 0 without progressivePreview
+	UPROPERTY(BlueprintReadWrite)
+	double firstPreviewTime = 0.;
+
+	//Working buffers of the height generator per stage
+	UPROPERTY(BlueprintReadWrite)
+	TArray<FGenScratchStageStats> scratchStats;
+
+	UPROPERTY(BlueprintReadWrite)
+	FString cpuFeatures;
+};
+
+USTRUCT(BlueprintType)
+struct FRaycastBenchmarkResult
+{
+	GENERATED_USTRUCT_BODY()
+
+	UPROPERTY(BlueprintReadWrite)
+	int32 rayCount = 0;
+
+	UPROPERTY(BlueprintReadWrite)
+	double heightfieldTime = 0.;
+
+	UPROPERTY(BlueprintReadWrite)
+	double physicsTime = 0.;
+
+	UPROPERTY(BlueprintReadWrite)
+	int32 heightfieldHits = 0;
+
+	UPROPERTY(BlueprintReadWrite)
+	int32 physicsHits = 0;
+
+	//Rays where both found a hit, but more than one vertex size apart
+	UPROPERTY(BlueprintReadWrite)
+	int32 mismatchedHits = 0;
 };
 
-DECLARE_MULTICAST_DELEGATE(FTerrainSectionReady);
-DECLARE_MULTICAST_DELEGATE(FAllTerrainSectionsReady);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FGenerationFinished, FGenStatData, StatData);
 
 UCLASS()
@@ -106,6 +220,7 @@ public:
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 public:	
 	// Called every frame
@@ -117,6 +232,11 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void BatchGenerate(int32 count);
 
+	//Generates and erodes every seed and variant with the terrain size of this world, without touching the terrain, and writes the heightfields to disk.
+	//Blocks until all runs are written. Does nothing and returns an empty report while the terrain is generating.
+	UFUNCTION(BlueprintCallable)
+	FGenBatchReport RunBatch(FGenBatchOptions options);
+
 	UFUNCTION(BlueprintCallable)
 	UGenHeight* GetHeightGenerator() const { return HeightGenerator; };
 
@@ -138,6 +258,44 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void UpdateFoliage();
 
+	UFUNCTION(BlueprintCallable)
+	void UpdateLOD(FVector viewpoint);
+
+	//Casts the same random rays against the heightfield pyramid and the collision mesh
+	UFUNCTION(BlueprintCallable)
+	FRaycastBenchmarkResult BenchmarkHeightfieldRaycasts(int32 rayCount = 10000);
+
+	/**
+	 * Runs every variant of the erosion, section mesh, TBN, height query and placement mask kernels on fixed seeds and compares them to the scalar variant.
+	 * Fails when a variant is off by more than the tolerance of its kernel or slower than the stored baseline of this machine.
+	 */
+	UFUNCTION(BlueprintCallable)
+	FGenKernelCheckReport CheckKernels(FGenKernelCheckOptions options);
+
+	//Terrain height and normal below many world XY positions, without going through physics
+	UFUNCTION(BlueprintCallable)
+	void QueryTerrainHeights(const TArray<FVector2D>& worldPositions, TArray<float>& outHeights, TArray<FVector>& outNormals, TArray<bool>& outValid);
+
+	UFUNCTION(BlueprintCallable)
+	void SetStreamingOptions(FStreamingOptions options) { StreamingOptions = options; };
+
+	//Replaces the fixed island with chunks generated around the streaming focus points
+	UFUNCTION(BlueprintCallable)
+	void StartStreaming();
+
+	UFUNCTION(BlueprintCallable)
+	void StopStreaming();
+
+	UFUNCTION(BlueprintCallable)
+	void SetStreamingFocusPoints(const TArray<FVector>& points);
+
+	UFUNCTION(BlueprintCallable)
+	UGenStreaming* GetStreamingGenerator() const { return StreamingGenerator; };
+
+	//With progressivePreview, sections closest to this world position get full resolution first
+	UFUNCTION(BlueprintCallable)
+	void SetRefinementViewpoint(FVector viewpoint);
+
 	UPROPERTY(BlueprintAssignable)
 	FGenerationFinished OnGenerationFinished;
 
@@ -175,44 +333,87 @@ private:
 	UPROPERTY(VisibleAnywhere, BlueprintGetter = GetHeightGenerator)
 	UGenHeight* HeightGenerator = nullptr;
 
+	//Low resolution terrain of the progressive preview
+	UPROPERTY()
+	UGenHeight* CoarseHeightGenerator = nullptr;
+
+	//Actor space, the terrain center when never set
+	FVector RefinementViewpoint = FVector::ZeroVector;
+	bool HasRefinementViewpoint = false;
+
 	UPROPERTY(VisibleAnywhere)
 	UGenFoliage* FoliageGenerator = nullptr;
 
 	UPROPERTY(VisibleAnywhere, BlueprintGetter = GetGenerationStats)
 	UGenStats* GenerationStats = nullptr;
 
-	void CalculateSectionTBN(const TArray<FVector>& vertices, const TArray<int32>& indices, const TArray<FVector2D>& uvs, TArray<FVector>& normals, TArray<FProcMeshTangent>& tangents);
-	void CalculateSectionTBN_Impl(const TArray<FVector>& vertices, const TArray<int32>& indices, const TArray<FVector2D>& uvs, TArray<FVector>& normals, TArray<FProcMeshTangent>& tangents);
-	void CalculateSectionTBN_Intrin(const TArray<FVector>& vertices, const TArray<int32>& indices, const TArray<FVector2D>& uvs, TArray<FVector>& normals, TArray<FProcMeshTangent>& tangents);
+	UPROPERTY(BlueprintSetter = SetStreamingOptions)
+	FStreamingOptions StreamingOptions;
 
-	TQueue<TPair<uint32, uint32>> SectionQueue;
-	void GenerateNextSection();
-	void GenerateNextSection_Impl();
-	void GenerateNextSection_Intrin();
+	UPROPERTY(VisibleAnywhere)
+	UProceduralMeshComponent* StreamingMesh = nullptr;
 
-	void OnNextSectionReady();
+	UPROPERTY(VisibleAnywhere, BlueprintGetter = GetStreamingGenerator)
+	UGenStreaming* StreamingGenerator = nullptr;
 
-	void CalculateTerrainTBN();
-	TQueue<uint32> TBNQueue;
-	void GenerateNextTBN();
-	
-	void OnTBNCalculationDone();
+	FGenBackends Backends;
+	void ResolveBackends();
+	//Times every backend candidate per stage on a small terrain, once per process
+	void CalibrateBackends();
 
-	FTerrainSectionReady TerrainSectionReady;
-	uint32 sectionIndex;
-	TArray<FVector> vertices;
-	TArray<int32> triangles;
-	TArray<FVector2D> uvs;
-	
-	FAllTerrainSectionsReady AllTerrainSectionsReady;
-	//TArray<FVector> normals;
-	//TArray<FProcMeshTangent> tangents;
+	void CalculateSectionTBN(const TArray<FVector>& vertices, const TArray<int32>& indices, const TArray<FVector2D>& uvs, TArray<FVector>& normals, TArray<FProcMeshTangent>& tangents);
+	void CalculateSectionTBN_Impl(const TArray<FVector>& vertices, const TArray<int32>& indices, const TArray<FVector2D>& uvs, TArray<FVector>& normals, TArray<FProcMeshTangent>& tangents);
+	void CalculateSectionTBN_Intrin(const TArray<FVector>& vertices, const TArray<int32>& indices, const TArray<FVector2D>& uvs, TArray<FVector>& normals, TArray<FProcMeshTangent>& tangents);
 
-	void RunGlobalFilters();
-	void UpdateAllSectionsPost();
-	TQueue<uint32> PostSectionQueue;
-	void UpdateNextSectionPost();
-	void OnAllSectionsUpdated();
+	void BuildSectionMesh_Impl(int32 xSection, int32 ySection, const TArray<float>& heightData, TArray<FVector>& outVertices, TArray<int32>& outTriangles, TArray<FVector2D>& outUVs);
+	void BuildSectionMesh_Intrin(int32 xSection, int32 ySection, const TArray<float>& heightData, TArray<FVector>& outVertices, TArray<int32>& outTriangles, TArray<FVector2D>& outUVs);
+	//Section of the progressive preview from the coarse heightfield, same extent and UVs as the full resolution one
+	void BuildCoarseSectionMesh(int32 xSection, int32 ySection, TArray<FVector>& outVertices, TArray<int32>& outTriangles, TArray<FVector2D>& outUVs);
+
+	//Everything a section produces on its way through the graph, every node only writes its own fields
+	struct FSectionData
+	{
+		TArray<float> heights;
+
+		TArray<FVector> vertices;
+		TArray<int32> triangles;
+		TArray<FVector2D> uvs;
+		TArray<FVector> normals;
+		TArray<FProcMeshTangent> tangents;
+
+		TArray<FVector> erodedVertices;
+		TArray<FVector> erodedNormals;
+		TArray<FProcMeshTangent> erodedTangents;
+	};
+
+	TUniquePtr<FGenPipeline> Pipeline;
+	TArray<FSectionData> Sections;
+	TArray<FSectionData> CoarseSections;
+	//The graph and the foliage update both have to finish
+	int32 PendingFinishSteps = 0;
+
+	bool IsGenerating() const { return Pipeline && Pipeline->IsRunning(); };
+	//Cancels the running graph and runs the request once it drained, false if nothing is running
+	bool DeferWhileGenerating(TUniqueFunction<void()> request);
+	TUniqueFunction<void()> PendingRequest;
+	void StartPipeline();
+	//Adds the low resolution pass, returns its erosion node and the upload node of every section
+	int32 AddCoarsePass(TArray<int32>& outUploadNodes);
+	//Sections sorted by distance to the refinement viewpoint
+	TArray<int32> GetRefinementOrder() const;
+	//Shows the heights of the running erosion on the texture and the uploaded full resolution sections, erosion pauses until it is done
+	void PublishErosionPreview();
+	void OnFinishStepDone();
+
+	void OnFoliageUpdated(int32 updatedSections);
+	void FinishGeneration();
+
+	bool FinishAfterFoliageUpdate = false;
+
+	FGenTerrainLOD TerrainLOD;
+	TArray<int32> SectionLODs;
+	TArray<uint32> SectionLODKeys;
+	void BuildLODs();
 
 	bool BatchGenerationEnabled = false;
 	int32 BatchIndex = 0;
@@ -222,4 +423,9 @@ private:
 	UStatCounter* HeightGenCounter = nullptr;
 	UStatCounter* TBNCalcCounter = nullptr;
 	UStatCounter* ErosionCounter = nullptr;
+	UStatCounter* LODBuildCounter = nullptr;
+	UStatCounter* FoliagePlacementCounter = nullptr;
+	int32 FoliageUpdatedSections = 0;
+	UStatCounter* HeightfieldRaycastCounter = nullptr;
+	UStatCounter* PhysicsRaycastCounter = nullptr;
 };
\ No newline at end of file
@@ -1,13 +1,28 @@
 #pragma once
 
 #include "CoreMinimal.h"
-#include <immintrin.h>
-
-__m128 mm128_cross_product(__m128 a, __m128 b);
-__m128 mm128_lerp(__m128 a, __m128 b, __m128 alpha);
-__m128 mm128_sign(__m128 x);
-__m128 mm128_is_negative(__m128 x);
-__m256 mm256_is_negative(__m256 x);
-__m256 mm256_lerp(__m256 a, __m256 b, __m256 alpha);
-float mm256_sum(__m256 x);
-float mm128_sum(__m128 x);
\ No newline at end of file
+#include "GenSimd.h"
+
+FGenFloat4 simd_cross_product(const FGenFloat4& a, const FGenFloat4& b);
+
+template<int32 N>
+FORCEINLINE TGenFloatVec<N> simd_lerp(const TGenFloatVec<N>& a, const TGenFloatVec<N>& b, const TGenFloatVec<N>& alpha)
+{
+	//a * (1 - t) + b * t
+	return a * (TGenFloatVec<N>::Splat(1.f) - alpha) + b * alpha;
+}
+
+template<int32 N>
+FORCEINLINE TGenFloatVec<N> simd_sign(const TGenFloatVec<N>& x)
+{
+	//Returns -1 or +1 based on sign of x (0 is positive)
+	TGenIntVec<N> signBit = x.ToBits() & TGenIntVec<N>::Splat(int32(0x80000000));
+	return TGenFloatVec<N>::FromBits(TGenFloatVec<N>::Splat(1.f).ToBits() | signBit);
+}
+
+template<int32 N>
+FORCEINLINE TGenFloatVec<N> simd_is_negative(const TGenFloatVec<N>& x)
+{
+	//Returns 0 for positive/0, 1 for negative
+	return TGenFloatVec<N>::FromInt(x.ToBits().ShiftRightLogical(31));
+}
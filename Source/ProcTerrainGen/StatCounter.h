@@ -20,6 +20,8 @@ public:
 	void Start(bool reset = false);
 	void Stop();
 	void Reset();
+	//Time measured somewhere else, such as the nodes of the generation graph
+	void AddSeconds(double seconds) { Duration += seconds; };
 	double GetSeconds() const { return Duration; };
 
 private: